@@ -0,0 +1,85 @@
+#ifndef ANS_H
+#define ANS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Табличная асимметричная система счисления (tANS, как в FSE) для 1-байтных символов.
+// Вероятности приближаются долями таблицы из 2^tableLog состояний, а не степенями двойки,
+// как у кодов Хаффмана, поэтому на перекошенных распределениях символ стоит дробное число бит.
+// Кодер проходит данные с конца и пишет биты вперёд, декодер читает их с конца потока;
+// два чередующихся состояния дают процессору две независимые цепочки вычислений
+
+#define ANS_ALPHABET_SIZE 256
+#define ANS_MIN_TABLE_LOG 5
+#define ANS_MAX_TABLE_LOG 12
+
+// Таблица кодирования: переходы состояний и параметры символов
+typedef struct
+{
+    uint32_t tableLog;
+    uint16_t states[1U << ANS_MAX_TABLE_LOG];
+    struct
+    {
+        int32_t deltaFindState;
+        uint32_t deltaNbBits;
+    } symbols[ANS_ALPHABET_SIZE];
+} AnsEncodeTable;
+
+// Элемент таблицы декодирования: символ состояния и как получить следующее состояние
+typedef struct
+{
+    uint16_t newState;
+    uint8_t symbol;
+    uint8_t nbBits;
+} AnsDecodeEntry;
+
+typedef struct
+{
+    uint32_t tableLog;
+    AnsDecodeEntry entries[1U << ANS_MAX_TABLE_LOG];
+} AnsDecodeTable;
+
+// Чтение потока с конца: окно из 64 бит и число уже израсходованных его бит
+typedef struct
+{
+    const unsigned char *start;
+    const unsigned char *ptr;
+    uint64_t container;
+    uint32_t consumed;
+    uint32_t stateA;
+    uint32_t stateB;
+    uint64_t position; // Номер следующего символа: чётные декодируются состоянием A, нечётные — B
+} AnsDecoder;
+
+// Разрядность таблицы для блока из total символов, среди которых active различных
+uint32_t AnsChooseTableLog(uint64_t total, uint32_t active);
+
+// Приводит частоты к долям norm, которые в сумме дают 2^tableLog; каждый встречающийся
+// символ получает не меньше одной доли. Возвращает -1, если символов больше, чем долей
+int AnsNormalize(const uint64_t *freq, uint32_t tableLog, uint16_t *norm);
+
+// Оценка размера закодированных данных в 1/256 бита (без описания долей)
+uint64_t AnsEstimateCost(const uint64_t *freq, const uint16_t *norm, uint32_t tableLog);
+
+void AnsBuildEncodeTable(AnsEncodeTable *table, const uint16_t *norm, uint32_t tableLog);
+
+// Строит таблицу декодирования; -1, если доли не дают в сумме 2^tableLog
+int AnsBuildDecodeTable(AnsDecodeTable *table, const uint16_t *norm, uint32_t tableLog);
+
+// Наибольший размер потока для size символов
+#define ANS_BOUND(size) ((size_t)(size) * ANS_MAX_TABLE_LOG / 8 + 16)
+
+// Кодирует size символов в dst (не меньше ANS_BOUND(size) байт) и возвращает размер потока
+size_t AnsEncode(const AnsEncodeTable *table, const unsigned char *data, size_t size, unsigned char *dst);
+
+// Начинает чтение потока src; -1, если поток пуст или не завершён меткой
+int AnsDecoderInit(AnsDecoder *decoder, const AnsDecodeTable *table, const unsigned char *src, size_t srcSize);
+
+// Восстанавливает очередные size символов; -1, если поток кончился раньше
+int AnsDecodeSymbols(AnsDecoder *decoder, const AnsDecodeTable *table, unsigned char *out, size_t size);
+
+// 0, если поток прочитан ровно до конца
+int AnsDecoderFinish(const AnsDecoder *decoder);
+
+#endif
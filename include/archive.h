@@ -0,0 +1,64 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// Общие константы формата архива.
+// Заголовок: "HUFF" | version (8) | symbol_size (8) | dict_id (32) | file_count (32), далее записи.
+// dict_id — идентификатор словаря (DICT_ID_NONE, если блоки хранят собственные таблицы).
+// Запись начинается с типа (8):
+//   RECORD_FILE:  name_len (16) | name | блоки | raw_len = 0
+//   RECORD_SOLID: member_count (16) | member_count * [name_len (16) | name | offset (32) | size (32)]
+//                 | один блок с содержимым всех файлов подряд
+//   RECORD_COPIES: name_count (16) | name_count * [name_len (16) | name] | блоки | raw_len = 0 —
+//                 одинаковые по содержимому файлы, записанные один раз
+// Начиная с версии 6 за raw_len = 0 записей RECORD_FILE и RECORD_COPIES следуют сведения о файле:
+//   size (64) | mtime (64) | hash (64) — по ним --base находит неизменившиеся файлы.
+//   mtime = RECORD_INFO_NO_MTIME у записей, перенесённых слиянием из архивов до версии 6:
+//   известен только размер, а hash не задан и не сверяется
+// Начиная с версии 7 записи завершаются концевиком "HEND" | file_count (32) | segment_offset (64):
+// число записей во всех сегментах и начало завершаемого сегмента. Дописывание (-a) добавляет сегмент
+//   "HAPP" | file_count (32) | записи | концевик
+// Метка "HAPP" пишется последней, после сброса сегмента на диск, поэтому прерванное дописывание
+// оставляет за последним концевиком данные без метки, которые при чтении отбрасываются
+// Начиная с версии 8 в method блока выставлен BLOCK_FLAG_CRC и за заголовком блока следует
+// crc32c (32) несжатого содержимого; блоки, перенесённые из архивов старых версий, остаются без него
+// Начиная с версии 9 блок может быть разбит на несколько потоков (BLOCK_FLAG_STREAMS),
+// с версии 10 — закодирован tANS (BLOCK_METHOD_ANS8), с версии 11 — повторами LZ77 (BLOCK_METHOD_LZ),
+// с версии 12 — кодами, зависящими от предыдущего байта (BLOCK_METHOD_CTX8), с версии 13 —
+// алфавитом из байтов и пар байтов (BLOCK_METHOD_DIGRAM8), с версии 14 — после обратимого
+// преобразования (BLOCK_FLAG_TRANSFORM), с версии 15 — храниться как есть (BLOCK_METHOD_STORED)
+// В версии 2 тип записи отсутствует, все записи — RECORD_FILE; dict_id появился в версии 4,
+// RECORD_COPIES — в версии 5
+
+#define ARCHIVE_MAGIC "HUFF"
+#define ARCHIVE_VERSION 15
+#define ARCHIVE_MIN_VERSION 2
+#define RECORD_INFO_VERSION 6
+#define RECORD_INFO_SIZE 24
+#define RECORD_INFO_NO_MTIME 0x8000000000000000ULL
+#define ARCHIVE_SEGMENT_VERSION 7
+#define ARCHIVE_END_MAGIC "HEND"
+#define ARCHIVE_APPEND_MAGIC "HAPP"
+#define ARCHIVE_END_SIZE 16
+#define BLOCK_CRC_VERSION 8
+#define BLOCK_STREAMS_VERSION 9
+#define BLOCK_ANS_VERSION 10
+#define BLOCK_LZ_VERSION 11
+#define BLOCK_CONTEXT_VERSION 12
+#define BLOCK_DIGRAM_VERSION 13
+#define BLOCK_TRANSFORM_VERSION 14
+#define BLOCK_STORED_VERSION 15
+#define ARCHIVE_HEADER_SIZE 14
+
+typedef enum
+{
+    RECORD_FILE = 1,   // Отдельный файл из независимых блоков
+    RECORD_SOLID = 2,  // Группа малых файлов в одном блоке с общей таблицей
+    RECORD_COPIES = 3  // Один файл под несколькими именами
+} RecordKind;
+
+// Solid-режим: файлы не больше порога объединяются в блоки не больше заданного размера
+#define SOLID_DEFAULT_THRESHOLD (16 * 1024)
+#define SOLID_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define SOLID_MAX_MEMBERS 4096
+
+#endif
@@ -9,6 +9,9 @@ typedef enum
     MODE_NONE,       // Режим не задан (ошибка или ожидание ввода)
     MODE_COMPRESS,   // Режим сжатия
     MODE_DECOMPRESS, // Режим распаковки
+    MODE_TRAIN,      // Построение словаря по образцам
+    MODE_MERGE,      // Объединение архивов без перекодирования
+    MODE_TEST,       // Проверка целостности архива без записи файлов
     MODE_HELP        // Режим вывода справки
 } OperationMode;
 
@@ -19,6 +22,31 @@ typedef struct
     size_t num_input_paths;     // Количество входных путей
     char **input_paths;         // Массив путей к входным файлам/директориям (дублируются) 
     uint32_t symbol_size;      // Размер символа в байтах (1 или 2). Актуален только для сжатия.
+    uint32_t threads;          // Количество потоков кодирования/декодирования
+    int allow_uring;           // Разрешить пакетный ввод-вывод через io_uring (иначе пул потоков)
+    int direct_io;             // Читать входные файлы и писать архив в обход страничного кеша (O_DIRECT)
+    int solid;                 // Объединять малые файлы в solid-блоки с общей таблицей
+    uint32_t solid_threshold;  // Наибольший размер файла, попадающего в solid-блок
+    uint32_t solid_block_size; // Предельный размер solid-блока
+    char *dict_path;           // Файл словаря или "builtin" (дублируется), иначе NULL
+    int dedup;                 // Хранить одинаковые файлы один раз (по умолчанию включено)
+    char *base_path;           // Предыдущий архив для переноса неизменившихся файлов (дублируется), иначе NULL
+    int append;                // Дописать файлы в существующий архив -o
+    int has_range;             // Извлечь диапазон байт одной записи в файл -o
+    uint64_t range_offset;     // Начало диапазона
+    uint64_t range_length;     // Длина диапазона (UINT64_MAX — до конца записи)
+    uint32_t streams;          // Потоков в блоке при сжатии: 1 или 4
+    int coder;                 // Энтропийный кодер блоков при сжатии (BlockCoder)
+    uint32_t lz_level;         // Уровень LZ77 при сжатии, 0 — без LZ
+    int context_model;         // Коды по контексту предыдущего байта при сжатии
+    uint32_t digrams;          // Пар байтов в алфавите блока при сжатии, 0 — без пар
+    int transforms;            // Преобразования блоков (разность, серии нулей, MTF) при сжатии
+    int level;                 // Уровень сжатия -1..-9, 0 — не задан
+    uint32_t block_size;       // Размер блока по уровню, 0 — наибольший
+    uint32_t sample_step;      // Коды по каждому sample_step-му отрезку блока, 0 — по всему блоку
+    uint32_t stored_percent;   // Доля сжатого блока (%), начиная с которой он хранится как есть, 0 — никогда
+    uint32_t max_code_length;  // Предельная длина кода, 0 — без ограничения
+    char *cpu;                 // Набор ядер кодека: "auto", "generic" или "bmi2" (дублируется), иначе NULL
 } ParsedArgs;
 
 
@@ -0,0 +1,62 @@
+#ifndef BASEARCHIVE_H
+#define BASEARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitstream.h"
+
+// Запись предыдущего архива, сжатые блоки которой можно перенести без перекодирования
+typedef struct
+{
+    const char *name;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+    uint64_t payloadOffset;   // Начало блоков записи в файле архива
+    uint64_t payloadLength;   // Длина блоков без завершающего raw_len = 0
+} BaseEntry;
+
+// Оглавление предыдущего архива для инкрементального сжатия (--base).
+// Учитываются только записи RECORD_FILE и RECORD_COPIES версии 6 и новее:
+// у solid-записей нет сведений о файлах, а их блок нельзя перенести по частям
+typedef struct
+{
+    int fd;
+    uint8_t symbolSize;
+    uint32_t dictId;
+    char *names;           // Арена имён
+    BaseEntry *entries;    // Отсортированы по имени
+    size_t count;
+    unsigned char *buffer; // Буфер копирования блоков
+} BaseArchive;
+
+// Читает оглавление архива path. Возвращает 0 при успехе
+int BaseArchiveOpen(const char *path, BaseArchive *base);
+void BaseArchiveClose(BaseArchive *base);
+
+// Запись с именем name или NULL; записи без сведений о файле (RECORD_INFO_NO_MTIME) не находятся
+const BaseEntry *BaseArchiveFind(const BaseArchive *base, const char *name);
+
+// Читает имена всех записей архива path версии 6 и новее, включая членов solid-групп, для поиска
+// через BaseArchiveFind; сведения о файлах и положение блоков не заполняются. Возвращает 0 при успехе
+int ArchiveReadNames(const char *path, BaseArchive *names);
+
+// Дописывает сжатые блоки записи в writer как есть. Возвращает 0 при успехе
+int BaseArchiveCopyPayload(BaseArchive *base, const BaseEntry *entry, BitWriter *writer);
+
+// Конец архива для дописывания: параметры заголовка и последний завершённый сегмент
+typedef struct
+{
+    uint8_t version;
+    uint8_t symbolSize;
+    uint32_t dictId;
+    uint32_t fileCount;    // Записей во всех завершённых сегментах
+    uint64_t endOffset;    // Смещение сразу за последним концевиком
+} ArchiveEnd;
+
+// Находит конец последнего завершённого сегмента архива (для версий до 7 заполняет только
+// поля заголовка). Если хвост остался от прерванного дописывания, записи разбираются с начала.
+// Возвращает 0 при успехе
+int ArchiveFindEnd(const char *path, ArchiveEnd *end);
+
+#endif
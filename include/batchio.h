@@ -0,0 +1,48 @@
+#ifndef BATCHIO_H
+#define BATCHIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Файлы не больше этого размера загружаются и записываются целиком пакетами
+#define BATCH_SMALL_FILE_LIMIT (64 * 1024)
+// Максимальное количество файлов в одном пакете
+#define BATCH_MAX_FILES 128
+
+// Результат пакетного открытия одного входного файла
+typedef struct
+{
+    int error;             // errno при ошибке, иначе 0
+    uint64_t size;         // Размер файла (statx)
+    uint32_t mode;         // Права доступа и тип файла (statx)
+    int fd;                // Открытый дескриптор для больших файлов, иначе -1
+    unsigned char *data;   // Содержимое малого файла (size байт), иначе NULL
+} BatchFile;
+
+// Запрос на пакетное создание выходного файла
+typedef struct
+{
+    const char *path;
+    const unsigned char *data;
+    size_t size;
+    int error;             // Заполняется по результату: errno или 0
+} BatchWrite;
+
+// Пакетный ввод-вывод: io_uring, если ядро его поддерживает, иначе пул потоков
+typedef struct BatchIO BatchIO;
+
+BatchIO *BatchIOCreate(int allowUring);
+const char *BatchIOBackendName(const BatchIO *io);
+
+// Открывает файлы, получает их размер и права, малые файлы читает целиком и закрывает.
+// Большие файлы остаются открытыми (BatchFile.fd) для потокового чтения.
+// Если haveMetadata, то size и mode в out уже заполнены вызывающим кодом и statx не выполняется.
+// count не больше BATCH_MAX_FILES
+void BatchReadFiles(BatchIO *io, const char **paths, size_t count, BatchFile *out, int haveMetadata);
+
+// Создаёт файлы и записывает в них содержимое; count не больше BATCH_MAX_FILES
+void BatchWriteFiles(BatchIO *io, BatchWrite *writes, size_t count);
+
+void BatchIODestroy(BatchIO *io);
+
+#endif
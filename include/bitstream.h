@@ -3,36 +3,73 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 
-// Поток для побитовой записи
-typedef struct 
+// Поток для побитовой записи.
+// Если file == NULL и directFd < 0, данные накапливаются в памяти (data/size) и забираются вызывающим кодом.
+typedef struct
 {
     FILE *file;
-    unsigned char buffer;
-    int bitPos; // от 0 до 7
+    int ownsFile;          // Закрывать ли file в BitWriterClose (не закрываем stdout и чужие потоки)
+    int directFd;          // Дескриптор, открытый с O_DIRECT, иначе -1
+    unsigned char *data;   // Буфер вывода
+    size_t size;           // Заполнено байт в буфере
+    size_t capacity;
+    uint64_t buffer;       // Накопитель ещё не записанных битов
+    int bitPos;            // Количество битов в накопителе (0..7 между вызовами)
+    uint64_t flushed;      // Байт, переданных в файл
+    int failed;            // Запись в файл не удалась (диск заполнен, закрыт канал); флаг не сбрасывается
 } BitWriter;
 
-// Поток для побитового чтения
+// Поток для побитового чтения.
+// Если file == NULL, чтение идёт из внешнего буфера в памяти (data/size).
 typedef struct
 {
     FILE *file;
+    int ownsFile;
+    unsigned char *data;   // Окно чтения (для файла) или внешний буфер
+    size_t size;           // Заполнено байт в окне
+    size_t pos;            // Позиция следующего байта в окне
     unsigned char buffer;
-    int bitPos; // от 0 до 7
+    int bitPos; // от 0 до 8
 } BitReader;
 
 // --- BitWriter ---
 
 BitWriter *BitWriterOpen(const char *path);
+BitWriter *BitWriterOpenStream(FILE *file, int ownsFile);
+// Открывает файл с O_DIRECT; NULL с errno = EINVAL, если файловая система его не поддерживает
+BitWriter *BitWriterOpenDirect(const char *path);
+BitWriter *BitWriterCreateMemory(size_t initialCapacity);
 void BitWriterWriteBit(BitWriter *writer, int bit);
 void BitWriterWriteBits(BitWriter *writer, unsigned int value, int count);
+void BitWriterWriteBytes(BitWriter *writer, const unsigned char *bytes, size_t count);
+void BitWriterAlign(BitWriter *writer);
+// Прямая запись в буфер: гарантирует count свободных байт и возвращает указатель на первый
+// (NULL при нехватке памяти). Заполненные байты учитываются BitWriterCommit; незавершённые биты
+// остаются в buffer/bitPos, как после BitWriterWriteBits
+unsigned char *BitWriterReserve(BitWriter *writer, size_t count);
+void BitWriterCommit(BitWriter *writer, size_t count);
+// Число целых байт, записанных с открытия потока
+uint64_t BitWriterTell(const BitWriter *writer);
 void BitWriterFlush(BitWriter *writer);
-void BitWriterClose(BitWriter *writer);
+// Ненулевое значение, если часть данных не удалось записать в файл
+int BitWriterError(const BitWriter *writer);
+// Сбрасывает остаток и закрывает поток. Возвращает -1, если часть данных не записана
+int BitWriterClose(BitWriter *writer);
 
 // --- BitReader ---
 
 BitReader *BitReaderOpen(const char *path);
+BitReader *BitReaderOpenStream(FILE *file, int ownsFile);
+BitReader *BitReaderCreateMemory(const unsigned char *data, size_t size);
 int BitReaderReadBit(BitReader *reader);
 unsigned int BitReaderReadBits(BitReader *reader, int count);
+size_t BitReaderReadBytes(BitReader *reader, unsigned char *bytes, size_t count);
+size_t BitReaderSkipBytes(BitReader *reader, uint64_t count);
+void BitReaderAlign(BitReader *reader);
+// Номер следующего непрочитанного бита от начала буфера (для потока в памяти)
+uint64_t BitReaderTellBits(const BitReader *reader);
 void BitReaderClose(BitReader *reader);
 
 #endif
@@ -0,0 +1,135 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitstream.h"
+#include "transform.h"
+
+// Максимальный размер несжатого блока. Ограничивает расход памяти при потоковой
+// обработке и длину кода Хаффмана (не более 29 бит для 2^20 символов).
+#define BLOCK_SIZE (1U << 20)
+
+// Заголовок блока в архиве: raw_len (32) | comp_len (32) | method (8)
+#define BLOCK_HEADER_SIZE 9
+
+// Флаг в старшем бите method: за заголовком следует crc32c (32) несжатого содержимого блока
+#define BLOCK_FLAG_CRC 0x80
+#define BLOCK_CRC_SIZE 4
+
+// Флаг в method: данные блока разбиты на BLOCK_STREAMS независимых битовых потоков, поток k
+// кодирует k-ю четверть блока (граница кратна размеру символа). За таблицей Хаффмана
+// с выравниванием по байту следует stream_len (32) первых трёх потоков, затем сами потоки,
+// каждый выровнен по байту. Потоки декодируются одновременно в одном цикле
+#define BLOCK_FLAG_STREAMS 0x40
+#define BLOCK_STREAMS 4
+// Блоки меньше этого кодируются одним потоком: таблица переходов и выравнивания не окупаются
+#define BLOCK_STREAMS_MIN_SIZE (16 * 1024)
+
+// Флаг в method: данные блока перед кодированием преобразованы (см. transform.h). Данные блока
+// начинаются с transform (8) | length (32) — размера преобразованных данных, за которыми следует
+// блок остальных битов method для этих length байт. Контрольная сумма — по исходным данным
+#define BLOCK_FLAG_TRANSFORM 0x20
+#define BLOCK_TRANSFORM_HEADER_SIZE 5
+
+typedef enum
+{
+    BLOCK_METHOD_HUFF8 = 1,  // Хаффман, алфавит из 1-байтных символов
+    BLOCK_METHOD_HUFF16 = 2, // Хаффман, алфавит из 2-байтных символов
+    BLOCK_METHOD_TABLE8 = 3, // Хаффман по статической таблице словаря, 1-байтные символы (без таблицы в блоке)
+    BLOCK_METHOD_TABLE16 = 4, // То же для 2-байтных символов
+    BLOCK_METHOD_ANS8 = 5,    // tANS, 1-байтные символы: table_log (8) | count (16) | count × [symbol (8) | norm (table_log + 1)] | поток
+    BLOCK_METHOD_LZ = 6,      // LZ77: таблицы Хаффмана литералов, длин и расстояний | последовательности (см. lz.h)
+    BLOCK_METHOD_CTX8 = 7,    // Контекст первого порядка: clusters (8) | [256 × cluster (4), если clusters > 1] | clusters × таблица | поток
+    BLOCK_METHOD_DIGRAM8 = 8, // Байты и пары (см. digram.h): count (16) | count × пара (16) | таблица с 9-битными символами | поток
+    BLOCK_METHOD_STORED = 9   // Данные блока как есть
+} BlockMethod;
+
+// Энтропийный кодер блоков без словаря
+typedef enum
+{
+    CODER_HUFFMAN = 0, // Коды Хаффмана (BLOCK_METHOD_HUFF*)
+    CODER_ANS = 1,     // tANS (BLOCK_METHOD_ANS8), только 1-байтные символы
+    CODER_AUTO = 2     // Для каждого блока тот из двух, что по оценке даёт меньший блок
+} BlockCoder;
+
+// Предельная длина кода в статической таблице
+#define CODEC_TABLE_MAX_CODE_LEN 24
+
+// Рабочие таблицы кодирования и декодирования блоков. Выделяются один раз
+// и переиспользуются; один экземпляр нельзя использовать из нескольких потоков
+typedef struct CodecScratch CodecScratch;
+
+CodecScratch *CodecScratchCreate(void);
+void CodecScratchDestroy(CodecScratch *scratch);
+
+// Предельная длина кодов Хаффмана в блоках, которые кодирует scratch (0 — без ограничения)
+void CodecScratchSetMaxCodeLength(CodecScratch *scratch, uint32_t maxCodeLength);
+
+// Статическая таблица кодов для всего алфавита (словарь). Неизменяема после создания,
+// поэтому одну таблицу используют все потоки
+typedef struct CodecTable CodecTable;
+
+// Строит канонические коды по длинам (по одной на каждый символ алфавита, от 1 до
+// CODEC_TABLE_MAX_CODE_LEN). NULL, если длины не образуют префиксный код
+CodecTable *CodecTableCreate(const uint8_t *lengths, uint32_t symbol_size);
+void CodecTableDestroy(CodecTable *table);
+uint32_t CodecTableSymbolSize(const CodecTable *table);
+
+// Кодирует блок (таблица Хаффмана + битовый поток) в буфер в памяти out; результат выровнен по байту.
+// streams — 1 или BLOCK_STREAMS (тогда в method блока ставится BLOCK_FLAG_STREAMS).
+// Если crc не NULL, в *crc продолжается CRC32C данных (см. Crc32c), посчитанный по ходу кодирования
+int EncodeBlock(CodecScratch *scratch, const unsigned char *data, size_t size, uint32_t symbol_size, uint32_t streams, BitWriter *out, uint32_t *crc);
+
+// Кодирует блок 1-байтных символов (BLOCK_METHOD_HUFF8) по гистограмме выборки: каждого sampleStep-го
+// отрезка из 4 КиБ. Полный проход подсчёта частот не нужен, зато коды получают все 256 байтов и таблица больше
+int EncodeBlockSampled(CodecScratch *scratch, uint32_t sampleStep, const unsigned char *data, size_t size, uint32_t streams,
+                       BitWriter *out, uint32_t *crc);
+
+// Пишет блок как есть (BLOCK_METHOD_STORED)
+int EncodeBlockStored(const unsigned char *data, size_t size, BitWriter *out, uint32_t *crc);
+
+// Кодирует блок по статической таблице: в out пишутся только битовые потоки
+int EncodeBlockWithTable(const CodecTable *table, const unsigned char *data, size_t size, uint32_t streams, BitWriter *out, uint32_t *crc);
+
+// Кодирует блок 1-байтных символов кодером coder и возвращает в *method метод блока.
+// Для CODER_AUTO размеры блока Хаффмана и tANS оцениваются по одной гистограмме, и блок
+// кодируется только выбранным кодером; streams действует на блоки Хаффмана
+int EncodeBlockWithCoder(CodecScratch *scratch, BlockCoder coder, const unsigned char *data, size_t size, uint32_t streams,
+                         BitWriter *out, uint8_t *method, uint32_t *crc);
+
+// Кодирует блок повторами LZ77 с глубиной поиска уровня level (1..9). Каждая последовательность —
+// код длины серии литералов, сами литералы, код длины повтора и код расстояния; у кодов длин и
+// расстояний свои таблицы Хаффмана, значения больше LZ_DIRECT_CODES дополняются битами как есть.
+// Если повторы не окупают своих кодов, блок пишется как BLOCK_METHOD_HUFF8 в streams потоков;
+// выбранный метод возвращается в *method
+int EncodeBlockLz(CodecScratch *scratch, uint32_t level, const unsigned char *data, size_t size, uint32_t streams,
+                  BitWriter *out, uint8_t *method, uint32_t *crc);
+
+// Кодирует блок 1-байтных символов кодами, зависящими от предыдущего байта (см. context.h):
+// контексты группируются не больше чем в CONTEXT_MAX_CLUSTERS кластеров со своими таблицами Хаффмана.
+// Если лишние таблицы не окупаются, блок пишется как BLOCK_METHOD_HUFF8 в streams потоков;
+// выбранный метод возвращается в *method
+int EncodeBlockContext(CodecScratch *scratch, const unsigned char *data, size_t size, uint32_t streams, BitWriter *out,
+                       uint8_t *method, uint32_t *crc);
+
+// Кодирует блок 1-байтных символов смешанным алфавитом из байтов и до maxDigrams самых частых пар блока
+// (см. digram.h). Если пары не окупают своего описания, блок пишется как BLOCK_METHOD_HUFF8 в streams потоков;
+// выбранный метод возвращается в *method
+int EncodeBlockDigrams(CodecScratch *scratch, uint32_t maxDigrams, const unsigned char *data, size_t size, uint32_t streams,
+                       BitWriter *out, uint8_t *method, uint32_t *crc);
+
+// Выбирает преобразование блока (см. transform.h) по пробному кодированию нескольких отрезков
+// и, если оно заметно уменьшает размер, пишет в out его заголовок, а в *transformed и *transformedSize
+// возвращает преобразованные данные (живут до следующего вызова с этим scratch) — их остаётся
+// закодировать любым методом, кроме словарного, и поставить в method BLOCK_FLAG_TRANSFORM.
+// Иначе возвращает TRANSFORM_NONE, а *transformed указывает на data
+BlockTransform TransformBlock(CodecScratch *scratch, const unsigned char *data, size_t size, BitWriter *out,
+                              const unsigned char **transformed, size_t *transformedSize);
+
+// Восстанавливает size байт блока из comp; возвращает 0 при успехе.
+// table нужна для блоков BLOCK_METHOD_TABLE*, иначе может быть NULL.
+// Если crc не NULL, в *crc продолжается CRC32C восстановленных данных
+int DecodeBlock(CodecScratch *scratch, const CodecTable *table, uint8_t method, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Модель первого порядка для 1-байтных символов: распределение байта зависит от предыдущего.
+// 256 контекстов (предыдущих байтов) группируются в несколько кластеров с похожими распределениями,
+// и у каждого кластера своя таблица Хаффмана. Группировка — k-средних по длине кода: контекст
+// относится к кластеру, коды которого дают его байтам наименьший суммарный размер
+
+#define CONTEXT_COUNT 256
+#define CONTEXT_MAX_CLUSTERS 16
+
+// Частоты пар: freq[prev * 256 + symbol]; первый байт блока считается идущим после нуля
+void CountContextFrequencies(uint64_t *freq, const unsigned char *data, size_t size);
+
+// Группирует контексты не больше чем в maxClusters кластеров (1..CONTEXT_MAX_CLUSTERS); новый кластер
+// заводится, только если выигрыш на его контекстах больше примерного размера ещё одной таблицы.
+// В map[prev] записывается номер кластера контекста, в clusterFreq[k * 256 + symbol] — частоты кластера.
+// Возвращает число непустых кластеров
+uint32_t ClusterContexts(const uint64_t *freq, uint32_t maxClusters, uint8_t *map, uint64_t *clusterFreq);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (полином Кастаньоли) — контрольная сумма несжатого содержимого блоков архива.
+// crc — результат для предыдущих данных (0 в начале), поэтому буфер можно обрабатывать частями.
+// Реализацию выбирает kernels.c: инструкция crc32 из SSE4.2 или таблицы slicing-by-8
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size);
+
+// CRC32C склейки двух буферов по их суммам crcA и crcB и длине второго буфера
+uint32_t Crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB);
+
+#endif
@@ -3,7 +3,22 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "dictionary.h"
 
-int DecodeArchive(const char *archivePath, const char *outputDir, const char **wantedFiles, size_t wantedCount, int extractAll);
+// dictionary обязателен для архивов, сжатых со словарём, иначе может быть NULL
+int DecodeArchive(const char *archivePath, const char *outputDir, const char **wantedFiles, size_t wantedCount, int extractAll, uint32_t threads, int allowUring,
+                  const Dictionary *dictionary);
+
+// Извлекает length байт записи entryName начиная с offset в файл outputPath ("-" — stdout).
+// Декодируются только блоки, пересекающие диапазон; остальные перематываются по заголовкам.
+// length = UINT64_MAX — до конца записи
+int DecodeRange(const char *archivePath, const char *entryName, uint64_t offset, uint64_t length, const char *outputPath,
+                uint32_t threads, const Dictionary *dictionary);
+
+// Декодирует записи (все, если wantedCount == 0) без записи на диск и сверяет размер и хеш
+// содержимого с сохранёнными в архиве. Сообщает о повреждённых записях и скорости проверки.
+// Возвращает 0, если повреждений нет
+int TestArchive(const char *archivePath, const char **wantedFiles, size_t wantedCount, uint32_t threads,
+                const Dictionary *dictionary);
 
 #endif
\ No newline at end of file
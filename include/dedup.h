@@ -0,0 +1,29 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fileutils.h"
+
+#define DEDUP_NONE SIZE_MAX
+// Наибольшее число имён у одного содержимого (поле name_count записи RECORD_COPIES)
+#define DEDUP_MAX_NAMES 65535
+
+// План дедупликации: файлы с одинаковым содержимым сжимаются и хранятся один раз
+typedef struct
+{
+    size_t *original;    // Первый файл с тем же содержимым (у уникальных — сам файл)
+    size_t *nextCopy;    // Следующая копия того же содержимого или DEDUP_NONE
+    size_t copyCount;    // Число найденных копий
+    uint64_t copyBytes;  // Их суммарный размер
+} DedupPlan;
+
+// Ищет одинаковые файлы списка. Хешируются только файлы с совпадающими размерами,
+// совпадение хешей подтверждается побайтовым сравнением. Возвращает 0 при успехе
+int BuildDedupPlan(const FileList *files, DedupPlan *plan);
+void FreeDedupPlan(DedupPlan *plan);
+
+// Хеш содержимого файла. Возвращает 0 при успехе
+int HashFile(const char *path, uint64_t *hash);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdint.h>
+#include "codec.h"
+#include "fileutils.h"
+
+// Файл словаря: "HDIC" | version (8) | symbol_size (8) | id (32) | длины кодов (8) для всех символов алфавита
+#define DICT_MAGIC "HDIC"
+#define DICT_VERSION 1
+
+#define DICT_ID_NONE 0            // Архив сжат без словаря
+#define DICT_ID_BUILTIN_ASCII 1   // Встроенная таблица для ASCII-текста
+#define DICT_BUILTIN_NAME "builtin"
+
+// Статическая таблица кодов, заранее построенная по образцам данных.
+// Архив хранит id словаря, чтобы распаковка с другим словарём обнаруживалась сразу
+typedef struct
+{
+    uint32_t id;
+    uint32_t symbolSize;
+    CodecTable *table;
+} Dictionary;
+
+// Загружает словарь из файла; путь DICT_BUILTIN_NAME — встроенная таблица для ASCII-текста
+Dictionary *DictionaryLoad(const char *path);
+void DictionaryFree(Dictionary *dict);
+
+// Строит таблицу длин кодов по файлам-образцам и сохраняет словарь в outputPath.
+// Возвращает 0 при успехе
+int TrainDictionary(const FileList *files, uint32_t symbolSize, const char *outputPath);
+
+#endif
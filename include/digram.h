@@ -0,0 +1,34 @@
+#ifndef DIGRAM_H
+#define DIGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Смешанный алфавит для 1-байтных данных: 256 байтов и до DIGRAM_MAX_COUNT самых частых пар байтов.
+// Символ 256 + k обозначает k-ю пару. Блок разбирается жадно: если пара с текущей позиции есть
+// в алфавите, она кодируется одним символом, иначе кодируется байт. В отличие от -s 2 пары
+// ищутся с любого смещения, а таблица кодов остаётся маленькой
+
+#define DIGRAM_MAX_COUNT 256
+#define DIGRAM_ALPHABET_SIZE (256 + DIGRAM_MAX_COUNT)
+#define DIGRAM_SYMBOL_BITS 9
+// Реже встречающиеся пары не окупают своего места в таблице блока
+#define DIGRAM_MIN_OCCURRENCES 16
+
+// Таблицы выбора пар, переиспользуемые между блоками
+typedef struct
+{
+    uint32_t counts[1U << 16];           // Число вхождений каждой пары (старший байт — первый)
+    uint16_t symbols[1U << 16];          // Символ пары в текущем алфавите, 0 — пары в алфавите нет
+    uint16_t digrams[DIGRAM_MAX_COUNT];  // Пары алфавита по номерам
+    uint32_t count;
+} DigramAlphabet;
+
+// Выбирает до maxDigrams (не больше DIGRAM_MAX_COUNT) самых частых пар блока за один проход
+// и заполняет symbols. Таблицы прошлого блока очищаются только в затронутых элементах
+void DigramSelect(DigramAlphabet *alphabet, const unsigned char *data, size_t size, uint32_t maxDigrams);
+
+// Добавляет к freq (DIGRAM_ALPHABET_SIZE элементов) частоты символов жадного разбора data
+void DigramCountSymbols(const DigramAlphabet *alphabet, const unsigned char *data, size_t size, uint64_t *freq);
+
+#endif
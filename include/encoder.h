@@ -3,8 +3,37 @@
 
 #include <stddef.h>
 #include <stdint.h>
-#include "args.h"
+#include "fileutils.h"
+#include "dictionary.h"
+#include "codec.h"
 
-int EncodeFiles(ParsedArgs *args, const char **inputPaths, size_t numInputPaths, const char *outputPath, uint32_t symbol_size);
+// Параметры создания архива
+typedef struct
+{
+    uint32_t symbolSize;   // Размер символа в байтах (1 или 2)
+    uint32_t threads;      // Количество потоков кодирования
+    int allowUring;        // Разрешить пакетный ввод-вывод через io_uring
+    int directIO;          // Читать входные файлы и писать архив с O_DIRECT
+    int solid;             // Объединять файлы не больше solidThreshold в solid-блоки
+    uint32_t solidThreshold;
+    uint32_t solidBlockSize; // Предельный размер solid-блока (не больше BLOCK_SIZE)
+    const Dictionary *dictionary; // Статическая таблица вместо таблиц в каждом блоке, иначе NULL
+    int dedup;             // Записывать одинаковые файлы один раз под несколькими именами
+    const char *basePath;  // Предыдущий архив: блоки неизменившихся файлов копируются из него, иначе NULL
+    int append;            // Дописать файлы новым сегментом в существующий архив (symbolSize 0 — как в архиве)
+    uint32_t streams;      // Потоков в блоке: 1 или BLOCK_STREAMS (для блоков от BLOCK_STREAMS_MIN_SIZE)
+    BlockCoder coder;      // Энтропийный кодер блоков; кроме CODER_HUFFMAN — только 1-байтные символы без словаря
+    uint32_t lzLevel;      // Уровень поиска повторов LZ77 (LZ_MIN_LEVEL..LZ_MAX_LEVEL), 0 — без LZ
+    int contextModel;      // Коды по контексту предыдущего байта (только 1-байтные символы, Хаффман, без LZ и словаря)
+    uint32_t digrams;      // Пар байтов в алфавите блока (до DIGRAM_MAX_COUNT), 0 — без пар; ограничения те же
+    int transforms;        // Выбирать для каждого блока обратимое преобразование (см. transform.h); без словаря
+    uint32_t blockSize;    // Размер блока, кратный 4 КиБ (не больше BLOCK_SIZE), 0 — BLOCK_SIZE
+    uint32_t sampleStep;   // Коды 1-байтных блоков Хаффмана по каждому sampleStep-му отрезку из 4 КиБ, 0 или 1 — по всему блоку
+    uint32_t storedPercent; // Блок пишется как есть, если сжатый занимает не меньше этой доли (%) исходного, 0 — никогда
+    uint32_t maxCodeLength; // Предельная длина кодов Хаффмана, 0 — без ограничения
+} EncodeOptions;
+
+// Сжимает файлы списка в архив outputPath ("-" — stdout) или дописывает их в него. Возвращает 0 при успехе
+int EncodeFiles(const EncodeOptions *options, const FileList *files, const char *outputPath);
 
 #endif
\ No newline at end of file
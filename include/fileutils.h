@@ -3,12 +3,33 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
-// Тип для хранения списка файлов
+// Путь "-" обозначает стандартный поток (stdin для чтения, stdout для записи)
+#define STD_STREAM_PATH "-"
+
+// Выравнивание адресов, смещений и длин для ввода-вывода с O_DIRECT
+#define DIRECT_IO_ALIGNMENT 4096
+
+// Метаданные файла, собранные при обходе (один stat на файл)
+typedef struct
+{
+    size_t pathOffset;     // Смещение пути в арене списка
+    size_t nameOffset;     // Смещение имени в архиве внутри пути
+    uint64_t size;         // Размер файла (для stdin — 0)
+    uint32_t mode;         // Тип и права доступа (для stdin — 0)
+    int64_t mtime;         // Время изменения, секунды
+} FileEntry;
+
+// Тип для хранения списка файлов: все пути лежат в одной арене
 typedef struct 
 {
-    char **paths;
+    char *arena;
+    size_t arenaSize;
+    size_t arenaCapacity;
+    FileEntry *entries;
     size_t count;
+    size_t capacity;
 } FileList;
 
 // Проверяет, существует ли файл
@@ -20,11 +41,20 @@ int IsDirectory(const char *path);
 // Получает размер файла в байтах
 uint64_t GetFileSize(const char *path);
 
-// Рекурсивно собирает список всех файлов внутри папки
-FileList GetFilesInDirectory(const char *dirPath);
+// Собирает список файлов из входных путей: файлы добавляются как есть, директории
+// обходятся рекурсивно (поддиректории — параллельно в threads потоках).
+// Порядок файлов внутри директории — по возрастанию пути. Возвращает 0 при успехе
+int ScanInputPaths(char **inputPaths, size_t numInputPaths, uint32_t threads, FileList *list);
+
+// Путь к файлу и имя, под которым он хранится в архиве
+const char *FileListPath(const FileList *list, size_t index);
+const char *FileListName(const FileList *list, size_t index);
+
+// Суммарный размер файлов списка
+uint64_t FileListTotalSize(const FileList *list);
 
 // Освобождает память, выделенную для списка файлов
-void FreeFileList(FileList list);
+void FreeFileList(FileList *list);
 
 // Загружает содержимое файла в буфер
 unsigned char *ReadBinaryFile(const char *path, size_t *sizeOut);
@@ -38,4 +68,15 @@ int CreateDirectoryRecursive(const char *path);
 // Получает имя файла из полного пути (без папки)
 const char *GetFileName(const char *path);
 
+// Проверяет, обозначает ли путь стандартный поток ("-")
+int IsStdStream(const char *path);
+
+// Включает или выключает O_DIRECT у открытого дескриптора. Возвращает 0 при успехе,
+// -1, если файловая система не поддерживает прямой ввод-вывод
+int SetDirectIO(int fd, int enable);
+
+// Забирает stdout под двоичные данные: возвращает поток на копии дескриптора,
+// а сам stdout перенаправляет в stderr, чтобы сообщения не смешивались с данными
+FILE *TakeStdout(void);
+
 #endif
@@ -0,0 +1,24 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Быстрый некриптографический 64-битный хеш содержимого (алгоритм xxHash64).
+// Используется для поиска одинаковых файлов; совпадение хеша подтверждается сравнением байтов
+typedef struct
+{
+    uint64_t lanes[4];
+    uint64_t totalSize;
+    unsigned char buffer[32];
+    size_t bufferSize;
+} ContentHash;
+
+void ContentHashInit(ContentHash *hash);
+void ContentHashUpdate(ContentHash *hash, const void *data, size_t size);
+uint64_t ContentHashFinal(const ContentHash *hash);
+
+// Хеш буфера целиком
+uint64_t HashBytes(const void *data, size_t size);
+
+#endif
@@ -10,6 +10,31 @@ typedef struct HuffCode
     uint32_t code_len;
 } HuffCode;
 
-HuffCode* GenerateCodes(FILE *data, uint64_t file_size, uint32_t symbol_size);
+// Рабочие таблицы построения кодов, переиспользуемые между вызовами
+typedef struct HuffScratch HuffScratch;
 
-#endif
\ No newline at end of file
+HuffScratch *HuffScratchCreate(void);
+void HuffScratchDestroy(HuffScratch *scratch);
+
+// Предельная длина кодов, которые строит scratch (0 — без ограничения). Короткие коды целиком
+// попадают в таблицу декодирования, зато блок немного больше
+void HuffScratchSetMaxCodeLength(HuffScratch *scratch, uint32_t maxCodeLength);
+
+// Считает частоты символов буфера (1 << (symbol_size * 8) элементов). Таблица принадлежит scratch
+// и действительна до следующего вызова; таблица кодов прошлого построения при этом очищается
+const uint64_t *CountFrequencies(HuffScratch *scratch, const unsigned char *data, uint64_t file_size, uint32_t symbol_size);
+
+// Строит коды Хаффмана для буфера. Таблица принадлежит scratch и действительна до следующего вызова
+const HuffCode *GenerateCodes(HuffScratch *scratch, const unsigned char *data, uint64_t file_size, uint32_t symbol_size);
+
+// Строит коды по готовой таблице частот (1 << (symbol_size * 8) элементов)
+const HuffCode *GenerateCodesFromFrequencies(HuffScratch *scratch, const uint64_t *freq, uint32_t symbol_size);
+
+// То же для алфавита из symbolCount символов (не больше 65536), например смешанного алфавита пар
+const HuffCode *GenerateCodesForAlphabet(HuffScratch *scratch, const uint64_t *freq, uint32_t symbolCount);
+
+// Символы последней таблицы с ненулевой частотой по возрастанию (список принадлежит scratch).
+// Таблица кодов ненулевая только у них, поэтому её можно описать, не обходя весь алфавит
+uint32_t HuffScratchActiveSymbols(const HuffScratch *scratch, const uint32_t **symbols);
+
+#endif
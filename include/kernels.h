@@ -0,0 +1,109 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitstream.h"
+#include "huffman.h"
+
+// Разрядность таблицы декодирования: коды не длиннее неё декодируются одним обращением
+#define DECODE_TABLE_BITS 11
+
+// Узел дерева декодирования; потомки задаются индексами в пуле (0 — нет потомка, корень всегда 0)
+typedef struct
+{
+    uint32_t child0;
+    uint32_t child1;
+    int is_leaf;
+    uint16_t symbol;
+} DecodingTreeNode;
+
+// Элемент таблицы декодирования для очередных DECODE_TABLE_BITS бит потока: символ и длина его кода.
+// Для более длинных кодов length = 0, а node — узел дерева, с которого продолжается разбор
+// (0 — префикс не принадлежит ни одному коду)
+typedef struct
+{
+    uint16_t symbol;
+    uint8_t length;
+    uint32_t node;
+} DecodeEntry;
+
+typedef enum
+{
+    UNPACK_OK = 0,
+    UNPACK_TRUNCATED, // Поток кончился раньше, чем восстановлено size байт
+    UNPACK_INVALID    // Последовательность битов не является кодом
+} UnpackResult;
+
+// Горячие циклы кодека. Каждый вариант собран в своей единице трансляции со своими флагами
+// целевой архитектуры, а при первом обращении для каждого ядра выбирается лучший вариант,
+// который поддерживает процессор
+typedef struct
+{
+    // Добавляет к freq частоты 1- или 2-байтных символов; неполный последний символ дополняется нулём
+    void (*histogram)(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize);
+    // Дописывает в out коды символов data (без выравнивания). size не больше нескольких десятков КиБ:
+    // под выход резервируется по 4 байта на символ
+    void (*packSymbols)(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out);
+    // Восстанавливает size байт из comp, начиная с бита *bitPos, и сдвигает *bitPos за последний код
+    UnpackResult (*unpackSymbols)(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp, size_t compSize,
+                                  uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size);
+    // То же для четырёх потоков блока сразу: из каждого восстанавливается size байт (кратно symbolSize)
+    UnpackResult (*unpackStreams4)(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                   const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4], size_t size);
+    // Контекстный режим (1-байтные символы): байт кодируется таблицей codes[prev], где prev — предыдущий байт;
+    // prev на входе — байт перед data (0 в начале блока)
+    void (*packContext)(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out);
+    UnpackResult (*unpackContext)(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256], const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char prev, unsigned char *out, size_t size);
+    // Смешанный алфавит байтов и пар (см. digram.h): pairs[первый << 8 | второй] — символ пары или 0,
+    // expand[symbol - 256] — пара символа. Пара не выходит за конец data/out
+    void (*packDigrams)(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out);
+    UnpackResult (*unpackDigrams)(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand, const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size);
+    // Шаг CRC32C без начальной и конечной инверсии (см. Crc32c)
+    uint32_t (*crc32c)(uint32_t crc, const unsigned char *data, size_t size);
+} CodecKernels;
+
+// Выбранные ядра; при первом вызове определяются возможности процессора
+const CodecKernels *GetKernels(void);
+
+// Принудительный выбор: "auto" — лучшие доступные, "generic" — базовые без расширений набора команд,
+// "bmi2" — AVX2/BMI2. Возвращает 0 при успехе, -1 для неизвестного имени или неподдерживаемых команд
+int SelectKernels(const char *name);
+
+// Имя выбранного набора ядер
+const char *KernelsName(void);
+
+// Варианты ядер
+void HistogramGeneric(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize);
+void PackSymbolsGeneric(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out);
+UnpackResult UnpackSymbolsGeneric(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp, size_t compSize,
+                                  uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size);
+UnpackResult UnpackStreams4Generic(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                   const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4], size_t size);
+void PackContextGeneric(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out);
+UnpackResult UnpackContextGeneric(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256], const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char prev, unsigned char *out, size_t size);
+void PackDigramsGeneric(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out);
+UnpackResult UnpackDigramsGeneric(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand, const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size);
+uint32_t Crc32cGeneric(uint32_t crc, const unsigned char *data, size_t size);
+
+#if defined(__x86_64__)
+void HistogramBmi2(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize);
+void PackSymbolsBmi2(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out);
+UnpackResult UnpackSymbolsBmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp, size_t compSize,
+                               uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size);
+UnpackResult UnpackStreams4Bmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4], size_t size);
+void PackContextBmi2(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out);
+UnpackResult UnpackContextBmi2(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256], const unsigned char *comp,
+                               size_t compSize, uint64_t *bitPos, unsigned char prev, unsigned char *out, size_t size);
+void PackDigramsBmi2(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out);
+UnpackResult UnpackDigramsBmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand, const unsigned char *comp,
+                               size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size);
+uint32_t Crc32cSse42(uint32_t crc, const unsigned char *data, size_t size);
+#endif
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef KERNELS_IMPL_H
+#define KERNELS_IMPL_H
+
+// Тела ядер кодека. Заголовок включается в единицы трансляции вариантов (kernels_*.c),
+// и каждая компилирует один и тот же код со своими флагами целевой архитектуры:
+// с -mbmi2 сдвиги на переменную величину и выделение бит становятся shlx/shrx/bzhi.
+// codec.c берёт отсюда PeekBits и DecodeSymbol для блоков LZ, где чередуются три алфавита
+
+#include "kernels.h"
+
+#include <string.h>
+
+#define KERNEL_PADDING_BYTE 0x00 // Дополнение последнего символа при symbolSize = 2 и нечётном размере
+#define HISTOGRAM_PIECE (1U << 30) // Наибольший кусок, счётчики которого помещаются в 32 бита
+
+// Четыре независимых набора счётчиков: подряд идущие одинаковые байты не ждут друг друга
+static inline void HistogramImpl(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize)
+{
+    if (symbolSize == 2)
+    {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            freq[((uint16_t)data[i] << 8) | data[i + 1]]++;
+            freq[((uint16_t)data[i + 2] << 8) | data[i + 3]]++;
+            freq[((uint16_t)data[i + 4] << 8) | data[i + 5]]++;
+            freq[((uint16_t)data[i + 6] << 8) | data[i + 7]]++;
+        }
+        for (; i + 1 < size; i += 2)
+            freq[((uint16_t)data[i] << 8) | data[i + 1]]++;
+        if (i < size)
+            freq[((uint16_t)data[i] << 8) | KERNEL_PADDING_BYTE]++;
+        return;
+    }
+
+    uint32_t counts[4][256];
+    while (size > 0)
+    {
+        size_t piece = size < HISTOGRAM_PIECE ? size : HISTOGRAM_PIECE;
+        memset(counts, 0, sizeof(counts));
+        size_t i = 0;
+        for (; i + 4 <= piece; i += 4)
+        {
+            counts[0][data[i]]++;
+            counts[1][data[i + 1]]++;
+            counts[2][data[i + 2]]++;
+            counts[3][data[i + 3]]++;
+        }
+        for (; i < piece; ++i)
+            counts[0][data[i]]++;
+        for (int b = 0; b < 256; ++b)
+            freq[b] += (uint64_t)counts[0][b] + counts[1][b] + counts[2][b] + counts[3][b];
+        data += piece;
+        size -= piece;
+    }
+}
+
+static inline void StoreBigEndian32(unsigned char *p, uint32_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    memcpy(p, &value, sizeof(value));
+}
+
+// Коды накапливаются в 64-битном регистре и выводятся по 32 бита; код не длиннее 32 бит,
+// поэтому в накопителе остаётся меньше 32 бит и следующий код всегда помещается
+#define PACK_CODE(hc)                                              \
+    do                                                             \
+    {                                                              \
+        acc = (acc << (hc).code_len) | (hc).code;                  \
+        bits += (hc).code_len;                                     \
+        if (bits >= 32)                                            \
+        {                                                          \
+            bits -= 32;                                            \
+            StoreBigEndian32(dst, (uint32_t)(acc >> bits));        \
+            dst += 4;                                              \
+        }                                                          \
+    } while (0)
+
+static inline void PackSymbolsImpl(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out)
+{
+    size_t symbols = symbolSize == 1 ? size : (size + 1) / 2;
+    unsigned char *start = BitWriterReserve(out, symbols * 4 + 4);
+    if (!start)
+    {
+        // Нехватка памяти: побитовая запись сама отбросит то, что не поместилось
+        for (size_t i = 0; i < size; i += symbolSize)
+        {
+            uint32_t symbol = symbolSize == 1 ? data[i] : ((uint32_t)data[i] << 8) | (i + 1 < size ? data[i + 1] : KERNEL_PADDING_BYTE);
+            BitWriterWriteBits(out, (unsigned int)codes[symbol].code, codes[symbol].code_len);
+        }
+        return;
+    }
+
+    unsigned char *dst = start;
+    uint64_t acc = out->buffer;
+    unsigned bits = (unsigned)out->bitPos;
+    if (symbolSize == 1)
+    {
+        for (size_t i = 0; i < size; ++i)
+            PACK_CODE(codes[data[i]]);
+    }
+    else
+    {
+        size_t i = 0;
+        for (; i + 1 < size; i += 2)
+            PACK_CODE(codes[((uint16_t)data[i] << 8) | data[i + 1]]);
+        if (i < size)
+            PACK_CODE(codes[((uint16_t)data[i] << 8) | KERNEL_PADDING_BYTE]);
+    }
+    for (; bits >= 8; bits -= 8)
+        *dst++ = (unsigned char)(acc >> (bits - 8));
+
+    BitWriterCommit(out, (size_t)(dst - start));
+    out->buffer = acc;
+    out->bitPos = (int)bits;
+}
+
+// Каждый байт кодируется таблицей, выбранной по предыдущему байту
+static inline void PackContextImpl(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out)
+{
+    unsigned char *start = BitWriterReserve(out, size * 4 + 4);
+    if (!start)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            BitWriterWriteBits(out, (unsigned int)codes[prev][data[i]].code, codes[prev][data[i]].code_len);
+            prev = data[i];
+        }
+        return;
+    }
+
+    unsigned char *dst = start;
+    uint64_t acc = out->buffer;
+    unsigned bits = (unsigned)out->bitPos;
+    for (size_t i = 0; i < size; ++i)
+    {
+        PACK_CODE(codes[prev][data[i]]);
+        prev = data[i];
+    }
+    for (; bits >= 8; bits -= 8)
+        *dst++ = (unsigned char)(acc >> (bits - 8));
+
+    BitWriterCommit(out, (size_t)(dst - start));
+    out->buffer = acc;
+    out->bitPos = (int)bits;
+}
+
+// Жадный разбор как в DigramCountSymbols: пара из алфавита — один код, иначе код байта
+static inline void PackDigramsImpl(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out)
+{
+    unsigned char *start = BitWriterReserve(out, size * 4 + 4);
+    if (!start)
+    {
+        for (size_t i = 0; i < size;)
+        {
+            uint16_t symbol = i + 1 < size ? pairs[((uint32_t)data[i] << 8) | data[i + 1]] : 0;
+            uint32_t code = symbol ? symbol : data[i];
+            BitWriterWriteBits(out, (unsigned int)codes[code].code, codes[code].code_len);
+            i += symbol ? 2 : 1;
+        }
+        return;
+    }
+
+    unsigned char *dst = start;
+    uint64_t acc = out->buffer;
+    unsigned bits = (unsigned)out->bitPos;
+    size_t i = 0;
+    while (i + 1 < size)
+    {
+        uint16_t symbol = pairs[((uint32_t)data[i] << 8) | data[i + 1]];
+        uint32_t code = symbol ? symbol : data[i];
+        PACK_CODE(codes[code]);
+        i += symbol ? 2 : 1;
+    }
+    if (i < size)
+        PACK_CODE(codes[data[i]]);
+    for (; bits >= 8; bits -= 8)
+        *dst++ = (unsigned char)(acc >> (bits - 8));
+
+    BitWriterCommit(out, (size_t)(dst - start));
+    out->buffer = acc;
+    out->bitPos = (int)bits;
+}
+
+#undef PACK_CODE
+
+// 64 бита потока начиная с бита bitPos (первый бит — старший); за концом буфера — нули.
+// Достоверны не меньше 57 старших бит
+static inline uint64_t PeekBits(const unsigned char *comp, size_t compSize, uint64_t bitPos)
+{
+    size_t byte = (size_t)(bitPos >> 3);
+    uint64_t window = 0;
+    if (byte + 8 <= compSize)
+    {
+        memcpy(&window, comp + byte, sizeof(window));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        window = __builtin_bswap64(window);
+#endif
+    }
+    else
+    {
+        for (int i = 0; i < 8; ++i)
+            window = (window << 8) | (byte + i < compSize ? comp[byte + i] : 0);
+    }
+    return window << (bitPos & 7);
+}
+
+// Символ по началу окна window; 0, если биты не образуют код. Коды не длиннее 32 бит,
+// поэтому при достоверных 57 битах окна код целиком в нём, даже если разбор ушёл в дерево
+static inline int DecodeSymbol(const DecodeEntry *table, const DecodingTreeNode *nodes, uint64_t window, uint32_t *symbol, unsigned *length)
+{
+    DecodeEntry entry = table[window >> (64 - DECODE_TABLE_BITS)];
+    *symbol = entry.symbol;
+    *length = entry.length;
+    if (entry.length != 0)
+        return 1;
+
+    // Код длиннее таблицы: разбор продолжается по дереву
+    uint32_t node = entry.node;
+    unsigned used = DECODE_TABLE_BITS;
+    while (node != 0 && !nodes[node].is_leaf)
+    {
+        node = ((window << used) >> 63) ? nodes[node].child1 : nodes[node].child0;
+        ++used;
+    }
+    if (node == 0)
+        return 0;
+    *symbol = nodes[node].symbol;
+    *length = used;
+    return 1;
+}
+
+// Одного окна PeekBits хватает на несколько кодов: пока израсходовано не больше
+// 57 - 32 бит, следующий код целиком в окне
+#define WINDOW_SPARE_BITS 25
+
+static inline UnpackResult UnpackSymbolsImpl(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp,
+                                             size_t compSize, uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size)
+{
+    const uint64_t limit = (uint64_t)compSize * 8;
+    uint64_t pos = *bitPos;
+    size_t produced = 0;
+    while (produced < size)
+    {
+        uint64_t window = PeekBits(comp, compSize, pos);
+        unsigned consumed = 0;
+        do
+        {
+            uint32_t symbol;
+            unsigned length;
+            if (!DecodeSymbol(table, nodes, window << consumed, &symbol, &length))
+                return UNPACK_INVALID;
+            consumed += length;
+
+            if (symbolSize == 1)
+                out[produced++] = (unsigned char)symbol;
+            else
+            {
+                out[produced++] = (unsigned char)(symbol >> 8);
+                if (produced < size)
+                    out[produced++] = (unsigned char)symbol;
+            }
+        } while (consumed <= WINDOW_SPARE_BITS && produced < size);
+
+        pos += consumed;
+        if (pos > limit)
+            return UNPACK_TRUNCATED;
+    }
+    *bitPos = pos;
+    return UNPACK_OK;
+}
+
+// Как UnpackSymbolsImpl для 1-байтных символов, но таблица выбирается по предыдущему байту
+static inline UnpackResult UnpackContextImpl(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256],
+                                             const unsigned char *comp, size_t compSize, uint64_t *bitPos, unsigned char prev,
+                                             unsigned char *out, size_t size)
+{
+    const uint64_t limit = (uint64_t)compSize * 8;
+    uint64_t pos = *bitPos;
+    size_t produced = 0;
+    while (produced < size)
+    {
+        uint64_t window = PeekBits(comp, compSize, pos);
+        unsigned consumed = 0;
+        do
+        {
+            uint32_t symbol;
+            unsigned length;
+            if (!DecodeSymbol(tables[prev], nodes[prev], window << consumed, &symbol, &length))
+                return UNPACK_INVALID;
+            consumed += length;
+            prev = (unsigned char)symbol;
+            out[produced++] = prev;
+        } while (consumed <= WINDOW_SPARE_BITS && produced < size);
+
+        pos += consumed;
+        if (pos > limit)
+            return UNPACK_TRUNCATED;
+    }
+    *bitPos = pos;
+    return UNPACK_OK;
+}
+
+// Смешанный алфавит: символ меньше 256 — байт, остальные раскрываются в пару по expand.
+// Пара, которая не помещается в оставшиеся size байт, — ошибка потока
+static inline UnpackResult UnpackDigramsImpl(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand,
+                                             const unsigned char *comp, size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size)
+{
+    const uint64_t limit = (uint64_t)compSize * 8;
+    uint64_t pos = *bitPos;
+    size_t produced = 0;
+    while (produced < size)
+    {
+        uint64_t window = PeekBits(comp, compSize, pos);
+        unsigned consumed = 0;
+        do
+        {
+            uint32_t symbol;
+            unsigned length;
+            if (!DecodeSymbol(table, nodes, window << consumed, &symbol, &length))
+                return UNPACK_INVALID;
+            consumed += length;
+            if (symbol < 256)
+                out[produced++] = (unsigned char)symbol;
+            else
+            {
+                if (size - produced < 2)
+                    return UNPACK_INVALID;
+                uint16_t pair = expand[symbol - 256];
+                out[produced] = (unsigned char)(pair >> 8);
+                out[produced + 1] = (unsigned char)pair;
+                produced += 2;
+            }
+        } while (consumed <= WINDOW_SPARE_BITS && produced < size);
+
+        pos += consumed;
+        if (pos > limit)
+            return UNPACK_TRUNCATED;
+    }
+    *bitPos = pos;
+    return UNPACK_OK;
+}
+
+// Четыре независимых потока за один проход: цепочки зависимостей «окно — таблица — длина»
+// разных потоков выполняются процессором одновременно
+static inline UnpackResult UnpackStreams4Impl(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                              const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4],
+                                              size_t size)
+{
+    uint64_t pos0 = bitPos[0], pos1 = bitPos[1], pos2 = bitPos[2], pos3 = bitPos[3];
+    unsigned char *out0 = out[0], *out1 = out[1], *out2 = out[2], *out3 = out[3];
+    for (size_t i = 0; i < size; i += symbolSize)
+    {
+        uint32_t s0, s1, s2, s3;
+        unsigned l0, l1, l2, l3;
+        int valid = DecodeSymbol(table, nodes, PeekBits(comp[0], compSize[0], pos0), &s0, &l0);
+        valid &= DecodeSymbol(table, nodes, PeekBits(comp[1], compSize[1], pos1), &s1, &l1);
+        valid &= DecodeSymbol(table, nodes, PeekBits(comp[2], compSize[2], pos2), &s2, &l2);
+        valid &= DecodeSymbol(table, nodes, PeekBits(comp[3], compSize[3], pos3), &s3, &l3);
+        if (!valid)
+            return UNPACK_INVALID;
+        pos0 += l0;
+        pos1 += l1;
+        pos2 += l2;
+        pos3 += l3;
+
+        if (symbolSize == 1)
+        {
+            out0[i] = (unsigned char)s0;
+            out1[i] = (unsigned char)s1;
+            out2[i] = (unsigned char)s2;
+            out3[i] = (unsigned char)s3;
+        }
+        else
+        {
+            out0[i] = (unsigned char)(s0 >> 8);
+            out0[i + 1] = (unsigned char)s0;
+            out1[i] = (unsigned char)(s1 >> 8);
+            out1[i + 1] = (unsigned char)s1;
+            out2[i] = (unsigned char)(s2 >> 8);
+            out2[i + 1] = (unsigned char)s2;
+            out3[i] = (unsigned char)(s3 >> 8);
+            out3[i + 1] = (unsigned char)s3;
+        }
+    }
+
+    bitPos[0] = pos0;
+    bitPos[1] = pos1;
+    bitPos[2] = pos2;
+    bitPos[3] = pos3;
+    for (int k = 0; k < 4; ++k)
+        if (bitPos[k] > (uint64_t)compSize[k] * 8)
+            return UNPACK_TRUNCATED;
+    return UNPACK_OK;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LIBHUFFMAN_H
+#define LIBHUFFMAN_H
+
+// Встраиваемый интерфейс сжатия буферов в памяти.
+// Сжатые данные — последовательность блоков в формате записи архива:
+// raw_len (32) | comp_len (32) | method (8) | данные, завершённая raw_len = 0.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    HUFF_OK = 0,
+    HUFF_ERROR_ARGUMENT,       // Неверные аргументы
+    HUFF_ERROR_MEMORY,         // Не удалось выделить память
+    HUFF_ERROR_DST_TOO_SMALL,  // Результат не помещается в выходной буфер
+    HUFF_ERROR_CORRUPT,        // Входные данные повреждены
+    HUFF_ERROR_DICTIONARY      // Словарь не загружен или не подходит к данным
+} HuffStatus;
+
+// Контекст хранит рабочие таблицы кодера и декодера между вызовами, поэтому
+// повторные вызовы не выделяют память. Один контекст — один поток
+typedef struct HuffContext HuffContext;
+
+HuffContext *HuffContextCreate(void);
+void HuffContextDestroy(HuffContext *ctx);
+
+// Загружает словарь (файл режима --train или "builtin" — встроенная таблица для ASCII-текста).
+// После этого HuffCompress кодирует блоки по таблице словаря без подсчёта частот и без
+// таблицы в каждом блоке; размер символа должен совпадать со словарём.
+// HuffDecompress использует словарь для таких блоков
+HuffStatus HuffContextLoadDictionary(HuffContext *ctx, const char *path);
+
+// Размер выходного буфера, достаточный для сжатия srcSize байт в худшем случае
+size_t HuffCompressBound(size_t srcSize);
+
+// Сжимает src в dst с символами размера symbolSize (1 или 2 байта).
+// Размер результата возвращается в *compressedSize
+HuffStatus HuffCompress(HuffContext *ctx, uint32_t symbolSize, const void *src, size_t srcSize,
+                        void *dst, size_t dstCapacity, size_t *compressedSize);
+
+// Распаковывает src в dst; размер результата возвращается в *decompressedSize
+HuffStatus HuffDecompress(HuffContext *ctx, const void *src, size_t srcSize,
+                          void *dst, size_t dstCapacity, size_t *decompressedSize);
+
+// Размер распакованных данных по заголовкам блоков (без декодирования)
+HuffStatus HuffDecompressedSize(const void *src, size_t srcSize, uint64_t *size);
+
+const char *HuffStatusString(HuffStatus status);
+
+// --- Потоковый интерфейс ---
+// Память ограничена одним блоком: вход принимается, пока предыдущий результат
+// не забран через Pull, поэтому целая запись никогда не хранится в памяти.
+
+typedef struct HuffEncoder HuffEncoder;
+typedef struct HuffDecoder HuffDecoder;
+
+HuffEncoder *HuffEncoderCreate(uint32_t symbolSize);
+void HuffEncoderDestroy(HuffEncoder *enc);
+
+// Принимает до size байт; сколько принято, возвращается в *consumed.
+// Если принято меньше size, нужно забрать готовые данные через HuffEncoderPull
+HuffStatus HuffEncoderPush(HuffEncoder *enc, const void *src, size_t size, size_t *consumed);
+
+// Отдаёт готовые сжатые данные; *produced = 0, если готовых данных нет
+HuffStatus HuffEncoderPull(HuffEncoder *enc, void *dst, size_t capacity, size_t *produced);
+
+// Завершает вход: после этого HuffEncoderPull отдаёт последний блок и маркер конца,
+// а затем возвращает *produced = 0
+HuffStatus HuffEncoderFinish(HuffEncoder *enc);
+
+HuffDecoder *HuffDecoderCreate(void);
+void HuffDecoderDestroy(HuffDecoder *dec);
+
+// Принимает до size байт сжатых данных. Принимает меньше, если распакованный блок
+// ещё не забран, или если достигнут маркер конца (следующие байты не относятся к потоку)
+HuffStatus HuffDecoderPush(HuffDecoder *dec, const void *src, size_t size, size_t *consumed);
+
+// Отдаёт распакованные данные; *produced = 0, если готовых данных нет
+HuffStatus HuffDecoderPull(HuffDecoder *dec, void *dst, size_t capacity, size_t *produced);
+
+// 1, если маркер конца прочитан и все данные забраны
+int HuffDecoderFinished(const HuffDecoder *dec);
+
+// --- Сообщения ---
+// Библиотека не пишет в stdout/stderr: сообщения (ошибки, предупреждения, прогресс
+// сжатия архива) передаются обработчику. Без обработчика они отбрасываются.
+// Обработчик устанавливается до остальных вызовов и может вызываться из разных потоков
+
+typedef enum
+{
+    HUFF_LOG_INFO,
+    HUFF_LOG_PROGRESS,   // Строка прогресса, начинается с '\r' и не завершается переводом строки
+    HUFF_LOG_SUCCESS,
+    HUFF_LOG_WARNING,
+    HUFF_LOG_ERROR
+} HuffLogLevel;
+
+typedef void (*HuffLogFn)(HuffLogLevel level, const char *message, void *userData);
+
+void HuffSetLogger(HuffLogFn fn, void *userData);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Поиск повторов LZ77 внутри блока по хеш-цепочкам. Блок разбирается на последовательности
+// «литералы + повтор»: literals байт копируются как есть, затем length байт повторяют данные,
+// стоящие на distance байт раньше. Последняя последовательность может быть без повтора (length = 0)
+
+#define LZ_MIN_MATCH 4
+#define LZ_MIN_LEVEL 1
+#define LZ_MAX_LEVEL 9
+
+// Значения (длины серий литералов, length - LZ_MIN_MATCH, distance) кодируются кодом группы
+// и дополнительными битами: значения меньше LZ_DIRECT_CODES — сами себе код, остальные группируются
+// по старшему биту и следующему за ним, младшие биты пишутся как есть
+#define LZ_DIRECT_CODES 16
+#define LZ_VALUE_CODES 50 // Хватает для значений до 2^21
+
+typedef struct
+{
+    uint32_t literals;
+    uint32_t length;
+    uint32_t distance;
+} LzSequence;
+
+// Хеш-таблица, цепочки и буфер последовательностей, переиспользуемые между блоками.
+// Один экземпляр нельзя использовать из нескольких потоков
+typedef struct LzMatcher LzMatcher;
+
+LzMatcher *LzMatcherCreate(void);
+void LzMatcherDestroy(LzMatcher *matcher);
+
+// Разбирает блок на последовательности с глубиной поиска уровня level (LZ_MIN_LEVEL..LZ_MAX_LEVEL):
+// чем выше уровень, тем больше кандидатов просматривается для каждой позиции.
+// Последовательности принадлежат matcher и действительны до следующего вызова.
+// Возвращает их число или (size_t)-1 при нехватке памяти
+size_t LzParse(LzMatcher *matcher, const unsigned char *data, size_t size, uint32_t level, const LzSequence **sequences);
+
+#endif
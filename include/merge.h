@@ -0,0 +1,12 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stddef.h>
+
+// Объединяет архивы в один архив outputPath ("-" — stdout) без перекодирования:
+// сжатые блоки и таблицы копируются как есть, заново пишутся только заголовок и концевик.
+// Архивы должны иметь одинаковый размер символа и словарь, а имена записей разных
+// архивов не должны совпадать. Возвращает 0 при успехе
+int MergeArchives(const char **archivePaths, size_t archiveCount, const char *outputPath);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/limits.h>
+#include "bitstream.h"
+#include "codec.h"
+
+// Вид элемента конвейера: начало записи, блок данных, конец записи,
+// solid-блок с несколькими файлами целиком, готовые сжатые блоки из другого архива
+typedef enum
+{
+    PIPE_ITEM_BEGIN,
+    PIPE_ITEM_DATA,
+    PIPE_ITEM_END,
+    PIPE_ITEM_SOLID,
+    PIPE_ITEM_REUSE
+} PipelineItemKind;
+
+// Ячейка кольцевого буфера. Заполняется читателем, обрабатывается кодером,
+// затем передаётся писателю строго в порядке чтения
+typedef struct
+{
+    PipelineItemKind kind;
+    size_t entry;          // Номер записи архива
+    char name[PATH_MAX];   // Имя записи (для PIPE_ITEM_BEGIN)
+    int skip;              // Запись не извлекается (только для распаковки)
+    unsigned char *raw;    // Несжатые данные блока (BLOCK_SIZE байт)
+    size_t rawSize;
+    BitWriter *comp;       // Сжатые данные блока (буфер в памяти)
+    uint8_t method;        // Вместе с BLOCK_FLAG_CRC, если у блока есть контрольная сумма
+    uint32_t crc;          // CRC32C несжатых данных блока
+    uint32_t memberCount;  // Число файлов solid-блока
+    BitWriter *index;      // Список файлов solid-блока в формате архива
+    uint64_t digest;       // Хеш содержимого записи (для PIPE_ITEM_END при сжатии)
+    uint64_t position;     // При распаковке: смещение блока от начала записи (PIPE_ITEM_DATA) или её размер (PIPE_ITEM_END)
+    int hasInfo;           // При распаковке: у записи есть размер и хеш содержимого (PIPE_ITEM_END)
+    int failed;            // Блок не декодировался или не сошлась контрольная сумма; при проверке архива ошибка не останавливает конвейер
+    int state;             // Внутреннее состояние ячейки
+} PipelineSlot;
+
+// Возвращает 1, если ячейка заполнена; 0 — вход закончился; -1 — ошибка
+typedef int (*PipelineReadFn)(void *ctx, PipelineSlot *slot);
+// Возвращает 0 при успехе; scratch принадлежит потоку-кодеру и живёт всё время работы конвейера
+typedef int (*PipelineCodeFn)(void *ctx, PipelineSlot *slot, CodecScratch *scratch);
+typedef int (*PipelineWriteFn)(void *ctx, PipelineSlot *slot);
+
+// Количество потоков-кодеров по умолчанию (число доступных ядер)
+uint32_t PipelineDefaultThreads(void);
+
+// Запускает конвейер: поток чтения, coderThreads потоков кодирования и писатель
+// на вызывающем потоке. Число ячеек ограничено, поэтому быстрая стадия ждёт медленную.
+// Возвращает 0, если все стадии завершились успешно
+int RunPipeline(uint32_t coderThreads, PipelineReadFn read, PipelineCodeFn code, PipelineWriteFn write, void *ctx);
+
+#endif
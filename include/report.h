@@ -0,0 +1,10 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "libhuffman.h"
+
+// Передаёт сообщение обработчику, установленному через HuffSetLogger.
+// Библиотека не пишет в stdout/stderr сама: без обработчика сообщения отбрасываются
+void Report(HuffLogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
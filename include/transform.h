@@ -0,0 +1,42 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Обратимые преобразования блока перед энтропийным кодированием. Коды Хаффмана учитывают только
+// частоты байтов, а у числовых дампов и разреженных файлов избыточность в соседстве байтов:
+// медленно меняющиеся отсчёты после разности сводятся к нескольким малым значениям,
+// длинные серии нулей — к паре байтов, а MTF превращает локально повторяющиеся байты в малые номера
+typedef enum
+{
+    TRANSFORM_NONE = 0,
+    TRANSFORM_DELTA8 = 1,   // Разность с предыдущим байтом
+    TRANSFORM_DELTA16 = 2,  // Разность с байтом двумя позициями раньше (16-битные отсчёты)
+    TRANSFORM_ZERO_RLE = 3, // Серия из n нулей (1..256) — байты 0 и n - 1; остальные байты как есть
+    TRANSFORM_MTF = 4,      // Номер байта в списке недавних (move-to-front)
+    TRANSFORM_COUNT
+} BlockTransform;
+
+// Прямое преобразование size байт data в out (не меньше size байт). Возвращает размер результата;
+// TRANSFORM_EXPANDED, если серии нулей не сокращают блок и результат не поместился бы в size байт
+#define TRANSFORM_EXPANDED ((size_t)-1)
+size_t TransformForward(BlockTransform transform, const unsigned char *data, size_t size, unsigned char *out);
+
+// Состояние обратного преобразования между порциями: преобразованный блок восстанавливается
+// по частям, и каждая часть выхода проверяется, пока она в кэше
+typedef struct
+{
+    BlockTransform transform;
+    unsigned char history[2];  // Последние восстановленные байты (для разностей)
+    int pendingZeros;          // Порция закончилась на нуле, длина серии — в следующей
+    unsigned char order[256];  // Список недавних байтов (для MTF)
+} TransformState;
+
+void TransformStateInit(TransformState *state, BlockTransform transform);
+
+// Восстанавливает очередную порцию in; выход дописывается в out, *produced — сколько байт записано.
+// Возвращает 1, если результат не помещается в capacity байт
+int TransformInverse(TransformState *state, const unsigned char *in, size_t inSize, unsigned char *out, size_t capacity, size_t *produced);
+
+#endif
@@ -0,0 +1,376 @@
+#include "ans.h"
+
+#include <string.h>
+
+static inline uint32_t HighBit(uint32_t value)
+{
+    return 31 - (uint32_t)__builtin_clz(value);
+}
+
+// log2(value) в 1/256 бита: целая часть — старший бит, дробная — последовательным возведением
+// мантиссы в квадрат (каждое возведение даёт следующий двоичный знак)
+static uint32_t Log2Fixed(uint32_t value)
+{
+    uint32_t high = HighBit(value);
+    uint64_t mantissa = ((uint64_t)value << 31) >> high; // [1, 2) в формате Q31
+    uint32_t fraction = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        mantissa = (mantissa * mantissa) >> 31;
+        fraction <<= 1;
+        if (mantissa >= (1ULL << 32))
+        {
+            mantissa >>= 1;
+            fraction |= 1;
+        }
+    }
+    return (high << 8) | fraction;
+}
+
+uint32_t AnsChooseTableLog(uint64_t total, uint32_t active)
+{
+    // Таблица не должна быть много больше блока: её описание и начальные состояния окупаются
+    // только на достаточно длинном потоке, а на каждый символ нужно хотя бы два состояния
+    uint32_t tableLog = total < 2 ? ANS_MIN_TABLE_LOG : HighBit((uint32_t)(total - 1 < UINT32_MAX ? total - 1 : UINT32_MAX)) - 2;
+    uint32_t minLog = HighBit(active ? active : 1) + 2;
+    if (tableLog > ANS_MAX_TABLE_LOG)
+        tableLog = ANS_MAX_TABLE_LOG;
+    if (tableLog < minLog)
+        tableLog = minLog;
+    if (tableLog < ANS_MIN_TABLE_LOG)
+        tableLog = ANS_MIN_TABLE_LOG;
+    return tableLog;
+}
+
+int AnsNormalize(const uint64_t *freq, uint32_t tableLog, uint16_t *norm)
+{
+    uint64_t total = 0;
+    uint32_t active = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+    {
+        total += freq[s];
+        active += freq[s] != 0;
+    }
+    uint32_t tableSize = 1U << tableLog;
+    if (total == 0 || active > tableSize)
+        return -1;
+
+    uint32_t sum = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+    {
+        uint64_t share = freq[s] ? (freq[s] * tableSize + total / 2) / total : 0;
+        norm[s] = (uint16_t)(freq[s] && share == 0 ? 1 : share);
+        sum += norm[s];
+    }
+
+    // Округление сдвинуло сумму: доли по одной отдаются символам, которым они нужнее всего,
+    // и забираются у тех, кому потеря обходится дешевле (цена доли примерно freq / norm)
+    while (sum < tableSize)
+    {
+        int best = -1;
+        for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+            if (freq[s] && (best < 0 || freq[s] * norm[best] > freq[best] * norm[s]))
+                best = s;
+        norm[best]++;
+        sum++;
+    }
+    while (sum > tableSize)
+    {
+        int best = -1;
+        for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+            if (norm[s] > 1 && (best < 0 || freq[s] * norm[best] < freq[best] * norm[s]))
+                best = s;
+        norm[best]--;
+        sum--;
+    }
+    return 0;
+}
+
+uint64_t AnsEstimateCost(const uint64_t *freq, const uint16_t *norm, uint32_t tableLog)
+{
+    uint64_t cost = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+        if (freq[s])
+            cost += freq[s] * ((tableLog << 8) - Log2Fixed(norm[s]));
+    return cost;
+}
+
+// Раскладывает символы по состояниям: шаг взаимно прост с размером таблицы, поэтому
+// обходит все состояния, а состояния одного символа оказываются разбросаны по таблице
+static void SpreadSymbols(const uint16_t *norm, uint32_t tableLog, uint8_t *tableSymbol)
+{
+    uint32_t tableSize = 1U << tableLog;
+    uint32_t mask = tableSize - 1;
+    uint32_t step = (tableSize >> 1) + (tableSize >> 3) + 3;
+    uint32_t position = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+    {
+        for (uint32_t i = 0; i < norm[s]; ++i)
+        {
+            tableSymbol[position] = (uint8_t)s;
+            position = (position + step) & mask;
+        }
+    }
+}
+
+void AnsBuildEncodeTable(AnsEncodeTable *table, const uint16_t *norm, uint32_t tableLog)
+{
+    uint32_t tableSize = 1U << tableLog;
+    uint8_t tableSymbol[1U << ANS_MAX_TABLE_LOG];
+    SpreadSymbols(norm, tableLog, tableSymbol);
+
+    uint32_t cumulative[ANS_ALPHABET_SIZE + 1];
+    cumulative[0] = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+        cumulative[s + 1] = cumulative[s] + norm[s];
+    for (uint32_t u = 0; u < tableSize; ++u)
+        table->states[cumulative[tableSymbol[u]]++] = (uint16_t)(tableSize + u);
+
+    // Число выводимых бит — maxBitsOut или на единицу меньше, в зависимости от того,
+    // достигло ли состояние minStatePlus; оба случая считаются одним сдвигом (state + deltaNbBits) >> 16
+    uint32_t total = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+    {
+        uint32_t count = norm[s];
+        if (count == 0)
+        {
+            table->symbols[s].deltaNbBits = ((tableLog + 1) << 16) - tableSize;
+            table->symbols[s].deltaFindState = 0;
+        }
+        else if (count == 1)
+        {
+            table->symbols[s].deltaNbBits = (tableLog << 16) - tableSize;
+            table->symbols[s].deltaFindState = (int32_t)total - 1;
+        }
+        else
+        {
+            uint32_t maxBitsOut = tableLog - HighBit(count - 1);
+            uint32_t minStatePlus = count << maxBitsOut;
+            table->symbols[s].deltaNbBits = (maxBitsOut << 16) - minStatePlus;
+            table->symbols[s].deltaFindState = (int32_t)total - (int32_t)count;
+        }
+        total += count;
+    }
+    table->tableLog = tableLog;
+}
+
+int AnsBuildDecodeTable(AnsDecodeTable *table, const uint16_t *norm, uint32_t tableLog)
+{
+    if (tableLog < ANS_MIN_TABLE_LOG || tableLog > ANS_MAX_TABLE_LOG)
+        return -1;
+    uint32_t tableSize = 1U << tableLog;
+    uint32_t sum = 0;
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+        sum += norm[s];
+    if (sum != tableSize)
+        return -1;
+
+    uint8_t tableSymbol[1U << ANS_MAX_TABLE_LOG];
+    SpreadSymbols(norm, tableLog, tableSymbol);
+
+    uint32_t next[ANS_ALPHABET_SIZE];
+    for (int s = 0; s < ANS_ALPHABET_SIZE; ++s)
+        next[s] = norm[s];
+    for (uint32_t u = 0; u < tableSize; ++u)
+    {
+        uint8_t symbol = tableSymbol[u];
+        uint32_t state = next[symbol]++;
+        uint32_t nbBits = tableLog - HighBit(state);
+        table->entries[u].symbol = symbol;
+        table->entries[u].nbBits = (uint8_t)nbBits;
+        table->entries[u].newState = (uint16_t)((state << nbBits) - tableSize);
+    }
+    table->tableLog = tableLog;
+    return 0;
+}
+
+static inline void StoreLittleEndian64(unsigned char *p, uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(p, &value, sizeof(value));
+}
+
+static inline uint64_t LoadLittleEndian64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+// Биты копятся с младших разрядов накопителя, а полные байты выводятся по 8 за раз
+typedef struct
+{
+    uint64_t acc;
+    uint32_t bits;
+    unsigned char *ptr;
+} AnsBitWriter;
+
+static inline void PutBits(AnsBitWriter *writer, uint32_t value, uint32_t count)
+{
+    writer->acc |= (uint64_t)(value & ((1U << count) - 1)) << writer->bits;
+    writer->bits += count;
+}
+
+static inline void FlushBits(AnsBitWriter *writer)
+{
+    uint32_t bytes = writer->bits >> 3;
+    StoreLittleEndian64(writer->ptr, writer->acc);
+    writer->ptr += bytes;
+    writer->acc >>= bytes * 8;
+    writer->bits &= 7;
+}
+
+static inline void EncodeSymbol(const AnsEncodeTable *table, AnsBitWriter *writer, uint32_t *state, unsigned char symbol)
+{
+    uint32_t nbBits = (*state + table->symbols[symbol].deltaNbBits) >> 16;
+    PutBits(writer, *state, nbBits);
+    *state = table->states[(int32_t)(*state >> nbBits) + table->symbols[symbol].deltaFindState];
+}
+
+size_t AnsEncode(const AnsEncodeTable *table, const unsigned char *data, size_t size, unsigned char *dst)
+{
+    AnsBitWriter writer = {0, 0, dst};
+    uint32_t tableSize = 1U << table->tableLog;
+    uint32_t stateA = tableSize, stateB = tableSize;
+
+    // Чётные символы кодируются состоянием A, нечётные — B. Сначала хвост до длины, кратной
+    // четырём, затем по четыре кода между сбросами: по ANS_MAX_TABLE_LOG бит накопитель не переполнят
+    size_t i = size;
+    while (i & 3)
+    {
+        --i;
+        EncodeSymbol(table, &writer, (i & 1) ? &stateB : &stateA, data[i]);
+    }
+    FlushBits(&writer);
+    while (i > 0)
+    {
+        i -= 4;
+        EncodeSymbol(table, &writer, &stateB, data[i + 3]);
+        EncodeSymbol(table, &writer, &stateA, data[i + 2]);
+        EncodeSymbol(table, &writer, &stateB, data[i + 1]);
+        EncodeSymbol(table, &writer, &stateA, data[i]);
+        FlushBits(&writer);
+    }
+
+    // Конечные состояния декодер читает первыми: сначала A, затем B
+    PutBits(&writer, stateB, table->tableLog);
+    FlushBits(&writer);
+    PutBits(&writer, stateA, table->tableLog);
+    PutBits(&writer, 1, 1); // Метка: по ней декодер находит последний значащий бит потока
+    FlushBits(&writer);
+    return (size_t)(writer.ptr - dst) + (writer.bits > 0);
+}
+
+static inline uint32_t ReadBits(uint64_t container, uint32_t *consumed, uint32_t count)
+{
+    uint64_t value = ((container << (*consumed & 63)) >> 1) >> ((63 - count) & 63);
+    *consumed += count;
+    return (uint32_t)value;
+}
+
+// Сдвигает окно к началу потока на израсходованные байты
+static inline void Reload(AnsDecoder *decoder)
+{
+    if (decoder->consumed > 64 || decoder->ptr == decoder->start)
+        return;
+    size_t bytes = decoder->consumed >> 3;
+    if (bytes > (size_t)(decoder->ptr - decoder->start))
+        bytes = (size_t)(decoder->ptr - decoder->start);
+    decoder->ptr -= bytes;
+    decoder->consumed -= (uint32_t)bytes * 8;
+    decoder->container = LoadLittleEndian64(decoder->ptr);
+}
+
+int AnsDecoderInit(AnsDecoder *decoder, const AnsDecodeTable *table, const unsigned char *src, size_t srcSize)
+{
+    if (srcSize == 0 || src[srcSize - 1] == 0)
+        return -1;
+
+    // Нули над меткой и сама метка считаются прочитанными
+    uint32_t marker = 8 - HighBit(src[srcSize - 1]);
+    decoder->start = src;
+    if (srcSize >= 8)
+    {
+        decoder->ptr = src + srcSize - 8;
+        decoder->container = LoadLittleEndian64(decoder->ptr);
+        decoder->consumed = marker;
+    }
+    else
+    {
+        decoder->ptr = src;
+        decoder->container = 0;
+        for (size_t i = 0; i < srcSize; ++i)
+            decoder->container |= (uint64_t)src[i] << (8 * i);
+        decoder->consumed = marker + (uint32_t)(8 - srcSize) * 8;
+    }
+
+    decoder->stateA = ReadBits(decoder->container, &decoder->consumed, table->tableLog);
+    decoder->stateB = ReadBits(decoder->container, &decoder->consumed, table->tableLog);
+    decoder->position = 0;
+    Reload(decoder);
+    return decoder->consumed > 64 ? -1 : 0;
+}
+
+#define DECODE_SYMBOL(state, target)                                         \
+    do                                                                       \
+    {                                                                        \
+        AnsDecodeEntry entry = entries[state];                               \
+        (target) = entry.symbol;                                             \
+        (state) = entry.newState + ReadBits(container, &consumed, entry.nbBits); \
+    } while (0)
+
+int AnsDecodeSymbols(AnsDecoder *decoder, const AnsDecodeTable *table, unsigned char *out, size_t size)
+{
+    const AnsDecodeEntry *entries = table->entries;
+    uint32_t stateA = decoder->stateA, stateB = decoder->stateB;
+    uint64_t container = decoder->container;
+    uint32_t consumed = decoder->consumed;
+    size_t i = 0;
+
+    // Окно обновляется после каждых четырёх символов: после сдвига в нём не меньше 57 бит
+    if (i < size && (decoder->position & 1))
+    {
+        DECODE_SYMBOL(stateB, out[i]);
+        ++i;
+    }
+    for (; i + 4 <= size; i += 4)
+    {
+        DECODE_SYMBOL(stateA, out[i]);
+        DECODE_SYMBOL(stateB, out[i + 1]);
+        DECODE_SYMBOL(stateA, out[i + 2]);
+        DECODE_SYMBOL(stateB, out[i + 3]);
+
+        decoder->consumed = consumed;
+        Reload(decoder);
+        container = decoder->container;
+        consumed = decoder->consumed;
+        if (consumed > 64)
+            return -1;
+    }
+    for (; i < size; ++i)
+    {
+        if ((decoder->position + i) & 1)
+            DECODE_SYMBOL(stateB, out[i]);
+        else
+            DECODE_SYMBOL(stateA, out[i]);
+    }
+
+    decoder->consumed = consumed;
+    Reload(decoder);
+    decoder->stateA = stateA;
+    decoder->stateB = stateB;
+    decoder->position += size;
+    return decoder->consumed > 64 ? -1 : 0;
+}
+
+#undef DECODE_SYMBOL
+
+int AnsDecoderFinish(const AnsDecoder *decoder)
+{
+    return decoder->ptr == decoder->start && decoder->consumed == 64 ? 0 : -1;
+}
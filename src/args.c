@@ -1,3 +1,11 @@
+#include "args.h"
+#include "pipeline.h"
+#include "batchio.h"
+#include "archive.h"
+#include "dictionary.h"
+#include "codec.h"
+#include "lz.h"
+#include "digram.h"
 #include "color.h"
 #include <stdio.h>
 #include <string.h>
@@ -9,24 +17,58 @@
 #define COMPRESS_ARG "-c"
 #define DECOMPRESS_ARG "-d"
 #define HELP_ARG "--help"
+#define THREADS_ARG "-j"
+#define NO_URING_ARG "--no-uring"
+#define DIRECT_ARG "--direct"
+#define SOLID_ARG "--solid"
+#define SOLID_THRESHOLD_ARG "--solid-threshold"
+#define SOLID_BLOCK_ARG "--solid-block"
+#define TRAIN_ARG "--train"
+#define MERGE_ARG "--merge"
+#define TEST_ARG "-t"
+#define TEST_LONG_ARG "--test"
+#define DICT_ARG "--dict"
+#define NO_DEDUP_ARG "--no-dedup"
+#define BASE_ARG "--base"
+#define APPEND_ARG "-a"
+#define APPEND_LONG_ARG "--append"
+#define OFFSET_ARG "--offset"
+#define LENGTH_ARG "--length"
+#define CPU_ARG "--cpu"
+#define STREAMS_ARG "--streams"
+#define CODER_ARG "--coder"
+#define LZ_ARG "--lz"
+#define CONTEXT_ARG "--context"
+#define DIGRAMS_ARG "--digrams"
+#define TRANSFORM_ARG "--transform"
+#define LEVEL_MIN 1
+#define LEVEL_MAX 9
 
-
-typedef enum 
+// Уровни сжатия -1..-9: от самого быстрого кодирования и распаковки до наименьшего архива.
+// Явно заданные --lz, --solid и --streams не переопределяются; LZ включается, только если он совместим с остальными опциями
+static const struct
 {
-    MODE_NONE,       // Режим не задан (ошибка или ожидание ввода)
-    MODE_COMPRESS,   // Режим сжатия
-    MODE_DECOMPRESS, // Режим распаковки
-    MODE_HELP        // Режим вывода справки
-} OperationMode;
+    uint32_t sampleStep;     // Коды по каждому sampleStep-му отрезку блока (0 — по всему блоку)
+    uint32_t blockSize;      // Размер блока
+    uint32_t storedPercent;  // Блок хранится как есть, если сжатый не меньше этой доли исходного
+    uint32_t maxCodeLength;  // Предельная длина кода (0 — без ограничения)
+    uint32_t streams;        // Потоков в больших блоках
+    uint32_t lzLevel;        // Глубина поиска повторов (0 — без LZ)
+    int solid;               // Общие таблицы для малых файлов
+    int transforms;          // Преобразования блоков
+} LevelPresets[LEVEL_MAX + 1] = {
+    {0, 0, 0, 0, 0, 0, 0, 0},
+    {16, 512 * 1024, 90, 0, 4, 0, 0, 0},
+    {4, 512 * 1024, 95, 0, 4, 0, 0, 0},
+    {0, 256 * 1024, 98, 12, 4, 0, 1, 0},
+    {0, 1024 * 1024, 100, 12, 4, 1, 1, 0},
+    {0, 1024 * 1024, 100, 12, 1, 2, 1, 0},
+    {0, 1024 * 1024, 100, 0, 1, 4, 1, 1},
+    {0, 1024 * 1024, 100, 0, 1, 6, 1, 1},
+    {0, 1024 * 1024, 100, 0, 1, 8, 1, 1},
+    {0, 1024 * 1024, 100, 0, 1, 9, 1, 1},
+};
 
-typedef struct 
-{
-    OperationMode mode;         // Режим работы (compress, decompress, help)
-    char *output_path;          // Путь к выходному файлу/директории (дублируется)
-    size_t num_input_paths;     // Количество входных путей
-    char **input_paths;         // Массив путей к входным файлам/директориям (дублируются) 
-    uint32_t symbol_size;      // Размер символа в байтах (1 или 2). Актуален только для сжатия.
-} ParsedArgs;
 
 void print_usage(const char *program_name) 
 {
@@ -35,19 +77,69 @@ void print_usage(const char *program_name)
     printf("Options:\n");
     printf("  %s\tCompress mode.\n", COMPRESS_ARG);
     printf("  %s\tDecompress mode.\n", DECOMPRESS_ARG);
-    printf("  %s <output_path>\tOutput file (compress) or directory (decompress).\n", OUTPUT_ARG);
-    printf("\tMandatory for compression. Optional for decompression (defaults to current dir).\n");
-    printf("  %s <1|2>\tSymbol size in bytes (1 or 2). Default is 1. Only for compression.\n", SYMBOL_SIZE_ARG);
+    printf("  %s\tTrain mode: build a dictionary of code lengths from sample files.\n", TRAIN_ARG);
+    printf("  %s, %s\tTest mode: decode entries on all cores and verify their checksums without writing files.\n", TEST_ARG, TEST_LONG_ARG);
+    printf("  %s\tMerge mode: combine archives into one without recompressing their data.\n", MERGE_ARG);
+    printf("  %s <output_path>\tOutput file (compress, train, merge) or directory (decompress; a file with --offset/--length).\n", OUTPUT_ARG);
+    printf("\tMandatory for compression, training and merging. Optional for decompression (defaults to current dir).\n");
+    printf("  %s <1|2>\tSymbol size in bytes (1 or 2). Default is 1. Only for compression and training.\n", SYMBOL_SIZE_ARG);
+    printf("  -%d..-%d\tCompression level: -%d is fastest, -%d gives the smallest archive (picks block size, LZ depth and table options).\n",
+           LEVEL_MIN, LEVEL_MAX, LEVEL_MIN, LEVEL_MAX);
+    printf("  %s <n>\tNumber of coder threads (default: number of CPUs).\n", THREADS_ARG);
+    printf("  %s\tUse the thread-pool batch I/O backend instead of io_uring.\n", NO_URING_ARG);
+    printf("  %s\tBypass the page cache (O_DIRECT) for large inputs and the archive. Only for compression.\n", DIRECT_ARG);
+    printf("  %s\tGroup small files into solid blocks with one shared table. Only for compression.\n", SOLID_ARG);
+    printf("  %s <size>\tLargest file put into a solid block (default 16K, max 64K).\n", SOLID_THRESHOLD_ARG);
+    printf("  %s <size>\tSolid block size limit (default 256K, max 1M).\n", SOLID_BLOCK_ARG);
+    printf("  %s <file|%s>\tCode with a trained dictionary (or the built-in ASCII table) instead of per-block tables.\n", DICT_ARG, DICT_BUILTIN_NAME);
+    printf("  %s\tStore identical files separately instead of as extra names of one copy.\n", NO_DEDUP_ARG);
+    printf("  %s, %s\tAdd files to the existing archive given by -o without rewriting it. Only for compression.\n", APPEND_ARG, APPEND_LONG_ARG);
+    printf("  %s <n>\tExtract bytes of one entry starting at offset n (suffix K, M or G) into the file given by -o.\n", OFFSET_ARG);
+    printf("  %s <n>\tNumber of bytes to extract with %s (default: to the end of the entry).\n", LENGTH_ARG, OFFSET_ARG);
+    printf("  %s <archive>\tCopy compressed data of files unchanged since a previous archive. Only for compression.\n", BASE_ARG);
+    printf("  %s <1|4>\tSplit blocks of 16K and more into 4 streams decoded in parallel (default 1). Only for compression.\n", STREAMS_ARG);
+    printf("  %s=<huffman|ans|auto>\tEntropy coder: Huffman (default), table ANS, or the smaller of the two per block.\n", CODER_ARG);
+    printf("  %s=<%d-%d>\tFind LZ77 repeats before Huffman coding; higher levels search deeper. Only for compression.\n", LZ_ARG,
+           LZ_MIN_LEVEL, LZ_MAX_LEVEL);
+    printf("  %s\tCode each byte with a Huffman table chosen by the previous byte (up to 16 tables). Only for compression.\n", CONTEXT_ARG);
+    printf("  %s[=<1-%d>]\tAdd the most frequent byte pairs (default %d) to the 1-byte alphabet of each block. Only for compression.\n",
+           DIGRAMS_ARG, DIGRAM_MAX_COUNT, DIGRAM_MAX_COUNT);
+    printf("  %s\tPick a reversible transform per block (delta, zero runs, move-to-front) before coding. Only for compression.\n",
+           TRANSFORM_ARG);
+    printf("\tANS works only with 1-byte symbols and without --dict. Only for compression.\n");
+    printf("  %s=<auto|generic|bmi2>\tCodec kernels: best for this CPU (default), baseline without extensions, or AVX2/BMI2.\n", CPU_ARG);
     printf("  %s\tShow this help message.\n", HELP_ARG);
     printf("\nInput Paths:\n");
     printf("  For compress (%s): One or more files OR exactly one directory.\n", COMPRESS_ARG);
-    printf("  For decompress (%s): Exactly one archive file.\n", DECOMPRESS_ARG);
+    printf("  For decompress (%s): One archive file, optionally followed by names of entries to extract.\n", DECOMPRESS_ARG);
+    printf("  For train (%s): Sample files or directories.\n", TRAIN_ARG);
+    printf("  For test (%s): One archive file, optionally followed by names of entries to test.\n", TEST_ARG);
+    printf("  For merge (%s): Archive files with the same symbol size and dictionary.\n", MERGE_ARG);
+    printf("  Use '-' as input or output path to read from stdin or write to stdout.\n");
     printf("\nExamples:\n");
     printf("  %s -c -o archive.huff file1.txt image.jpg\n", program_name);
     printf("  %s -c -s 2 -o archive.huff large_binary_data\n", program_name);
     printf("  %s -c -o archive.huff my_folder/\n", program_name);
+    printf("  %s -c --streams 4 -o fast.huff data/\n", program_name);
+    printf("  %s -c --coder=auto -o logs.huff logs/\n", program_name);
+    printf("  %s -c --lz=6 -o src.huff src/\n", program_name);
+    printf("  %s -c --context -o texts.huff texts/\n", program_name);
+    printf("  %s -c --digrams -o logs.huff logs/\n", program_name);
+    printf("  %s -c --transform -o dumps.huff dumps/\n", program_name);
+    printf("  %s -c --direct -o snapshot.huff /var/backups/db.img\n", program_name);
     printf("  %s -d -o unpacked_files/ archive.huff\n", program_name);
     printf("  %s -d archive.huff\n", program_name);
+    printf("  %s -t archive.huff\n", program_name);
+    printf("  %s -c --solid -o sources.huff src/\n", program_name);
+    printf("  %s -d -o out/ sources.huff src/main.c\n", program_name);
+    printf("  %s -d --offset 10G --length 100M -o - backup.huff disk.img\n", program_name);
+    printf("  %s -c -a -o logs.huff app.log.1\n", program_name);
+    printf("  %s -c --base nightly-1.huff -o nightly-2.huff data/\n", program_name);
+    printf("  %s --merge -o all.huff shard-1.huff shard-2.huff\n", program_name);
+    printf("  %s --train -o json.dict samples/\n", program_name);
+    printf("  %s -c --dict json.dict -o events.huff events/\n", program_name);
+    printf("  %s -d --dict json.dict -o events/ events.huff\n", program_name);
+    printf("  tar cf - dir | %s -c - -o - | %s -d - -o - | tar xf -\n", program_name, program_name);
     printf("  %s --help\n", program_name);
 }
 
@@ -67,6 +159,13 @@ void free_parsed_args(ParsedArgs *args)
         free(args->output_path);
         args->output_path = NULL;
     }
+
+    free(args->dict_path);
+    args->dict_path = NULL;
+    free(args->base_path);
+    args->base_path = NULL;
+    free(args->cpu);
+    args->cpu = NULL;
     
     if (args->input_paths != NULL) 
     {
@@ -85,12 +184,61 @@ void free_parsed_args(ParsedArgs *args)
     free(args);
 }
 
+// Разбирает размер в байтах с необязательным суффиксом K, M или G; -1 при ошибке
+static int parse_size64(const char *text, uint64_t *value)
+{
+    char *end = NULL;
+    if (*text < '0' || *text > '9')
+        return -1;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k')
+        shift = 10;
+    else if (*end == 'M' || *end == 'm')
+        shift = 20;
+    else if (*end == 'G' || *end == 'g')
+        shift = 30;
+    if (shift > 0)
+        end++;
+    if (*end != '\0' || parsed > (UINT64_MAX >> shift))
+        return -1;
+    *value = (uint64_t)parsed << shift;
+    return 0;
+}
+
+// Разбирает размер до 4 ГиБ; 0 при ошибке
+static uint32_t parse_size(const char *text)
+{
+    uint64_t value;
+    if (parse_size64(text, &value) != 0 || value > UINT32_MAX)
+        return 0;
+    return (uint32_t)value;
+}
+
+// Заполняет настройки уровня; LZ не включается там, где он несовместим с заданными опциями
+static void apply_level_preset(ParsedArgs *args)
+{
+    args->sample_step = LevelPresets[args->level].sampleStep;
+    args->block_size = LevelPresets[args->level].blockSize;
+    args->stored_percent = LevelPresets[args->level].storedPercent;
+    args->max_code_length = LevelPresets[args->level].maxCodeLength;
+    if (args->streams == 0)
+        args->streams = LevelPresets[args->level].streams;
+    if (LevelPresets[args->level].solid)
+        args->solid = 1;
+    if (LevelPresets[args->level].transforms && args->dict_path == NULL)
+        args->transforms = 1;
+    if (args->lz_level == 0 && args->symbol_size == 1 && args->dict_path == NULL && args->coder == CODER_HUFFMAN &&
+        !args->context_model && args->digrams == 0)
+        args->lz_level = LevelPresets[args->level].lzLevel;
+}
+
 static void validate_args(ParsedArgs *args, const char* program_name)
 {
     if (args->mode == MODE_NONE)
     {
         free_parsed_args(args);
-        print_error_and_exit("No operation mode specified (-c or -d).", program_name);
+        print_error_and_exit("No operation mode specified (-c, -d, -t, --train or --merge).", program_name);
     }
 
     if (args->mode == MODE_COMPRESS)
@@ -108,14 +256,83 @@ static void validate_args(ParsedArgs *args, const char* program_name)
             free_parsed_args(args);
             print_error_and_exit("No input files or directory specified for compression.", program_name);
         }
+
+        // Дописываемый архив уже существует и изменяется на месте
+        if (args->append && (IsStdStream(args->output_path) || args->direct_io))
+        {
+            free_parsed_args(args);
+            print_error_and_exit("--append requires an archive file and cannot be combined with --direct.", program_name);
+        }
+
+        // Базовый архив читается с произвольным доступом
+        if (args->base_path != NULL && IsStdStream(args->base_path))
+        {
+            free_parsed_args(args);
+            print_error_and_exit("--base requires an archive file, not a stream.", program_name);
+        }
     } 
+    else if (args->mode == MODE_TRAIN)
+    {
+        if (args->output_path == NULL)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("Output path (-o) is mandatory for training.", program_name);
+        }
+
+        if (args->num_input_paths == 0)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("No sample files specified for training.", program_name);
+        }
+
+        if (args->dict_path != NULL)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("--dict option is not valid for training.", program_name);
+        }
+    }
+    else if (args->mode == MODE_TEST)
+    {
+        if (args->num_input_paths == 0)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("Test requires an input archive file.", program_name);
+        }
+
+        if (args->symbol_size != 0U || args->output_path != NULL)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("-s and -o options are not valid for testing.", program_name);
+        }
+    }
+    else if (args->mode == MODE_MERGE)
+    {
+        if (args->output_path == NULL)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("Output path (-o) is mandatory for merging.", program_name);
+        }
+
+        if (args->num_input_paths == 0)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("No archives specified for merging.", program_name);
+        }
+
+        // Блоки переносятся как есть, параметры кодирования берутся из архивов
+        if (args->symbol_size != 0U || args->dict_path != NULL)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("-s and --dict options are not valid for merging.", program_name);
+        }
+    }
     else if (args->mode == MODE_DECOMPRESS)
     {
-            // Для распаковки должен быть ровно один входной путь (архивный файл)
-            if (args->num_input_paths != 1)
+            // Первый входной путь — архив, остальные — имена извлекаемых записей
+            if (args->num_input_paths == 0)
             {
                 free_parsed_args(args);
-                print_error_and_exit("Decompression requires exactly one input archive file.", program_name);
+                print_error_and_exit("Decompression requires an input archive file.", program_name);
             }
 
             if (args->symbol_size != 0U)
@@ -123,6 +340,104 @@ static void validate_args(ParsedArgs *args, const char* program_name)
                 free_parsed_args(args);
                 print_error_and_exit("-s option is only valid for compression mode (-c).", program_name);
             }
+
+            // Диапазон берётся из одной записи и пишется в один файл
+            if (args->has_range && args->num_input_paths != 2)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("--offset and --length require exactly one entry name after the archive.", program_name);
+            }
+    }
+
+    if (args->mode != MODE_COMPRESS && args->base_path != NULL)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--base option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->append)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--append option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->streams != 1)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--streams option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->coder != CODER_HUFFMAN)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--coder option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->coder != CODER_HUFFMAN && (args->symbol_size == 2 || args->dict_path != NULL))
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--coder=ans and --coder=auto work only with 1-byte symbols and without --dict.", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->lz_level != 0)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--lz option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->lz_level != 0 && (args->symbol_size == 2 || args->dict_path != NULL || args->coder != CODER_HUFFMAN))
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--lz works only with 1-byte symbols, the Huffman coder and without --dict.", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->context_model)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--context option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->context_model && (args->symbol_size == 2 || args->dict_path != NULL || args->coder != CODER_HUFFMAN || args->lz_level != 0))
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--context works only with 1-byte symbols, the Huffman coder and without --lz or --dict.", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->digrams != 0)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--digrams option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->digrams != 0 &&
+        (args->symbol_size == 2 || args->dict_path != NULL || args->coder != CODER_HUFFMAN || args->lz_level != 0 || args->context_model))
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--digrams works only with 1-byte symbols, the Huffman coder and without --lz, --context or --dict.", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->transforms)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--transform option is only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->transforms && args->dict_path != NULL)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--transform cannot be used with --dict.", program_name);
+    }
+
+    if (args->mode != MODE_COMPRESS && args->level != 0)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("Compression levels (-1..-9) are only valid for compression mode (-c).", program_name);
+    }
+
+    if (args->mode != MODE_DECOMPRESS && args->has_range)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("--offset and --length options are only valid for decompression mode (-d).", program_name);
     }
 }
 
@@ -135,6 +450,31 @@ ParsedArgs* parse_args(int argc, char *argv[])
     args->input_paths = NULL;
     args->num_input_paths = 0;
     args->symbol_size = 0;
+    args->threads = 0;
+    args->allow_uring = 1;
+    args->direct_io = 0;
+    args->solid = 0;
+    args->solid_threshold = SOLID_DEFAULT_THRESHOLD;
+    args->solid_block_size = SOLID_DEFAULT_BLOCK_SIZE;
+    args->dict_path = NULL;
+    args->dedup = 1;
+    args->base_path = NULL;
+    args->append = 0;
+    args->has_range = 0;
+    args->range_offset = 0;
+    args->range_length = UINT64_MAX;
+    args->streams = 0;
+    args->coder = CODER_HUFFMAN;
+    args->lz_level = 0;
+    args->context_model = 0;
+    args->digrams = 0;
+    args->transforms = 0;
+    args->level = 0;
+    args->block_size = 0;
+    args->sample_step = 0;
+    args->stored_percent = 0;
+    args->max_code_length = 0;
+    args->cpu = NULL;
 
     const char *program_name = argv[0];
 
@@ -159,23 +499,24 @@ ParsedArgs* parse_args(int argc, char *argv[])
     // Парсинг аргументов
     for (int i = 1; i < argc; ++i) 
     {
-        if (strcmp(argv[i], COMPRESS_ARG) == 0) 
+        if (strcmp(argv[i], COMPRESS_ARG) == 0 || strcmp(argv[i], DECOMPRESS_ARG) == 0 || strcmp(argv[i], TRAIN_ARG) == 0 ||
+            strcmp(argv[i], MERGE_ARG) == 0 || strcmp(argv[i], TEST_ARG) == 0 || strcmp(argv[i], TEST_LONG_ARG) == 0) 
         {
             if (args->mode != MODE_NONE)
             {
                 free_parsed_args(args);
-                print_error_and_exit("Cannot specify both -c and -d.", program_name);
+                print_error_and_exit("Cannot specify more than one of -c, -d, -t, --train and --merge.", program_name);
             }
-            args->mode = MODE_COMPRESS;
-        } 
-        else if (strcmp(argv[i], DECOMPRESS_ARG) == 0) 
-        {
-            if (args->mode != MODE_NONE)
-            {
-                free_parsed_args(args);
-                print_error_and_exit("Cannot specify both -c and -d.", program_name);
-            }
-            args->mode = MODE_DECOMPRESS;
+            if (strcmp(argv[i], COMPRESS_ARG) == 0)
+                args->mode = MODE_COMPRESS;
+            else if (strcmp(argv[i], DECOMPRESS_ARG) == 0)
+                args->mode = MODE_DECOMPRESS;
+            else if (strcmp(argv[i], TRAIN_ARG) == 0)
+                args->mode = MODE_TRAIN;
+            else if (strcmp(argv[i], MERGE_ARG) != 0)
+                args->mode = MODE_TEST;
+            else
+                args->mode = MODE_MERGE;
         } 
         else if (strcmp(argv[i], OUTPUT_ARG) == 0) 
         {
@@ -226,6 +567,242 @@ ParsedArgs* parse_args(int argc, char *argv[])
             args->symbol_size = size;
             i++;
         }
+        else if (strcmp(argv[i], NO_URING_ARG) == 0)
+            args->allow_uring = 0;
+        else if (strcmp(argv[i], DIRECT_ARG) == 0)
+            args->direct_io = 1;
+        else if (strcmp(argv[i], SOLID_ARG) == 0)
+            args->solid = 1;
+        else if (argv[i][0] == '-' && argv[i][1] >= '0' + LEVEL_MIN && argv[i][1] <= '0' + LEVEL_MAX && argv[i][2] == '\0')
+        {
+            if (args->level != 0)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Compression level specified multiple times.", program_name);
+            }
+            args->level = argv[i][1] - '0';
+        }
+        else if (strcmp(argv[i], NO_DEDUP_ARG) == 0)
+            args->dedup = 0;
+        else if (strcmp(argv[i], APPEND_ARG) == 0 || strcmp(argv[i], APPEND_LONG_ARG) == 0)
+            args->append = 1;
+        else if (strcmp(argv[i], SOLID_THRESHOLD_ARG) == 0 || strcmp(argv[i], SOLID_BLOCK_ARG) == 0)
+        {
+            int isThreshold = strcmp(argv[i], SOLID_THRESHOLD_ARG) == 0;
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit(isThreshold ? "Missing argument for --solid-threshold." : "Missing argument for --solid-block.", program_name);
+            }
+
+            uint32_t size = parse_size(argv[i+1]);
+            if (isThreshold && (size == 0 || size > BATCH_SMALL_FILE_LIMIT))
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --solid-threshold. Must be from 1 to 64K.", program_name);
+            }
+            if (!isThreshold && (size == 0 || size > BLOCK_SIZE))
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --solid-block. Must be from 1 to 1M.", program_name);
+            }
+
+            if (isThreshold)
+                args->solid_threshold = size;
+            else
+                args->solid_block_size = size;
+            args->solid = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], OFFSET_ARG) == 0 || strcmp(argv[i], LENGTH_ARG) == 0)
+        {
+            int isOffset = strcmp(argv[i], OFFSET_ARG) == 0;
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit(isOffset ? "Missing argument for --offset." : "Missing argument for --length.", program_name);
+            }
+
+            uint64_t value;
+            if (parse_size64(argv[i+1], &value) != 0 || (!isOffset && value == 0))
+            {
+                free_parsed_args(args);
+                print_error_and_exit(isOffset ? "Invalid value for --offset." : "Invalid value for --length. Must be a positive size.", program_name);
+            }
+
+            if (isOffset)
+                args->range_offset = value;
+            else
+                args->range_length = value;
+            args->has_range = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], STREAMS_ARG) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --streams.", program_name);
+            }
+
+            uint32_t streams = atoi(argv[i+1]);
+            if (streams != 1 && streams != BLOCK_STREAMS)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --streams. Must be 1 or 4.", program_name);
+            }
+
+            args->streams = streams;
+            i++;
+        }
+        else if (strcmp(argv[i], BASE_ARG) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --base.", program_name);
+            }
+
+            free(args->base_path);
+            args->base_path = strdup(argv[i+1]);
+            if (args->base_path == NULL)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Memory allocation failed.", program_name);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], CPU_ARG) == 0 || strncmp(argv[i], CPU_ARG "=", strlen(CPU_ARG "=")) == 0)
+        {
+            // Имя набора допускается и отдельным аргументом, и через '='
+            const char *name = argv[i] + strlen(CPU_ARG);
+            if (*name == '=')
+                name++;
+            else if (i + 1 < argc)
+                name = argv[++i];
+            else
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --cpu.", program_name);
+            }
+
+            if (strcmp(name, "auto") != 0 && strcmp(name, "generic") != 0 && strcmp(name, "bmi2") != 0)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --cpu. Must be auto, generic or bmi2.", program_name);
+            }
+
+            free(args->cpu);
+            args->cpu = strdup(name);
+            if (args->cpu == NULL)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Memory allocation failed.", program_name);
+            }
+        }
+        else if (strcmp(argv[i], CODER_ARG) == 0 || strncmp(argv[i], CODER_ARG "=", strlen(CODER_ARG "=")) == 0)
+        {
+            const char *name = argv[i] + strlen(CODER_ARG);
+            if (*name == '=')
+                name++;
+            else if (i + 1 < argc)
+                name = argv[++i];
+            else
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --coder.", program_name);
+            }
+
+            if (strcmp(name, "huffman") == 0)
+                args->coder = CODER_HUFFMAN;
+            else if (strcmp(name, "ans") == 0)
+                args->coder = CODER_ANS;
+            else if (strcmp(name, "auto") == 0)
+                args->coder = CODER_AUTO;
+            else
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --coder. Must be huffman, ans or auto.", program_name);
+            }
+        }
+        else if (strcmp(argv[i], CONTEXT_ARG) == 0)
+            args->context_model = 1;
+        else if (strcmp(argv[i], TRANSFORM_ARG) == 0)
+            args->transforms = 1;
+        else if (strcmp(argv[i], DIGRAMS_ARG) == 0)
+            args->digrams = DIGRAM_MAX_COUNT;
+        else if (strncmp(argv[i], DIGRAMS_ARG "=", strlen(DIGRAMS_ARG "=")) == 0)
+        {
+            // Число пар — только через '=': без него берётся наибольшее
+            int count = atoi(argv[i] + strlen(DIGRAMS_ARG "="));
+            if (count < 1 || count > DIGRAM_MAX_COUNT)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --digrams. Must be from 1 to 256.", program_name);
+            }
+            args->digrams = (uint32_t)count;
+        }
+        else if (strcmp(argv[i], LZ_ARG) == 0 || strncmp(argv[i], LZ_ARG "=", strlen(LZ_ARG "=")) == 0)
+        {
+            const char *value = argv[i] + strlen(LZ_ARG);
+            if (*value == '=')
+                value++;
+            else if (i + 1 < argc)
+                value = argv[++i];
+            else
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --lz.", program_name);
+            }
+
+            int level = atoi(value);
+            if (level < LZ_MIN_LEVEL || level > LZ_MAX_LEVEL)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for --lz. Must be from 1 to 9.", program_name);
+            }
+            args->lz_level = (uint32_t)level;
+        }
+        else if (strcmp(argv[i], DICT_ARG) == 0)
+        {
+            if (args->dict_path != NULL)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Dictionary specified multiple times.", program_name);
+            }
+
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for --dict.", program_name);
+            }
+
+            args->dict_path = strdup(argv[i+1]);
+            if (args->dict_path == NULL)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Memory allocation failed.", program_name);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], THREADS_ARG) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Missing argument for -j.", program_name);
+            }
+
+            int threads = atoi(argv[i+1]);
+            if (threads < 1 || threads > 64)
+            {
+                free_parsed_args(args);
+                print_error_and_exit("Invalid value for -j. Must be from 1 to 64.", program_name);
+            }
+
+            args->threads = (uint32_t)threads;
+            i++;
+        }
         else 
         {
             // Если это не известный флаг, считаем это входным путем
@@ -250,9 +827,19 @@ ParsedArgs* parse_args(int argc, char *argv[])
         }
     }
 
-    if (args->mode == MODE_COMPRESS && args->symbol_size == 0)
+    // Со словарём размер символа по умолчанию берётся из словаря, при дописывании — из архива
+    if ((args->mode == MODE_COMPRESS && args->symbol_size == 0 && args->dict_path == NULL && !args->append) ||
+        (args->mode == MODE_TRAIN && args->symbol_size == 0))
         args->symbol_size = 1;
 
+    if (args->threads == 0)
+        args->threads = PipelineDefaultThreads();
+
+    if (args->mode == MODE_COMPRESS && args->level != 0)
+        apply_level_preset(args);
+    if (args->streams == 0)
+        args->streams = 1;
+
     validate_args(args, program_name);
 
     return args;
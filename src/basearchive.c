@@ -0,0 +1,448 @@
+#include "basearchive.h"
+#include "archive.h"
+#include "codec.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+#define BASE_COPY_CHUNK (1024 * 1024)
+
+// Последовательный разбор архива с подсчётом смещения от его начала
+typedef struct
+{
+    BitReader *reader;
+    uint64_t position;
+    size_t namesSize;
+    size_t namesCapacity;
+    size_t entriesCapacity;
+    size_t *nameOffsets;   // Пока арена растёт, имена записей хранятся смещениями
+    uint32_t fileCount;    // Записей в завершённых сегментах
+    uint64_t endOffset;    // Конец последнего завершённого сегмента
+    int allNames;          // Собирать и имена членов solid-групп, без сведений о файлах
+} Scanner;
+
+// Читает целое из bytes байт (старший байт первым); -1 при обрыве архива
+static int ScanUint(Scanner *scan, size_t bytes, uint64_t *value)
+{
+    unsigned char raw[8];
+    if (BitReaderReadBytes(scan->reader, raw, bytes) != bytes)
+        return -1;
+    scan->position += bytes;
+    *value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        *value = (*value << 8) | raw[i];
+    return 0;
+}
+
+static int ScanSkip(Scanner *scan, uint64_t count)
+{
+    if (BitReaderSkipBytes(scan->reader, count) != count)
+        return -1;
+    scan->position += count;
+    return 0;
+}
+
+// Читает имя и добавляет в оглавление запись с этим именем
+static int ScanName(Scanner *scan, BaseArchive *base)
+{
+    uint64_t nameLen;
+    if (ScanUint(scan, 2, &nameLen) != 0 || nameLen == 0 || nameLen >= PATH_MAX)
+        return -1;
+
+    if (base->count == scan->entriesCapacity)
+    {
+        size_t capacity = scan->entriesCapacity ? scan->entriesCapacity * 2 : 256;
+        BaseEntry *entries = realloc(base->entries, capacity * sizeof(BaseEntry));
+        if (entries)
+            base->entries = entries;
+        size_t *offsets = realloc(scan->nameOffsets, capacity * sizeof(size_t));
+        if (offsets)
+            scan->nameOffsets = offsets;
+        if (!entries || !offsets)
+            return -1;
+        scan->entriesCapacity = capacity;
+    }
+    if (scan->namesSize + nameLen + 1 > scan->namesCapacity)
+    {
+        size_t capacity = scan->namesCapacity ? scan->namesCapacity * 2 : 64 * 1024;
+        while (capacity < scan->namesSize + nameLen + 1)
+            capacity *= 2;
+        char *names = realloc(base->names, capacity);
+        if (!names)
+            return -1;
+        base->names = names;
+        scan->namesCapacity = capacity;
+    }
+
+    char *name = base->names + scan->namesSize;
+    if (BitReaderReadBytes(scan->reader, (unsigned char *)name, nameLen) != nameLen)
+        return -1;
+    scan->position += nameLen;
+    name[nameLen] = '\0';
+
+    memset(&base->entries[base->count], 0, sizeof(BaseEntry));
+    scan->nameOffsets[base->count++] = scan->namesSize;
+    scan->namesSize += nameLen + 1;
+    return 0;
+}
+
+// Перематывает блоки записи до завершающего raw_len = 0 и возвращает их длину
+static int ScanBlocks(Scanner *scan, uint64_t *length)
+{
+    uint64_t start = scan->position;
+    for (;;)
+    {
+        uint64_t rawLen, compLen, method;
+        if (ScanUint(scan, 4, &rawLen) != 0)
+            return -1;
+        if (rawLen == 0)
+            break;
+        if (ScanUint(scan, 4, &compLen) != 0 || ScanUint(scan, 1, &method) != 0 ||
+            ScanSkip(scan, ((method & BLOCK_FLAG_CRC) ? BLOCK_CRC_SIZE : 0) + compLen) != 0)
+            return -1;
+    }
+    *length = scan->position - 4 - start;
+    return 0;
+}
+
+static int ScanSegment(Scanner *scan, BaseArchive *base, uint32_t fileCount)
+{
+    for (uint32_t index = 0; index < fileCount;)
+    {
+        uint64_t kind, count = 1;
+        if (ScanUint(scan, 1, &kind) != 0)
+            return -1;
+
+        if (kind == RECORD_SOLID)
+        {
+            // Список файлов группы и один блок: перематываются целиком
+            if (ScanUint(scan, 2, &count) != 0 || count == 0)
+                return -1;
+            for (uint64_t m = 0; m < count; ++m)
+            {
+                uint64_t nameLen;
+                if (scan->allNames ? ScanName(scan, base) != 0 || ScanSkip(scan, 8) != 0
+                                   : ScanUint(scan, 2, &nameLen) != 0 || ScanSkip(scan, nameLen + 8) != 0)
+                    return -1;
+            }
+            uint64_t compLen, method;
+            if (ScanSkip(scan, 4) != 0 || ScanUint(scan, 4, &compLen) != 0 || ScanUint(scan, 1, &method) != 0 ||
+                ScanSkip(scan, ((method & BLOCK_FLAG_CRC) ? BLOCK_CRC_SIZE : 0) + compLen) != 0)
+                return -1;
+            index += (uint32_t)count;
+            continue;
+        }
+
+        if (kind == RECORD_COPIES && (ScanUint(scan, 2, &count) != 0 || count == 0))
+            return -1;
+        if (kind != RECORD_FILE && kind != RECORD_COPIES)
+            return -1;
+
+        size_t first = base->count;
+        for (uint64_t n = 0; n < count; ++n)
+            if (ScanName(scan, base) != 0)
+                return -1;
+
+        uint64_t offset = scan->position, length, size, mtime, hash;
+        if (ScanBlocks(scan, &length) != 0 || ScanUint(scan, 8, &size) != 0 ||
+            ScanUint(scan, 8, &mtime) != 0 || ScanUint(scan, 8, &hash) != 0)
+            return -1;
+        for (size_t e = first; e < base->count && !scan->allNames; ++e)
+        {
+            base->entries[e].size = size;
+            base->entries[e].mtime = (int64_t)mtime;
+            base->entries[e].hash = hash;
+            base->entries[e].payloadOffset = offset;
+            base->entries[e].payloadLength = length;
+        }
+        index += (uint32_t)count;
+    }
+    return 0;
+}
+
+// Проверяет концевик сегмента, начавшегося с segmentOffset
+static int ScanEnd(Scanner *scan, uint32_t fileCount, uint64_t segmentOffset)
+{
+    char magic[4];
+    uint64_t count, offset;
+    if (BitReaderReadBytes(scan->reader, (unsigned char *)magic, 4) != 4 || memcmp(magic, ARCHIVE_END_MAGIC, 4) != 0)
+        return -1;
+    scan->position += 4;
+    if (ScanUint(scan, 4, &count) != 0 || ScanUint(scan, 8, &offset) != 0 || count != fileCount || offset != segmentOffset)
+        return -1;
+    scan->fileCount = fileCount;
+    scan->endOffset = scan->position;
+    return 0;
+}
+
+// Разбирает записи всех сегментов. Данные без метки сегмента за последним концевиком —
+// след прерванного дописывания — не считаются частью архива
+static int ScanRecords(Scanner *scan, BaseArchive *base, uint8_t version, uint32_t fileCount)
+{
+    if (ScanSegment(scan, base, fileCount) != 0)
+        return -1;
+    if (version < ARCHIVE_SEGMENT_VERSION)
+    {
+        scan->fileCount = fileCount;
+        scan->endOffset = scan->position;
+        return 0;
+    }
+
+    uint32_t total = fileCount;
+    uint64_t segmentOffset = 0;
+    for (;;)
+    {
+        if (ScanEnd(scan, total, segmentOffset) != 0)
+            return -1;
+
+        char magic[4];
+        segmentOffset = scan->position;
+        if (BitReaderReadBytes(scan->reader, (unsigned char *)magic, 4) != 4 || memcmp(magic, ARCHIVE_APPEND_MAGIC, 4) != 0)
+            return 0;
+        scan->position += 4;
+
+        uint64_t count;
+        if (ScanUint(scan, 4, &count) != 0 || ScanSegment(scan, base, (uint32_t)count) != 0)
+            return -1;
+        total += (uint32_t)count;
+    }
+}
+
+// Читает заголовок архива; у архивов до версии 4 нет dict_id
+static int ScanHeader(Scanner *scan, ArchiveEnd *header)
+{
+    char magic[5] = {0};
+    uint64_t version, symbolSize, dictId = 0, fileCount;
+    if (BitReaderReadBytes(scan->reader, (unsigned char *)magic, 4) != 4 || strcmp(magic, ARCHIVE_MAGIC) != 0)
+        return -1;
+    scan->position = 4;
+    if (ScanUint(scan, 1, &version) != 0 || version < ARCHIVE_MIN_VERSION || version > ARCHIVE_VERSION ||
+        ScanUint(scan, 1, &symbolSize) != 0 || (version >= 4 && ScanUint(scan, 4, &dictId) != 0) ||
+        ScanUint(scan, 4, &fileCount) != 0)
+        return -1;
+
+    header->version = (uint8_t)version;
+    header->symbolSize = (uint8_t)symbolSize;
+    header->dictId = (uint32_t)dictId;
+    header->fileCount = (uint32_t)fileCount;
+    header->endOffset = 0;
+    return 0;
+}
+
+static int CompareByName(const void *a, const void *b)
+{
+    return strcmp(((const BaseEntry *)a)->name, ((const BaseEntry *)b)->name);
+}
+
+int BaseArchiveOpen(const char *path, BaseArchive *base)
+{
+    memset(base, 0, sizeof(BaseArchive));
+    base->fd = -1;
+
+    Scanner scan = {0};
+    scan.reader = BitReaderOpen(path);
+    if (!scan.reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening base archive %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    ArchiveEnd header;
+    if (ScanHeader(&scan, &header) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: %s is not a supported archive.\n", path);
+        BitReaderClose(scan.reader);
+        return -1;
+    }
+    if (header.version < RECORD_INFO_VERSION)
+    {
+        // В старых архивах нет размеров и хешей файлов: сравнивать не с чем
+        Report(HUFF_LOG_WARNING, "Warning: Base archive %s (version %u) has no file metadata; all files will be compressed.\n",
+               path, header.version);
+        BitReaderClose(scan.reader);
+        return 0;
+    }
+
+    int failed = ScanRecords(&scan, base, header.version, header.fileCount) != 0;
+    BitReaderClose(scan.reader);
+    if (!failed)
+    {
+        base->fd = open(path, O_RDONLY);
+        failed = base->fd < 0;
+    }
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Base archive %s is corrupted or cannot be read.\n", path);
+        free(scan.nameOffsets);
+        BaseArchiveClose(base);
+        return -1;
+    }
+
+    base->symbolSize = header.symbolSize;
+    base->dictId = header.dictId;
+    for (size_t i = 0; i < base->count; ++i)
+        base->entries[i].name = base->names + scan.nameOffsets[i];
+    free(scan.nameOffsets);
+    qsort(base->entries, base->count, sizeof(BaseEntry), CompareByName);
+    return 0;
+}
+
+int ArchiveReadNames(const char *path, BaseArchive *names)
+{
+    memset(names, 0, sizeof(BaseArchive));
+    names->fd = -1;
+
+    Scanner scan = {.allNames = 1};
+    scan.reader = BitReaderOpen(path);
+    if (!scan.reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening archive %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    ArchiveEnd header;
+    int failed = ScanHeader(&scan, &header) != 0 || header.version < RECORD_INFO_VERSION ||
+                 ScanRecords(&scan, names, header.version, header.fileCount) != 0;
+    BitReaderClose(scan.reader);
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive %s is corrupted or cannot be read.\n", path);
+        free(scan.nameOffsets);
+        BaseArchiveClose(names);
+        return -1;
+    }
+
+    names->symbolSize = header.symbolSize;
+    names->dictId = header.dictId;
+    for (size_t i = 0; i < names->count; ++i)
+        names->entries[i].name = names->names + scan.nameOffsets[i];
+    free(scan.nameOffsets);
+    qsort(names->entries, names->count, sizeof(BaseEntry), CompareByName);
+    return 0;
+}
+
+void BaseArchiveClose(BaseArchive *base)
+{
+    if (base->fd >= 0)
+        close(base->fd);
+    free(base->names);
+    free(base->entries);
+    free(base->buffer);
+    memset(base, 0, sizeof(BaseArchive));
+    base->fd = -1;
+}
+
+const BaseEntry *BaseArchiveFind(const BaseArchive *base, const char *name)
+{
+    if (base->count == 0)
+        return NULL;
+    BaseEntry key = {.name = name};
+    const BaseEntry *entry = bsearch(&key, base->entries, base->count, sizeof(BaseEntry), CompareByName);
+    // У записи, перенесённой слиянием из архива до версии 6, хеша нет: сравнивать не с чем
+    if (entry && (uint64_t)entry->mtime == RECORD_INFO_NO_MTIME)
+        return NULL;
+    return entry;
+}
+
+int BaseArchiveCopyPayload(BaseArchive *base, const BaseEntry *entry, BitWriter *writer)
+{
+    if (!base->buffer && !(base->buffer = malloc(BASE_COPY_CHUNK)))
+        return -1;
+
+    uint64_t done = 0;
+    while (done < entry->payloadLength)
+    {
+        size_t chunk = BASE_COPY_CHUNK;
+        if (chunk > entry->payloadLength - done)
+            chunk = (size_t)(entry->payloadLength - done);
+        ssize_t got = pread(base->fd, base->buffer, chunk, (off_t)(entry->payloadOffset + done));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            Report(HUFF_LOG_ERROR, "Error reading base archive: %s\n", got < 0 ? strerror(errno) : "unexpected end of file");
+            return -1;
+        }
+        BitWriterWriteBytes(writer, base->buffer, (size_t)got);
+        done += (uint64_t)got;
+    }
+    return 0;
+}
+
+// Концевик в последних байтах файла действителен, если он закрывает завершённый сегмент:
+// по segment_offset лежит заголовок архива или метка дописанного сегмента
+static int ReadLastEnd(int fd, uint64_t fileSize, ArchiveEnd *end)
+{
+    unsigned char tail[ARCHIVE_END_SIZE], magic[4];
+    if (fileSize < ARCHIVE_HEADER_SIZE + ARCHIVE_END_SIZE ||
+        pread(fd, tail, ARCHIVE_END_SIZE, (off_t)(fileSize - ARCHIVE_END_SIZE)) != ARCHIVE_END_SIZE ||
+        memcmp(tail, ARCHIVE_END_MAGIC, 4) != 0)
+        return -1;
+
+    uint64_t segmentOffset = 0;
+    for (int i = 8; i < 16; ++i)
+        segmentOffset = (segmentOffset << 8) | tail[i];
+    if (segmentOffset >= fileSize - ARCHIVE_END_SIZE || pread(fd, magic, 4, (off_t)segmentOffset) != 4 ||
+        memcmp(magic, segmentOffset == 0 ? ARCHIVE_MAGIC : ARCHIVE_APPEND_MAGIC, 4) != 0)
+        return -1;
+
+    end->fileCount = ((uint32_t)tail[4] << 24) | ((uint32_t)tail[5] << 16) | ((uint32_t)tail[6] << 8) | tail[7];
+    end->endOffset = fileSize;
+    return 0;
+}
+
+int ArchiveFindEnd(const char *path, ArchiveEnd *end)
+{
+    Scanner scan = {0};
+    scan.reader = BitReaderOpen(path);
+    if (!scan.reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening archive %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (ScanHeader(&scan, end) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: %s is not a supported archive.\n", path);
+        BitReaderClose(scan.reader);
+        return -1;
+    }
+    if (end->version < ARCHIVE_SEGMENT_VERSION)
+    {
+        BitReaderClose(scan.reader);
+        return 0;
+    }
+
+    // Обычно архив кончается концевиком, и разбирать записи не нужно
+    struct stat st = {0};
+    int fd = fileno(scan.reader->file);
+    if (fstat(fd, &st) == 0 && ReadLastEnd(fd, (uint64_t)st.st_size, end) == 0)
+    {
+        BitReaderClose(scan.reader);
+        return 0;
+    }
+
+    BaseArchive names = {0};
+    int failed = ScanRecords(&scan, &names, end->version, end->fileCount) != 0;
+    BitReaderClose(scan.reader);
+    free(scan.nameOffsets);
+    free(names.names);
+    free(names.entries);
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive %s is corrupted.\n", path);
+        return -1;
+    }
+
+    if ((uint64_t)st.st_size > scan.endOffset)
+        Report(HUFF_LOG_WARNING, "Warning: %s ends with %llu bytes of an interrupted append; they will be discarded.\n",
+               path, (unsigned long long)((uint64_t)st.st_size - scan.endOffset));
+    end->fileCount = scan.fileCount;
+    end->endOffset = scan.endOffset;
+    return 0;
+}
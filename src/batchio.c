@@ -0,0 +1,612 @@
+#include "batchio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES (2 * BATCH_MAX_FILES) // open + statx на каждый файл в одной отправке
+#define FALLBACK_THREADS 8
+
+// Кольца io_uring, отображённые в память процесса (без liburing)
+typedef struct
+{
+    int fd;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+
+    int broken;            // io_uring_enter завершился ошибкой: кольцо больше не используется
+    unsigned inFlight;     // Отправленные запросы, ответ на которые так и не получен
+} Uring;
+
+struct BatchIO
+{
+    int useUring;
+    Uring ring;
+};
+
+// --- Синхронные операции (пул потоков и запасной путь для io_uring) ---
+
+static int IsSmallRegular(uint32_t mode, uint64_t size)
+{
+    return S_ISREG(mode) && size <= BATCH_SMALL_FILE_LIMIT;
+}
+
+// Дочитывает файл с позиции done; возвращает итоговое количество байт
+static size_t ReadRest(int fd, unsigned char *buffer, size_t done, size_t size)
+{
+    while (done < size)
+    {
+        ssize_t got = pread(fd, buffer + done, size - done, (off_t)done);
+        if (got <= 0)
+        {
+            if (got < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        done += (size_t)got;
+    }
+    return done;
+}
+
+static int WriteRest(int fd, const unsigned char *data, size_t done, size_t size)
+{
+    while (done < size)
+    {
+        ssize_t put = pwrite(fd, data + done, size - done, (off_t)done);
+        if (put < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        done += (size_t)put;
+    }
+    return 0;
+}
+
+static void ReadOneFile(const char *path, BatchFile *out, int haveMetadata)
+{
+    out->fd = -1;
+    out->data = NULL;
+    out->error = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        out->error = errno;
+        return;
+    }
+
+    if (!haveMetadata)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            out->error = errno;
+            close(fd);
+            return;
+        }
+        out->size = (uint64_t)st.st_size;
+        out->mode = (uint32_t)st.st_mode;
+    }
+
+    if (!IsSmallRegular(out->mode, out->size))
+    {
+        out->fd = fd;
+        return;
+    }
+
+    out->data = malloc(out->size > 0 ? out->size : 1);
+    if (!out->data)
+        out->error = ENOMEM;
+    else
+        out->size = ReadRest(fd, out->data, 0, out->size);
+    close(fd);
+}
+
+static void WriteOneFile(BatchWrite *w)
+{
+    int fd = open(w->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        w->error = errno;
+        return;
+    }
+    w->error = WriteRest(fd, w->data, 0, w->size);
+    if (close(fd) != 0 && w->error == 0)
+        w->error = errno;
+}
+
+// --- Пул потоков ---
+
+typedef struct
+{
+    const char **paths;
+    BatchFile *files;
+    BatchWrite *writes;
+    int haveMetadata;
+    size_t begin;
+    size_t end;
+} PoolTask;
+
+static void *PoolWorker(void *arg)
+{
+    PoolTask *task = arg;
+    for (size_t i = task->begin; i < task->end; ++i)
+    {
+        if (task->files)
+            ReadOneFile(task->paths[i], &task->files[i], task->haveMetadata);
+        else
+            WriteOneFile(&task->writes[i]);
+    }
+    return NULL;
+}
+
+// Делит пакет между потоками; при невозможности создать поток работает сам
+static void RunOnPool(const char **paths, BatchFile *files, BatchWrite *writes, size_t count, int haveMetadata)
+{
+    size_t threads = count < FALLBACK_THREADS ? count : FALLBACK_THREADS;
+    pthread_t ids[FALLBACK_THREADS];
+    PoolTask tasks[FALLBACK_THREADS];
+    int started[FALLBACK_THREADS] = {0};
+
+    for (size_t t = 0; t < threads; ++t)
+    {
+        tasks[t].paths = paths;
+        tasks[t].files = files;
+        tasks[t].writes = writes;
+        tasks[t].haveMetadata = haveMetadata;
+        tasks[t].begin = count * t / threads;
+        tasks[t].end = count * (t + 1) / threads;
+        started[t] = pthread_create(&ids[t], NULL, PoolWorker, &tasks[t]) == 0;
+        if (!started[t])
+            PoolWorker(&tasks[t]);
+    }
+    for (size_t t = 0; t < threads; ++t)
+        if (started[t])
+            pthread_join(ids[t], NULL);
+}
+
+// --- io_uring ---
+
+static int UringSetup(Uring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->broken = 0;
+    ring->inFlight = 0;
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0)
+        return -1;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cqRingSize > ring->sqRingSize)
+            ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+    {
+        close(ring->fd);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cqRing = ring->sqRing;
+    else
+    {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED)
+        {
+            munmap(ring->sqRing, ring->sqRingSize);
+            close(ring->fd);
+            return -1;
+        }
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        if (ring->cqRing != ring->sqRing)
+            munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        return -1;
+    }
+
+    unsigned char *sq = ring->sqRing;
+    unsigned char *cq = ring->cqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void UringClose(Uring *ring)
+{
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing)
+        munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+static struct io_uring_sqe *UringPrepare(Uring *ring, unsigned slot, uint8_t opcode, int fd, uint64_t userData)
+{
+    unsigned index = (*ring->sqTail + slot) & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    return sqe;
+}
+
+// Забирает из очереди завершений все готовые ответы, не дожидаясь новых
+static unsigned UringReap(Uring *ring, int *results)
+{
+    unsigned reaped = 0;
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head, ++reaped)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+        results[cqe->user_data] = cqe->res;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+// Отправляет count подготовленных запросов одним системным вызовом и ждёт все ответы.
+// results[user_data] получает результат операции (или -errno). При ошибке вызова ответы уже
+// отправленных запросов всё равно забираются (по возможности дожидаясь их), чтобы вызывающий
+// код закрыл открытые ими файлы; у неотправленных results не меняется, а сами они снимаются с очереди.
+// Кольцо помечается неисправным, в inFlight — число запросов, ответа на которые дождаться не удалось
+static int UringSubmitAndWait(Uring *ring, unsigned count, int *results)
+{
+    unsigned tail = *ring->sqTail;
+    __atomic_store_n(ring->sqTail, tail + count, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    unsigned reaped = 0;
+    while (reaped < count)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, count - submitted, count - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            __atomic_store_n(ring->sqTail, tail + submitted, __ATOMIC_RELEASE);
+            reaped += UringReap(ring, results);
+            while (reaped < submitted)
+            {
+                ret = (int)syscall(__NR_io_uring_enter, ring->fd, 0, submitted - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (ret < 0 && errno != EINTR)
+                    break;
+                reaped += UringReap(ring, results);
+            }
+            ring->broken = 1;
+            ring->inFlight = submitted - reaped;
+            return -1;
+        }
+        submitted += (unsigned)ret;
+        if (submitted > count)
+            submitted = count;
+        reaped += UringReap(ring, results);
+    }
+    return 0;
+}
+
+// Результат запроса, ответ на который не получен
+#define URING_NOT_DONE (-ECANCELED)
+
+static void InitResults(int *results, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        results[i] = URING_NOT_DONE;
+}
+
+static int IsUnsupported(int res)
+{
+    return res == -EINVAL || res == -EOPNOTSUPP;
+}
+
+static int UringReadFiles(Uring *ring, const char **paths, size_t count, BatchFile *out, int haveMetadata)
+{
+    int results[URING_ENTRIES];
+    struct statx stx[BATCH_MAX_FILES];
+    unsigned n = 0;
+    InitResults(results, 2 * count);
+
+    // Пакет 1: открытие и statx всех файлов (statx не нужен, если метаданные уже известны)
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct io_uring_sqe *sqe = UringPrepare(ring, n++, IORING_OP_OPENAT, AT_FDCWD, 2 * i);
+        sqe->addr = (uint64_t)(uintptr_t)paths[i];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+        results[2 * i + 1] = 0;
+        if (haveMetadata)
+            continue;
+        sqe = UringPrepare(ring, n++, IORING_OP_STATX, AT_FDCWD, 2 * i + 1);
+        sqe->addr = (uint64_t)(uintptr_t)paths[i];
+        sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE;
+        sqe->off = (uint64_t)(uintptr_t)&stx[i];
+    }
+    if (UringSubmitAndWait(ring, n, results) != 0)
+    {
+        // Пакет повторит пул потоков: файлы, уже открытые кольцом, закрываются
+        for (size_t i = 0; i < count; ++i)
+            if (results[2 * i] >= 0)
+                close(results[2 * i]);
+        return -1;
+    }
+
+    int openResults[BATCH_MAX_FILES];
+    for (size_t i = 0; i < count; ++i)
+    {
+        openResults[i] = results[2 * i];
+        int statResult = results[2 * i + 1];
+        uint64_t knownSize = out[i].size;
+        uint32_t knownMode = out[i].mode;
+        out[i].fd = -1;
+        out[i].data = NULL;
+        out[i].error = 0;
+
+        if (IsUnsupported(openResults[i]) || IsUnsupported(statResult))
+        {
+            // Ядро без нужных операций io_uring: этот файл обрабатываем синхронно
+            if (openResults[i] >= 0)
+                close(openResults[i]);
+            openResults[i] = -1;
+            out[i].size = knownSize;
+            out[i].mode = knownMode;
+            ReadOneFile(paths[i], &out[i], haveMetadata);
+            continue;
+        }
+        if (openResults[i] < 0 || statResult < 0)
+        {
+            out[i].error = openResults[i] < 0 ? -openResults[i] : -statResult;
+            if (openResults[i] >= 0)
+                close(openResults[i]);
+            openResults[i] = -1;
+            continue;
+        }
+        if (!haveMetadata)
+        {
+            out[i].size = stx[i].stx_size;
+            out[i].mode = stx[i].stx_mode;
+        }
+    }
+
+    // Пакет 2: чтение малых файлов целиком
+    n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (openResults[i] < 0)
+            continue;
+        if (!IsSmallRegular(out[i].mode, out[i].size))
+        {
+            out[i].fd = openResults[i];
+            openResults[i] = -1;
+            continue;
+        }
+        out[i].data = malloc(out[i].size > 0 ? out[i].size : 1);
+        if (!out[i].data)
+        {
+            out[i].error = ENOMEM;
+            continue;
+        }
+        if (out[i].size == 0)
+            continue;
+        struct io_uring_sqe *sqe = UringPrepare(ring, n++, IORING_OP_READ, openResults[i], i);
+        sqe->addr = (uint64_t)(uintptr_t)out[i].data;
+        sqe->len = (uint32_t)out[i].size;
+        sqe->off = 0;
+    }
+    if (n > 0 && UringSubmitAndWait(ring, n, results) != 0)
+    {
+        // Файлы уже открыты: дочитываем синхронно, чтобы не повторять пакет целиком
+        for (size_t i = 0; i < count; ++i)
+            results[i] = 0;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (openResults[i] < 0 || !out[i].data || out[i].size == 0)
+            continue;
+        if (results[i] < 0)
+            out[i].error = -results[i];
+        else if ((uint64_t)results[i] < out[i].size)
+            out[i].size = ReadRest(openResults[i], out[i].data, (size_t)results[i], out[i].size); // Короткое чтение
+    }
+
+    // Пакет 3: закрытие прочитанных файлов
+    n = 0;
+    InitResults(results, count);
+    for (size_t i = 0; i < count; ++i)
+        if (openResults[i] >= 0)
+            UringPrepare(ring, n++, IORING_OP_CLOSE, openResults[i], i);
+    if (n > 0 && UringSubmitAndWait(ring, n, results) != 0)
+    {
+        // Закрываем только то, что кольцо не успело закрыть: повторный close задел бы чужой дескриптор.
+        // Если часть запросов осталась без ответа, неясно, какие из них выполнены, и файлы не трогаем
+        for (size_t i = 0; i < count && ring->inFlight == 0; ++i)
+            if (openResults[i] >= 0 && results[i] == URING_NOT_DONE)
+                close(openResults[i]);
+    }
+    return 0;
+}
+
+static int UringWriteFiles(Uring *ring, BatchWrite *writes, size_t count)
+{
+    int results[URING_ENTRIES];
+    int fds[BATCH_MAX_FILES];
+    unsigned n = 0;
+    InitResults(results, count);
+
+    // Пакет 1: создание файлов
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct io_uring_sqe *sqe = UringPrepare(ring, n++, IORING_OP_OPENAT, AT_FDCWD, i);
+        sqe->addr = (uint64_t)(uintptr_t)writes[i].path;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len = 0666;
+    }
+    if (UringSubmitAndWait(ring, n, results) != 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+            if (results[i] >= 0)
+                close(results[i]);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        fds[i] = results[i];
+        writes[i].error = 0;
+        if (IsUnsupported(fds[i]))
+        {
+            fds[i] = -1;
+            WriteOneFile(&writes[i]);
+        }
+        else if (fds[i] < 0)
+            writes[i].error = -fds[i];
+    }
+
+    // Пакет 2: запись содержимого
+    n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (fds[i] < 0 || writes[i].size == 0)
+            continue;
+        struct io_uring_sqe *sqe = UringPrepare(ring, n++, IORING_OP_WRITE, fds[i], i);
+        sqe->addr = (uint64_t)(uintptr_t)writes[i].data;
+        sqe->len = (uint32_t)writes[i].size;
+        sqe->off = 0;
+    }
+    if (n > 0 && UringSubmitAndWait(ring, n, results) != 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+            results[i] = 0; // Файлы уже созданы: дописываем синхронно
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (fds[i] < 0 || writes[i].size == 0)
+            continue;
+        if (results[i] < 0)
+            writes[i].error = -results[i];
+        else if ((size_t)results[i] < writes[i].size)
+            writes[i].error = WriteRest(fds[i], writes[i].data, (size_t)results[i], writes[i].size);
+    }
+
+    // Пакет 3: закрытие
+    n = 0;
+    InitResults(results, count);
+    for (size_t i = 0; i < count; ++i)
+        if (fds[i] >= 0)
+            UringPrepare(ring, n++, IORING_OP_CLOSE, fds[i], i);
+    if (n > 0 && UringSubmitAndWait(ring, n, results) != 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+            if (fds[i] >= 0 && results[i] == URING_NOT_DONE)
+                results[i] = ring->inFlight > 0 ? 0 : close(fds[i]) == 0 ? 0 : -errno;
+    }
+    for (size_t i = 0; i < count; ++i)
+        if (fds[i] >= 0 && results[i] < 0 && writes[i].error == 0)
+            writes[i].error = -results[i];
+    return 0;
+}
+
+// --- Общий интерфейс ---
+
+BatchIO *BatchIOCreate(int allowUring)
+{
+    BatchIO *io = malloc(sizeof(BatchIO));
+    if (!io)
+        return NULL;
+
+    io->useUring = allowUring && UringSetup(&io->ring) == 0;
+    return io;
+}
+
+const char *BatchIOBackendName(const BatchIO *io)
+{
+    return io->useUring ? "io_uring" : "thread pool";
+}
+
+void BatchReadFiles(BatchIO *io, const char **paths, size_t count, BatchFile *out, int haveMetadata)
+{
+    if (count > BATCH_MAX_FILES)
+        count = BATCH_MAX_FILES;
+
+    int failed = !io->useUring || UringReadFiles(&io->ring, paths, count, out, haveMetadata) != 0;
+
+    // Кольцо недоступно (например, запрещено seccomp) или в нём остались неполученные ответы:
+    // переходим на пул потоков насовсем
+    if (io->useUring && (failed || io->ring.broken))
+    {
+        UringClose(&io->ring);
+        io->useUring = 0;
+    }
+    if (failed)
+        RunOnPool(paths, out, NULL, count, haveMetadata);
+}
+
+void BatchWriteFiles(BatchIO *io, BatchWrite *writes, size_t count)
+{
+    if (count > BATCH_MAX_FILES)
+        count = BATCH_MAX_FILES;
+
+    int failed = !io->useUring || UringWriteFiles(&io->ring, writes, count) != 0;
+    if (io->useUring && (failed || io->ring.broken))
+    {
+        UringClose(&io->ring);
+        io->useUring = 0;
+    }
+    if (failed)
+        RunOnPool(NULL, NULL, writes, count, 0);
+}
+
+void BatchIODestroy(BatchIO *io)
+{
+    if (!io)
+        return;
+    if (io->useUring)
+        UringClose(&io->ring);
+    free(io);
+}
@@ -1,92 +1,395 @@
 #include "bitstream.h"
+#include "fileutils.h"
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#define STREAM_BUFFER_SIZE (64 * 1024) // Размер буфера файлового ввода-вывода
+#define DIRECT_BUFFER_SIZE (4 * 1024 * 1024) // Размер выровненного буфера для O_DIRECT
 
-BitWriter *BitWriterOpen(const char *path)
+
+static BitWriter *CreateWriter(FILE *file, int ownsFile, size_t capacity)
 {
     BitWriter *writer = malloc(sizeof(BitWriter));
 
     if (!writer)
         return NULL;
 
-    writer->file = fopen(path, "wb");
-    if (!writer->file)
+    writer->data = malloc(capacity > 0 ? capacity : 1);
+    if (!writer->data)
     {
         free(writer);
         return NULL;
     }
 
+    writer->file = file;
+    writer->ownsFile = ownsFile;
+    writer->directFd = -1;
+    writer->size = 0;
+    writer->capacity = capacity > 0 ? capacity : 1;
     writer->buffer = 0;
     writer->bitPos = 0;
+    writer->flushed = 0;
+    writer->failed = 0;
     return writer;
 }
 
-void BitWriterWriteBit(BitWriter *writer, int bit)
+BitWriter *BitWriterOpen(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return NULL;
+
+    BitWriter *writer = CreateWriter(file, 1, STREAM_BUFFER_SIZE);
+    if (!writer)
+        fclose(file);
+    return writer;
+}
+
+BitWriter *BitWriterOpenStream(FILE *file, int ownsFile)
+{
+    if (!file)
+        return NULL;
+    return CreateWriter(file, ownsFile, STREAM_BUFFER_SIZE);
+}
+
+BitWriter *BitWriterOpenDirect(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    if (fd < 0)
+        return NULL;
+
+    BitWriter *writer = malloc(sizeof(BitWriter));
+    void *data = NULL;
+    if (!writer || posix_memalign(&data, DIRECT_IO_ALIGNMENT, DIRECT_BUFFER_SIZE) != 0)
+    {
+        free(writer);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    writer->file = NULL;
+    writer->ownsFile = 0;
+    writer->directFd = fd;
+    writer->data = data;
+    writer->size = 0;
+    writer->capacity = DIRECT_BUFFER_SIZE;
+    writer->buffer = 0;
+    writer->bitPos = 0;
+    writer->flushed = 0;
+    writer->failed = 0;
+    return writer;
+}
+
+BitWriter *BitWriterCreateMemory(size_t initialCapacity)
+{
+    return CreateWriter(NULL, 0, initialCapacity);
+}
+
+static int IsMemoryWriter(const BitWriter *writer)
+{
+    return !writer->file && writer->directFd < 0;
+}
+
+static void WriteDirect(BitWriter *writer, const unsigned char *data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t put = write(writer->directFd, data + done, size - done);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put < 0 && errno == EINVAL && SetDirectIO(writer->directFd, 0) == 0)
+            continue; // Файловая система отвергла прямую запись: дописываем через кеш
+        if (put <= 0)
+        {
+            writer->failed = 1;
+            return;
+        }
+        done += (size_t)put;
+    }
+}
+
+static void WriteFile(BitWriter *writer, const unsigned char *data, size_t size)
 {
-    if (bit)
-        writer->buffer |= (1 << (7 - writer->bitPos));
-        
-    writer->bitPos++;
+    if (size > 0 && fwrite(data, 1, size, writer->file) != size)
+        writer->failed = 1;
+}
+
+// Сбрасывает буфер в файл. В режиме O_DIRECT пишутся только целые выровненные
+// блоки, а невыровненный хвост остаётся в начале буфера до следующего сброса.
+// Если final, хвост дописывается после отключения O_DIRECT
+static void FlushBuffer(BitWriter *writer, int final)
+{
+    if (writer->file)
+    {
+        WriteFile(writer, writer->data, writer->size);
+        writer->flushed += writer->size;
+        writer->size = 0;
+        return;
+    }
+
+    size_t aligned = writer->size - writer->size % DIRECT_IO_ALIGNMENT;
+    if (aligned > 0)
+        WriteDirect(writer, writer->data, aligned);
+    writer->flushed += aligned;
+
+    size_t tail = writer->size - aligned;
+    if (tail > 0 && final)
+    {
+        if (SetDirectIO(writer->directFd, 0) != 0)
+            writer->failed = 1;
+        WriteDirect(writer, writer->data + aligned, tail);
+        writer->flushed += tail;
+        tail = 0;
+    }
+    else if (tail > 0)
+        memmove(writer->data, writer->data + aligned, tail);
+    writer->size = tail;
+}
+
+// Сбрасывает заполненный буфер в файл или расширяет его (режим памяти)
+static void EnsureSpace(BitWriter *writer, size_t extra)
+{
+    if (writer->size + extra <= writer->capacity)
+        return;
+
+    if (!IsMemoryWriter(writer))
+    {
+        FlushBuffer(writer, 0);
+        if (writer->size + extra <= writer->capacity || writer->directFd >= 0)
+            return;
+    }
+
+    size_t newCapacity = writer->capacity * 2;
+    while (newCapacity < writer->size + extra)
+        newCapacity *= 2;
+
+    unsigned char *grown = realloc(writer->data, newCapacity);
+    if (!grown)
+    {
+        writer->failed = 1;
+        return;
+    }
+    writer->data = grown;
+    writer->capacity = newCapacity;
+}
 
-    if (writer->bitPos == 8)
+static void PutByte(BitWriter *writer, unsigned char byte)
+{
+    if (writer->size == writer->capacity)
     {
-        fwrite(&writer->buffer, 1, 1, writer->file);
-        writer->buffer = 0;
-        writer->bitPos = 0;
+        EnsureSpace(writer, 1);
+        if (writer->size == writer->capacity)
+            return; // Нехватка памяти: байт теряется, как при ошибке fwrite
     }
+    writer->data[writer->size++] = byte;
+}
+
+void BitWriterWriteBit(BitWriter *writer, int bit)
+{
+    BitWriterWriteBits(writer, bit ? 1U : 0U, 1);
 }
 
+// Записывает count (до 32) младших битов value, начиная со старшего
 void BitWriterWriteBits(BitWriter *writer, unsigned int value, int count)
 {
-    for (int i = count - 1; i >= 0; i--)
-        BitWriterWriteBit(writer, (value >> i) & 1);
+    if (count <= 0)
+        return;
+
+    if (count < 32)
+        value &= (1U << count) - 1U;
+
+    writer->buffer = (writer->buffer << count) | value;
+    writer->bitPos += count;
+
+    while (writer->bitPos >= 8)
+    {
+        writer->bitPos -= 8;
+        PutByte(writer, (unsigned char)(writer->buffer >> writer->bitPos));
+    }
 }
 
-void BitWriterFlush(BitWriter *writer)
+// Дописывает байты как есть; перед этим поток выравнивается по границе байта
+void BitWriterWriteBytes(BitWriter *writer, const unsigned char *bytes, size_t count)
+{
+    BitWriterAlign(writer);
+
+    if (writer->file && count > writer->capacity)
+    {
+        FlushBuffer(writer, 0);
+        WriteFile(writer, bytes, count);
+        writer->flushed += count;
+        return;
+    }
+
+    // Прямой вывод идёт только через выровненный буфер
+    while (writer->directFd >= 0 && writer->size + count > writer->capacity)
+    {
+        size_t chunk = writer->capacity - writer->size;
+        memcpy(writer->data + writer->size, bytes, chunk);
+        writer->size += chunk;
+        FlushBuffer(writer, 0);
+        bytes += chunk;
+        count -= chunk;
+    }
+
+    EnsureSpace(writer, count);
+    if (writer->size + count > writer->capacity)
+        return;
+    memcpy(writer->data + writer->size, bytes, count);
+    writer->size += count;
+}
+
+// Дополняет последний байт нулевыми битами
+void BitWriterAlign(BitWriter *writer)
 {
     if (writer->bitPos > 0)
-        fwrite(&writer->buffer, 1, 1, writer->file);
+        BitWriterWriteBits(writer, 0, 8 - writer->bitPos);
 
     writer->buffer = 0;
     writer->bitPos = 0;
 }
 
-void BitWriterClose(BitWriter *writer)
+unsigned char *BitWriterReserve(BitWriter *writer, size_t count)
 {
-    if (!writer)
+    EnsureSpace(writer, count);
+    if (writer->size + count > writer->capacity)
+        return NULL;
+    return writer->data + writer->size;
+}
+
+void BitWriterCommit(BitWriter *writer, size_t count)
+{
+    writer->size += count;
+}
+
+uint64_t BitWriterTell(const BitWriter *writer)
+{
+    return writer->flushed + writer->size;
+}
+
+// В режиме O_DIRECT невыровненный хвост остаётся в буфере до BitWriterClose
+void BitWriterFlush(BitWriter *writer)
+{
+    BitWriterAlign(writer);
+
+    if (IsMemoryWriter(writer))
         return;
-    BitWriterFlush(writer);
-    fclose(writer->file);
+    FlushBuffer(writer, 0);
+    if (writer->file && fflush(writer->file) != 0)
+        writer->failed = 1;
+}
+
+int BitWriterError(const BitWriter *writer)
+{
+    return writer->failed || (writer->file && ferror(writer->file));
+}
+
+int BitWriterClose(BitWriter *writer)
+{
+    if (!writer)
+        return 0;
+    BitWriterAlign(writer);
+    if (!IsMemoryWriter(writer))
+        FlushBuffer(writer, 1);
+    if (writer->file)
+    {
+        if (fflush(writer->file) != 0 || ferror(writer->file))
+            writer->failed = 1;
+        if (writer->ownsFile && fclose(writer->file) != 0)
+            writer->failed = 1;
+    }
+    if (writer->directFd >= 0 && close(writer->directFd) != 0)
+        writer->failed = 1;
+    int failed = writer->failed;
+    free(writer->data);
     free(writer);
+    return failed ? -1 : 0;
 }
 
 // --- BitReader ---
 
-BitReader *BitReaderOpen(const char *path)
+static BitReader *CreateReader(FILE *file, int ownsFile)
 {
     BitReader *reader = malloc(sizeof(BitReader));
 
     if (!reader)
         return NULL;
 
-    reader->file = fopen(path, "rb");
-
-    if (!reader->file)
+    reader->data = malloc(STREAM_BUFFER_SIZE);
+    if (!reader->data)
     {
         free(reader);
         return NULL;
     }
 
+    reader->file = file;
+    reader->ownsFile = ownsFile;
+    reader->size = 0;
+    reader->pos = 0;
+    reader->buffer = 0;
     reader->bitPos = 8; // Чтобы сразу считать байт при первом чтении
     return reader;
 }
 
+BitReader *BitReaderOpen(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    BitReader *reader = CreateReader(file, 1);
+    if (!reader)
+        fclose(file);
+    return reader;
+}
+
+BitReader *BitReaderOpenStream(FILE *file, int ownsFile)
+{
+    if (!file)
+        return NULL;
+    return CreateReader(file, ownsFile);
+}
+
+BitReader *BitReaderCreateMemory(const unsigned char *data, size_t size)
+{
+    BitReader *reader = malloc(sizeof(BitReader));
+
+    if (!reader)
+        return NULL;
+
+    reader->file = NULL;
+    reader->ownsFile = 0;
+    reader->data = (unsigned char *)data;
+    reader->size = size;
+    reader->pos = 0;
+    reader->buffer = 0;
+    reader->bitPos = 8;
+    return reader;
+}
+
+// Подгружает следующую порцию файла в окно; возвращает 0 на EOF
+static int Refill(BitReader *reader)
+{
+    if (!reader->file)
+        return 0;
+
+    reader->size = fread(reader->data, 1, STREAM_BUFFER_SIZE, reader->file);
+    reader->pos = 0;
+    return reader->size > 0;
+}
+
 int BitReaderReadBit(BitReader *reader)
 {
     if (reader->bitPos == 8)
     {
-        if (fread(&reader->buffer, 1, 1, reader->file) != 1)
+        if (reader->pos == reader->size && !Refill(reader))
             return -1; // EOF
+        reader->buffer = reader->data[reader->pos++];
         reader->bitPos = 0;
     }
 
@@ -108,10 +411,83 @@ unsigned int BitReaderReadBits(BitReader *reader, int count)
     return result;
 }
 
+// Отбрасывает недочитанные биты текущего байта
+void BitReaderAlign(BitReader *reader)
+{
+    reader->bitPos = 8;
+}
+
+uint64_t BitReaderTellBits(const BitReader *reader)
+{
+    return (uint64_t)reader->pos * 8 - (8 - reader->bitPos);
+}
+
+size_t BitReaderReadBytes(BitReader *reader, unsigned char *bytes, size_t count)
+{
+    BitReaderAlign(reader);
+
+    size_t done = 0;
+    while (done < count)
+    {
+        if (reader->pos == reader->size)
+        {
+            // Крупные куски читаем из файла напрямую, минуя окно
+            if (reader->file && count - done >= STREAM_BUFFER_SIZE)
+            {
+                size_t got = fread(bytes + done, 1, count - done, reader->file);
+                done += got;
+                break;
+            }
+            if (!Refill(reader))
+                break;
+        }
+        size_t chunk = reader->size - reader->pos;
+        if (chunk > count - done)
+            chunk = count - done;
+        memcpy(bytes + done, reader->data + reader->pos, chunk);
+        reader->pos += chunk;
+        done += chunk;
+    }
+    return done;
+}
+
+// Пропускает байты без чтения, если поток позволяет seek (иначе читает их вхолостую)
+size_t BitReaderSkipBytes(BitReader *reader, uint64_t count)
+{
+    BitReaderAlign(reader);
+
+    uint64_t done = 0;
+    size_t inWindow = reader->size - reader->pos;
+    if (inWindow > count)
+        inWindow = (size_t)count;
+    reader->pos += inWindow;
+    done += inWindow;
+
+    if (done < count && reader->file && fseek(reader->file, (long)(count - done), SEEK_CUR) == 0)
+        return (size_t)count;
+
+    while (done < count)
+    {
+        if (!Refill(reader))
+            break;
+        size_t chunk = reader->size;
+        if (chunk > count - done)
+            chunk = (size_t)(count - done);
+        reader->pos = chunk;
+        done += chunk;
+    }
+    return (size_t)done;
+}
+
 void BitReaderClose(BitReader *reader)
 {
     if (!reader)
         return;
-    fclose(reader->file);
+    if (reader->file)
+    {
+        if (reader->ownsFile)
+            fclose(reader->file);
+        free(reader->data);
+    }
     free(reader);
 }
@@ -0,0 +1,1373 @@
+#include "codec.h"
+#include "ans.h"
+#include "context.h"
+#include "crc32c.h"
+#include "digram.h"
+#include "kernels_impl.h"
+#include "huffman.h"
+#include "lz.h"
+#include "report.h"
+#include "transform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Ядра кодируют и декодируют блок порциями, а контрольная сумма порции считается сразу,
+// пока она ещё в кэше L1; размер чётный, чтобы 2-байтный символ не делился между порциями
+#define CRC_CHUNK_SIZE (16 * 1024)
+#define STREAM_ROUND (CRC_CHUNK_SIZE / BLOCK_STREAMS)
+
+// Преобразование блока выбирается по нескольким отрезкам, разнесённым по блоку
+#define TRANSFORM_SAMPLE_SLICES 4
+#define TRANSFORM_SLICE_SIZE (4 * 1024)
+
+// Выборочная гистограмма строится по отрезкам такого размера
+#define HISTOGRAM_SAMPLE_SLICE (4 * 1024)
+
+// Пул узлов дерева декодирования и таблица по первым DECODE_TABLE_BITS битам кода,
+// которая строится по готовому дереву
+typedef struct
+{
+    DecodingTreeNode *nodes;
+    size_t nodeCapacity;
+    size_t nodeCount;
+    DecodeEntry table[1U << DECODE_TABLE_BITS];
+} DecodingTree;
+
+// Таблицы контекстного режима: около 900 КиБ, поэтому выделяются только при первом таком блоке
+typedef struct
+{
+    uint64_t freq[CONTEXT_COUNT * 256];
+    uint64_t clusterFreq[CONTEXT_MAX_CLUSTERS * 256];
+    HuffCode codes[CONTEXT_MAX_CLUSTERS][256];
+    DecodingTree trees[CONTEXT_MAX_CLUSTERS];
+} ContextScratch;
+
+struct CodecScratch
+{
+    HuffScratch *huff;
+    DecodingTree tree;
+    AnsEncodeTable ansEncode;
+    AnsDecodeTable ansDecode;
+    LzMatcher *lz;              // Создаётся при первом блоке LZ
+    DecodingTree lengthTree;    // Длины серий литералов и повторов в блоках LZ
+    DecodingTree distanceTree;  // Расстояния повторов в блоках LZ
+    ContextScratch *context;    // Создаётся при первом контекстном блоке
+    DigramAlphabet *digrams;    // Создаётся при первом блоке с парами
+    uint16_t digramExpand[DIGRAM_MAX_COUNT];
+    unsigned char *transformed; // Преобразованный блок (BLOCK_SIZE байт), выделяется при первом таком блоке
+};
+
+// Статическая таблица: коды для кодирования и готовое дерево для декодирования
+struct CodecTable
+{
+    uint32_t symbol_size;
+    HuffCode *codes;
+    DecodingTree tree;
+};
+
+CodecScratch *CodecScratchCreate(void)
+{
+    CodecScratch *scratch = calloc(1, sizeof(CodecScratch));
+    if (!scratch)
+        return NULL;
+    scratch->huff = HuffScratchCreate();
+    if (!scratch->huff)
+    {
+        free(scratch);
+        return NULL;
+    }
+    return scratch;
+}
+
+void CodecScratchDestroy(CodecScratch *scratch)
+{
+    if (!scratch)
+        return;
+    HuffScratchDestroy(scratch->huff);
+    free(scratch->tree.nodes);
+    free(scratch->lengthTree.nodes);
+    free(scratch->distanceTree.nodes);
+    LzMatcherDestroy(scratch->lz);
+    if (scratch->context)
+        for (uint32_t k = 0; k < CONTEXT_MAX_CLUSTERS; ++k)
+            free(scratch->context->trees[k].nodes);
+    free(scratch->context);
+    free(scratch->digrams);
+    free(scratch->transformed);
+    free(scratch);
+}
+
+void CodecScratchSetMaxCodeLength(CodecScratch *scratch, uint32_t maxCodeLength)
+{
+    HuffScratchSetMaxCodeLength(scratch->huff, maxCodeLength);
+}
+
+// Готовит пул под дерево из symbolCount листьев: не больше symbolCount * 2 узлов при корректной таблице
+static int ResetDecodingTree(DecodingTree *scratch, uint32_t symbolCount)
+{
+    size_t needed = (size_t)symbolCount * 2;
+    if (scratch->nodeCapacity < needed)
+    {
+        DecodingTreeNode *nodes = realloc(scratch->nodes, needed * sizeof(DecodingTreeNode));
+        if (!nodes)
+            return 0;
+        scratch->nodes = nodes;
+        scratch->nodeCapacity = needed;
+    }
+    memset(&scratch->nodes[0], 0, sizeof(DecodingTreeNode));
+    scratch->nodeCount = 1;
+    return 1;
+}
+
+static uint32_t CreateDecodingNode(DecodingTree *scratch)
+{
+    if (scratch->nodeCount == scratch->nodeCapacity)
+        return 0; // Таблица описывает не префиксный код: узлов больше, чем возможно
+    uint32_t index = (uint32_t)scratch->nodeCount++;
+    memset(&scratch->nodes[index], 0, sizeof(DecodingTreeNode));
+    return index;
+}
+
+static int InsertIntoDecodingTree(DecodingTree *scratch, uint16_t symbol_val, uint64_t code, uint8_t code_len)
+{
+    DecodingTreeNode *root = &scratch->nodes[0];
+    if (code_len == 0)
+    {
+        if (root->is_leaf && root->symbol != symbol_val)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Root is already a leaf with a different symbol, cannot insert zero-length code for symbol %u\n", symbol_val);
+            return 0;
+        }
+        if (!root->is_leaf && (root->child0 || root->child1))
+        {
+            Report(HUFF_LOG_ERROR, "Error: Root has children, cannot insert zero-length code for symbol %u\n", symbol_val);
+            return 0;
+        }
+        root->is_leaf = 1;
+        root->symbol = symbol_val;
+        return 1;
+    }
+
+    uint32_t current = 0;
+    for (int i = code_len - 1; i >= 0; --i)
+    {
+        int bit = (code >> i) & 1;
+        uint32_t next = bit == 0 ? scratch->nodes[current].child0 : scratch->nodes[current].child1;
+        if (!next)
+        {
+            next = CreateDecodingNode(scratch);
+            if (!next)
+            {
+                Report(HUFF_LOG_ERROR, "Error: Huffman table describes too many codes for symbol %u.\n", symbol_val);
+                return 0;
+            }
+            if (bit == 0)
+                scratch->nodes[current].child0 = next;
+            else
+                scratch->nodes[current].child1 = next;
+        }
+        current = next;
+        if (scratch->nodes[current].is_leaf && i > 0)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Huffman tree structure conflict: non-leaf node is marked as leaf during path traversal for symbol %u.\n", symbol_val);
+            return 0;
+        }
+    }
+    if (scratch->nodes[current].is_leaf)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Huffman code collision or non-prefix code detected for symbol %u.\n", symbol_val);
+        return 0;
+    }
+    scratch->nodes[current].is_leaf = 1;
+    scratch->nodes[current].symbol = symbol_val;
+    return 1;
+}
+
+// Заполняет таблицу декодирования для поддерева node, код которого prefix имеет длину depth
+static void FillDecodeTable(DecodingTree *tree, uint32_t node, uint32_t prefix, int depth)
+{
+    const DecodingTreeNode *current = &tree->nodes[node];
+    if (current->is_leaf)
+    {
+        // Коду соответствуют все элементы, которые начинаются с него
+        uint32_t span = 1U << (DECODE_TABLE_BITS - depth);
+        DecodeEntry entry = {current->symbol, (uint8_t)depth, 0};
+        for (uint32_t i = 0; i < span; ++i)
+            tree->table[(prefix << (DECODE_TABLE_BITS - depth)) + i] = entry;
+        return;
+    }
+    if (depth == DECODE_TABLE_BITS)
+    {
+        tree->table[prefix].node = node;
+        return;
+    }
+    // Отсутствующий потомок оставляет элементы нулевыми: такой префикс недопустим
+    if (current->child0)
+        FillDecodeTable(tree, current->child0, prefix << 1, depth + 1);
+    if (current->child1)
+        FillDecodeTable(tree, current->child1, (prefix << 1) | 1, depth + 1);
+}
+
+static void BuildDecodeTable(DecodingTree *tree)
+{
+    memset(tree->table, 0, sizeof(tree->table));
+    if (!tree->nodes[0].is_leaf)
+        FillDecodeTable(tree, 0, 0, 0);
+}
+
+// Кодирует содержимое блока по готовым кодам и выравнивает результат по байту.
+// Если crc не NULL, по ходу кодирования считается CRC32C данных
+static void WriteSymbols(const HuffCode *huff_codes, const unsigned char *data, size_t size, uint32_t symbol_size, BitWriter *out, uint32_t *crc)
+{
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        kernels->packSymbols(huff_codes, data + start, chunk, symbol_size, out);
+        if (crc)
+            *crc = Crc32c(*crc, data + start, chunk);
+    }
+
+    BitWriterAlign(out);
+}
+
+static int ReportUnpackError(UnpackResult result, size_t produced, size_t size)
+{
+    if (result == UNPACK_TRUNCATED)
+        Report(HUFF_LOG_ERROR, "\nError: Unexpected end of block data (%zu/%zu decoded).\n", produced, size);
+    else
+        Report(HUFF_LOG_ERROR, "\nError: Invalid Huffman code sequence in archive. Corrupted data.\n");
+    return 1;
+}
+
+// Восстанавливает size байт из comp начиная с бита bitPos; если crc не NULL, считает CRC32C результата
+static int ReadSymbols(const DecodingTree *tree, const unsigned char *comp, size_t compSize, uint64_t bitPos,
+                       uint32_t symbol_size, unsigned char *out, size_t size, uint32_t *crc)
+{
+    const DecodingTreeNode *root = &tree->nodes[0];
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        if (root->is_leaf)
+        {
+            // Единственный символ с кодом нулевой длины: битов в потоке нет
+            for (size_t i = 0; i < chunk; ++i)
+                out[start + i] = (unsigned char)(symbol_size == 1 || ((start + i) & 1) ? root->symbol & 0xFF : root->symbol >> 8);
+        }
+        else
+        {
+            UnpackResult result = kernels->unpackSymbols(tree->table, tree->nodes, comp, compSize, &bitPos, symbol_size, out + start, chunk);
+            if (result != UNPACK_OK)
+                return ReportUnpackError(result, start, size);
+        }
+        if (crc)
+            *crc = Crc32c(*crc, out + start, chunk);
+    }
+    return 0;
+}
+
+// Размер части блока, которую кодирует один поток (кроме, возможно, последнего)
+static size_t StreamSegmentSize(size_t size, uint32_t symbol_size)
+{
+    size_t symbols = (size + symbol_size - 1) / symbol_size;
+    return (symbols + BLOCK_STREAMS - 1) / BLOCK_STREAMS * symbol_size;
+}
+
+static uint32_t GetUint32BE(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Восстанавливает блок из BLOCK_STREAMS потоков, начиная с бита bitPos (конец таблицы).
+// Потоки декодируются кругами по STREAM_ROUND байт каждый, и после круга контрольная сумма
+// каждой четверти продолжается по только что восстановленным данным; в конце суммы склеиваются
+static int ReadStreams(const DecodingTree *tree, const unsigned char *comp, size_t compSize, uint64_t bitPos,
+                       uint32_t symbol_size, unsigned char *out, size_t size, uint32_t *crc)
+{
+    // Единственный символ без битов в потоках: содержимое то же, что и у одного потока
+    if (tree->nodes[0].is_leaf)
+        return ReadSymbols(tree, comp, compSize, bitPos, symbol_size, out, size, crc);
+
+    size_t offset = (size_t)((bitPos + 7) / 8);
+    if (offset > compSize || compSize - offset < 4 * (BLOCK_STREAMS - 1))
+    {
+        Report(HUFF_LOG_ERROR, "\nError: Invalid stream jump table in block. Corrupted data.\n");
+        return 1;
+    }
+    const unsigned char *jump = comp + offset;
+    offset += 4 * (BLOCK_STREAMS - 1);
+
+    const unsigned char *streams[BLOCK_STREAMS];
+    size_t lengths[BLOCK_STREAMS];
+    unsigned char *parts[BLOCK_STREAMS];
+    size_t partSizes[BLOCK_STREAMS];
+    size_t segment = StreamSegmentSize(size, symbol_size);
+    for (int k = 0; k < BLOCK_STREAMS; ++k)
+    {
+        lengths[k] = k < BLOCK_STREAMS - 1 ? GetUint32BE(jump + 4 * k) : compSize - offset;
+        if (lengths[k] > compSize - offset)
+        {
+            Report(HUFF_LOG_ERROR, "\nError: Invalid stream jump table in block. Corrupted data.\n");
+            return 1;
+        }
+        streams[k] = comp + offset;
+        offset += lengths[k];
+
+        size_t begin = (size_t)k * segment < size ? (size_t)k * segment : size;
+        parts[k] = out + begin;
+        partSizes[k] = size - begin < segment ? size - begin : segment;
+    }
+
+    const CodecKernels *kernels = GetKernels();
+    uint64_t positions[BLOCK_STREAMS] = {0};
+    uint32_t partCrcs[BLOCK_STREAMS] = {0};
+    for (size_t done = 0; done < partSizes[0]; done += STREAM_ROUND)
+    {
+        size_t step = partSizes[0] - done < STREAM_ROUND ? partSizes[0] - done : STREAM_ROUND;
+        size_t steps[BLOCK_STREAMS];
+        for (int k = 0; k < BLOCK_STREAMS; ++k)
+            steps[k] = partSizes[k] <= done ? 0 : partSizes[k] - done < step ? partSizes[k] - done : step;
+
+        // Последняя четверть короче остальных: её хвост и хвосты других потоков декодируются по одному
+        if (steps[BLOCK_STREAMS - 1] == step)
+        {
+            unsigned char *const targets[BLOCK_STREAMS] = {parts[0] + done, parts[1] + done, parts[2] + done, parts[3] + done};
+            UnpackResult result = kernels->unpackStreams4(tree->table, tree->nodes, streams, lengths, positions, symbol_size, targets, step);
+            if (result != UNPACK_OK)
+                return ReportUnpackError(result, done, segment);
+        }
+        else
+        {
+            for (int k = 0; k < BLOCK_STREAMS; ++k)
+            {
+                if (steps[k] == 0)
+                    continue;
+                UnpackResult result = kernels->unpackSymbols(tree->table, tree->nodes, streams[k], lengths[k], &positions[k], symbol_size,
+                                                             parts[k] + done, steps[k]);
+                if (result != UNPACK_OK)
+                    return ReportUnpackError(result, done, segment);
+            }
+        }
+
+        if (crc)
+            for (int k = 0; k < BLOCK_STREAMS; ++k)
+                partCrcs[k] = Crc32c(partCrcs[k], parts[k] + done, steps[k]);
+    }
+
+    if (crc)
+    {
+        uint32_t blockCrc = partCrcs[0];
+        for (int k = 1; k < BLOCK_STREAMS; ++k)
+            blockCrc = Crc32cCombine(blockCrc, partCrcs[k], partSizes[k]);
+        *crc = Crc32cCombine(*crc, blockCrc, size);
+    }
+    return 0;
+}
+
+static int ReadPayload(const DecodingTree *tree, const unsigned char *comp, size_t compSize, uint64_t bitPos,
+                       uint32_t symbol_size, int streams, unsigned char *out, size_t size, uint32_t *crc)
+{
+    return streams ? ReadStreams(tree, comp, compSize, bitPos, symbol_size, out, size, crc)
+                   : ReadSymbols(tree, comp, compSize, bitPos, symbol_size, out, size, crc);
+}
+
+// Пишет данные блока одним потоком или BLOCK_STREAMS потоками с таблицей переходов.
+// Длины потоков известны только после кодирования, поэтому таблица заполняется в буфере задним числом.
+// Возвращает 1, если буфер не удалось расширить и блок записан не полностью
+static int WritePayload(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbol_size, uint32_t streams,
+                         BitWriter *out, uint32_t *crc)
+{
+    if (streams == 1)
+    {
+        WriteSymbols(codes, data, size, symbol_size, out, crc);
+        return BitWriterError(out) ? 1 : 0;
+    }
+
+    static const unsigned char emptyJump[4 * (BLOCK_STREAMS - 1)];
+    BitWriterAlign(out);
+    size_t jump = out->size;
+    BitWriterWriteBytes(out, emptyJump, sizeof(emptyJump));
+    if (out->size != jump + sizeof(emptyJump))
+        return 1; // Нехватка памяти
+
+    size_t segment = StreamSegmentSize(size, symbol_size);
+    for (uint32_t k = 0; k < BLOCK_STREAMS; ++k)
+    {
+        size_t begin = (size_t)k * segment < size ? (size_t)k * segment : size;
+        size_t length = size - begin < segment ? size - begin : segment;
+        size_t start = out->size;
+        WriteSymbols(codes, data + begin, length, symbol_size, out, crc);
+        if (k < BLOCK_STREAMS - 1)
+        {
+            uint32_t streamSize = (uint32_t)(out->size - start);
+            unsigned char *p = out->data + jump + 4 * k;
+            p[0] = (unsigned char)(streamSize >> 24);
+            p[1] = (unsigned char)(streamSize >> 16);
+            p[2] = (unsigned char)(streamSize >> 8);
+            p[3] = (unsigned char)streamSize;
+        }
+    }
+    return BitWriterError(out) ? 1 : 0;
+}
+
+// Пишет таблицу Хаффмана алфавита из alphabet_cardinality символов:
+// count (32) | count × [symbol (symbol_bits) | code_len (8) | code]
+static void WriteAlphabetTable(const HuffCode *huff_codes, uint32_t symbol_bits, uint32_t alphabet_cardinality, BitWriter *out)
+{
+    uint32_t active_codes_count = 0;
+
+    for (uint32_t sym_val_idx = 0; sym_val_idx < alphabet_cardinality; ++sym_val_idx)
+    {
+        if (huff_codes[sym_val_idx].code_len > 0)
+            active_codes_count++;
+    }
+    BitWriterWriteBits(out, active_codes_count, 32);
+
+    for (uint32_t sym_val_idx = 0; sym_val_idx < alphabet_cardinality; ++sym_val_idx)
+    {
+        if (huff_codes[sym_val_idx].code_len > 0)
+        {
+            BitWriterWriteBits(out, sym_val_idx, (int)symbol_bits);
+            BitWriterWriteBits(out, huff_codes[sym_val_idx].code_len, 8);
+            BitWriterWriteBits(out, (unsigned int)huff_codes[sym_val_idx].code, huff_codes[sym_val_idx].code_len);
+        }
+    }
+}
+
+static void WriteHuffmanTable(const HuffCode *huff_codes, uint32_t symbol_size, BitWriter *out)
+{
+    WriteAlphabetTable(huff_codes, symbol_size * 8, 1U << (symbol_size * 8), out);
+}
+
+// То же по списку символов с ненулевой частотой (см. HuffScratchActiveSymbols): таблица 2-байтного
+// блока из нескольких сотен символов пишется без обхода всех 65536 элементов
+static void WriteSparseTable(const HuffCode *huff_codes, const uint32_t *symbols, uint32_t count, uint32_t symbol_bits, BitWriter *out)
+{
+    uint32_t active_codes_count = 0;
+    for (uint32_t k = 0; k < count; ++k)
+        if (huff_codes[symbols[k]].code_len > 0)
+            active_codes_count++;
+    BitWriterWriteBits(out, active_codes_count, 32);
+
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        const HuffCode *code = &huff_codes[symbols[k]];
+        if (code->code_len > 0)
+        {
+            BitWriterWriteBits(out, symbols[k], (int)symbol_bits);
+            BitWriterWriteBits(out, code->code_len, 8);
+            BitWriterWriteBits(out, (unsigned int)code->code, code->code_len);
+        }
+    }
+}
+
+// Пишет таблицу Хаффмана и данные блока
+static int WriteHuffmanBlock(const HuffCode *huff_codes, const unsigned char *data, size_t size, uint32_t symbol_size, uint32_t streams,
+                              BitWriter *out, uint32_t *crc)
+{
+    WriteHuffmanTable(huff_codes, symbol_size, out);
+    return WritePayload(huff_codes, data, size, symbol_size, streams, out, crc);
+}
+
+int EncodeBlock(CodecScratch *scratch, const unsigned char *data, size_t size, uint32_t symbol_size, uint32_t streams, BitWriter *out, uint32_t *crc)
+{
+    if ((symbol_size != 1 && symbol_size != 2) || (streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+
+    const HuffCode *huff_codes = GenerateCodes(scratch->huff, data, size, symbol_size);
+    if (!huff_codes)
+        return 1;
+
+    const uint32_t *symbols;
+    uint32_t count = HuffScratchActiveSymbols(scratch->huff, &symbols);
+    WriteSparseTable(huff_codes, symbols, count, symbol_size * 8, out);
+    return WritePayload(huff_codes, data, size, symbol_size, streams, out, crc);
+}
+
+// Код группы значения LZ, число и значение дополнительных бит (см. LZ_DIRECT_CODES)
+static uint32_t LzValueCode(uint32_t value, uint32_t *extraBits, uint32_t *extra)
+{
+    if (value < LZ_DIRECT_CODES)
+    {
+        *extraBits = 0;
+        *extra = 0;
+        return value;
+    }
+    uint32_t high = 31 - (uint32_t)__builtin_clz(value);
+    *extraBits = high - 1;
+    *extra = value & ((1U << (high - 1)) - 1);
+    return LZ_DIRECT_CODES + (high - 4) * 2 + ((value >> (high - 1)) & 1);
+}
+
+static void WriteLzValue(const HuffCode *codes, uint32_t value, BitWriter *out)
+{
+    uint32_t extraBits, extra;
+    uint32_t code = LzValueCode(value, &extraBits, &extra);
+    BitWriterWriteBits(out, (unsigned int)codes[code].code, (int)codes[code].code_len);
+    if (extraBits)
+        BitWriterWriteBits(out, extra, (int)extraBits);
+}
+
+// Код нулевой длины у единственного символа алфавита в потоке LZ не отличить от отсутствия кода,
+// поэтому такому алфавиту добавляется второй символ: оба кода получают по одному биту
+static void EnsureTwoSymbols(uint64_t *freq)
+{
+    uint32_t used = 0, last = 0;
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        if (freq[symbol])
+        {
+            ++used;
+            last = symbol;
+        }
+    if (used == 1)
+        freq[last ^ 1] = 1;
+}
+
+int EncodeBlockSampled(CodecScratch *scratch, uint32_t sampleStep, const unsigned char *data, size_t size, uint32_t streams,
+                       BitWriter *out, uint32_t *crc)
+{
+    if ((streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+
+    // Единица у каждого байта даёт код и тем символам, которых нет в выборке
+    uint64_t freq[256];
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        freq[symbol] = 1;
+    size_t stride = (size_t)HISTOGRAM_SAMPLE_SLICE * (sampleStep ? sampleStep : 1);
+    for (size_t start = 0; start < size; start += stride)
+        GetKernels()->histogram(freq, data + start, size - start < HISTOGRAM_SAMPLE_SLICE ? size - start : HISTOGRAM_SAMPLE_SLICE, 1);
+
+    const HuffCode *codes = GenerateCodesFromFrequencies(scratch->huff, freq, 1);
+    if (!codes)
+        return 1;
+    return WriteHuffmanBlock(codes, data, size, 1, streams, out, crc);
+}
+
+int EncodeBlockStored(const unsigned char *data, size_t size, BitWriter *out, uint32_t *crc)
+{
+    if (size == 0 || size > BLOCK_SIZE)
+        return 1;
+    BitWriterWriteBytes(out, data, size);
+    if (crc)
+        *crc = Crc32c(*crc, data, size);
+    return 0;
+}
+
+// Размер описания таблицы (см. WriteHuffmanTable) и данных с частотами freq в битах
+static uint64_t HuffmanCost(const HuffCode *codes, const uint64_t *freq)
+{
+    uint64_t bits = 32;
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        if (codes[symbol].code_len)
+            bits += 16 + codes[symbol].code_len + freq[symbol] * codes[symbol].code_len;
+    return bits;
+}
+
+int EncodeBlockLz(CodecScratch *scratch, uint32_t level, const unsigned char *data, size_t size, uint32_t streams,
+                  BitWriter *out, uint8_t *method, uint32_t *crc)
+{
+    if ((streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+    if (!scratch->lz && !(scratch->lz = LzMatcherCreate()))
+        return 1;
+
+    const LzSequence *sequences;
+    size_t count = LzParse(scratch->lz, data, size, level, &sequences);
+    if (count == (size_t)-1)
+        return 1;
+
+    // Частоты трёх алфавитов: литералы, длины (серий литералов и повторов) и расстояния
+    uint64_t literalFreq[256] = {0}, lengthFreq[256] = {0}, distanceFreq[256] = {0};
+    uint32_t extraBits, extra;
+    uint64_t lzExtraBits = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (uint32_t k = 0; k < sequences[i].literals; ++k)
+            literalFreq[data[pos + k]]++;
+        lengthFreq[LzValueCode(sequences[i].literals, &extraBits, &extra)]++;
+        lzExtraBits += extraBits;
+        if (sequences[i].length)
+        {
+            lengthFreq[LzValueCode(sequences[i].length - LZ_MIN_MATCH, &extraBits, &extra)]++;
+            lzExtraBits += extraBits;
+            distanceFreq[LzValueCode(sequences[i].distance, &extraBits, &extra)]++;
+            lzExtraBits += extraBits;
+        }
+        pos += sequences[i].literals + sequences[i].length;
+    }
+    EnsureTwoSymbols(literalFreq);
+    EnsureTwoSymbols(lengthFreq);
+    EnsureTwoSymbols(distanceFreq);
+
+    // Таблица, которую возвращает GenerateCodesFromFrequencies, живёт до следующего вызова
+    HuffCode literalCodes[256], lengthCodes[256], distanceCodes[256];
+    const HuffCode *codes = GenerateCodesFromFrequencies(scratch->huff, literalFreq, 1);
+    if (!codes)
+        return 1;
+    memcpy(literalCodes, codes, sizeof(literalCodes));
+    if (!(codes = GenerateCodesFromFrequencies(scratch->huff, lengthFreq, 1)))
+        return 1;
+    memcpy(lengthCodes, codes, sizeof(lengthCodes));
+    if (!(codes = GenerateCodesFromFrequencies(scratch->huff, distanceFreq, 1)))
+        return 1;
+    memcpy(distanceCodes, codes, sizeof(distanceCodes));
+
+    // Данные без повторов (случайные, уже сжатые) дешевле закодировать обычным блоком Хаффмана:
+    // сравниваются точные размеры обоих вариантов
+    uint64_t lzCost = HuffmanCost(literalCodes, literalFreq) + HuffmanCost(lengthCodes, lengthFreq) +
+                      HuffmanCost(distanceCodes, distanceFreq) + lzExtraBits;
+    const uint64_t *counted = CountFrequencies(scratch->huff, data, size, 1);
+    if (!counted)
+        return 1;
+    uint64_t freq[256];
+    memcpy(freq, counted, sizeof(freq));
+    if (!(codes = GenerateCodesFromFrequencies(scratch->huff, freq, 1)))
+        return 1;
+    if (HuffmanCost(codes, freq) <= lzCost)
+    {
+        *method = BLOCK_METHOD_HUFF8 | (streams > 1 ? BLOCK_FLAG_STREAMS : 0);
+        return WriteHuffmanBlock(codes, data, size, 1, streams, out, crc);
+    }
+
+    *method = BLOCK_METHOD_LZ;
+    WriteHuffmanTable(literalCodes, 1, out);
+    WriteHuffmanTable(lengthCodes, 1, out);
+    WriteHuffmanTable(distanceCodes, 1, out);
+
+    const CodecKernels *kernels = GetKernels();
+    pos = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        WriteLzValue(lengthCodes, sequences[i].literals, out);
+        // Длинные серии литералов пишутся порциями: packSymbols резервирует выход под весь вызов
+        size_t end = pos + sequences[i].literals;
+        while (pos < end)
+        {
+            size_t chunk = end - pos < CRC_CHUNK_SIZE ? end - pos : CRC_CHUNK_SIZE;
+            kernels->packSymbols(literalCodes, data + pos, chunk, 1, out);
+            pos += chunk;
+        }
+        if (sequences[i].length)
+        {
+            WriteLzValue(lengthCodes, sequences[i].length - LZ_MIN_MATCH, out);
+            WriteLzValue(distanceCodes, sequences[i].distance, out);
+            pos += sequences[i].length;
+        }
+    }
+    BitWriterAlign(out);
+
+    if (crc)
+        *crc = Crc32c(*crc, data, size);
+    return 0;
+}
+
+int EncodeBlockContext(CodecScratch *scratch, const unsigned char *data, size_t size, uint32_t streams, BitWriter *out,
+                       uint8_t *method, uint32_t *crc)
+{
+    if ((streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+    if (!scratch->context && !(scratch->context = calloc(1, sizeof(ContextScratch))))
+        return 1;
+    ContextScratch *context = scratch->context;
+
+    CountContextFrequencies(context->freq, data, size);
+    uint8_t map[CONTEXT_COUNT];
+    uint32_t clusters = ClusterContexts(context->freq, CONTEXT_MAX_CLUSTERS, map, context->clusterFreq);
+
+    uint64_t freq[256] = {0};
+    for (uint32_t k = 0; k < clusters; ++k)
+        for (uint32_t symbol = 0; symbol < 256; ++symbol)
+            freq[symbol] += context->clusterFreq[k * 256 + symbol];
+
+    uint64_t contextCost = 8 + (clusters > 1 ? CONTEXT_COUNT * 4 : 0);
+    const HuffCode *codes;
+    for (uint32_t k = 0; k < clusters; ++k)
+    {
+        uint64_t *clusterFreq = context->clusterFreq + k * 256;
+        EnsureTwoSymbols(clusterFreq);
+        if (!(codes = GenerateCodesFromFrequencies(scratch->huff, clusterFreq, 1)))
+            return 1;
+        memcpy(context->codes[k], codes, sizeof(context->codes[k]));
+        contextCost += HuffmanCost(context->codes[k], clusterFreq);
+    }
+
+    // Однородные данные выигрывают от контекста меньше, чем стоят лишние таблицы
+    if (!(codes = GenerateCodesFromFrequencies(scratch->huff, freq, 1)))
+        return 1;
+    if (HuffmanCost(codes, freq) <= contextCost)
+    {
+        *method = BLOCK_METHOD_HUFF8 | (streams > 1 ? BLOCK_FLAG_STREAMS : 0);
+        return WriteHuffmanBlock(codes, data, size, 1, streams, out, crc);
+    }
+
+    *method = BLOCK_METHOD_CTX8;
+    BitWriterWriteBits(out, clusters, 8);
+    if (clusters > 1)
+        for (uint32_t prev = 0; prev < CONTEXT_COUNT; ++prev)
+            BitWriterWriteBits(out, map[prev], 4);
+    for (uint32_t k = 0; k < clusters; ++k)
+        WriteHuffmanTable(context->codes[k], 1, out);
+
+    const HuffCode *byContext[CONTEXT_COUNT];
+    for (uint32_t prev = 0; prev < CONTEXT_COUNT; ++prev)
+        byContext[prev] = context->codes[map[prev]];
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        kernels->packContext(byContext, data + start, chunk, start ? data[start - 1] : 0, out);
+        if (crc)
+            *crc = Crc32c(*crc, data + start, chunk);
+    }
+    BitWriterAlign(out);
+    return 0;
+}
+
+int EncodeBlockDigrams(CodecScratch *scratch, uint32_t maxDigrams, const unsigned char *data, size_t size, uint32_t streams,
+                       BitWriter *out, uint8_t *method, uint32_t *crc)
+{
+    if ((streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+    if (!scratch->digrams && !(scratch->digrams = calloc(1, sizeof(DigramAlphabet))))
+        return 1;
+    DigramAlphabet *alphabet = scratch->digrams;
+
+    // Разбор начинается заново в каждой порции CRC_CHUNK_SIZE: пара не пересекает границу порции,
+    // и декодер проверяет порцию сразу после восстановления
+    DigramSelect(alphabet, data, size, maxDigrams);
+    uint64_t freq[DIGRAM_ALPHABET_SIZE] = {0};
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+        DigramCountSymbols(alphabet, data + start, size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE, freq);
+    uint32_t symbolCount = 256 + alphabet->count;
+
+    const HuffCode *codes = GenerateCodesForAlphabet(scratch->huff, freq, symbolCount);
+    if (!codes)
+        return 1;
+    HuffCode digramCodes[DIGRAM_ALPHABET_SIZE];
+    memcpy(digramCodes, codes, sizeof(HuffCode) * symbolCount);
+    uint64_t digramCost = 16 + (uint64_t)alphabet->count * 16 + 32;
+    for (uint32_t symbol = 0; symbol < symbolCount; ++symbol)
+        if (digramCodes[symbol].code_len)
+            digramCost += DIGRAM_SYMBOL_BITS + 8 + digramCodes[symbol].code_len + freq[symbol] * digramCodes[symbol].code_len;
+
+    // Без частых пар (или когда их коды почти не короче двух байтовых) обычный блок меньше
+    const uint64_t *counted = CountFrequencies(scratch->huff, data, size, 1);
+    if (!counted)
+        return 1;
+    uint64_t byteFreq[256];
+    memcpy(byteFreq, counted, sizeof(byteFreq));
+    if (!(codes = GenerateCodesFromFrequencies(scratch->huff, byteFreq, 1)))
+        return 1;
+    if (alphabet->count == 0 || HuffmanCost(codes, byteFreq) <= digramCost)
+    {
+        *method = BLOCK_METHOD_HUFF8 | (streams > 1 ? BLOCK_FLAG_STREAMS : 0);
+        return WriteHuffmanBlock(codes, data, size, 1, streams, out, crc);
+    }
+
+    *method = BLOCK_METHOD_DIGRAM8;
+    BitWriterWriteBits(out, alphabet->count, 16);
+    for (uint32_t k = 0; k < alphabet->count; ++k)
+        BitWriterWriteBits(out, alphabet->digrams[k], 16);
+    WriteAlphabetTable(digramCodes, DIGRAM_SYMBOL_BITS, symbolCount, out);
+
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        kernels->packDigrams(digramCodes, alphabet->symbols, data + start, chunk, out);
+        if (crc)
+            *crc = Crc32c(*crc, data + start, chunk);
+    }
+    BitWriterAlign(out);
+    return 0;
+}
+
+// Размер данных с частотами freq в битах без описания таблицы: таблицы вариантов сравнимы,
+// а по небольшой выборке их доля сильно завышена
+static uint64_t HuffmanDataCost(const HuffCode *codes, const uint64_t *freq)
+{
+    uint64_t bits = 0;
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        bits += freq[symbol] * codes[symbol].code_len;
+    return bits;
+}
+
+BlockTransform TransformBlock(CodecScratch *scratch, const unsigned char *data, size_t size, BitWriter *out,
+                              const unsigned char **transformed, size_t *transformedSize)
+{
+    *transformed = data;
+    *transformedSize = size;
+    if (size == 0 || size > BLOCK_SIZE || (!scratch->transformed && !(scratch->transformed = malloc(BLOCK_SIZE))))
+        return TRANSFORM_NONE;
+
+    // Отрезки берутся подряд идущими байтами, чтобы разности и серии нулей в них были как в блоке
+    size_t slices = size > TRANSFORM_SAMPLE_SLICES * TRANSFORM_SLICE_SIZE ? TRANSFORM_SAMPLE_SLICES : 1;
+    size_t sliceSize = slices > 1 ? TRANSFORM_SLICE_SIZE : size;
+    unsigned char *sample = scratch->transformed;
+    BlockTransform best = TRANSFORM_NONE;
+    uint64_t bestCost = UINT64_MAX, noneCost = UINT64_MAX;
+    for (int transform = TRANSFORM_NONE; transform < TRANSFORM_COUNT; ++transform)
+    {
+        uint64_t freq[256] = {0};
+        int expanded = 0;
+        for (size_t k = 0; k < slices && !expanded; ++k)
+        {
+            const unsigned char *slice = data + (slices > 1 ? k * (size - sliceSize) / (slices - 1) : 0);
+            size_t length = TransformForward((BlockTransform)transform, slice, sliceSize, sample);
+            if (length == TRANSFORM_EXPANDED)
+                expanded = 1;
+            else
+                GetKernels()->histogram(freq, sample, length, 1);
+        }
+        if (expanded)
+            continue;
+        const HuffCode *codes = GenerateCodesFromFrequencies(scratch->huff, freq, 1);
+        if (!codes)
+            return TRANSFORM_NONE;
+        uint64_t cost = HuffmanDataCost(codes, freq);
+        if (transform == TRANSFORM_NONE)
+            noneCost = cost;
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            best = (BlockTransform)transform;
+        }
+    }
+
+    // Небольшой выигрыш на выборке не стоит прохода по блоку при распаковке
+    if (best == TRANSFORM_NONE || bestCost > noneCost - noneCost / 32)
+        return TRANSFORM_NONE;
+    size_t length = TransformForward(best, data, size, scratch->transformed);
+    if (length == TRANSFORM_EXPANDED)
+        return TRANSFORM_NONE;
+
+    BitWriterWriteBits(out, best, 8);
+    BitWriterWriteBits(out, (unsigned int)length, 32);
+    *transformed = scratch->transformed;
+    *transformedSize = length;
+    return best;
+}
+
+// Пишет доли символов и поток tANS
+static int WriteAnsBlock(CodecScratch *scratch, const uint16_t *norm, uint32_t tableLog, uint32_t active,
+                         const unsigned char *data, size_t size, BitWriter *out, uint32_t *crc)
+{
+    BitWriterWriteBits(out, tableLog, 8);
+    BitWriterWriteBits(out, active, 16);
+    for (uint32_t symbol = 0; symbol < ANS_ALPHABET_SIZE; ++symbol)
+    {
+        if (norm[symbol] == 0)
+            continue;
+        BitWriterWriteBits(out, symbol, 8);
+        BitWriterWriteBits(out, norm[symbol], (int)tableLog + 1);
+    }
+    BitWriterAlign(out);
+
+    AnsBuildEncodeTable(&scratch->ansEncode, norm, tableLog);
+    unsigned char *dst = BitWriterReserve(out, ANS_BOUND(size));
+    if (!dst)
+        return 1;
+    BitWriterCommit(out, AnsEncode(&scratch->ansEncode, data, size, dst));
+
+    // Кодер идёт с конца блока, поэтому сумма считается отдельным проходом
+    if (crc)
+        *crc = Crc32c(*crc, data, size);
+    return 0;
+}
+
+int EncodeBlockWithCoder(CodecScratch *scratch, BlockCoder coder, const unsigned char *data, size_t size, uint32_t streams,
+                         BitWriter *out, uint8_t *method, uint32_t *crc)
+{
+    if ((streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+
+    const uint64_t *counted = CountFrequencies(scratch->huff, data, size, 1);
+    if (!counted)
+        return 1;
+    uint64_t freq[ANS_ALPHABET_SIZE];
+    memcpy(freq, counted, sizeof(freq));
+
+    uint32_t active = 0;
+    for (int symbol = 0; symbol < ANS_ALPHABET_SIZE; ++symbol)
+        active += freq[symbol] != 0;
+    uint32_t tableLog = AnsChooseTableLog(size, active);
+    uint16_t norm[ANS_ALPHABET_SIZE];
+    if (AnsNormalize(freq, tableLog, norm) != 0)
+        return 1;
+
+    const HuffCode *huff_codes = NULL;
+    if (coder != CODER_ANS)
+    {
+        huff_codes = GenerateCodesFromFrequencies(scratch->huff, freq, 1);
+        if (!huff_codes)
+            return 1;
+    }
+
+    if (coder == CODER_AUTO)
+    {
+        // Оценки в 1/256 бита: данные плюс описание таблицы
+        uint64_t huffmanCost = 32 * 256;
+        for (int symbol = 0; symbol < ANS_ALPHABET_SIZE; ++symbol)
+            if (freq[symbol])
+                huffmanCost += (freq[symbol] * huff_codes[symbol].code_len + 16 + huff_codes[symbol].code_len) * 256;
+        uint64_t ansCost = AnsEstimateCost(freq, norm, tableLog) + (24 + 2 * tableLog + (uint64_t)active * (9 + tableLog)) * 256;
+        coder = ansCost < huffmanCost ? CODER_ANS : CODER_HUFFMAN;
+    }
+
+    if (coder == CODER_ANS)
+    {
+        *method = BLOCK_METHOD_ANS8;
+        return WriteAnsBlock(scratch, norm, tableLog, active, data, size, out, crc);
+    }
+
+    *method = BLOCK_METHOD_HUFF8 | (streams > 1 ? BLOCK_FLAG_STREAMS : 0);
+    return WriteHuffmanBlock(huff_codes, data, size, 1, streams, out, crc);
+}
+
+int EncodeBlockWithTable(const CodecTable *table, const unsigned char *data, size_t size, uint32_t streams, BitWriter *out, uint32_t *crc)
+{
+    if (!table || (streams != 1 && streams != BLOCK_STREAMS) || size == 0 || size > BLOCK_SIZE)
+        return 1;
+
+    // Таблица известна декодеру заранее: ни подсчёта частот, ни таблицы в блоке
+    return WritePayload(table->codes, data, size, table->symbol_size, streams, out, crc);
+}
+
+// Читает таблицу Хаффмана (см. WriteAlphabetTable) и строит по ней дерево и таблицу декодирования.
+// Пустая таблица допустима, только если allowEmpty: тогда любой код в потоке будет ошибкой
+static int ReadAlphabetTable(BitReader *reader, DecodingTree *tree, uint32_t symbol_bits, uint32_t alphabet_cardinality, int allowEmpty)
+{
+    uint32_t huff_table_entry_count = BitReaderReadBits(reader, 32);
+    if ((huff_table_entry_count == 0 && !allowEmpty) || huff_table_entry_count > alphabet_cardinality)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid Huffman table size (%u).\n", huff_table_entry_count);
+        return 1;
+    }
+    if (!ResetDecodingTree(tree, huff_table_entry_count ? huff_table_entry_count : 1))
+        return 1;
+
+    for (uint32_t entry_idx = 0; entry_idx < huff_table_entry_count; ++entry_idx)
+    {
+        uint32_t symbol = BitReaderReadBits(reader, (int)symbol_bits);
+        uint8_t code_len = BitReaderReadBits(reader, 8);
+
+        if (code_len > 32 || symbol >= alphabet_cardinality)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Invalid code_len (%u) for symbol %u.\n", code_len, symbol);
+            return 1;
+        }
+        uint64_t code = 0;
+        if (code_len > 0)
+            code = BitReaderReadBits(reader, code_len);
+
+        if (!InsertIntoDecodingTree(tree, (uint16_t)symbol, code, code_len))
+            return 1;
+    }
+
+    BuildDecodeTable(tree);
+    return 0;
+}
+
+static int ReadHuffmanTable(BitReader *reader, DecodingTree *tree, uint32_t symbol_size, int allowEmpty)
+{
+    return ReadAlphabetTable(reader, tree, symbol_size * 8, 1U << (symbol_size * 8), allowEmpty);
+}
+
+// Восстанавливает блок BLOCK_METHOD_ANS8 порциями, считая контрольную сумму каждой порции сразу
+static int DecodeAnsBlock(CodecScratch *scratch, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc)
+{
+    BitReader *reader = BitReaderCreateMemory(comp, compSize);
+    if (!reader)
+        return 1;
+
+    uint16_t norm[ANS_ALPHABET_SIZE] = {0};
+    uint32_t tableLog = BitReaderReadBits(reader, 8);
+    uint32_t active = BitReaderReadBits(reader, 16);
+    int valid = tableLog >= ANS_MIN_TABLE_LOG && tableLog <= ANS_MAX_TABLE_LOG && active > 0 && active <= ANS_ALPHABET_SIZE;
+    for (uint32_t i = 0; i < active && valid; ++i)
+    {
+        uint32_t symbol = BitReaderReadBits(reader, 8);
+        norm[symbol] = (uint16_t)BitReaderReadBits(reader, (int)tableLog + 1);
+    }
+    size_t offset = (size_t)((BitReaderTellBits(reader) + 7) / 8);
+    BitReaderClose(reader);
+
+    AnsDecoder decoder;
+    if (!valid || offset > compSize || AnsBuildDecodeTable(&scratch->ansDecode, norm, tableLog) != 0 ||
+        AnsDecoderInit(&decoder, &scratch->ansDecode, comp + offset, compSize - offset) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "\nError: Invalid ANS table in block. Corrupted data.\n");
+        return 1;
+    }
+
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        if (AnsDecodeSymbols(&decoder, &scratch->ansDecode, out + start, chunk) != 0)
+            return ReportUnpackError(UNPACK_TRUNCATED, start, size);
+        if (crc)
+            *crc = Crc32c(*crc, out + start, chunk);
+    }
+    if (AnsDecoderFinish(&decoder) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "\nError: Invalid ANS stream in block. Corrupted data.\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Читает значение LZ: код группы и дополнительные биты берутся из одного окна
+// (код не длиннее 32 бит, дополнительных бит не больше 19)
+static int ReadLzValue(const DecodingTree *tree, const unsigned char *comp, size_t compSize, uint64_t *bitPos, uint32_t *value)
+{
+    uint64_t window = PeekBits(comp, compSize, *bitPos);
+    uint32_t code;
+    unsigned length;
+    if (!DecodeSymbol(tree->table, tree->nodes, window, &code, &length) || code >= LZ_VALUE_CODES)
+        return 1;
+    if (code < LZ_DIRECT_CODES)
+    {
+        *value = code;
+        *bitPos += length;
+    }
+    else
+    {
+        uint32_t group = code - LZ_DIRECT_CODES;
+        uint32_t extraBits = group / 2 + 3;
+        *value = ((2 | (group & 1)) << extraBits) | (uint32_t)((window << length) >> (64 - extraBits));
+        *bitPos += length + extraBits;
+    }
+    return *bitPos > (uint64_t)compSize * 8;
+}
+
+// Восстанавливает блок BLOCK_METHOD_LZ: серии литералов декодируются ядром, повторы копируются
+// из уже восстановленной части. Контрольная сумма считается порциями по мере продвижения
+static int DecodeLzBlock(CodecScratch *scratch, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc)
+{
+    BitReader *reader = BitReaderCreateMemory(comp, compSize);
+    if (!reader)
+        return 1;
+    int result = ReadHuffmanTable(reader, &scratch->tree, 1, 0);
+    if (result == 0)
+        result = ReadHuffmanTable(reader, &scratch->lengthTree, 1, 0);
+    if (result == 0)
+        result = ReadHuffmanTable(reader, &scratch->distanceTree, 1, 1);
+    uint64_t bitPos = BitReaderTellBits(reader);
+    BitReaderClose(reader);
+    if (result != 0)
+        return 1;
+
+    const CodecKernels *kernels = GetKernels();
+    size_t produced = 0, checked = 0;
+    while (produced < size)
+    {
+        uint32_t literals, length, distance;
+        if (ReadLzValue(&scratch->lengthTree, comp, compSize, &bitPos, &literals) != 0 || literals > size - produced)
+            break;
+        if (literals)
+        {
+            UnpackResult unpacked = kernels->unpackSymbols(scratch->tree.table, scratch->tree.nodes, comp, compSize, &bitPos, 1,
+                                                           out + produced, literals);
+            if (unpacked != UNPACK_OK)
+                return ReportUnpackError(unpacked, produced, size);
+            produced += literals;
+        }
+
+        if (produced < size)
+        {
+            if (ReadLzValue(&scratch->lengthTree, comp, compSize, &bitPos, &length) != 0 ||
+                ReadLzValue(&scratch->distanceTree, comp, compSize, &bitPos, &distance) != 0)
+                break;
+            length += LZ_MIN_MATCH;
+            if (length > size - produced || distance == 0 || distance > produced)
+                break;
+
+            unsigned char *dst = out + produced;
+            const unsigned char *src = dst - distance;
+            if (distance >= length)
+                memcpy(dst, src, length);
+            else if (distance == 1)
+                memset(dst, *src, length);
+            else
+                for (uint32_t i = 0; i < length; ++i)
+                    dst[i] = src[i]; // Повтор перекрывает сам себя: байты берутся уже скопированные
+            produced += length;
+        }
+
+        if (crc)
+            for (; produced - checked >= CRC_CHUNK_SIZE; checked += CRC_CHUNK_SIZE)
+                *crc = Crc32c(*crc, out + checked, CRC_CHUNK_SIZE);
+    }
+
+    if (produced < size)
+    {
+        Report(HUFF_LOG_ERROR, "\nError: Invalid LZ sequence in block (%zu/%zu decoded). Corrupted data.\n", produced, size);
+        return 1;
+    }
+    if (crc)
+        *crc = Crc32c(*crc, out + checked, size - checked);
+    return 0;
+}
+
+// Восстанавливает блок BLOCK_METHOD_CTX8: таблица каждого байта выбирается по кластеру предыдущего
+static int DecodeContextBlock(CodecScratch *scratch, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc)
+{
+    if (!scratch->context && !(scratch->context = calloc(1, sizeof(ContextScratch))))
+        return 1;
+    ContextScratch *context = scratch->context;
+
+    BitReader *reader = BitReaderCreateMemory(comp, compSize);
+    if (!reader)
+        return 1;
+    uint8_t map[CONTEXT_COUNT] = {0};
+    uint32_t clusters = BitReaderReadBits(reader, 8);
+    int result = 0;
+    if (clusters == 0 || clusters > CONTEXT_MAX_CLUSTERS)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid number of context clusters (%u).\n", clusters);
+        result = 1;
+    }
+    for (uint32_t prev = 0; result == 0 && clusters > 1 && prev < CONTEXT_COUNT; ++prev)
+    {
+        map[prev] = (uint8_t)BitReaderReadBits(reader, 4);
+        if (map[prev] >= clusters)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Invalid context map entry (%u of %u clusters).\n", map[prev], clusters);
+            result = 1;
+        }
+    }
+    for (uint32_t k = 0; result == 0 && k < clusters; ++k)
+        result = ReadHuffmanTable(reader, &context->trees[k], 1, 0);
+    uint64_t bitPos = BitReaderTellBits(reader);
+    BitReaderClose(reader);
+    if (result != 0)
+        return 1;
+
+    const DecodeEntry *tables[CONTEXT_COUNT];
+    const DecodingTreeNode *nodes[CONTEXT_COUNT];
+    for (uint32_t prev = 0; prev < CONTEXT_COUNT; ++prev)
+    {
+        tables[prev] = context->trees[map[prev]].table;
+        nodes[prev] = context->trees[map[prev]].nodes;
+    }
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        UnpackResult unpacked = kernels->unpackContext(tables, nodes, comp, compSize, &bitPos, start ? out[start - 1] : 0, out + start, chunk);
+        if (unpacked != UNPACK_OK)
+            return ReportUnpackError(unpacked, start, size);
+        if (crc)
+            *crc = Crc32c(*crc, out + start, chunk);
+    }
+    return 0;
+}
+
+// Восстанавливает блок BLOCK_METHOD_DIGRAM8: символы от 256 разворачиваются в пары из заголовка блока
+static int DecodeDigramBlock(CodecScratch *scratch, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc)
+{
+    BitReader *reader = BitReaderCreateMemory(comp, compSize);
+    if (!reader)
+        return 1;
+    uint32_t count = BitReaderReadBits(reader, 16);
+    int result = 0;
+    if (count > DIGRAM_MAX_COUNT)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid number of digrams (%u).\n", count);
+        result = 1;
+    }
+    for (uint32_t k = 0; result == 0 && k < count; ++k)
+        scratch->digramExpand[k] = (uint16_t)BitReaderReadBits(reader, 16);
+    if (result == 0)
+        result = ReadAlphabetTable(reader, &scratch->tree, DIGRAM_SYMBOL_BITS, 256 + count, 0);
+    uint64_t bitPos = BitReaderTellBits(reader);
+    BitReaderClose(reader);
+    if (result != 0)
+        return 1;
+
+    const CodecKernels *kernels = GetKernels();
+    for (size_t start = 0; start < size; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = size - start < CRC_CHUNK_SIZE ? size - start : CRC_CHUNK_SIZE;
+        UnpackResult unpacked = kernels->unpackDigrams(scratch->tree.table, scratch->tree.nodes, scratch->digramExpand, comp, compSize,
+                                                       &bitPos, out + start, chunk);
+        if (unpacked != UNPACK_OK)
+            return ReportUnpackError(unpacked, start, size);
+        if (crc)
+            *crc = Crc32c(*crc, out + start, chunk);
+    }
+    return 0;
+}
+
+// Восстанавливает блок с BLOCK_FLAG_TRANSFORM: внутренний блок декодируется в рабочий буфер,
+// затем преобразование снимается порциями, и контрольная сумма считается по каждой восстановленной порции
+static int DecodeTransformedBlock(CodecScratch *scratch, const CodecTable *table, uint8_t method, const unsigned char *comp, size_t compSize,
+                                  unsigned char *out, size_t size, uint32_t *crc)
+{
+    if (compSize < BLOCK_TRANSFORM_HEADER_SIZE)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Transformed block is too short.\n");
+        return 1;
+    }
+    uint32_t transform = comp[0];
+    uint32_t length = GetUint32BE(comp + 1);
+    // Размер сохраняют все преобразования, кроме серий нулей, а те выбираются, только если сокращают блок.
+    // method приходит уже без BLOCK_FLAG_TRANSFORM; словарные методы с преобразованием не сочетаются
+    uint8_t inner = method & ~BLOCK_FLAG_STREAMS;
+    if (transform == TRANSFORM_NONE || transform >= TRANSFORM_COUNT || length == 0 || length > size ||
+        (transform != TRANSFORM_ZERO_RLE && length != size) || inner == BLOCK_METHOD_TABLE8 || inner == BLOCK_METHOD_TABLE16)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid block transform (%u, %u of %zu bytes).\n", transform, length, size);
+        return 1;
+    }
+    if (!scratch->transformed && !(scratch->transformed = malloc(BLOCK_SIZE)))
+        return 1;
+    if (DecodeBlock(scratch, table, method, comp + BLOCK_TRANSFORM_HEADER_SIZE, compSize - BLOCK_TRANSFORM_HEADER_SIZE,
+                    scratch->transformed, length, NULL) != 0)
+        return 1;
+
+    TransformState state;
+    TransformStateInit(&state, (BlockTransform)transform);
+    size_t produced = 0;
+    for (size_t start = 0; start < length; start += CRC_CHUNK_SIZE)
+    {
+        size_t chunk = length - start < CRC_CHUNK_SIZE ? length - start : CRC_CHUNK_SIZE;
+        size_t written;
+        if (TransformInverse(&state, scratch->transformed + start, chunk, out + produced, size - produced, &written) != 0)
+            break;
+        if (crc)
+            *crc = Crc32c(*crc, out + produced, written);
+        produced += written;
+    }
+    if (produced != size || state.pendingZeros)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Transformed block does not restore to %zu bytes.\n", size);
+        return 1;
+    }
+    return 0;
+}
+
+int DecodeBlock(CodecScratch *scratch, const CodecTable *table, uint8_t method, const unsigned char *comp, size_t compSize, unsigned char *out, size_t size, uint32_t *crc)
+{
+    if (method & BLOCK_FLAG_TRANSFORM)
+        return DecodeTransformedBlock(scratch, table, method & ~BLOCK_FLAG_TRANSFORM, comp, compSize, out, size, crc);
+    if (method == BLOCK_METHOD_STORED)
+    {
+        if (compSize != size)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Stored block holds %zu bytes instead of %zu.\n", compSize, size);
+            return 1;
+        }
+        memcpy(out, comp, size);
+        if (crc)
+            *crc = Crc32c(*crc, out, size);
+        return 0;
+    }
+    if (method == BLOCK_METHOD_ANS8)
+        return DecodeAnsBlock(scratch, comp, compSize, out, size, crc);
+    if (method == BLOCK_METHOD_LZ)
+        return DecodeLzBlock(scratch, comp, compSize, out, size, crc);
+    if (method == BLOCK_METHOD_CTX8)
+        return DecodeContextBlock(scratch, comp, compSize, out, size, crc);
+    if (method == BLOCK_METHOD_DIGRAM8)
+        return DecodeDigramBlock(scratch, comp, compSize, out, size, crc);
+
+    int streams = (method & BLOCK_FLAG_STREAMS) != 0;
+    method &= ~BLOCK_FLAG_STREAMS;
+    if (method == BLOCK_METHOD_TABLE8 || method == BLOCK_METHOD_TABLE16)
+    {
+        uint32_t symbol_size = (method == BLOCK_METHOD_TABLE8) ? 1 : 2;
+        if (!table || table->symbol_size != symbol_size)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Block is coded with a dictionary, but no matching dictionary is loaded.\n");
+            return 1;
+        }
+        return ReadPayload(&table->tree, comp, compSize, 0, symbol_size, streams, out, size, crc);
+    }
+
+    if (method != BLOCK_METHOD_HUFF8 && method != BLOCK_METHOD_HUFF16)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Unknown block method (%u).\n", method);
+        return 1;
+    }
+    uint32_t symbol_size = (method == BLOCK_METHOD_HUFF8) ? 1 : 2;
+
+    BitReader *reader = BitReaderCreateMemory(comp, compSize);
+    if (!reader)
+        return 1;
+
+    int result = ReadHuffmanTable(reader, &scratch->tree, symbol_size, 0);
+    if (result == 0)
+        result = ReadPayload(&scratch->tree, comp, compSize, BitReaderTellBits(reader), symbol_size, streams, out, size, crc);
+
+    BitReaderClose(reader);
+    return result;
+}
+
+CodecTable *CodecTableCreate(const uint8_t *lengths, uint32_t symbol_size)
+{
+    if (symbol_size != 1 && symbol_size != 2)
+        return NULL;
+    uint32_t symbolCount = 1U << (symbol_size * 8);
+
+    // Канонические коды: символы упорядочены по длине кода, затем по значению
+    uint32_t lengthCount[CODEC_TABLE_MAX_CODE_LEN + 1] = {0};
+    for (uint32_t i = 0; i < symbolCount; ++i)
+    {
+        if (lengths[i] == 0 || lengths[i] > CODEC_TABLE_MAX_CODE_LEN)
+            return NULL;
+        lengthCount[lengths[i]]++;
+    }
+
+    uint64_t nextCode[CODEC_TABLE_MAX_CODE_LEN + 1] = {0};
+    uint64_t code = 0;
+    for (uint32_t len = 1; len <= CODEC_TABLE_MAX_CODE_LEN; ++len)
+    {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+        if (code + lengthCount[len] > (1ULL << len))
+            return NULL; // Кодов длины len больше, чем допускает неравенство Крафта
+    }
+
+    CodecTable *table = calloc(1, sizeof(CodecTable));
+    if (!table)
+        return NULL;
+    table->symbol_size = symbol_size;
+    table->codes = malloc(symbolCount * sizeof(HuffCode));
+    if (!table->codes || !ResetDecodingTree(&table->tree, symbolCount))
+    {
+        CodecTableDestroy(table);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < symbolCount; ++i)
+    {
+        table->codes[i].code_len = lengths[i];
+        table->codes[i].code = nextCode[lengths[i]]++;
+        if (!InsertIntoDecodingTree(&table->tree, (uint16_t)i, table->codes[i].code, lengths[i]))
+        {
+            CodecTableDestroy(table);
+            return NULL;
+        }
+    }
+    BuildDecodeTable(&table->tree);
+    return table;
+}
+
+void CodecTableDestroy(CodecTable *table)
+{
+    if (!table)
+        return;
+    free(table->codes);
+    free(table->tree.nodes);
+    free(table);
+}
+
+uint32_t CodecTableSymbolSize(const CodecTable *table)
+{
+    return table->symbol_size;
+}
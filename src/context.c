@@ -0,0 +1,206 @@
+#include "context.h"
+
+#include <string.h>
+
+#define CLUSTER_ITERATIONS 4
+
+void CountContextFrequencies(uint64_t *freq, const unsigned char *data, size_t size)
+{
+    memset(freq, 0, sizeof(uint64_t) * CONTEXT_COUNT * 256);
+    unsigned prev = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        freq[(prev << 8) | data[i]]++;
+        prev = data[i];
+    }
+}
+
+// Двоичный логарифм в 1/256 бита; дробная часть — линейное приближение по мантиссе,
+// ошибки меньше 0,09 бита для сравнения кластеров достаточно
+static uint32_t Log2Q8(uint64_t value)
+{
+    uint32_t high = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t fraction = high >= 8 ? (uint32_t)(value >> (high - 8)) & 0xFF : (uint32_t)(value << (8 - high)) & 0xFF;
+    return (high << 8) | fraction;
+}
+
+// Длины кодов кластера в 1/256 бита. Частоты удваиваются и сдвигаются на единицу,
+// чтобы символ, которого в кластере нет, стоил дорого, но конечно
+static void ClusterCosts(const uint64_t *clusterFreq, uint32_t *cost)
+{
+    uint64_t total = 0;
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        total += clusterFreq[symbol];
+    uint32_t top = Log2Q8(2 * total + 256);
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        cost[symbol] = top - Log2Q8(2 * clusterFreq[symbol] + 1);
+}
+
+// Байты одного контекста обычно занимают узкий диапазон (текст — печатные символы),
+// поэтому размер считается только между первым и последним встреченным
+typedef struct
+{
+    const uint64_t *freq;
+    uint32_t first;
+    uint32_t end;
+} ContextRow;
+
+static uint64_t ContextCost(const ContextRow *row, const uint32_t *cost)
+{
+    uint64_t bits = 0;
+    for (uint32_t symbol = row->first; symbol < row->end; ++symbol)
+        bits += row->freq[symbol] * cost[symbol];
+    return bits;
+}
+
+// Примерный размер описания таблицы кластера в 1/256 бита: по 24 бита на символ
+static uint64_t TableCost(const uint64_t *clusterFreq)
+{
+    uint64_t symbols = 0;
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        symbols += clusterFreq[symbol] != 0;
+    return (32 + symbols * 24) * 256;
+}
+
+uint32_t ClusterContexts(const uint64_t *freq, uint32_t maxClusters, uint8_t *map, uint64_t *clusterFreq)
+{
+    uint32_t used[CONTEXT_COUNT];
+    ContextRow rows[CONTEXT_COUNT];
+    uint32_t usedCount = 0;
+    uint32_t largest = 0;
+    uint64_t largestTotal = 0;
+    for (uint32_t context = 0; context < CONTEXT_COUNT; ++context)
+    {
+        const uint64_t *row = freq + context * 256;
+        uint64_t total = 0;
+        uint32_t first = 256, end = 0;
+        for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        {
+            total += row[symbol];
+            if (row[symbol])
+            {
+                first = first < symbol ? first : symbol;
+                end = symbol + 1;
+            }
+        }
+        if (total == 0)
+            continue;
+        rows[usedCount] = (ContextRow){row, first, end};
+        used[usedCount++] = context;
+        if (total > largestTotal)
+        {
+            largestTotal = total;
+            largest = context;
+        }
+    }
+
+    memset(map, 0, CONTEXT_COUNT);
+    if (maxClusters < 1)
+        maxClusters = 1;
+    if (maxClusters > CONTEXT_MAX_CLUSTERS)
+        maxClusters = CONTEXT_MAX_CLUSTERS;
+    uint32_t limit = usedCount < maxClusters ? usedCount : maxClusters;
+    memset(clusterFreq, 0, sizeof(uint64_t) * CONTEXT_MAX_CLUSTERS * 256);
+    if (limit <= 1)
+    {
+        for (uint32_t i = 0; i < usedCount; ++i)
+            for (uint32_t symbol = 0; symbol < 256; ++symbol)
+                clusterFreq[symbol] += freq[used[i] * 256 + symbol];
+        return 1;
+    }
+
+    // Затравки: самый частый контекст, затем каждый раз тот, что хуже всего описывается
+    // уже выбранными кластерами по сравнению с собственным распределением
+    static const uint64_t Unassigned = UINT64_MAX;
+    uint32_t cost[CONTEXT_MAX_CLUSTERS][256];
+    uint64_t selfCost[CONTEXT_COUNT];
+    uint64_t bestCost[CONTEXT_COUNT];
+    for (uint32_t i = 0; i < usedCount; ++i)
+    {
+        uint32_t own[256];
+        ClusterCosts(rows[i].freq, own);
+        selfCost[i] = ContextCost(&rows[i], own);
+        bestCost[i] = Unassigned;
+    }
+
+    uint32_t clusters = 0;
+    uint32_t seed = largest;
+    while (clusters < limit)
+    {
+        memcpy(clusterFreq + clusters * 256, freq + seed * 256, sizeof(uint64_t) * 256);
+        ClusterCosts(clusterFreq + clusters * 256, cost[clusters]);
+        ++clusters;
+        if (clusters == limit)
+            break;
+
+        uint64_t worst = 0;
+        for (uint32_t i = 0; i < usedCount; ++i)
+        {
+            uint64_t bits = ContextCost(&rows[i], cost[clusters - 1]);
+            if (bits < bestCost[i])
+                bestCost[i] = bits;
+            uint64_t excess = bestCost[i] > selfCost[i] ? bestCost[i] - selfCost[i] : 0;
+            if (excess > worst)
+            {
+                worst = excess;
+                seed = used[i];
+            }
+        }
+        // Новый кластер — это ещё одна таблица в блоке: её описание должно окупиться
+        if (worst < TableCost(freq + seed * 256))
+            break;
+    }
+
+    // Уточнение: контексты переходят к лучшему кластеру, кластеры пересчитываются по своим контекстам
+    for (int iteration = 0; iteration < CLUSTER_ITERATIONS; ++iteration)
+    {
+        int changed = iteration == 0;
+        for (uint32_t i = 0; i < usedCount; ++i)
+        {
+            uint32_t best = 0;
+            uint64_t bestBits = Unassigned;
+            for (uint32_t k = 0; k < clusters; ++k)
+            {
+                uint64_t bits = ContextCost(&rows[i], cost[k]);
+                if (bits < bestBits)
+                {
+                    bestBits = bits;
+                    best = k;
+                }
+            }
+            if (map[used[i]] != best)
+                changed = 1;
+            map[used[i]] = (uint8_t)best;
+        }
+        if (!changed)
+            break;
+
+        // Пересчёт частот; опустевшие кластеры удаляются, номера остальных сдвигаются
+        memset(clusterFreq, 0, sizeof(uint64_t) * clusters * 256);
+        for (uint32_t i = 0; i < usedCount; ++i)
+            for (uint32_t symbol = rows[i].first; symbol < rows[i].end; ++symbol)
+                clusterFreq[map[used[i]] * 256 + symbol] += rows[i].freq[symbol];
+
+        uint8_t renumber[CONTEXT_MAX_CLUSTERS];
+        uint32_t kept = 0;
+        for (uint32_t k = 0; k < clusters; ++k)
+        {
+            uint64_t total = 0;
+            for (uint32_t symbol = 0; symbol < 256; ++symbol)
+                total += clusterFreq[k * 256 + symbol];
+            if (total == 0)
+                continue;
+            renumber[k] = (uint8_t)kept;
+            if (kept != k)
+                memcpy(clusterFreq + kept * 256, clusterFreq + k * 256, sizeof(uint64_t) * 256);
+            ++kept;
+        }
+        memset(clusterFreq + kept * 256, 0, sizeof(uint64_t) * (clusters - kept) * 256);
+        for (uint32_t i = 0; i < usedCount; ++i)
+            map[used[i]] = renumber[map[used[i]]];
+        clusters = kept;
+        for (uint32_t k = 0; k < clusters; ++k)
+            ClusterCosts(clusterFreq + k * 256, cost[k]);
+    }
+    return clusters;
+}
@@ -0,0 +1,81 @@
+#include "crc32c.h"
+#include "kernels.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define CRC32C_POLY 0x82F63B78U // Отражённый полином Кастаньоли
+
+// Таблицы slicing-by-8: table[k][b] — вклад байта b, за которым следуют k нулевых байтов
+static uint32_t crcTable[8][256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+static void BuildCrcTable(void)
+{
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+        crcTable[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b)
+        for (int k = 1; k < 8; ++k)
+            crcTable[k][b] = (crcTable[k - 1][b] >> 8) ^ crcTable[0][crcTable[k - 1][b] & 0xFF];
+}
+
+// Восемь байтов за шаг: независимые обращения к восьми таблицам вместо цепочки из восьми
+uint32_t Crc32cGeneric(uint32_t crc, const unsigned char *p, size_t size)
+{
+    pthread_once(&crcTableOnce, BuildCrcTable);
+    for (; size > 0 && ((uintptr_t)p & 7) != 0; ++p, --size)
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p) & 0xFF];
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = crcTable[7][lo & 0xFF] ^ crcTable[6][(lo >> 8) & 0xFF] ^ crcTable[5][(lo >> 16) & 0xFF] ^ crcTable[4][lo >> 24] ^
+              crcTable[3][hi & 0xFF] ^ crcTable[2][(hi >> 8) & 0xFF] ^ crcTable[1][(hi >> 16) & 0xFF] ^ crcTable[0][hi >> 24];
+    }
+    for (; size > 0; ++p, --size)
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p) & 0xFF];
+    return crc;
+}
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size)
+{
+    return ~GetKernels()->crc32c(~crc, data, size);
+}
+
+// Произведение многочленов a и b по модулю полинома (в отражённом представлении x^0 — старший бит)
+static uint32_t MultModPoly(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t mask = 1U << 31; mask != 0; mask >>= 1)
+    {
+        if (a & mask)
+            product ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+uint32_t Crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB)
+{
+    // Дописывание lengthB байт к первой части умножает её остаток на x^(8 * lengthB)
+    uint32_t power = 1U << 31; // x^0
+    uint32_t square = 1U << 23; // x^8
+    for (; lengthB != 0; lengthB >>= 1)
+    {
+        if (lengthB & 1)
+            power = MultModPoly(square, power);
+        square = MultModPoly(square, square);
+    }
+    return MultModPoly(power, crcA) ^ crcB;
+}
@@ -0,0 +1,27 @@
+// CRC32C инструкцией crc32 (Makefile собирает файл с -msse4.2).
+// Вызывается только после проверки возможностей процессора в kernels.c
+#if defined(__x86_64__)
+
+#include "kernels.h"
+
+#include <string.h>
+#include <nmmintrin.h>
+
+uint32_t Crc32cSse42(uint32_t crc, const unsigned char *p, size_t size)
+{
+    for (; size > 0 && ((uintptr_t)p & 7) != 0; ++p, --size)
+        crc = _mm_crc32_u8(crc, *p);
+    uint64_t crc64 = crc;
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; size > 0; ++p, --size)
+        crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+#endif
@@ -1,417 +1,1086 @@
 #include "decoder.h"
+#include "archive.h"
 #include "bitstream.h"
+#include "codec.h"
+#include "pipeline.h"
+#include "batchio.h"
 #include "fileutils.h"
-#include "args.h"
-#include <color.h>
+#include "report.h"
+#include "hash.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <time.h>
 #include <linux/limits.h>
+#include <sys/stat.h>
 
-#define MAGIC_BYTES_EXPECTED "HUFF"
-#define ARCHIVE_VERSION_EXPECTED 1
+// Состояние распаковки, разделяемое стадиями конвейера
+typedef struct
+{
+    const char *outputDir;
+    const char **wantedFiles;
+    size_t wantedCount;
+    int extractAll;
+    uint32_t num_total_files;   // Записей в прочитанных сегментах (растёт при переходе к дописанному)
+    uint8_t version;
+    const CodecTable *table;   // Таблица словаря архива, иначе NULL
+
+    // Стадия чтения: последовательный разбор архива
+    BitReader *reader;
+    uint32_t readIndex;
+    int inEntry;
+    int entryWanted;
+    uint32_t entryNames;   // Число имён текущей записи (у RECORD_COPIES больше одного)
+
+    // Стадия записи
+    FILE *stdoutSink;   // При выводе в stdout содержимое всех извлекаемых записей пишется подряд
+    FILE *outFile;
+    uint64_t bytesWritten;
+    char outputPath[PATH_MAX];       // Путь извлекаемой записи
+    char lastCreatedDir[PATH_MAX];   // Последняя созданная директория (не создаём её повторно)
+
+    // Малые записи накапливаются в памяти и создаются пакетами
+    BatchIO *io;
+    int entryInMemory;
+    unsigned char *entryData;
+    size_t entrySize;
+    BatchWrite pending[BATCH_MAX_FILES];
+    size_t pendingCount;
+
+    // Остальные извлекаемые имена записи RECORD_COPIES: строки подряд через '\0'.
+    // Копии создаются из содержимого первого имени после его извлечения
+    char *aliases;
+    size_t aliasCount;
+    FILE *teeFile;   // При выводе в stdout содержимое записи сохраняется для повторного вывода
+
+    // Извлечение диапазона байт одной записи: остальные блоки перематываются по заголовкам
+    int rangeMode;
+    uint64_t rangeStart;
+    uint64_t rangeEnd;         // Конец диапазона (не включая); UINT64_MAX — до конца записи
+    uint64_t entryPos;         // Стадия чтения: смещение следующего блока от начала записи
+    int rangeFound;
+    int rangeDone;             // Нужные блоки прочитаны, дальше архив не разбирается
+    uint64_t rangeEntrySize;   // Размер записи (или прочитанная часть, если чтение остановлено)
 
-typedef struct DecodingTreeNode
+    // Проверка архива: содержимое никуда не пишется, а сверяется с размером и хешем из сведений о файле
+    int testMode;
+    int entryCorrupt;
+    ContentHash entryHash;
+    char entryName[PATH_MAX];
+    uint32_t testedNames;   // Имён у проверяемой записи (стадия записи)
+    size_t testedCount;
+    size_t corruptCount;
+    uint64_t testedBytes;
+} DecodeContext;
+
+static uint32_t ReadUint32(BitReader *reader)
 {
-    struct DecodingTreeNode *child0;
-    struct DecodingTreeNode *child1;
-    int is_leaf;
-    uint16_t symbol;
-} DecodingTreeNode;
+    return BitReaderReadBits(reader, 32);
+}
 
-static DecodingTreeNode *CreateDecodingNode()
+static int IsWanted(DecodeContext *dec, const char *name)
 {
-    DecodingTreeNode *node = (DecodingTreeNode *)malloc(sizeof(DecodingTreeNode));
-    if (node)
-    {
-        node->child0 = NULL;
-        node->child1 = NULL;
-        node->is_leaf = 0;
-        node->symbol = 0;
-    }
-    return node;
+    if (dec->extractAll || dec->wantedCount == 0)
+        return dec->extractAll;
+
+    for (size_t w_idx = 0; w_idx < dec->wantedCount; ++w_idx)
+        if (strcmp(dec->wantedFiles[w_idx], name) == 0)
+            return 1;
+    return 0;
 }
 
-static void FreeDecodingTree(DecodingTreeNode *node)
+// Читает сжатые данные блока в ячейку
+static int ReadBlockPayload(DecodeContext *dec, PipelineSlot *slot, uint32_t comp_len)
 {
-    if (!node)
-        return;
-    FreeDecodingTree(node->child0);
-    FreeDecodingTree(node->child1);
-    free(node);
+    BitWriter *comp = slot->comp;
+    if (comp->capacity < comp_len)
+    {
+        unsigned char *grown = realloc(comp->data, comp_len);
+        if (!grown)
+            return -1;
+        comp->data = grown;
+        comp->capacity = comp_len;
+    }
+    if (BitReaderReadBytes(dec->reader, comp->data, comp_len) != comp_len)
+    {
+        Report(HUFF_LOG_ERROR, "\nError: Unexpected end of archive data while decompressing entry %u. File may be incomplete.\n", dec->readIndex + 1);
+        return -1;
+    }
+    comp->size = comp_len;
+    return 0;
 }
 
-static int InsertIntoDecodingTree(DecodingTreeNode *root, uint16_t symbol_val, uint64_t code, uint8_t code_len)
+// Разбирает solid-запись: список файлов копируется в slot->index для писателя.
+// Если ни один файл группы не нужен, блок перематывается без декодирования
+static int ReadSolidRecord(DecodeContext *dec, PipelineSlot *slot)
 {
-    DecodingTreeNode *current = root;
-    if (code_len == 0)
+    BitReader *reader = dec->reader;
+
+    uint16_t memberCount = BitReaderReadBits(reader, 16);
+    if (memberCount == 0 || memberCount > SOLID_MAX_MEMBERS || memberCount > dec->num_total_files - dec->readIndex)
     {
-        if (root->is_leaf && root->symbol != symbol_val)
-        {
-            fprintf(stderr, COLOR_STR("Error: Root is already a leaf with a different symbol, cannot insert zero-length code for symbol %u\n", RED), symbol_val);
-            return 0;
-        }
-        if (!root->is_leaf && (root->child0 || root->child1))
-        {
-            fprintf(stderr, COLOR_STR("Error: Root has children, cannot insert zero-length code for symbol %u\n", RED), symbol_val);
-            return 0;
-        }
-        current->is_leaf = 1;
-        current->symbol = symbol_val;
-        return 1;
+        Report(HUFF_LOG_ERROR, "Error: Invalid solid record (%u files) in archive at file index %u.\n", memberCount, dec->readIndex);
+        return -1;
     }
 
-    for (int i = code_len - 1; i >= 0; --i)
+    int anyWanted = 0;
+    for (uint16_t m = 0; m < memberCount; ++m)
     {
-        int bit = (code >> i) & 1;
-        if (bit == 0)
-        {
-            if (!current->child0)
-            {
-                current->child0 = CreateDecodingNode();
-                if (!current->child0)
-                    return 0; // Ошибка выделения памяти
-            }
-            current = current->child0;
-        }
-        else
-        {
-            if (!current->child1)
-            {
-                current->child1 = CreateDecodingNode();
-                if (!current->child1)
-                    return 0; // Ошибка выделения памяти
-            }
-            current = current->child1;
-        }
-        if (current->is_leaf && i > 0)
+        uint16_t filename_len = BitReaderReadBits(reader, 16);
+        if (filename_len == 0 || filename_len >= PATH_MAX)
         {
-            fprintf(stderr, COLOR_STR("Error: Huffman tree structure conflict: non-leaf node is marked as leaf during path traversal for symbol %u.\n", RED), symbol_val);
-            return 0;
+            Report(HUFF_LOG_ERROR, "Error: Invalid filename length (%u) in archive for file index %u.\n", filename_len, dec->readIndex + m);
+            return -1;
         }
+        for (uint16_t k = 0; k < filename_len; ++k)
+            slot->name[k] = (char)BitReaderReadBits(reader, 8);
+        slot->name[filename_len] = '\0';
+        int wanted = IsWanted(dec, slot->name);
+        anyWanted |= wanted;
+
+        uint32_t offset = ReadUint32(reader);
+        uint32_t size = ReadUint32(reader);
+        BitWriterWriteBits(slot->index, filename_len, 16);
+        BitWriterWriteBytes(slot->index, (const unsigned char *)slot->name, filename_len);
+        BitWriterWriteBits(slot->index, offset, 32);
+        BitWriterWriteBits(slot->index, size, 32);
+        if (wanted && dec->rangeMode)
+            dec->rangeEntrySize = size;
     }
-    if (current->is_leaf)
+
+    uint32_t raw_len = ReadUint32(reader);
+    uint32_t comp_len = ReadUint32(reader);
+    uint8_t method = BitReaderReadBits(reader, 8);
+    uint32_t crc = (method & BLOCK_FLAG_CRC) ? ReadUint32(reader) : 0;
+    if (raw_len > BLOCK_SIZE || comp_len > 2 * BLOCK_SIZE)
     {
-        fprintf(stderr, COLOR_STR("Error: Huffman code collision or non-prefix code detected for symbol %u.\n", RED), symbol_val);
-        return 0;
+        Report(HUFF_LOG_ERROR, "\nError: Invalid block header in archive for entry %u. Corrupted data.\n", dec->readIndex + 1);
+        return -1;
     }
-    current->is_leaf = 1;
-    current->symbol = symbol_val;
+
+    slot->kind = PIPE_ITEM_SOLID;
+    slot->entry = dec->readIndex;
+    slot->memberCount = memberCount;
+    slot->rawSize = raw_len;
+    slot->method = method;
+    slot->crc = crc;
+    slot->skip = !anyWanted;
+    if (slot->skip)
+    {
+        if (BitReaderSkipBytes(reader, comp_len) != comp_len)
+        {
+            Report(HUFF_LOG_ERROR, "\nError: Unexpected end of archive data while skipping entry %u.\n", dec->readIndex + 1);
+            return -1;
+        }
+    }
+    else if (ReadBlockPayload(dec, slot, comp_len) != 0)
+        return -1;
+
+    dec->readIndex += memberCount;
+    if (anyWanted && dec->rangeMode)
+        dec->rangeFound = dec->rangeDone = 1;
     return 1;
 }
 
-static uint64_t BitReaderReadUint64(BitReader *reader)
+static int ReadEntryName(DecodeContext *dec, char *name, uint32_t index)
 {
-    uint32_t high = BitReaderReadBits(reader, 32);
-    uint32_t low = BitReaderReadBits(reader, 32);
-    return ((uint64_t)high << 32) | low;
+    uint16_t filename_len = BitReaderReadBits(dec->reader, 16);
+    if (filename_len == 0 || filename_len >= PATH_MAX)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid filename length (%u) in archive for file index %u.\n", filename_len, index);
+        return -1;
+    }
+    for (uint16_t k = 0; k < filename_len; ++k)
+        name[k] = (char)BitReaderReadBits(dec->reader, 8);
+    name[filename_len] = '\0';
+    return 0;
 }
 
-int DecodeArchive(const char *archivePath, const char *outputDir, const char **wantedFiles, size_t wantedCount, int extractAll)
+// Разбирает заголовок записи RECORD_COPIES: все имена копируются в slot->index,
+// основным именем записи становится первое извлекаемое. Блоки читаются как у RECORD_FILE
+static int ReadCopiesHeader(DecodeContext *dec, PipelineSlot *slot)
 {
-    if (!archivePath || !outputDir)
+    uint16_t nameCount = BitReaderReadBits(dec->reader, 16);
+    if (nameCount < 2 || nameCount > dec->num_total_files - dec->readIndex)
     {
-        fprintf(stderr, COLOR_STR("Error: Invalid arguments to DecodeArchive.\n", RED));
-        return 1;
+        Report(HUFF_LOG_ERROR, "Error: Invalid copies record (%u names) in archive at file index %u.\n", nameCount, dec->readIndex);
+        return -1;
     }
 
-    BitReader *reader = BitReaderOpen(archivePath);
-    if (!reader)
+    char name[PATH_MAX];
+    int anyWanted = 0;
+    for (uint16_t n = 0; n < nameCount; ++n)
     {
-        perror(COLOR_STR("Error opening input archive for reading", RED));
-        return 1;
+        if (ReadEntryName(dec, name, dec->readIndex + n) != 0)
+            return -1;
+        size_t nameLen = strlen(name);
+        BitWriterWriteBits(slot->index, (uint16_t)nameLen, 16);
+        BitWriterWriteBytes(slot->index, (const unsigned char *)name, nameLen);
+        if (n == 0 || (!anyWanted && IsWanted(dec, name)))
+        {
+            memcpy(slot->name, name, nameLen + 1);
+            anyWanted = n == 0 ? IsWanted(dec, name) : 1;
+        }
     }
 
-    char magic_read[5] = {0};
-    for (int i = 0; i < strlen(MAGIC_BYTES_EXPECTED); ++i)
-    {
-        magic_read[i] = (char)BitReaderReadBits(reader, 8);
-    }
-    if (strncmp(magic_read, MAGIC_BYTES_EXPECTED, strlen(MAGIC_BYTES_EXPECTED)) != 0)
+    slot->kind = PIPE_ITEM_BEGIN;
+    slot->entry = dec->readIndex;
+    slot->memberCount = nameCount;
+    slot->skip = !anyWanted;
+    dec->entryWanted = anyWanted;
+    dec->entryNames = nameCount;
+    dec->entryPos = 0;
+    dec->rangeFound |= anyWanted;
+    dec->inEntry = 1;
+    return 1;
+}
+
+// Проверяет концевик прочитанного сегмента и переходит к дописанному следующим.
+// Возвращает 1, если записи продолжаются, 0 в конце архива и -1 при ошибке
+static int ReadSegmentEnd(DecodeContext *dec)
+{
+    BitReader *reader = dec->reader;
+    unsigned char magic[4];
+    if (BitReaderReadBytes(reader, magic, 4) != 4 || memcmp(magic, ARCHIVE_END_MAGIC, 4) != 0 ||
+        ReadUint32(reader) != dec->num_total_files)
     {
-        fprintf(stderr, COLOR_STR("Error: Not a valid Huffman archive (magic bytes mismatch).\n", RED));
-        BitReaderClose(reader);
-        return 1;
+        Report(HUFF_LOG_ERROR, "\nError: Invalid end marker after entry %u. Corrupted data.\n", dec->num_total_files);
+        return -1;
     }
+    BitReaderSkipBytes(reader, 8); // Начало сегмента нужно только для поиска конца архива с хвоста
 
-    uint8_t version = BitReaderReadBits(reader, 8);
-    if (version != ARCHIVE_VERSION_EXPECTED)
+    size_t got = BitReaderReadBytes(reader, magic, 4);
+    if (got == 0)
+        return 0;
+    if (got != 4 || memcmp(magic, ARCHIVE_APPEND_MAGIC, 4) != 0)
     {
-        fprintf(stderr, COLOR_STR("Error: Unsupported archive version (%u). Expected %u.\n", RED), version, ARCHIVE_VERSION_EXPECTED);
-        BitReaderClose(reader);
-        return 1;
+        // Метка пишется последней, поэтому без неё сегмент не был дописан до конца
+        Report(HUFF_LOG_WARNING, "Warning: Ignoring an incomplete append at the end of the archive.\n");
+        return 0;
     }
 
-    uint8_t symbol_size_val = BitReaderReadBits(reader, 8);
-    if (symbol_size_val != 1 && symbol_size_val != 2)
+    uint32_t count = ReadUint32(reader);
+    if (count == 0 || count > UINT32_MAX - dec->num_total_files)
     {
-        fprintf(stderr, COLOR_STR("Error: Archive contains invalid symbol_size (%u).\n", RED), symbol_size_val);
-        BitReaderClose(reader);
-        return 1;
+        Report(HUFF_LOG_ERROR, "\nError: Invalid appended segment after entry %u. Corrupted data.\n", dec->num_total_files);
+        return -1;
     }
+    dec->num_total_files += count;
+    Report(HUFF_LOG_INFO, "\nAppended segment: %u more file(s).\n", count);
+    return 1;
+}
 
-    uint32_t num_total_files = BitReaderReadBits(reader, 32);
-    printf("Archive contains %u file(s). Symbol size: %u byte(s).\n", num_total_files, symbol_size_val);
+// Стадия чтения: разбирает заголовки записей и блоков, читает сжатые данные.
+// Блоки невостребованных записей не декодируются, а перематываются по comp_len
+static int ReadArchive(void *ctx, PipelineSlot *slot)
+{
+    DecodeContext *dec = ctx;
+    BitReader *reader = dec->reader;
 
-    if (CreateDirectoryRecursive(outputDir) != 0)
-    {
-        fprintf(stderr, COLOR_STR("Error: Could not create output directory: %s (errno: %d, message: %s)\n", RED),
-                outputDir, errno, strerror(errno));
-        BitReaderClose(reader);
-        return 1;
-    }
+    if (dec->rangeDone)
+        return 0;
 
-    for (uint32_t file_idx = 0; file_idx < num_total_files; ++file_idx)
+    for (;;)
     {
-        uint16_t filename_len = BitReaderReadBits(reader, 16);
-        
-        if (filename_len == 0 || filename_len >= PATH_MAX)
-        {
-            fprintf(stderr, COLOR_STR("Error: Invalid filename length (%u) in archive for file index %u.\n", RED), filename_len, file_idx);
-            BitReaderClose(reader);
-            return 1;
-        }
-        char *filename_from_archive = (char *)malloc(filename_len + 1);
-        if (!filename_from_archive)
-        {
-            perror(COLOR_STR("Malloc failed for filename", RED));
-            BitReaderClose(reader);
-            return 1;
-        }
-        for (uint16_t k = 0; k < filename_len; ++k)
+        if (!dec->inEntry)
         {
-            filename_from_archive[k] = (char)BitReaderReadBits(reader, 8);
-        }
-        filename_from_archive[filename_len] = '\0';
+            if (dec->readIndex >= dec->num_total_files)
+            {
+                if (dec->version < ARCHIVE_SEGMENT_VERSION)
+                    return 0;
+                int more = ReadSegmentEnd(dec);
+                if (more <= 0)
+                    return more;
+                continue;
+            }
+
+            // В версии 2 тип записи не хранится: все записи — отдельные файлы
+            uint8_t kind = dec->version >= 3 ? BitReaderReadBits(reader, 8) : RECORD_FILE;
+            if (kind == RECORD_SOLID)
+                return ReadSolidRecord(dec, slot);
+            if (kind == RECORD_COPIES)
+                return ReadCopiesHeader(dec, slot);
+            if (kind != RECORD_FILE)
+            {
+                Report(HUFF_LOG_ERROR, "Error: Unknown record type (%u) in archive for file index %u.\n", kind, dec->readIndex);
+                return -1;
+            }
 
-        uint64_t original_file_size_bytes = BitReaderReadUint64(reader);
+            if (ReadEntryName(dec, slot->name, dec->readIndex) != 0)
+                return -1;
 
-        printf("\nProcessing archive entry %u/%u: %s (Original size: %llu bytes)\n",
-               file_idx + 1, num_total_files, filename_from_archive, (unsigned long long)original_file_size_bytes);
+            slot->kind = PIPE_ITEM_BEGIN;
+            slot->entry = dec->readIndex;
+            slot->skip = !IsWanted(dec, slot->name);
+            dec->entryWanted = !slot->skip;
+            dec->entryNames = 1;
+            dec->entryPos = 0;
+            dec->rangeFound |= dec->entryWanted;
+            dec->inEntry = 1;
+            return 1;
+        }
 
-        uint16_t huff_table_entry_count = BitReaderReadBits(reader, 16);
-        DecodingTreeNode *decoding_root = CreateDecodingNode();
-        if (!decoding_root)
+        slot->entry = dec->readIndex;
+        if (dec->rangeMode && dec->entryWanted && dec->entryPos >= dec->rangeEnd)
         {
-            perror(COLOR_STR("Failed to create decoding tree root", RED));
-            free(filename_from_archive);
-            BitReaderClose(reader);
+            // Диапазон прочитан: остаток записи и архива не нужен
+            slot->kind = PIPE_ITEM_END;
+            dec->rangeEntrySize = dec->entryPos;
+            dec->rangeDone = 1;
+            dec->inEntry = 0;
             return 1;
         }
 
-        int huff_table_valid = 1;
-        for (uint16_t entry_idx = 0; entry_idx < huff_table_entry_count; ++entry_idx)
+        uint32_t raw_len = ReadUint32(reader);
+        if (raw_len == 0)
         {
-            uint16_t symbol = 0;
-            if (symbol_size_val == 1)
+            // Сведения о файле: размер и хеш содержимого сверяются при проверке архива
+            unsigned char info[RECORD_INFO_SIZE];
+            if (dec->version >= RECORD_INFO_VERSION && BitReaderReadBytes(reader, info, RECORD_INFO_SIZE) != RECORD_INFO_SIZE)
             {
-                symbol = (uint16_t)BitReaderReadBits(reader, 8);
+                Report(HUFF_LOG_ERROR, "\nError: Unexpected end of archive data in entry %u.\n", dec->readIndex + 1);
+                return -1;
             }
-            else
+            uint64_t mtime = 0;
+            if (dec->version >= RECORD_INFO_VERSION)
             {
-                symbol = (uint16_t)BitReaderReadBits(reader, 16);
-            }
-            uint8_t code_len = BitReaderReadBits(reader, 8);
-
-            if (code_len > 64 && huff_table_entry_count > 1)
-            {
-                fprintf(stderr, COLOR_STR("Error: Invalid code_len (%u) for symbol %u in %s.\n", RED), code_len, symbol, filename_from_archive);
-                huff_table_valid = 0;
-                break;
+                for (int i = 0; i < 8; ++i)
+                {
+                    slot->position = (slot->position << 8) | info[i];
+                    mtime = (mtime << 8) | info[8 + i];
+                    slot->digest = (slot->digest << 8) | info[16 + i];
+                }
             }
-            uint64_t code = 0;
-            if (code_len > 0)
-                code = BitReaderReadBits(reader, code_len);
-
-            if (!InsertIntoDecodingTree(decoding_root, symbol, code, code_len))
+            slot->hasInfo = dec->version >= RECORD_INFO_VERSION && mtime != RECORD_INFO_NO_MTIME;
+            slot->kind = PIPE_ITEM_END;
+            slot->skip = !dec->entryWanted;
+            dec->inEntry = 0;
+            dec->readIndex += dec->entryNames;
+            if (dec->rangeMode && dec->entryWanted)
             {
-                fprintf(stderr, COLOR_STR("Error inserting into decoding tree for %s.\n", RED), filename_from_archive);
-                huff_table_valid = 0;
-                break;
+                dec->rangeEntrySize = dec->entryPos;
+                dec->rangeDone = 1;
             }
+            return 1;
         }
-        if (!huff_table_valid)
+
+        uint32_t comp_len = ReadUint32(reader);
+        uint8_t method = BitReaderReadBits(reader, 8);
+        uint32_t crc = (method & BLOCK_FLAG_CRC) ? ReadUint32(reader) : 0;
+        if (raw_len > BLOCK_SIZE || comp_len > 2 * BLOCK_SIZE)
         {
-            FreeDecodingTree(decoding_root);
-            free(filename_from_archive);
-            BitReaderClose(reader);
-            return 1;
+            Report(HUFF_LOG_ERROR, "\nError: Invalid block header in archive for entry %u. Corrupted data.\n", dec->readIndex + 1);
+            return -1;
         }
 
-        int should_extract = extractAll;
-        if (!extractAll && wantedCount > 0)
+        // Смещение блока в записи известно из raw_len предыдущих блоков, поэтому
+        // блоки вне диапазона перематываются без чтения и декодирования
+        uint64_t position = dec->entryPos;
+        dec->entryPos += raw_len;
+        if (!dec->entryWanted || (dec->rangeMode && (dec->entryPos <= dec->rangeStart || position >= dec->rangeEnd)))
         {
-            should_extract = 0;
-            for (size_t w_idx = 0; w_idx < wantedCount; ++w_idx)
+            if (BitReaderSkipBytes(reader, comp_len) != comp_len)
             {
-                if (strcmp(wantedFiles[w_idx], filename_from_archive) == 0)
-                {
-                    should_extract = 1;
-                    break;
-                }
+                Report(HUFF_LOG_ERROR, "\nError: Unexpected end of archive data while skipping entry %u.\n", dec->readIndex + 1);
+                return -1;
             }
+            continue;
         }
 
-        FILE *outFile = NULL;
-        char full_output_path[PATH_MAX];
-        int opened_successfully_for_writing = 0;
-        if (should_extract)
+        if (ReadBlockPayload(dec, slot, comp_len) != 0)
+            return -1;
+        slot->kind = PIPE_ITEM_DATA;
+        slot->rawSize = raw_len;
+        slot->method = method;
+        slot->crc = crc;
+        slot->position = position;
+        return 1;
+    }
+}
+
+// Стадия декодирования: блоки независимы и декодируются параллельно
+static int DecodeSlot(void *ctx, PipelineSlot *slot, CodecScratch *scratch)
+{
+    DecodeContext *dec = ctx;
+    // Контрольная сумма считается внутри декодера, пока восстановленные данные в кэше
+    int checked = (slot->method & BLOCK_FLAG_CRC) != 0;
+    uint32_t crc = 0;
+    uint8_t method = slot->method & ~BLOCK_FLAG_CRC;
+    if (DecodeBlock(scratch, dec->table, method, slot->comp->data, slot->comp->size, slot->raw, slot->rawSize, checked ? &crc : NULL) != 0)
+        Report(HUFF_LOG_ERROR, "Error: Failed to decode block of entry %zu.\n", slot->entry + 1);
+    else if (checked && crc != slot->crc)
+        Report(HUFF_LOG_ERROR, "Error: Checksum mismatch in block of entry %zu (stored %08x, computed %08x).\n", slot->entry + 1, slot->crc, crc);
+    else
+        return 0;
+
+    // Границы блоков известны из заголовков, поэтому проверка продолжается со следующего
+    slot->failed = 1;
+    return dec->testMode ? 0 : 1;
+}
+
+// Формирует путь для записи и создаёт недостающие директории
+static void PrepareOutputPath(DecodeContext *dec, const char *filename_from_archive)
+{
+    char *full_output_path = dec->outputPath;
+    snprintf(full_output_path, PATH_MAX, "%s/%s", dec->outputDir, filename_from_archive);
+    full_output_path[PATH_MAX - 1] = '\0';
+
+    char dir_part_to_create[PATH_MAX];
+    strncpy(dir_part_to_create, full_output_path, PATH_MAX - 1);
+    dir_part_to_create[PATH_MAX - 1] = '\0';
+
+    char *last_slash = strrchr(dir_part_to_create, '/');
+    if (last_slash != NULL && last_slash != dir_part_to_create)
+    {
+        *last_slash = '\0';
+        if (strcmp(dir_part_to_create, dec->lastCreatedDir) == 0)
+            return;
+        if (strlen(dir_part_to_create) > 0 && CreateDirectoryRecursive(dir_part_to_create) != 0)
         {
-            snprintf(full_output_path, PATH_MAX, "%s/%s", outputDir, filename_from_archive);
-            full_output_path[PATH_MAX - 1] = '\0';
+            Report(HUFF_LOG_WARNING, "Warning: Could not create directory %s for storing %s (errno: %d, %s)\n",
+                   dir_part_to_create, filename_from_archive, errno, strerror(errno));
+            return;
+        }
+        snprintf(dec->lastCreatedDir, PATH_MAX, "%s", dir_part_to_create);
+    }
+}
 
-            char dir_part_to_create[PATH_MAX];
-            strncpy(dir_part_to_create, full_output_path, PATH_MAX - 1);
-            dir_part_to_create[PATH_MAX - 1] = '\0';
+static void ReportOutputError(const char *path, int error)
+{
+    Report(HUFF_LOG_ERROR, "Error opening output file for writing: %s\n", strerror(error));
+    Report(HUFF_LOG_ERROR, "Failed output file: %s\n", path);
+}
 
-            char *last_slash = strrchr(dir_part_to_create, '/');
-            if (last_slash != NULL && last_slash != dir_part_to_create)
-            {
-                *last_slash = '\0';
-                if (strlen(dir_part_to_create) > 0 && CreateDirectoryRecursive(dir_part_to_create) != 0)
-                {
-                    fprintf(stderr, COLOR_STR("Warning: Could not create directory %s for storing %s (errno: %d, %s)\n", RED),
-                            dir_part_to_create, filename_from_archive, errno, strerror(errno));
-                }
-            }
+// Создаёт накопленные малые файлы одним пакетом
+static void FlushPendingWrites(DecodeContext *dec)
+{
+    if (dec->pendingCount == 0)
+        return;
 
-            outFile = fopen(full_output_path, "wb");
-            if (!outFile)
-            {
-                perror(COLOR_STR("Error opening output file for writing", RED));
-                fprintf(stderr, COLOR_STR("Failed output file: %s\n", RED), full_output_path);
-                should_extract = 0; // Не можем извлечь, если не открылся файл
-            }
-            else
-            {
-                printf("  Extracting to: %s\n", full_output_path);
-                opened_successfully_for_writing = 1;
-            }
+    BatchWriteFiles(dec->io, dec->pending, dec->pendingCount);
+    for (size_t i = 0; i < dec->pendingCount; ++i)
+    {
+        if (dec->pending[i].error != 0)
+            ReportOutputError(dec->pending[i].path, dec->pending[i].error);
+        free((char *)dec->pending[i].path);
+        free((unsigned char *)dec->pending[i].data);
+    }
+    dec->pendingCount = 0;
+}
+
+// Запись оказалась больше порога: открываем файл и сбрасываем накопленное начало
+static int SpillToFile(DecodeContext *dec)
+{
+    dec->entryInMemory = 0;
+    dec->outFile = fopen(dec->outputPath, "wb");
+    if (!dec->outFile)
+    {
+        ReportOutputError(dec->outputPath, errno);
+        free(dec->entryData);
+        dec->entryData = NULL;
+        return 0; // Не можем извлечь, если не открылся файл
+    }
+    // Запись может уйти в файл раньше, чем что-то накоплено: тогда entryData == NULL
+    int ok = dec->entrySize == 0 || fwrite(dec->entryData, 1, dec->entrySize, dec->outFile) == dec->entrySize;
+    free(dec->entryData);
+    dec->entryData = NULL;
+    if (!ok)
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to output file: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Начинает извлечение записи: вывод в stdout, либо накопление в памяти до порога
+static void BeginEntry(DecodeContext *dec, size_t entry, const char *name, int skip)
+{
+    Report(HUFF_LOG_INFO, "\nProcessing archive entry %zu/%u: %s\n", entry + 1, dec->num_total_files, name);
+    dec->bytesWritten = 0;
+    if (skip)
+        Report(HUFF_LOG_INFO, "  Skipping file: %s\n", name);
+    else if (dec->testMode)
+    {
+        snprintf(dec->entryName, PATH_MAX, "%s", name);
+        dec->entryCorrupt = 0;
+        ContentHashInit(&dec->entryHash);
+    }
+    else if (dec->stdoutSink)
+        dec->outFile = dec->stdoutSink;
+    else
+    {
+        PrepareOutputPath(dec, name);
+        Report(HUFF_LOG_INFO, "  Extracting to: %s\n", dec->outputPath);
+        dec->entryInMemory = 1;
+        dec->entryData = NULL;
+        dec->entrySize = 0;
+    }
+}
+
+// Дописывает очередной фрагмент содержимого извлекаемой записи
+static int AppendEntry(DecodeContext *dec, size_t entry, const unsigned char *data, size_t size)
+{
+    if (dec->testMode)
+    {
+        ContentHashUpdate(&dec->entryHash, data, size);
+        dec->bytesWritten += size;
+        return 0;
+    }
+    if (dec->entryInMemory)
+    {
+        if (dec->entrySize + size <= BATCH_SMALL_FILE_LIMIT)
+        {
+            unsigned char *grown = realloc(dec->entryData, dec->entrySize + size);
+            if (!grown && dec->entrySize + size > 0)
+                return -1;
+            if (size > 0)
+                memcpy(grown + dec->entrySize, data, size);
+            dec->entryData = grown;
+            dec->entrySize += size;
+            dec->bytesWritten += size;
+            return 0;
         }
-        else
-            printf("  Skipping file: %s\n", filename_from_archive);
+        if (SpillToFile(dec) != 0)
+            return -1;
+    }
+    if (!dec->outFile)
+        return 0;
+    if (fwrite(data, 1, size, dec->outFile) != size ||
+        (dec->teeFile && fwrite(data, 1, size, dec->teeFile) != size))
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to output file: %s\n", strerror(errno));
+        return -1;
+    }
+    dec->bytesWritten += size;
+
+    // Обновление индикатора прогресса
+    Report(HUFF_LOG_PROGRESS, "\r  Decompressing entry %zu: %llu bytes", entry + 1, (unsigned long long)dec->bytesWritten);
+    return 0;
+}
 
-        uint64_t bytes_written_or_skipped = 0;
-        DecodingTreeNode *current_node = decoding_root;
-        int error_occurred_for_this_file = 0;
+// Ставит файл dec->outputPath в очередь пакетного создания; владение data переходит очереди
+static int QueueWrite(DecodeContext *dec, unsigned char *data, size_t size)
+{
+    BatchWrite *w = &dec->pending[dec->pendingCount];
+    w->path = strdup(dec->outputPath);
+    w->data = data;
+    w->size = size;
+    w->error = 0;
+    if (!w->path)
+    {
+        free(data);
+        return -1;
+    }
+    dec->pendingCount++;
+    if (dec->pendingCount == BATCH_MAX_FILES)
+        FlushPendingWrites(dec);
+    return 0;
+}
 
-        while (bytes_written_or_skipped < original_file_size_bytes)
+// Завершает запись: малая запись ставится в очередь пакетного создания, большая закрывается
+static int EndEntry(DecodeContext *dec)
+{
+    if (dec->entryInMemory)
+    {
+        dec->entryInMemory = 0;
+        unsigned char *data = dec->entryData;
+        dec->entryData = NULL;
+        return QueueWrite(dec, data, dec->entrySize);
+    }
+    if (dec->outFile)
+        Report(HUFF_LOG_INFO, "\n");
+    if (dec->outFile && dec->outFile != dec->stdoutSink)
+        fclose(dec->outFile);
+    dec->outFile = NULL;
+    return 0;
+}
+
+// Помечает проверяемую запись повреждённой (сообщается один раз на запись)
+static void MarkCorrupt(DecodeContext *dec, const char *reason)
+{
+    if (!dec->entryCorrupt)
+        Report(HUFF_LOG_ERROR, "Error: Entry %s is corrupted: %s.\n", dec->entryName, reason);
+    dec->entryCorrupt = 1;
+}
+
+// Завершает проверку записи; haveInfo — в архиве есть размер и хеш содержимого
+static void EndTestedEntry(DecodeContext *dec, int haveInfo, uint64_t size, uint64_t hash, size_t names)
+{
+    if (!dec->entryCorrupt && haveInfo && dec->bytesWritten != size)
+        MarkCorrupt(dec, "length mismatch");
+    else if (!dec->entryCorrupt && haveInfo && ContentHashFinal(&dec->entryHash) != hash)
+        MarkCorrupt(dec, "checksum mismatch");
+    dec->testedCount += names;
+    dec->testedBytes += dec->bytesWritten;
+    if (dec->entryCorrupt)
+        dec->corruptCount += names;
+}
+
+// Запоминает извлекаемые имена записи RECORD_COPIES, кроме основного
+static int BeginCopies(DecodeContext *dec, PipelineSlot *slot)
+{
+    dec->aliasCount = 0;
+    if (slot->skip)
+        return 0;
+
+    free(dec->aliases);
+    dec->aliases = malloc(slot->index->size);
+    if (!dec->aliases)
+        return -1;
+
+    BitReader *index = BitReaderCreateMemory(slot->index->data, slot->index->size);
+    if (!index)
+        return -1;
+    char *next = dec->aliases;
+    for (uint32_t n = 0; n < slot->memberCount; ++n)
+    {
+        uint16_t nameLen = BitReaderReadBits(index, 16);
+        BitReaderReadBytes(index, (unsigned char *)next, nameLen);
+        next[nameLen] = '\0';
+        if (strcmp(next, slot->name) != 0 && IsWanted(dec, next))
         {
-            while (!current_node->is_leaf)
-            {
-                int bit = BitReaderReadBit(reader);
-                if (bit == -1)
-                {
-                    if (bytes_written_or_skipped < original_file_size_bytes && original_file_size_bytes > 0)
-                    {
-                         fprintf(stderr, COLOR_STR("\nError: Unexpected end of archive data while decompressing %s. File may be incomplete (%llu/%llu processed).\n", RED),
-                                filename_from_archive, bytes_written_or_skipped, original_file_size_bytes);
-                    }
-                    error_occurred_for_this_file = 1;
-                    goto end_of_current_file_processing;
-                }
+            next += nameLen + 1;
+            dec->aliasCount++;
+        }
+    }
+    BitReaderClose(index);
+
+    // В stdout копии выводятся повторно: содержимое сохраняется во временный файл
+    if (dec->aliasCount > 0 && dec->stdoutSink && !(dec->teeFile = tmpfile()))
+    {
+        Report(HUFF_LOG_ERROR, "Error creating temporary file: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
 
-                current_node = (bit == 0) ? current_node->child0 : current_node->child1;
+static int CopyStream(FILE *from, FILE *to)
+{
+    unsigned char buffer[64 * 1024];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), from)) > 0)
+        if (fwrite(buffer, 1, got, to) != got)
+            return -1;
+    return ferror(from) ? -1 : 0;
+}
 
-                if (current_node == NULL)
-                {
-                    fprintf(stderr, COLOR_STR("\nError: Invalid Huffman code sequence in archive for %s. Corrupted data.\n", RED), filename_from_archive);
-                    error_occurred_for_this_file = 1;
-                    goto end_of_current_file_processing;
-                }
-            }
+// Создаёт копии извлечённой записи под остальными именами и завершает запись
+static int EndCopies(DecodeContext *dec)
+{
+    char primaryPath[PATH_MAX];
+    memcpy(primaryPath, dec->outputPath, PATH_MAX);
+    int inMemory = dec->entryInMemory;
+    int toFile = dec->outFile && dec->outFile != dec->stdoutSink;
+    int failed = 0;
 
-            uint16_t decoded_symbol_value = current_node->symbol;
+    const char *alias = dec->aliases;
+    for (size_t n = 0; n < dec->aliasCount && !failed && inMemory; ++n, alias += strlen(alias) + 1)
+    {
+        unsigned char *copy = malloc(dec->entrySize);
+        if (!copy && dec->entrySize > 0)
+            return -1;
+        if (dec->entrySize > 0)
+            memcpy(copy, dec->entryData, dec->entrySize);
+        PrepareOutputPath(dec, alias);
+        Report(HUFF_LOG_INFO, "  Extracting copy to: %s\n", dec->outputPath);
+        failed = QueueWrite(dec, copy, dec->entrySize) != 0;
+    }
+    memcpy(dec->outputPath, primaryPath, PATH_MAX);
+    if (failed || EndEntry(dec) != 0)
+        return -1;
+    if (inMemory)
+        return 0;
 
-            if (should_extract && outFile)
+    // Большие записи и stdout: повторное чтение уже записанного содержимого
+    FILE *source = toFile ? fopen(primaryPath, "rb") : dec->teeFile;
+    if (!source)
+        return dec->aliasCount > 0 && (toFile || dec->stdoutSink) ? -1 : 0;
+    alias = dec->aliases;
+    for (size_t n = 0; n < dec->aliasCount && !failed; ++n, alias += strlen(alias) + 1)
+    {
+        FILE *target = dec->stdoutSink;
+        if (toFile)
+        {
+            PrepareOutputPath(dec, alias);
+            Report(HUFF_LOG_INFO, "  Extracting copy to: %s\n", dec->outputPath);
+            if (!(target = fopen(dec->outputPath, "wb")))
             {
-                if (symbol_size_val == 1)
-                {
-                    uint8_t sym_byte_to_write = (uint8_t)decoded_symbol_value;
-                    if (fwrite(&sym_byte_to_write, 1, 1, outFile) != 1)
-                    {
-                        perror(COLOR_STR("Error writing byte to output file", RED));
-                        error_occurred_for_this_file = 1;
-                        goto end_of_current_file_processing;
-                    }
-                    bytes_written_or_skipped++;
-                }
-                else if (symbol_size_val == 2)
-                {
-                    unsigned char s_bytes[2];
-                    s_bytes[0] = (unsigned char)(decoded_symbol_value >> 8);
-                    s_bytes[1] = (unsigned char)(decoded_symbol_value & 0xFF);
-
-                    if (bytes_written_or_skipped < original_file_size_bytes)
-                    {
-                        if (fwrite(&s_bytes[0], 1, 1, outFile) != 1)
-                        {
-                            perror(COLOR_STR("Error writing first byte of 2-byte symbol", RED));
-                            error_occurred_for_this_file = 1; goto end_of_current_file_processing;
-                        }
-                        bytes_written_or_skipped++;
-                    }
-
-                    if (bytes_written_or_skipped < original_file_size_bytes)
-                    {
-                        if (fwrite(&s_bytes[1], 1, 1, outFile) != 1)
-                        {
-                            perror(COLOR_STR("Error writing second byte of 2-byte symbol", RED));
-                            error_occurred_for_this_file = 1; goto end_of_current_file_processing;
-                        }
-                        bytes_written_or_skipped++;
-                    }
-                }
+                ReportOutputError(dec->outputPath, errno);
+                continue;
             }
+        }
+        rewind(source);
+        failed = CopyStream(source, target) != 0;
+        if (failed)
+            Report(HUFF_LOG_ERROR, "Error writing to output file: %s\n", strerror(errno));
+        if (toFile && fclose(target) != 0)
+            failed = 1;
+    }
+    fclose(source);
+    dec->teeFile = NULL;
+    return failed ? -1 : 0;
+}
+
+// Оставляет от фрагмента записи, начинающегося со смещения position, только часть внутри диапазона
+static void ClipToRange(const DecodeContext *dec, uint64_t position, const unsigned char **data, size_t *size)
+{
+    if (position >= dec->rangeEnd)
+    {
+        *size = 0;
+        return;
+    }
+    uint64_t from = position > dec->rangeStart ? position : dec->rangeStart;
+    uint64_t to = dec->rangeEnd - position > *size ? position + *size : dec->rangeEnd;
+    if (from >= to)
+    {
+        *size = 0;
+        return;
+    }
+    *data += from - position;
+    *size = (size_t)(to - from);
+}
+
+// Извлекает файлы solid-блока по списку из slot->index
+static int WriteSolidMembers(DecodeContext *dec, PipelineSlot *slot)
+{
+    BitReader *index = BitReaderCreateMemory(slot->index->data, slot->index->size);
+    if (!index)
+        return 1;
+
+    char name[PATH_MAX];
+    int failed = 0;
+    for (uint32_t m = 0; m < slot->memberCount && !failed; ++m)
+    {
+        uint16_t nameLen = BitReaderReadBits(index, 16);
+        BitReaderReadBytes(index, (unsigned char *)name, nameLen);
+        name[nameLen] = '\0';
+        uint32_t offset = ReadUint32(index);
+        uint32_t size = ReadUint32(index);
+
+        int skip = slot->skip || !IsWanted(dec, name);
+        if (!skip && ((uint64_t)offset + size > slot->rawSize))
+        {
+            Report(HUFF_LOG_ERROR, "Error: Solid record member %s is out of block bounds. Corrupted data.\n", name);
+            failed = 1;
+            break;
+        }
+        BeginEntry(dec, slot->entry + m, name, skip);
+        const unsigned char *data = slot->raw + offset;
+        size_t dataSize = size;
+        if (dec->rangeMode)
+            ClipToRange(dec, 0, &data, &dataSize);
+        if (dec->testMode && !skip)
+        {
+            // У членов solid-группы нет собственных сведений о файле: проверяется декодирование блока
+            if (slot->failed)
+                MarkCorrupt(dec, "solid block is corrupted");
             else
+                AppendEntry(dec, slot->entry + m, data, dataSize);
+            EndTestedEntry(dec, 0, 0, 0, 1);
+            continue;
+        }
+        if (!skip)
+            failed = AppendEntry(dec, slot->entry + m, data, dataSize) != 0;
+        if (!failed)
+            failed = EndEntry(dec) != 0;
+    }
+    BitReaderClose(index);
+    return failed;
+}
+
+// Стадия записи: ячейки приходят в порядке следования в архиве
+static int WriteExtracted(void *ctx, PipelineSlot *slot)
+{
+    DecodeContext *dec = ctx;
+
+    switch (slot->kind)
+    {
+        case PIPE_ITEM_BEGIN:
+            BeginEntry(dec, slot->entry, slot->name, slot->skip);
+            dec->testedNames = slot->memberCount > 0 ? slot->memberCount : 1;
+            if (slot->memberCount > 0 && !dec->testMode && BeginCopies(dec, slot) != 0)
+                return 1;
+            break;
+
+        case PIPE_ITEM_DATA:
+        {
+            const unsigned char *data = slot->raw;
+            size_t size = slot->rawSize;
+            if (dec->rangeMode)
+                ClipToRange(dec, slot->position, &data, &size);
+            if (slot->failed)
             {
-                if (symbol_size_val == 1)
-                    if (bytes_written_or_skipped < original_file_size_bytes)
-                        bytes_written_or_skipped++;
-                else if (symbol_size_val == 2)
-                {
-                    if (bytes_written_or_skipped < original_file_size_bytes)
-                        bytes_written_or_skipped++; // Для первого "логического" байта символа
-                    if (bytes_written_or_skipped < original_file_size_bytes)
-                        bytes_written_or_skipped++; // Для второго "логического" байта символа
-                }
+                char reason[64];
+                snprintf(reason, sizeof(reason), "block at offset %llu is corrupted", (unsigned long long)slot->position);
+                MarkCorrupt(dec, reason);
             }
-            
-            current_node = decoding_root; // Сбрасываем на корень для следующего символа
+            else if (AppendEntry(dec, slot->entry, data, size) != 0)
+                return 1;
+            break;
+        }
 
-            // Обновление индикатора прогресса
-            if (opened_successfully_for_writing && (bytes_written_or_skipped % 102400 == 0 || bytes_written_or_skipped == original_file_size_bytes))
+        case PIPE_ITEM_END:
+            if (dec->testMode)
             {
-                printf("\r  Decompressing %s: %llu / %llu bytes (%.2f%%)",
-                       filename_from_archive, (unsigned long long)bytes_written_or_skipped,
-                       (unsigned long long)original_file_size_bytes,
-                       original_file_size_bytes > 0 ? (double)bytes_written_or_skipped * 100.0 / original_file_size_bytes : 100.0);
-                fflush(stdout);
+                if (!slot->skip)
+                    EndTestedEntry(dec, slot->hasInfo, slot->position, slot->digest, dec->testedNames);
+                break;
             }
-        }
+            if ((dec->aliasCount > 0 ? EndCopies(dec) : EndEntry(dec)) != 0)
+                return 1;
+            dec->aliasCount = 0;
+            break;
+
+        case PIPE_ITEM_SOLID:
+            return WriteSolidMembers(dec, slot);
+
+        case PIPE_ITEM_REUSE:
+            break; // Только при сжатии
+    }
+    return 0;
+}
 
-    end_of_current_file_processing:; // Метка для выхода из цикла обработки содержимого файла
+// Открывает архив и разбирает заголовок; при успехе dec->reader готов к чтению записей
+static int OpenArchive(DecodeContext *dec, const char *archivePath, const Dictionary *dictionary)
+{
+    BitReader *reader = IsStdStream(archivePath) ? BitReaderOpenStream(stdin, 0) : BitReaderOpen(archivePath);
+    if (!reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening input archive for reading: %s\n", strerror(errno));
+        return -1;
+    }
 
-        if (opened_successfully_for_writing)
-             printf("\n");
-        if (outFile)
+    char magic_read[5] = {0};
+    for (size_t i = 0; i < strlen(ARCHIVE_MAGIC); ++i)
+    {
+        magic_read[i] = (char)BitReaderReadBits(reader, 8);
+    }
+    if (strncmp(magic_read, ARCHIVE_MAGIC, strlen(ARCHIVE_MAGIC)) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Not a valid Huffman archive (magic bytes mismatch).\n");
+        BitReaderClose(reader);
+        return -1;
+    }
+
+    uint8_t version = BitReaderReadBits(reader, 8);
+    if (version < ARCHIVE_MIN_VERSION || version > ARCHIVE_VERSION)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Unsupported archive version (%u). Expected %u..%u.\n", version, ARCHIVE_MIN_VERSION, ARCHIVE_VERSION);
+        BitReaderClose(reader);
+        return -1;
+    }
+
+    uint8_t symbol_size_val = BitReaderReadBits(reader, 8);
+    if (symbol_size_val != 1 && symbol_size_val != 2)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive contains invalid symbol_size (%u).\n", symbol_size_val);
+        BitReaderClose(reader);
+        return -1;
+    }
+
+    // Словарь проверяется до разбора записей: с чужой таблицей данные декодировались бы в мусор
+    uint32_t dictId = version >= 4 ? BitReaderReadBits(reader, 32) : DICT_ID_NONE;
+    if (dictId != DICT_ID_NONE && !dictionary)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive was compressed with dictionary %08x. Pass it with --dict.\n", dictId);
+        BitReaderClose(reader);
+        return -1;
+    }
+    if (dictId != DICT_ID_NONE && (dictionary->id != dictId || dictionary->symbolSize != symbol_size_val))
+    {
+        Report(HUFF_LOG_ERROR, "Error: Dictionary mismatch: archive needs %08x, given %08x.\n", dictId, dictionary->id);
+        BitReaderClose(reader);
+        return -1;
+    }
+
+    if (dictId == DICT_ID_NONE && dictionary)
+        Report(HUFF_LOG_WARNING, "Warning: Archive does not use a dictionary, --dict is ignored.\n");
+
+    dec->table = dictId != DICT_ID_NONE ? dictionary->table : NULL;
+    dec->reader = reader;
+    dec->version = version;
+    dec->num_total_files = BitReaderReadBits(reader, 32);
+    Report(HUFF_LOG_INFO, "Archive contains %u file(s). Symbol size: %u byte(s).\n", dec->num_total_files, symbol_size_val);
+    return 0;
+}
+
+// Разбор архива, декодирование блоков и запись файлов идут параллельно.
+// Закрывает архив и вывод; возвращает 0, если всё извлечено без ошибок
+static int RunDecoder(DecodeContext *dec, uint32_t threads, int allowUring)
+{
+    int failed = 1;
+    dec->io = BatchIOCreate(allowUring);
+    if (!dec->io)
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for batch I/O.\n");
+    else
+        failed = RunPipeline(threads, ReadArchive, DecodeSlot, WriteExtracted, dec);
+
+    FlushPendingWrites(dec);
+    BatchIODestroy(dec->io);
+    free(dec->entryData);
+    free(dec->aliases);
+    if (dec->teeFile)
+        fclose(dec->teeFile);
+    if (dec->outFile && dec->outFile != dec->stdoutSink)
+        fclose(dec->outFile);
+    // Ошибка записи в stdout могла случиться при любом fwrite: проверяется и флаг потока
+    int sinkFailed = dec->stdoutSink && (fflush(dec->stdoutSink) != 0 || ferror(dec->stdoutSink));
+    if (dec->stdoutSink && fclose(dec->stdoutSink) != 0)
+        sinkFailed = 1;
+    if (sinkFailed && !failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to output file: %s\n", strerror(errno));
+        failed = 1;
+    }
+    BitReaderClose(dec->reader);
+    return failed;
+}
+
+int DecodeArchive(const char *archivePath, const char *outputDir, const char **wantedFiles, size_t wantedCount, int extractAll, uint32_t threads, int allowUring,
+                  const Dictionary *dictionary)
+{
+    if (!archivePath || !outputDir)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to DecodeArchive.\n");
+        return 1;
+    }
+
+    DecodeContext dec = {0};
+    if (OpenArchive(&dec, archivePath, dictionary) != 0)
+        return 1;
+    dec.outputDir = outputDir;
+    dec.wantedFiles = wantedFiles;
+    dec.wantedCount = wantedCount;
+    dec.extractAll = extractAll;
+
+    if (IsStdStream(outputDir))
+    {
+        dec.stdoutSink = TakeStdout();
+        if (!dec.stdoutSink)
         {
-            fclose(outFile);
-            outFile = NULL;
+            Report(HUFF_LOG_ERROR, "Error opening stdout for writing: %s\n", strerror(errno));
+            BitReaderClose(dec.reader);
+            return 1;
         }
+    }
+    else if (CreateDirectoryRecursive(outputDir) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Could not create output directory: %s (errno: %d, message: %s)\n",
+               outputDir, errno, strerror(errno));
+        BitReaderClose(dec.reader);
+        return 1;
+    }
 
-        FreeDecodingTree(decoding_root);
-        free(filename_from_archive);
+    if (RunDecoder(&dec, threads, allowUring) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: An error occurred while processing the archive. Archive is corrupted.\n");
+        return 1;
+    }
+    Report(HUFF_LOG_SUCCESS, "\nDecompression finished.\n");
+    return 0;
+}
 
-        if (error_occurred_for_this_file && file_idx < num_total_files - 1) {
-            fprintf(stderr, COLOR_STR("Warning: An error occurred processing file %s. Subsequent files may be affected.\n", YELLOW), filename_from_archive);
-            BitReaderClose(reader);
-        }
+int DecodeRange(const char *archivePath, const char *entryName, uint64_t offset, uint64_t length, const char *outputPath,
+                uint32_t threads, const Dictionary *dictionary)
+{
+    if (!archivePath || !entryName || !outputPath)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to DecodeRange.\n");
+        return 1;
+    }
+
+    DecodeContext dec = {0};
+    if (OpenArchive(&dec, archivePath, dictionary) != 0)
+        return 1;
+    dec.wantedFiles = &entryName;
+    dec.wantedCount = 1;
+    dec.rangeMode = 1;
+    dec.rangeStart = offset;
+    dec.rangeEnd = length > UINT64_MAX - offset ? UINT64_MAX : offset + length;
+
+    // Весь вывод — одна последовательность байт, как при распаковке в stdout
+    dec.stdoutSink = IsStdStream(outputPath) ? TakeStdout() : fopen(outputPath, "wb");
+    if (!dec.stdoutSink)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening output file for writing: %s\n", strerror(errno));
+        BitReaderClose(dec.reader);
+        return 1;
+    }
+
+    int failed = RunDecoder(&dec, threads, 0);
+    if (!failed && !dec.rangeFound)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Entry %s not found in the archive.\n", entryName);
+        failed = 1;
+    }
+    else if (!failed && offset > 0 && offset >= dec.rangeEntrySize)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Offset %llu is beyond the end of %s (%llu bytes).\n",
+               (unsigned long long)offset, entryName, (unsigned long long)dec.rangeEntrySize);
+        failed = 1;
+    }
+    // Недописанный файл удаляется, а устройство или канал (-o /dev/full) остаётся
+    struct stat outputStat;
+    if (failed)
+    {
+        if (!IsStdStream(outputPath) && stat(outputPath, &outputStat) == 0 && S_ISREG(outputStat.st_mode))
+            remove(outputPath);
+        return 1;
     }
-    BitReaderClose(reader);
-    printf(COLOR_STR("\nDecompression finished.\n", GREEN));
+
+    uint64_t end = dec.rangeEnd < dec.rangeEntrySize ? dec.rangeEnd : dec.rangeEntrySize;
+    Report(HUFF_LOG_SUCCESS, "\nExtracted %llu bytes of %s starting at offset %llu.\n", (unsigned long long)(end - offset),
+           entryName, (unsigned long long)offset);
+    return 0;
+}
+
+static double ElapsedSeconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int TestArchive(const char *archivePath, const char **wantedFiles, size_t wantedCount, uint32_t threads,
+                const Dictionary *dictionary)
+{
+    if (!archivePath)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to TestArchive.\n");
+        return 1;
+    }
+
+    DecodeContext dec = {0};
+    if (OpenArchive(&dec, archivePath, dictionary) != 0)
+        return 1;
+    dec.wantedFiles = wantedFiles;
+    dec.wantedCount = wantedCount;
+    dec.extractAll = wantedCount == 0;
+    dec.testMode = 1;
+    if (dec.version < RECORD_INFO_VERSION)
+        Report(HUFF_LOG_WARNING, "Warning: Archive version %u stores no checksums; only block decoding is verified.\n", dec.version);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int failed = RunDecoder(&dec, threads, 0);
+    double seconds = ElapsedSeconds(&start);
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive structure is damaged; the test stopped after %zu file(s).\n", dec.testedCount);
+        return 1;
+    }
+
+    double megabytes = (double)dec.testedBytes / (1024.0 * 1024.0);
+    Report(HUFF_LOG_INFO, "\nTested %zu file(s), %.1f MiB in %.2f s (%.1f MiB/s).\n", dec.testedCount, megabytes, seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+    if (dec.corruptCount > 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: %zu file(s) are corrupted.\n", dec.corruptCount);
+        return 1;
+    }
+    Report(HUFF_LOG_SUCCESS, "No errors found.\n");
     return 0;
-}
\ No newline at end of file
+}
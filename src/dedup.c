@@ -0,0 +1,177 @@
+#include "dedup.h"
+#include "hash.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define DEDUP_READ_CHUNK (256 * 1024)
+
+typedef struct
+{
+    size_t index;
+    uint64_t size;
+    uint64_t hash;
+    int hashed;
+} DedupCandidate;
+
+static int CompareBySize(const void *a, const void *b)
+{
+    const DedupCandidate *x = a, *y = b;
+    if (x->size != y->size)
+        return x->size < y->size ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+// Внутри группы одного размера: по хешу, затем по порядку в списке,
+// чтобы первой в цепочке копий оказался файл, который архивируется раньше остальных
+static int CompareByHash(const void *a, const void *b)
+{
+    const DedupCandidate *x = a, *y = b;
+    if (x->hashed != y->hashed)
+        return x->hashed ? -1 : 1;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+int HashFile(const char *path, uint64_t *hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    unsigned char *buffer = malloc(DEDUP_READ_CHUNK);
+    if (!buffer)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    ContentHash state;
+    ContentHashInit(&state);
+    size_t got;
+    while ((got = fread(buffer, 1, DEDUP_READ_CHUNK, file)) > 0)
+        ContentHashUpdate(&state, buffer, got);
+    int failed = ferror(file);
+
+    free(buffer);
+    fclose(file);
+    if (failed)
+        return -1;
+    *hash = ContentHashFinal(&state);
+    return 0;
+}
+
+// Побайтовое сравнение двух файлов; 1 — содержимое совпадает
+static int SameContent(const char *pathA, const char *pathB)
+{
+    FILE *a = fopen(pathA, "rb");
+    FILE *b = fopen(pathB, "rb");
+    unsigned char *bufA = malloc(DEDUP_READ_CHUNK);
+    unsigned char *bufB = malloc(DEDUP_READ_CHUNK);
+    int same = a && b && bufA && bufB;
+
+    while (same)
+    {
+        size_t gotA = fread(bufA, 1, DEDUP_READ_CHUNK, a);
+        size_t gotB = fread(bufB, 1, DEDUP_READ_CHUNK, b);
+        if (gotA != gotB || memcmp(bufA, bufB, gotA) != 0 || ferror(a) || ferror(b))
+            same = 0;
+        else if (gotA == 0)
+            break;
+    }
+
+    free(bufA);
+    free(bufB);
+    if (a)
+        fclose(a);
+    if (b)
+        fclose(b);
+    return same;
+}
+
+// Связывает копии внутри группы файлов одного размера
+static void LinkCopies(const FileList *files, DedupCandidate *group, size_t count, DedupPlan *plan)
+{
+    for (size_t k = 0; k < count; ++k)
+        group[k].hashed = HashFile(FileListPath(files, group[k].index), &group[k].hash) == 0;
+    qsort(group, count, sizeof(DedupCandidate), CompareByHash);
+
+    for (size_t first = 0; first < count;)
+    {
+        size_t end = first + 1;
+        while (end < count && group[end].hashed && group[first].hashed && group[end].hash == group[first].hash)
+            end++;
+
+        size_t original = group[first].index;
+        size_t tail = original;
+        size_t names = 1;
+        for (size_t k = first + 1; k < end && names < DEDUP_MAX_NAMES; ++k)
+        {
+            size_t index = group[k].index;
+            if (!SameContent(FileListPath(files, original), FileListPath(files, index)))
+                continue; // Коллизия хеша: файл остаётся самостоятельным
+            plan->original[index] = original;
+            plan->nextCopy[tail] = index;
+            tail = index;
+            names++;
+            plan->copyCount++;
+            plan->copyBytes += group[k].size;
+        }
+        first = end;
+    }
+}
+
+int BuildDedupPlan(const FileList *files, DedupPlan *plan)
+{
+    memset(plan, 0, sizeof(DedupPlan));
+    plan->original = malloc(files->count * sizeof(size_t));
+    plan->nextCopy = malloc(files->count * sizeof(size_t));
+    DedupCandidate *candidates = malloc(files->count * sizeof(DedupCandidate));
+    if (!plan->original || !plan->nextCopy || !candidates)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for deduplication.\n");
+        free(candidates);
+        FreeDedupPlan(plan);
+        return -1;
+    }
+
+    // Копиями могут быть только непустые обычные файлы одного размера
+    size_t count = 0;
+    for (size_t i = 0; i < files->count; ++i)
+    {
+        plan->original[i] = i;
+        plan->nextCopy[i] = DEDUP_NONE;
+        const FileEntry *entry = &files->entries[i];
+        if (!IsStdStream(FileListPath(files, i)) && S_ISREG(entry->mode) && entry->size > 0)
+            candidates[count++] = (DedupCandidate){i, entry->size, 0, 0};
+    }
+    qsort(candidates, count, sizeof(DedupCandidate), CompareBySize);
+
+    for (size_t first = 0; first < count;)
+    {
+        size_t end = first + 1;
+        while (end < count && candidates[end].size == candidates[first].size)
+            end++;
+        if (end - first > 1)
+            LinkCopies(files, candidates + first, end - first, plan);
+        first = end;
+    }
+
+    free(candidates);
+    if (plan->copyCount > 0)
+        Report(HUFF_LOG_INFO, "Found %zu duplicate file(s), %llu bytes stored once.\n",
+               plan->copyCount, (unsigned long long)plan->copyBytes);
+    return 0;
+}
+
+void FreeDedupPlan(DedupPlan *plan)
+{
+    free(plan->original);
+    free(plan->nextCopy);
+    plan->original = NULL;
+    plan->nextCopy = NULL;
+}
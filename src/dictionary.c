@@ -0,0 +1,239 @@
+#include "dictionary.h"
+#include "bitstream.h"
+#include "huffman.h"
+#include "kernels.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Длины кодов встроенной таблицы для ASCII-текста, построенной по исходным текстам на C и Python,
+// лицензиям, журналам и JSON (5.2 бита на символ на этих образцах). Управляющие байты
+// и байты UTF-8 получают коды не длиннее 15 бит, чтобы таблица оставалась пригодной для любых данных
+static const uint8_t BuiltinAsciiLengths[256] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15,  8,  5, 15, 15, 12, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+     2, 12,  6,  9, 12, 11, 11,  9,  8,  8,  8, 10,  6,  8,  7,  6,
+     7,  7,  8,  9,  9,  9,  9, 10,  9, 10,  7,  9,  9,  8,  9, 12,
+    11,  7,  8,  7,  9,  8,  9,  9, 10,  8, 12, 11,  8,  9,  8,  8,
+     9, 12,  8,  8,  8,  9, 10, 10, 10, 10, 12,  9, 10,  9, 13,  6,
+    11,  5,  6,  6,  6,  4,  6,  7,  6,  5, 10,  8,  5,  6,  5,  5,
+     6, 10,  5,  5,  5,  6,  8,  8,  8,  7, 10,  9, 12,  9, 13, 15,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 13, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 13, 13, 13, 12, 13, 13,
+    12, 12, 12, 13, 12, 13, 13, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    15, 15, 13, 14, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    14, 14, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 13, 14, 12, 10, 10, 10, 10, 11, 14, 13, 12, 13, 15, 14,
+    13, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+};
+
+// Идентификатор обученного словаря — FNV-1a от его параметров и длин кодов.
+// Значения DICT_ID_NONE и DICT_ID_BUILTIN_ASCII зарезервированы
+static uint32_t ComputeDictionaryId(const uint8_t *lengths, uint32_t symbolCount, uint32_t symbolSize)
+{
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ symbolSize) * 16777619u;
+    for (uint32_t i = 0; i < symbolCount; ++i)
+        hash = (hash ^ lengths[i]) * 16777619u;
+    if (hash == DICT_ID_NONE || hash == DICT_ID_BUILTIN_ASCII)
+        hash += 2;
+    return hash;
+}
+
+static Dictionary *CreateDictionary(uint32_t id, uint32_t symbolSize, const uint8_t *lengths)
+{
+    Dictionary *dict = malloc(sizeof(Dictionary));
+    if (!dict)
+        return NULL;
+    dict->id = id;
+    dict->symbolSize = symbolSize;
+    dict->table = CodecTableCreate(lengths, symbolSize);
+    if (!dict->table)
+    {
+        free(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+Dictionary *DictionaryLoad(const char *path)
+{
+    if (strcmp(path, DICT_BUILTIN_NAME) == 0)
+        return CreateDictionary(DICT_ID_BUILTIN_ASCII, 1, BuiltinAsciiLengths);
+
+    BitReader *reader = BitReaderOpen(path);
+    if (!reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening dictionary %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    char magic[5] = {0};
+    for (size_t i = 0; i < strlen(DICT_MAGIC); ++i)
+        magic[i] = (char)BitReaderReadBits(reader, 8);
+    uint8_t version = BitReaderReadBits(reader, 8);
+    uint8_t symbolSize = BitReaderReadBits(reader, 8);
+    uint32_t id = BitReaderReadBits(reader, 32);
+    if (strcmp(magic, DICT_MAGIC) != 0 || version != DICT_VERSION || (symbolSize != 1 && symbolSize != 2))
+    {
+        Report(HUFF_LOG_ERROR, "Error: %s is not a valid dictionary file.\n", path);
+        BitReaderClose(reader);
+        return NULL;
+    }
+
+    uint32_t symbolCount = 1U << (symbolSize * 8);
+    uint8_t *lengths = malloc(symbolCount);
+    Dictionary *dict = NULL;
+    if (!lengths)
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for dictionary.\n");
+    else if (BitReaderReadBytes(reader, lengths, symbolCount) != symbolCount)
+        Report(HUFF_LOG_ERROR, "Error: Dictionary %s is truncated.\n", path);
+    else if (ComputeDictionaryId(lengths, symbolCount, symbolSize) != id)
+        Report(HUFF_LOG_ERROR, "Error: Dictionary %s is corrupted (id mismatch).\n", path);
+    else if (!(dict = CreateDictionary(id, symbolSize, lengths)))
+        Report(HUFF_LOG_ERROR, "Error: Dictionary %s contains invalid code lengths.\n", path);
+
+    free(lengths);
+    BitReaderClose(reader);
+    return dict;
+}
+
+void DictionaryFree(Dictionary *dict)
+{
+    if (!dict)
+        return;
+    CodecTableDestroy(dict->table);
+    free(dict);
+}
+
+// Суммирует частоты символов всех образцов; чтение блоками по BLOCK_SIZE, как при сжатии
+static int CountCorpus(const FileList *files, uint32_t symbolSize, uint64_t *freq, uint64_t *totalBytes)
+{
+    unsigned char *buffer = malloc(BLOCK_SIZE);
+    if (!buffer)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for training buffer.\n");
+        return -1;
+    }
+
+    int failed = 0;
+    for (size_t f = 0; f < files->count && !failed; ++f)
+    {
+        const char *path = FileListPath(files, f);
+        FILE *in = IsStdStream(path) ? stdin : fopen(path, "rb");
+        if (!in)
+        {
+            Report(HUFF_LOG_ERROR, "Error opening sample file %s: %s\n", path, strerror(errno));
+            failed = 1;
+            break;
+        }
+
+        size_t got;
+        while ((got = fread(buffer, 1, BLOCK_SIZE, in)) > 0)
+        {
+            GetKernels()->histogram(freq, buffer, got, symbolSize);
+            *totalBytes += got;
+        }
+        if (ferror(in))
+        {
+            Report(HUFF_LOG_ERROR, "Error reading sample file %s: %s\n", path, strerror(errno));
+            failed = 1;
+        }
+        if (in != stdin)
+            fclose(in);
+    }
+
+    free(buffer);
+    return failed ? -1 : 0;
+}
+
+int TrainDictionary(const FileList *files, uint32_t symbolSize, const char *outputPath)
+{
+    if (!files || !outputPath || (symbolSize != 1 && symbolSize != 2))
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to TrainDictionary.\n");
+        return 1;
+    }
+
+    uint32_t symbolCount = 1U << (symbolSize * 8);
+    uint64_t *samples = calloc(symbolCount, sizeof(uint64_t));
+    uint64_t *freq = malloc(symbolCount * sizeof(uint64_t));
+    uint8_t *lengths = malloc(symbolCount);
+    HuffScratch *scratch = HuffScratchCreate();
+    uint64_t totalBytes = 0;
+    int result = 1;
+
+    if (!samples || !freq || !lengths || !scratch)
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for training.\n");
+    else if (CountCorpus(files, symbolSize, samples, &totalBytes) == 0)
+    {
+        // Каждый символ получает код, даже если не встретился в образцах:
+        // иначе словарь не сможет закодировать новые данные
+        for (uint32_t i = 0; i < symbolCount; ++i)
+            freq[i] = samples[i] + 1;
+
+        const HuffCode *codes = NULL;
+        for (;;)
+        {
+            codes = GenerateCodesFromFrequencies(scratch, freq, symbolSize);
+            if (!codes)
+                break;
+            uint32_t maxLength = 0;
+            for (uint32_t i = 0; i < symbolCount; ++i)
+                if (codes[i].code_len > maxLength)
+                    maxLength = codes[i].code_len;
+            if (maxLength <= CODEC_TABLE_MAX_CODE_LEN)
+                break;
+
+            // Коды слишком длинные: уменьшаем разброс частот и строим дерево заново
+            for (uint32_t i = 0; i < symbolCount; ++i)
+                freq[i] = (freq[i] + 1) / 2;
+        }
+
+        if (!codes)
+            Report(HUFF_LOG_ERROR, "Error generating Huffman codes for dictionary.\n");
+        else
+        {
+            uint64_t bits = 0, symbols = 0;
+            for (uint32_t i = 0; i < symbolCount; ++i)
+            {
+                lengths[i] = (uint8_t)codes[i].code_len;
+                bits += samples[i] * codes[i].code_len;
+                symbols += samples[i];
+            }
+            uint32_t id = ComputeDictionaryId(lengths, symbolCount, symbolSize);
+
+            BitWriter *writer = IsStdStream(outputPath) ? BitWriterOpenStream(TakeStdout(), 1) : BitWriterOpen(outputPath);
+            if (!writer)
+                Report(HUFF_LOG_ERROR, "Error opening dictionary for writing: %s\n", strerror(errno));
+            else
+            {
+                for (size_t i = 0; i < strlen(DICT_MAGIC); ++i)
+                    BitWriterWriteBits(writer, DICT_MAGIC[i], 8);
+                BitWriterWriteBits(writer, DICT_VERSION, 8);
+                BitWriterWriteBits(writer, symbolSize, 8);
+                BitWriterWriteBits(writer, id, 32);
+                BitWriterWriteBytes(writer, lengths, symbolCount);
+                if (BitWriterClose(writer) != 0)
+                    Report(HUFF_LOG_ERROR, "Error writing dictionary: %s\n", strerror(errno));
+                else
+                {
+                    Report(HUFF_LOG_INFO, "Trained on %zu file(s), %llu bytes: %.2f bits per symbol on the samples.\n",
+                           files->count, (unsigned long long)totalBytes, symbols ? (double)bits / symbols : 0.0);
+                    Report(HUFF_LOG_SUCCESS, "Dictionary %08x saved: %s\n", id, IsStdStream(outputPath) ? "<stdout>" : outputPath);
+                    result = 0;
+                }
+            }
+        }
+    }
+
+    HuffScratchDestroy(scratch);
+    free(lengths);
+    free(freq);
+    free(samples);
+    return result;
+}
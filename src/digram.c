@@ -0,0 +1,118 @@
+#include "digram.h"
+
+#include <string.h>
+
+typedef struct
+{
+    uint32_t occurrences;
+    uint16_t digram;
+} Candidate;
+
+// Кандидаты хранятся в куче с наименьшим числом вхождений в корне: новая пара вытесняет
+// корень, если встречается чаще
+static void SiftDown(Candidate *heap, uint32_t size, uint32_t i)
+{
+    for (;;)
+    {
+        uint32_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && heap[left].occurrences < heap[smallest].occurrences)
+            smallest = left;
+        if (right < size && heap[right].occurrences < heap[smallest].occurrences)
+            smallest = right;
+        if (smallest == i)
+            return;
+        Candidate tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void Consider(Candidate *heap, uint32_t *size, uint32_t limit, uint16_t digram, uint32_t occurrences)
+{
+    if (occurrences < DIGRAM_MIN_OCCURRENCES)
+        return;
+    if (*size < limit)
+    {
+        uint32_t i = (*size)++;
+        heap[i] = (Candidate){occurrences, digram};
+        while (i && heap[i].occurrences < heap[(i - 1) / 2].occurrences)
+        {
+            Candidate tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    }
+    else if (occurrences > heap[0].occurrences)
+    {
+        heap[0] = (Candidate){occurrences, digram};
+        SiftDown(heap, *size, 0);
+    }
+}
+
+void DigramSelect(DigramAlphabet *alphabet, const unsigned char *data, size_t size, uint32_t maxDigrams)
+{
+    for (uint32_t k = 0; k < alphabet->count; ++k)
+        alphabet->symbols[alphabet->digrams[k]] = 0;
+    alphabet->count = 0;
+    if (maxDigrams > DIGRAM_MAX_COUNT)
+        maxDigrams = DIGRAM_MAX_COUNT;
+    if (size < 2 || maxDigrams == 0)
+        return;
+
+    // Пересекающиеся пары тоже считаются: «aaa» даёт две пары «aa», хотя жадный разбор
+    // возьмёт одну, — для выбора самых частых это не важно
+    uint32_t *counts = alphabet->counts;
+    for (size_t i = 0; i + 1 < size; ++i)
+        counts[((uint32_t)data[i] << 8) | data[i + 1]]++;
+
+    // Малый блок затрагивает немного пар: они обходятся по данным и обнуляются по ходу,
+    // большой — проходом по всей таблице
+    Candidate heap[DIGRAM_MAX_COUNT];
+    uint32_t heapSize = 0;
+    if (size - 1 < (1U << 16))
+    {
+        for (size_t i = 0; i + 1 < size; ++i)
+        {
+            uint32_t digram = ((uint32_t)data[i] << 8) | data[i + 1];
+            if (counts[digram])
+            {
+                Consider(heap, &heapSize, maxDigrams, (uint16_t)digram, counts[digram]);
+                counts[digram] = 0;
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t digram = 0; digram < (1U << 16); ++digram)
+            Consider(heap, &heapSize, maxDigrams, (uint16_t)digram, counts[digram]);
+        memset(counts, 0, sizeof(alphabet->counts));
+    }
+
+    // Порядок символов не важен для размера: коды всё равно строятся по частотам
+    for (uint32_t k = 0; k < heapSize; ++k)
+    {
+        alphabet->digrams[k] = heap[k].digram;
+        alphabet->symbols[heap[k].digram] = (uint16_t)(256 + k);
+    }
+    alphabet->count = heapSize;
+}
+
+void DigramCountSymbols(const DigramAlphabet *alphabet, const unsigned char *data, size_t size, uint64_t *freq)
+{
+    size_t i = 0;
+    while (i + 1 < size)
+    {
+        uint16_t symbol = alphabet->symbols[((uint32_t)data[i] << 8) | data[i + 1]];
+        if (symbol)
+        {
+            freq[symbol]++;
+            i += 2;
+        }
+        else
+            freq[data[i++]]++;
+    }
+    if (i < size)
+        freq[data[i]]++;
+}
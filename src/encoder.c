@@ -1,259 +1,955 @@
 #include "encoder.h"
+#include "archive.h"
 #include "bitstream.h"
-#include "huffman.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "pipeline.h"
+#include "basearchive.h"
+#include "batchio.h"
+#include "dedup.h"
 #include "fileutils.h"
-#include "args.h"
-#include <color.h>
+#include "hash.h"
+#include "report.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <linux/limits.h>
 
-#define MAGIC_BYTES "HUFF"
-#define ARCHIVE_VERSION 1
-#define PADDING_BYTE 0x00 // Байт для дополнения последнего символа при symbol_size=2 и нечетном размере файла
+#define STDIN_ENTRY_NAME "stdin" // Имя записи в архиве для данных из stdin
+#define APPEND_MAX_REPORTED_COLLISIONS 10
 
-static void BitWriterWriteUint64(BitWriter *writer, uint64_t value)
+// Состояние сжатия, разделяемое стадиями конвейера.
+// Поля чтения трогает только поток чтения, поля записи — только писатель
+typedef struct
 {
-    BitWriterWriteBits(writer, (unsigned int)(value >> 32), 32);
-    BitWriterWriteBits(writer, (unsigned int)(value & 0xFFFFFFFFU), 32);
+    const FileList *files;
+    uint32_t symbol_size;
+    int directIO;
+    int solid;
+    uint32_t solidThreshold;
+    uint32_t solidBlockSize;
+    const Dictionary *dictionary;
+    DedupPlan dedup;   // Копии не читаются и не кодируются; original == NULL без дедупликации
+    BaseArchive base;
+    const BaseEntry **reuse; // Запись базового архива для неизменившегося файла, иначе NULL
+    int blockCrc;            // Блоки пишутся с контрольной суммой (нет при дописывании в архив старой версии)
+    uint32_t streams;        // Потоков в больших блоках (1 при дописывании в архив старой версии)
+    BlockCoder coder;        // CODER_HUFFMAN при дописывании в архив старой версии
+    uint32_t lzLevel;        // 0 без LZ и при дописывании в архив старой версии
+    int contextModel;        // 0 при дописывании в архив старой версии
+    uint32_t digrams;        // 0 без пар и при дописывании в архив старой версии
+    int transforms;          // 0 при дописывании в архив старой версии
+    uint32_t blockSize;
+    uint32_t sampleStep;
+    uint32_t storedPercent;  // 0 при дописывании в архив старой версии
+    uint32_t maxCodeLength;
+
+    // Стадия чтения. Файлы открываются пакетами: малые читаются целиком,
+    // большие остаются открытыми и читаются потоково
+    BatchIO *io;
+    BatchFile batch[BATCH_MAX_FILES];
+    size_t batchStart;
+    size_t batchCount;
+    size_t readIndex;
+    int fileOpened;
+    FILE *inFile;
+    int inFd;                     // Большой файл, читаемый с O_DIRECT, иначе -1
+    int directWarned;
+    const unsigned char *inData;  // Содержимое малого файла, загруженного пакетом
+    size_t inDataSize;
+    size_t inDataOffset;
+    ContentHash contentHash;      // Хеш содержимого текущего файла для сведений о записи
+    int reuseSent;                // Блоки неизменившегося файла уже переданы писателю
+
+    // Стадия записи
+    BitWriter *writer;
+    uint64_t bytesProcessed;
+} EncodeContext;
+
+static void printProgress(uint64_t bytesProcessed, const char fileName[])
+{
+    // Индикатор прогресса (размер потока заранее неизвестен, поэтому выводим только объём)
+    Report(HUFF_LOG_PROGRESS, "\r  Encoding %s: %llu bytes", fileName, (unsigned long long)bytesProcessed);
 }
 
-static printProgress(uint64_t bytesProcessed, uint64_t fileSize, const char fileName[])
+// Недописанный новый архив удаляется, а дописываемый усекается до прежнего конца.
+// Вывод в устройство или канал (-o /dev/full, -o /dev/stdout) не удаляется
+static void FailEncoding(BitWriter *writer, const char *outputPath, FILE *appendFile, uint64_t appendOffset)
 {
-    // Индикатор прогресса
-    if (bytesProcessed == fileSize)
+    BitWriterClose(writer);
+    struct stat outputStat;
+    if (appendFile)
     {
-        printf("\r  Encoding %s: %llu / %llu bytes (%.2f%%)", fileName, (unsigned long long)bytesProcessed, (unsigned long long)fileSize,
-               fileSize > 0 ? (double)bytesProcessed * 100.0 / fileSize : 100.0);
-        fflush(stdout);
+        if (ftruncate(fileno(appendFile), (off_t)appendOffset) != 0)
+            Report(HUFF_LOG_WARNING, "Warning: Cannot cut off the unfinished segment: %s\n", strerror(errno));
+        fclose(appendFile);
     }
+    else if (!IsStdStream(outputPath) && stat(outputPath, &outputStat) == 0 && S_ISREG(outputStat.st_mode))
+        remove(outputPath);
+}
+
+// Имя файла в архиве определено при обходе входных путей
+static const char *GetArchiveName(const FileList *files, size_t index)
+{
+    if (IsStdStream(FileListPath(files, index)))
+        return STDIN_ENTRY_NAME;
+    return FileListName(files, index);
+}
+
+// Файл совпадает по содержимому с более ранним и хранится как его дополнительное имя
+static int IsCopy(const EncodeContext *enc, size_t index)
+{
+    return enc->dedup.original && enc->dedup.original[index] != index;
+}
+
+static int IsReused(const EncodeContext *enc, size_t index)
+{
+    return enc->reuse && enc->reuse[index];
+}
+
+// Следующее имя того же содержимого или DEDUP_NONE
+static size_t NextCopy(const EncodeContext *enc, size_t index)
+{
+    return enc->dedup.original ? enc->dedup.nextCopy[index] : DEDUP_NONE;
+}
+
+static size_t CountCopies(const EncodeContext *enc, size_t index)
+{
+    size_t count = 0;
+    for (size_t i = NextCopy(enc, index); i != DEDUP_NONE; i = NextCopy(enc, i))
+        count++;
+    return count;
 }
 
-int EncodeFiles(ParsedArgs *cmd_args, const char **inputPaths, size_t numInputPaths, const char *outputPath, uint32_t symbol_size)
+// Освобождает ещё не обработанные файлы текущего пакета начиная с first
+static void ReleaseBatch(EncodeContext *enc, size_t first)
 {
-    if (!cmd_args || !inputPaths || numInputPaths == 0 || !outputPath)
+    for (size_t i = first; i < enc->batchStart + enc->batchCount; ++i)
     {
-        fprintf(stderr, COLOR_STR("Error: Invalid arguments to EncodeFiles.\n", RED));
-        return 1;
+        BatchFile *file = &enc->batch[i - enc->batchStart];
+        free(file->data);
+        file->data = NULL;
+        if (file->fd >= 0)
+            close(file->fd);
+        file->fd = -1;
     }
-    if (symbol_size != 1 && symbol_size != 2)
+    enc->batchCount = 0;
+}
+
+// Открывает следующий пакет файлов: open + чтение малых файлов выполняются пачкой
+// вместо нескольких системных вызовов на каждый файл. Размер и тип уже известны из обхода
+// Копии и файлы, блоки которых берутся из базового архива, занимают позицию в пакете, но не открываются
+static void LoadBatch(EncodeContext *enc)
+{
+    const char *paths[BATCH_MAX_FILES];
+    BatchFile loaded[BATCH_MAX_FILES];
+    size_t position[BATCH_MAX_FILES];
+    size_t count = 0, loadCount = 0;
+
+    while (count < BATCH_MAX_FILES && enc->readIndex + count < enc->files->count &&
+           !IsStdStream(FileListPath(enc->files, enc->readIndex + count)))
     {
-        fprintf(stderr, COLOR_STR("Error: Invalid symbol_size (%u). Must be 1 or 2.\n", RED), symbol_size);
-        return 1;
+        size_t index = enc->readIndex + count;
+        BatchFile *file = &enc->batch[count];
+        file->error = 0;
+        file->fd = -1;
+        file->data = NULL;
+        if (!IsCopy(enc, index) && !IsReused(enc, index))
+        {
+            const FileEntry *entry = &enc->files->entries[index];
+            paths[loadCount] = FileListPath(enc->files, index);
+            loaded[loadCount].size = entry->size;
+            loaded[loadCount].mode = entry->mode;
+            position[loadCount++] = count;
+        }
+        count++;
     }
 
-    BitWriter *writer = BitWriterOpen(outputPath);
-    if (!writer)
+    enc->batchStart = enc->readIndex;
+    enc->batchCount = count;
+    if (loadCount > 0)
+        BatchReadFiles(enc->io, paths, loadCount, loaded, 1);
+    for (size_t i = 0; i < loadCount; ++i)
+        enc->batch[position[i]] = loaded[i];
+}
+
+// Открывает текущий файл: stdin, содержимое из пакета или дескриптор из пакета
+static int OpenCurrentInput(EncodeContext *enc, const char *currentFilePath)
+{
+    enc->inFile = NULL;
+    enc->inData = NULL;
+
+    if (IsStdStream(currentFilePath))
     {
-        perror(COLOR_STR("Error opening output archive for writing", RED));
-        return 1;
+        enc->inFile = stdin;
+        return 0;
     }
 
-    // Запись заголовка архива
-    for (size_t i = 0; i < strlen(MAGIC_BYTES); ++i)
-        BitWriterWriteBits(writer, MAGIC_BYTES[i], 8);
+    if (enc->readIndex < enc->batchStart || enc->readIndex >= enc->batchStart + enc->batchCount)
+        LoadBatch(enc);
 
-    BitWriterWriteBits(writer, ARCHIVE_VERSION, 8);
-    BitWriterWriteBits(writer, (uint8_t)symbol_size, 8);
-    BitWriterWriteBits(writer, (uint32_t)numInputPaths, 32);
+    BatchFile *file = &enc->batch[enc->readIndex - enc->batchStart];
+    if (file->error != 0)
+    {
+        errno = file->error;
+        return -1;
+    }
+    if (file->data)
+    {
+        enc->inData = file->data;
+        enc->inDataSize = (size_t)file->size;
+        enc->inDataOffset = 0;
+        return 0;
+    }
 
-    for (size_t i = 0; i < numInputPaths; ++i)
+    if (enc->directIO)
     {
-        const char *currentFilePath = inputPaths[i];
-        const char *fileNameInArchive = NULL;
+        // Прямое чтение блоками в выровненные ячейки конвейера, минуя страничный кеш
+        if (SetDirectIO(file->fd, 1) != 0 && !enc->directWarned)
+        {
+            Report(HUFF_LOG_WARNING, "Warning: O_DIRECT is not supported for %s, using buffered reads.\n", currentFilePath);
+            enc->directWarned = 1;
+        }
+        enc->inFd = file->fd;
+        file->fd = -1;
+        return 0;
+    }
 
-        // Определение имени файла для сохранения в архиве (и обработка относительных путей)
-        char bestBasePath[PATH_MAX] = {0};
-        int bestBasePathLen = -1;
+    enc->inFile = fdopen(file->fd, "rb");
+    if (!enc->inFile)
+        return -1;
+    file->fd = -1; // Дескриптор теперь принадлежит FILE
+    return 0;
+}
 
-        for (size_t j = 0; j < cmd_args->num_input_paths; ++j)
-        {
-            const char *original_arg_path = cmd_args->input_paths[j];
-            size_t original_arg_len = strlen(original_arg_path);
+static void CloseCurrentInput(EncodeContext *enc)
+{
+    if (enc->inFile && enc->inFile != stdin)
+        fclose(enc->inFile);
+    enc->inFile = NULL;
+    if (enc->inFd >= 0)
+        close(enc->inFd);
+    enc->inFd = -1;
+
+    if (enc->inData)
+    {
+        BatchFile *file = &enc->batch[enc->readIndex - enc->batchStart];
+        free(file->data);
+        file->data = NULL;
+        enc->inData = NULL;
+    }
+}
 
-            if (IsDirectory(original_arg_path))
-            {
-                if (strncmp(currentFilePath, original_arg_path, original_arg_len) == 0)
-                {
-                    if (currentFilePath[original_arg_len] == '\0' || currentFilePath[original_arg_len] == '/')
-                    {
-                        if ((int)original_arg_len > bestBasePathLen)
-                        {
-                            strncpy(bestBasePath, original_arg_path, sizeof(bestBasePath) - 1);
-                            bestBasePath[sizeof(bestBasePath) - 1] = '\0';
-                            bestBasePathLen = original_arg_len;
-                        }
-                    }
-                }
-            }
+// Читает до size байт из дескриптора с O_DIRECT. Короткое чтение оставляет смещение
+// невыровненным, поэтому хвост файла дочитывается уже без O_DIRECT
+static ssize_t ReadBlockDirect(int fd, unsigned char *buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t got = read(fd, buffer + done, size - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && errno == EINVAL && SetDirectIO(fd, 0) == 0)
+            continue;
+        if (got < 0)
+            return -1;
+        if (got == 0)
+            break;
+        done += (size_t)got;
+    }
+    return (ssize_t)done;
+}
+
+// Читает до size байт текущего файла из пакета, дескриптора или потока.
+// Возвращает число прочитанных байт; 0 — конец файла
+static size_t ReadChunk(EncodeContext *enc, unsigned char *buffer, size_t size, int *failed)
+{
+    if (enc->inData)
+    {
+        size_t chunk = enc->inDataSize - enc->inDataOffset;
+        if (chunk > size)
+            chunk = size;
+        memcpy(buffer, enc->inData + enc->inDataOffset, chunk);
+        enc->inDataOffset += chunk;
+        return chunk;
+    }
+    if (enc->inFd >= 0)
+    {
+        ssize_t got = ReadBlockDirect(enc->inFd, buffer, size);
+        *failed = got < 0;
+        return got > 0 ? (size_t)got : 0;
+    }
+    size_t got = fread(buffer, 1, size, enc->inFile);
+    *failed = ferror(enc->inFile) != 0;
+    return got;
+}
+
+// Файл попадает в solid-блок, если он обычный, не больше порога и все его имена
+// помещаются в список одного блока
+static int IsSolidCandidate(const EncodeContext *enc, size_t index)
+{
+    const FileEntry *entry = &enc->files->entries[index];
+    return !IsStdStream(FileListPath(enc->files, index)) && S_ISREG(entry->mode) && !IsReused(enc, index) &&
+           entry->size <= enc->solidThreshold && CountCopies(enc, index) < SOLID_MAX_MEMBERS;
+}
+
+// Добавляет файл в список solid-блока
+static void AddSolidMember(PipelineSlot *slot, const char *name, size_t offset, size_t size)
+{
+    size_t nameLen = strlen(name);
+    BitWriterWriteBits(slot->index, (uint16_t)nameLen, 16);
+    BitWriterWriteBytes(slot->index, (const unsigned char *)name, nameLen);
+    BitWriterWriteBits(slot->index, (uint32_t)offset, 32);
+    BitWriterWriteBits(slot->index, (uint32_t)size, 32);
+    slot->memberCount++;
+}
+
+// Собирает подряд идущие малые файлы в один блок. Список файлов (имя, смещение, размер)
+// пишется в slot->index сразу в формате архива
+static int ReadSolidGroup(EncodeContext *enc, PipelineSlot *slot)
+{
+    slot->kind = PIPE_ITEM_SOLID;
+    slot->entry = enc->readIndex;
+
+    for (;;)
+    {
+        while (enc->readIndex < enc->files->count && IsCopy(enc, enc->readIndex))
+            enc->readIndex++;
+        if (enc->readIndex >= enc->files->count || !IsSolidCandidate(enc, enc->readIndex) ||
+            slot->memberCount + 1 + CountCopies(enc, enc->readIndex) > SOLID_MAX_MEMBERS ||
+            slot->rawSize + enc->files->entries[enc->readIndex].size > enc->solidBlockSize)
+            break;
+
+        const char *currentFilePath = FileListPath(enc->files, enc->readIndex);
+        if (OpenCurrentInput(enc, currentFilePath) != 0)
+        {
+            Report(HUFF_LOG_ERROR, "Error opening input file: %s\n", strerror(errno));
+            Report(HUFF_LOG_ERROR, "Failed file: %s\n", currentFilePath);
+            return -1;
         }
 
-        if (bestBasePathLen != -1)
+        // Размер из обхода: если файл с тех пор вырос, лишнее не читается
+        size_t offset = slot->rawSize;
+        size_t limit = (size_t)enc->files->entries[enc->readIndex].size;
+        size_t size = 0;
+        int failed = 0;
+        while (size < limit && !failed)
         {
-            fileNameInArchive = currentFilePath + bestBasePathLen;
-            if (*fileNameInArchive == '/')
-                fileNameInArchive++;
-            if (*fileNameInArchive == '\0')
-                fileNameInArchive = GetFileName(currentFilePath);
+            size_t got = ReadChunk(enc, slot->raw + offset + size, limit - size, &failed);
+            if (got == 0)
+                break;
+            size += got;
         }
-        else
-            fileNameInArchive = GetFileName(currentFilePath);
+        CloseCurrentInput(enc);
+        if (failed)
+        {
+            Report(HUFF_LOG_ERROR, "Error reading input file during encoding content: %s\n", strerror(errno));
+            Report(HUFF_LOG_ERROR, "Failed file: %s\n", currentFilePath);
+            return -1;
+        }
+
+        // Копии — те же байты блока под другими именами
+        AddSolidMember(slot, GetArchiveName(enc->files, enc->readIndex), offset, size);
+        for (size_t i = NextCopy(enc, enc->readIndex); i != DEDUP_NONE; i = NextCopy(enc, i))
+            AddSolidMember(slot, GetArchiveName(enc->files, i), offset, size);
+
+        slot->rawSize += size;
+        enc->readIndex++;
+    }
+    return 1;
+}
+
+// Стадия чтения: для каждого файла выдаёт BEGIN, блоки данных и END,
+// для группы малых файлов в solid-режиме — один элемент SOLID
+static int ReadInput(void *ctx, PipelineSlot *slot)
+{
+    EncodeContext *enc = ctx;
+
+    // Копии записываются вместе с первым файлом того же содержимого
+    while (!enc->fileOpened && enc->readIndex < enc->files->count && IsCopy(enc, enc->readIndex))
+        enc->readIndex++;
+    if (enc->readIndex >= enc->files->count)
+        return 0;
 
-        printf("Processing file %zu/%zu: %s (archiving as: %s)\n", i + 1, numInputPaths, GetFileName(currentFilePath), fileNameInArchive);
+    if (enc->solid && !enc->fileOpened && IsSolidCandidate(enc, enc->readIndex))
+        return ReadSolidGroup(enc, slot);
 
-        FILE *inFile = fopen(currentFilePath, "rb");
-        if (!inFile)
+    const char *currentFilePath = FileListPath(enc->files, enc->readIndex);
+    slot->entry = enc->readIndex;
+
+    if (!enc->fileOpened)
+    {
+        if (!IsReused(enc, enc->readIndex) && OpenCurrentInput(enc, currentFilePath) != 0)
         {
-            perror(COLOR_STR("Error opening input file", RED));
-            fprintf(stderr, COLOR_STR("Failed file: %s\n", RED), currentFilePath);
-            BitWriterClose(writer);
-            remove(outputPath);
-            return 1;
+            Report(HUFF_LOG_ERROR, "Error opening input file: %s\n", strerror(errno));
+            Report(HUFF_LOG_ERROR, "Failed file: %s\n", currentFilePath);
+            return -1;
         }
+        enc->fileOpened = 1;
+        ContentHashInit(&enc->contentHash);
+        slot->kind = PIPE_ITEM_BEGIN;
+        snprintf(slot->name, sizeof(slot->name), "%s", GetArchiveName(enc->files, enc->readIndex));
+        return 1;
+    }
 
-        uint64_t fileSize = GetFileSize(currentFilePath);
-        if (fileSize == (uint64_t)-1)
+    // Неизменившийся файл не читается: писатель копирует его блоки из базового архива
+    if (IsReused(enc, enc->readIndex))
+    {
+        enc->reuseSent = !enc->reuseSent;
+        if (enc->reuseSent)
         {
-            fprintf(stderr, COLOR_STR("Error getting size of file: %s\n", RED), currentFilePath);
-            fclose(inFile);
-            BitWriterClose(writer);
-            remove(outputPath);
+            slot->kind = PIPE_ITEM_REUSE;
             return 1;
         }
+        enc->fileOpened = 0;
+        slot->kind = PIPE_ITEM_END;
+        slot->digest = enc->reuse[enc->readIndex]->hash;
+        enc->readIndex++;
+        return 1;
+    }
+
+    int failed = 0;
+    slot->rawSize = ReadChunk(enc, slot->raw, enc->blockSize, &failed);
+    if (slot->rawSize > 0)
+    {
+        ContentHashUpdate(&enc->contentHash, slot->raw, slot->rawSize);
+        slot->kind = PIPE_ITEM_DATA;
+        return 1;
+    }
+
+    CloseCurrentInput(enc);
+    enc->fileOpened = 0;
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error reading input file during encoding content: %s\n", strerror(errno));
+        return -1;
+    }
+
+    slot->kind = PIPE_ITEM_END;
+    slot->digest = ContentHashFinal(&enc->contentHash);
+    enc->readIndex++;
+    return 1;
+}
+
+// Стадия кодирования: блоки независимы, поэтому кодируются параллельно
+static int EncodeSlot(void *ctx, PipelineSlot *slot, CodecScratch *scratch)
+{
+    EncodeContext *enc = ctx;
+    CodecScratchSetMaxCodeLength(scratch, enc->maxCodeLength);
+
+    // Преобразованный блок кодируется как обычный, но его сумма считается по исходным данным
+    const unsigned char *raw = slot->raw;
+    size_t rawSize = slot->rawSize;
+    BlockTransform transform = enc->transforms ? TransformBlock(scratch, slot->raw, slot->rawSize, slot->comp, &raw, &rawSize) : TRANSFORM_NONE;
+    uint32_t *crc = enc->blockCrc && transform == TRANSFORM_NONE ? &slot->crc : NULL;
+
+    // Малые блоки (хвосты файлов, solid-блоки) остаются одним потоком
+    uint32_t streams = rawSize >= BLOCK_STREAMS_MIN_SIZE ? enc->streams : 1;
+    int failed;
+    if (enc->dictionary)
+    {
+        slot->method = enc->symbol_size == 1 ? BLOCK_METHOD_TABLE8 : BLOCK_METHOD_TABLE16;
+        failed = EncodeBlockWithTable(enc->dictionary->table, raw, rawSize, streams, slot->comp, crc);
+    }
+    else if (enc->lzLevel)
+        failed = EncodeBlockLz(scratch, enc->lzLevel, raw, rawSize, streams, slot->comp, &slot->method, crc);
+    else if (enc->contextModel)
+        failed = EncodeBlockContext(scratch, raw, rawSize, streams, slot->comp, &slot->method, crc);
+    else if (enc->digrams)
+        failed = EncodeBlockDigrams(scratch, enc->digrams, raw, rawSize, streams, slot->comp, &slot->method, crc);
+    else if (enc->coder != CODER_HUFFMAN)
+        failed = EncodeBlockWithCoder(scratch, enc->coder, raw, rawSize, streams, slot->comp, &slot->method, crc);
+    else
+    {
+        slot->method = enc->symbol_size == 1 ? BLOCK_METHOD_HUFF8 : BLOCK_METHOD_HUFF16;
+        failed = enc->symbol_size == 1 && enc->sampleStep > 1 ? EncodeBlockSampled(scratch, enc->sampleStep, raw, rawSize, streams, slot->comp, crc)
+                                                              : EncodeBlock(scratch, raw, rawSize, enc->symbol_size, streams, slot->comp, crc);
+        if (streams > 1)
+            slot->method |= BLOCK_FLAG_STREAMS;
+    }
+    if (failed)
+    {
+        Report(HUFF_LOG_ERROR, "Error generating Huffman codes for %s.\n", FileListPath(enc->files, slot->entry));
+        return 1;
+    }
+    // Буфер блока не удалось расширить: недописанный блок не должен попасть в архив
+    if (BitWriterError(slot->comp))
+    {
+        Report(HUFF_LOG_ERROR, "Error: Out of memory while encoding %s.\n", FileListPath(enc->files, slot->entry));
+        return 1;
+    }
+    // Почти несжимаемый блок быстрее распаковать копированием
+    if (enc->storedPercent && (uint64_t)slot->comp->size * 100 >= (uint64_t)slot->rawSize * enc->storedPercent)
+    {
+        slot->comp->size = 0;
+        slot->crc = 0;
+        slot->method = BLOCK_METHOD_STORED;
+        EncodeBlockStored(slot->raw, slot->rawSize, slot->comp, enc->blockCrc ? &slot->crc : NULL);
+    }
+    else if (transform != TRANSFORM_NONE)
+    {
+        slot->method |= BLOCK_FLAG_TRANSFORM;
+        if (enc->blockCrc)
+            slot->crc = Crc32c(slot->crc, slot->raw, slot->rawSize);
+    }
+    if (enc->blockCrc)
+        slot->method |= BLOCK_FLAG_CRC;
+    return 0;
+}
+
+// Список файлов solid-блока берётся из уже сформированного индекса
+static void ReportSolidMembers(const PipelineSlot *slot)
+{
+    BitReader *index = BitReaderCreateMemory(slot->index->data, slot->index->size);
+    if (!index)
+        return;
+
+    char name[PATH_MAX];
+    for (uint32_t m = 0; m < slot->memberCount; ++m)
+    {
+        uint16_t nameLen = BitReaderReadBits(index, 16);
+        BitReaderReadBytes(index, (unsigned char *)name, nameLen);
+        name[nameLen] = '\0';
+        BitReaderSkipBytes(index, 8); // offset и size
+        Report(HUFF_LOG_INFO, "Processing file: %s (solid)\n", name);
+    }
+    BitReaderClose(index);
+}
+
+static void WriteUint64(BitWriter *writer, uint64_t value)
+{
+    BitWriterWriteBits(writer, (uint32_t)(value >> 32), 32);
+    BitWriterWriteBits(writer, (uint32_t)value, 32);
+}
 
-        // Запись метаданных файла в архив
-        size_t fileNameLen = strlen(fileNameInArchive);
-        BitWriterWriteBits(writer, (uint16_t)fileNameLen, 16);
-        for (size_t k = 0; k < fileNameLen; ++k)
-            BitWriterWriteBits(writer, fileNameInArchive[k], 8);
+// Заголовок блока: raw_len | comp_len | method [| crc32c], затем сжатые данные
+static void WriteBlock(BitWriter *writer, const PipelineSlot *slot)
+{
+    BitWriterWriteBits(writer, (uint32_t)slot->rawSize, 32);
+    BitWriterWriteBits(writer, (uint32_t)slot->comp->size, 32);
+    BitWriterWriteBits(writer, slot->method, 8);
+    if (slot->method & BLOCK_FLAG_CRC)
+        BitWriterWriteBits(writer, slot->crc, 32);
+    BitWriterWriteBytes(writer, slot->comp->data, slot->comp->size);
+}
 
-        BitWriterWriteUint64(writer, fileSize);
+// Стадия записи: ячейки приходят в исходном порядке
+static int WriteOutput(void *ctx, PipelineSlot *slot)
+{
+    EncodeContext *enc = ctx;
+    BitWriter *writer = enc->writer;
 
-        HuffCode *huff_codes = NULL;
-        if (fileSize > 0)
+    switch (slot->kind)
+    {
+        case PIPE_ITEM_BEGIN:
         {
-            huff_codes = GenerateCodes(inFile, fileSize, symbol_size);
-            if (!huff_codes)
+            Report(HUFF_LOG_INFO, "Processing file %zu/%zu: %s (archiving as: %s)\n", slot->entry + 1, enc->files->count,
+                   GetFileName(FileListPath(enc->files, slot->entry)), slot->name);
+
+            // Запись метаданных файла в архив. У файла с копиями — список всех имён
+            size_t copies = CountCopies(enc, slot->entry);
+            BitWriterWriteBits(writer, copies == 0 ? RECORD_FILE : RECORD_COPIES, 8);
+            if (copies > 0)
+                BitWriterWriteBits(writer, (uint16_t)(copies + 1), 16);
+            size_t fileNameLen = strlen(slot->name);
+            BitWriterWriteBits(writer, (uint16_t)fileNameLen, 16);
+            for (size_t k = 0; k < fileNameLen; ++k)
+                BitWriterWriteBits(writer, slot->name[k], 8);
+            for (size_t i = NextCopy(enc, slot->entry); i != DEDUP_NONE; i = NextCopy(enc, i))
             {
-                fprintf(stderr, COLOR_STR("Error generating Huffman codes for %s.\n", RED), fileNameInArchive);
-                fclose(inFile);
-                BitWriterClose(writer);
-                remove(outputPath);
-                return 1;
-            }
-            if (fseek(inFile, 0, SEEK_SET) != 0)
-            {
-                perror(COLOR_STR("Error rewinding input file (GenerateCodes is expected to read to EOF, encoder must rewind)", RED));
-                free(huff_codes);
-                fclose(inFile);
-                BitWriterClose(writer);
-                remove(outputPath);
-                return 1;
+                const char *name = GetArchiveName(enc->files, i);
+                Report(HUFF_LOG_INFO, "  Duplicate stored as a second name: %s\n", name);
+                BitWriterWriteBits(writer, (uint16_t)strlen(name), 16);
+                BitWriterWriteBytes(writer, (const unsigned char *)name, strlen(name));
             }
+            enc->bytesProcessed = 0;
+            break;
         }
-        else
-            printf(COLOR_STR("  File %s is empty. Storing as empty.\n", YELLOW), fileNameInArchive);
 
-        // Запись таблицы Хаффмана
-        uint32_t alphabet_cardinality = (1 << (symbol_size * 8));
-        uint16_t active_codes_count = 0;
+        case PIPE_ITEM_DATA:
+            // Длина каждого блока известна заранее, блок с raw_len = 0 завершает запись
+            WriteBlock(writer, slot);
+
+            enc->bytesProcessed += slot->rawSize;
+            printProgress(enc->bytesProcessed, GetFileName(FileListPath(enc->files, slot->entry)));
+            break;
 
-        if (huff_codes)
+        case PIPE_ITEM_REUSE:
         {
-            for (uint32_t sym_val_idx = 0; sym_val_idx < alphabet_cardinality; ++sym_val_idx)
-            {
-                if (huff_codes[sym_val_idx].code_len > 0)
-                {
-                    active_codes_count++;
-                }
-            }
+            const BaseEntry *old = enc->reuse[slot->entry];
+            if (BaseArchiveCopyPayload(&enc->base, old, writer) != 0)
+                return 1;
+            enc->bytesProcessed = old->size;
+            Report(HUFF_LOG_INFO, "  Unchanged since base archive: %llu bytes copied as is", (unsigned long long)old->size);
+            break;
         }
-        BitWriterWriteBits(writer, active_codes_count, 16);
 
-        if (huff_codes)
+        case PIPE_ITEM_END:
+            // Конец блоков и сведения о файле для следующего инкрементального сжатия
+            BitWriterWriteBits(writer, 0, 32);
+            WriteUint64(writer, enc->bytesProcessed);
+            WriteUint64(writer, (uint64_t)enc->files->entries[slot->entry].mtime);
+            WriteUint64(writer, slot->digest);
+            if (enc->bytesProcessed == 0)
+                Report(HUFF_LOG_WARNING, "  File %s is empty. Storing as empty.\n", GetFileName(FileListPath(enc->files, slot->entry)));
+            else
+                Report(HUFF_LOG_INFO, "\n");
+            Report(HUFF_LOG_INFO, "\n");
+            break;
+
+        case PIPE_ITEM_SOLID:
+            ReportSolidMembers(slot);
+
+            // Тип записи, список файлов и один блок с их содержимым
+            BitWriterWriteBits(writer, RECORD_SOLID, 8);
+            BitWriterWriteBits(writer, (uint16_t)slot->memberCount, 16);
+            BitWriterWriteBytes(writer, slot->index->data, slot->index->size);
+            WriteBlock(writer, slot);
+            Report(HUFF_LOG_INFO, "  %u files, %zu -> %zu bytes\n\n", slot->memberCount, slot->rawSize, slot->comp->size);
+            break;
+    }
+
+    // Диск заполнен или канал закрыт: дальше сжимать незачем
+    if (BitWriterError(writer))
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to archive: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+// Открывает базовый архив и находит файлы, не изменившиеся с его создания:
+// совпадают имя, размер, время изменения и хеш содержимого
+static int PrepareBase(EncodeContext *enc, const EncodeOptions *options, const char *outputPath)
+{
+    // Вывод открывается с усечением, поэтому базовый архив не может быть выходным
+    struct stat baseStat, outputStat;
+    if (!IsStdStream(outputPath) && stat(options->basePath, &baseStat) == 0 && stat(outputPath, &outputStat) == 0 &&
+        baseStat.st_dev == outputStat.st_dev && baseStat.st_ino == outputStat.st_ino)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Base archive cannot be the output archive.\n");
+        return -1;
+    }
+    if (BaseArchiveOpen(options->basePath, &enc->base) != 0)
+        return -1;
+    if (enc->base.count == 0)
+        return 0;
+
+    // Блоки переносятся без перекодирования только при тех же параметрах кодирования
+    uint32_t dictId = options->dictionary ? options->dictionary->id : DICT_ID_NONE;
+    if (enc->base.symbolSize != options->symbolSize || enc->base.dictId != dictId)
+    {
+        Report(HUFF_LOG_WARNING, "Warning: Base archive uses a different symbol size or dictionary; all files will be compressed.\n");
+        return 0;
+    }
+
+    enc->reuse = calloc(enc->files->count, sizeof(const BaseEntry *));
+    if (!enc->reuse)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for base archive matching.\n");
+        return -1;
+    }
+
+    size_t reused = 0;
+    uint64_t reusedBytes = 0;
+    for (size_t i = 0; i < enc->files->count; ++i)
+    {
+        const char *path = FileListPath(enc->files, i);
+        const FileEntry *entry = &enc->files->entries[i];
+        if (IsCopy(enc, i) || IsStdStream(path) || !S_ISREG(entry->mode) || entry->size == 0)
+            continue;
+
+        const BaseEntry *old = BaseArchiveFind(&enc->base, GetArchiveName(enc->files, i));
+        uint64_t hash;
+        if (old && old->size == entry->size && old->mtime == entry->mtime &&
+            HashFile(path, &hash) == 0 && hash == old->hash)
         {
-            for (uint32_t sym_val_idx = 0; sym_val_idx < alphabet_cardinality; ++sym_val_idx)
-            {
-                if (huff_codes[sym_val_idx].code_len > 0)
-                {
-                    if (symbol_size == 1)
-                        BitWriterWriteBits(writer, (uint8_t)sym_val_idx, 8);
-                    else if (symbol_size == 2)
-                        BitWriterWriteBits(writer, (uint16_t)sym_val_idx, 16);
-
-                    BitWriterWriteBits(writer, huff_codes[sym_val_idx].code_len, 8);
-                    BitWriterWriteBits(writer, huff_codes[sym_val_idx].code, huff_codes[sym_val_idx].code_len);
-                }
-            }
+            enc->reuse[i] = old;
+            reused++;
+            reusedBytes += entry->size;
         }
+    }
+    Report(HUFF_LOG_INFO, "Base archive: %zu file(s) unchanged, %llu bytes will be copied without recompression.\n",
+           reused, (unsigned long long)reusedBytes);
+    return 0;
+}
+
+static void FreePlans(EncodeContext *enc)
+{
+    FreeDedupPlan(&enc->dedup);
+    BaseArchiveClose(&enc->base);
+    free(enc->reuse);
+    enc->reuse = NULL;
+}
+
+// Проверяет, что к архиву можно дописать сегмент с теми же параметрами кодирования.
+// Без -s размер символа берётся из архива
+static int PrepareAppend(const EncodeOptions *options, const FileList *files, const char *outputPath, ArchiveEnd *end,
+                         uint32_t *symbolSize)
+{
+    if (ArchiveFindEnd(outputPath, end) != 0)
+        return -1;
+    if (end->version < ARCHIVE_SEGMENT_VERSION)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive version %u does not support appending. Recreate it with this version.\n", end->version);
+        return -1;
+    }
+    if (*symbolSize == 0)
+        *symbolSize = end->symbolSize;
+    uint32_t dictId = options->dictionary ? options->dictionary->id : DICT_ID_NONE;
+    if (end->symbolSize != *symbolSize || end->dictId != dictId)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Archive uses %u-byte symbols and dictionary %08x; append with the same -s and --dict.\n",
+               end->symbolSize, end->dictId);
+        return -1;
+    }
+
+    // Запись с уже существующим именем сделала бы архив неоднозначным: распаковка и извлечение
+    // диапазона выбрали бы разные версии файла. Обновлённые файлы собираются заново (или с --base)
+    BaseArchive names;
+    if (ArchiveReadNames(outputPath, &names) != 0)
+        return -1;
+    size_t collisions = 0;
+    for (size_t i = 0; i < files->count; ++i)
+    {
+        const char *name = GetArchiveName(files, i);
+        if (!BaseArchiveFind(&names, name))
+            continue;
+        if (collisions < APPEND_MAX_REPORTED_COLLISIONS)
+            Report(HUFF_LOG_ERROR, "Error: Entry %s is already in %s.\n", name, outputPath);
+        collisions++;
+    }
+    BaseArchiveClose(&names);
+    if (collisions > APPEND_MAX_REPORTED_COLLISIONS)
+        Report(HUFF_LOG_ERROR, "Error: ... and %zu more name collision(s).\n", collisions - APPEND_MAX_REPORTED_COLLISIONS);
+    return collisions ? -1 : 0;
+}
+
+// Открывает архив для записи сегмента сразу за последним концевиком.
+// След прерванного дописывания отбрасывается; прежние байты не меняются
+static BitWriter *OpenAppendWriter(const char *outputPath, const ArchiveEnd *end, FILE **file)
+{
+    *file = fopen(outputPath, "r+b");
+    if (!*file)
+        return NULL;
+    BitWriter *writer = NULL;
+    if (ftruncate(fileno(*file), (off_t)end->endOffset) == 0 && fseeko(*file, (off_t)end->endOffset, SEEK_SET) == 0)
+        writer = BitWriterOpenStream(*file, 0);
+    if (!writer)
+    {
+        fclose(*file);
+        *file = NULL;
+    }
+    return writer;
+}
+
+// Метка сегмента пишется только после того, как сегмент целиком сброшен на диск:
+// до этого момента архив читается в прежнем виде
+static int CommitAppend(FILE *file, uint64_t segmentOffset)
+{
+    if (fflush(file) != 0 || ferror(file) || fsync(fileno(file)) != 0 ||
+        fseeko(file, (off_t)segmentOffset, SEEK_SET) != 0 ||
+        fwrite(ARCHIVE_APPEND_MAGIC, 1, strlen(ARCHIVE_APPEND_MAGIC), file) != strlen(ARCHIVE_APPEND_MAGIC) ||
+        fflush(file) != 0 || fsync(fileno(file)) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to archive: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int EncodeFiles(const EncodeOptions *options, const FileList *files, const char *outputPath)
+{
+    if (!options || !files || files->count == 0 || !outputPath || (options->append && IsStdStream(outputPath)))
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to EncodeFiles.\n");
+        return 1;
+    }
+    uint32_t symbol_size = options->symbolSize;
+    ArchiveEnd end = {0};
+    if (options->append && PrepareAppend(options, files, outputPath, &end, &symbol_size) != 0)
+        return 1;
+    if (options->append && (uint64_t)end.fileCount + files->count > UINT32_MAX)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Too many files in the archive.\n");
+        return 1;
+    }
+    if (symbol_size != 1 && symbol_size != 2)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid symbol_size (%u). Must be 1 or 2.\n", symbol_size);
+        return 1;
+    }
+    if (options->dictionary && options->dictionary->symbolSize != symbol_size)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Dictionary is built for %u-byte symbols, but symbol_size is %u.\n",
+               options->dictionary->symbolSize, symbol_size);
+        return 1;
+    }
+    if (options->coder != CODER_HUFFMAN && (symbol_size != 1 || options->dictionary))
+    {
+        Report(HUFF_LOG_ERROR, "Error: The ANS coder supports only 1-byte symbols without a dictionary.\n");
+        return 1;
+    }
+    if (options->lzLevel && (symbol_size != 1 || options->dictionary || options->coder != CODER_HUFFMAN))
+    {
+        Report(HUFF_LOG_ERROR, "Error: LZ compression supports only 1-byte symbols with the Huffman coder and no dictionary.\n");
+        return 1;
+    }
+    if (options->contextModel && (symbol_size != 1 || options->dictionary || options->coder != CODER_HUFFMAN || options->lzLevel))
+    {
+        Report(HUFF_LOG_ERROR, "Error: The context model supports only 1-byte symbols with the Huffman coder, without LZ and a dictionary.\n");
+        return 1;
+    }
+    if (options->digrams &&
+        (symbol_size != 1 || options->dictionary || options->coder != CODER_HUFFMAN || options->lzLevel || options->contextModel))
+    {
+        Report(HUFF_LOG_ERROR, "Error: Digrams support only 1-byte symbols with the Huffman coder, without LZ, context and a dictionary.\n");
+        return 1;
+    }
+    if (options->blockSize % 4096 != 0 || options->blockSize > BLOCK_SIZE || options->maxCodeLength > 32)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid block size (%u) or code length limit (%u).\n", options->blockSize, options->maxCodeLength);
+        return 1;
+    }
+    if (options->transforms && options->dictionary)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Block transforms cannot be used with a dictionary.\n");
+        return 1;
+    }
+
+    // Чтение, кодирование и запись идут параллельно; входные данные читаются блоками
+    // фиксированного размера, поэтому расход памяти не зависит от размера входа
+    EncodeContext enc = {0};
+    enc.files = files;
+    enc.directIO = options->directIO;
+    enc.solid = options->solid;
+    enc.solidThreshold = options->solidThreshold;
+    enc.solidBlockSize = options->solidBlockSize;
+    enc.dictionary = options->dictionary;
+    enc.base.fd = -1;
+    enc.inFd = -1;
+    enc.symbol_size = symbol_size;
+    enc.blockCrc = !options->append || end.version >= BLOCK_CRC_VERSION;
+    enc.streams = !options->append || end.version >= BLOCK_STREAMS_VERSION ? options->streams : 1;
+    enc.coder = !options->append || end.version >= BLOCK_ANS_VERSION ? options->coder : CODER_HUFFMAN;
+    enc.lzLevel = !options->append || end.version >= BLOCK_LZ_VERSION ? options->lzLevel : 0;
+    enc.contextModel = options->contextModel && (!options->append || end.version >= BLOCK_CONTEXT_VERSION);
+    enc.digrams = !options->append || end.version >= BLOCK_DIGRAM_VERSION ? options->digrams : 0;
+    enc.transforms = options->transforms && (!options->append || end.version >= BLOCK_TRANSFORM_VERSION);
+    enc.blockSize = options->blockSize ? options->blockSize : BLOCK_SIZE;
+    enc.sampleStep = options->sampleStep;
+    enc.storedPercent = !options->append || end.version >= BLOCK_STORED_VERSION ? options->storedPercent : 0;
+    enc.maxCodeLength = options->maxCodeLength;
+
+    // Одинаковые и неизменившиеся файлы находятся до открытия выходного архива
+    if ((options->dedup && BuildDedupPlan(files, &enc.dedup) != 0) ||
+        (options->basePath && PrepareBase(&enc, options, outputPath) != 0))
+    {
+        FreePlans(&enc);
+        return 1;
+    }
 
-        if (fileSize > 0 && huff_codes)
+    BitWriter *writer = NULL;
+    FILE *appendFile = NULL;
+    if (options->append)
+        writer = OpenAppendWriter(outputPath, &end, &appendFile);
+    else if (IsStdStream(outputPath))
+        writer = BitWriterOpenStream(TakeStdout(), 1);
+    else if (options->directIO)
+    {
+        writer = BitWriterOpenDirect(outputPath);
+        if (!writer && errno == EINVAL)
         {
-            uint64_t bytes_processed = 0;
-            unsigned char symbol_read_buffer[2];
+            Report(HUFF_LOG_WARNING, "Warning: O_DIRECT is not supported for %s, using buffered writes.\n", outputPath);
+            writer = BitWriterOpen(outputPath);
+        }
+    }
+    else
+        writer = BitWriterOpen(outputPath);
+    if (!writer)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening output archive for writing: %s\n", strerror(errno));
+        FreePlans(&enc);
+        return 1;
+    }
 
-            while (bytes_processed < fileSize)
-            {
-                uint16_t current_symbol_val;
-
-                size_t bytes_to_read_this_iteration = symbol_size;
-                // Обработка последнего неполного символа (если symbol_size=2 и размер файла нечетный)
-                if (fileSize - bytes_processed < symbol_size)
-                    bytes_to_read_this_iteration = fileSize - bytes_processed;
-
-                size_t bytes_actually_read_from_file = fread(symbol_read_buffer, 1, bytes_to_read_this_iteration, inFile);
-
-                if (bytes_actually_read_from_file == 0)
-                {
-                    if (feof(inFile) && bytes_processed == fileSize)
-                        break;
-                    perror(COLOR_STR("Error reading input file during encoding content", RED));
-                    free(huff_codes);
-                    fclose(inFile);
-                    BitWriterClose(writer);
-                    remove(outputPath);
-                    return 1;
-                }
-
-                if (symbol_size == 1)
-                    current_symbol_val = symbol_read_buffer[0];
-                else if (symbol_size == 2)
-                {
-                    if (bytes_actually_read_from_file == 1) // Последний байт файла с 2-байтными символами и требуется дополнение
-                        current_symbol_val = ((uint16_t)symbol_read_buffer[0] << 8) | PADDING_BYTE;
-                    else // Прочитано 2 байта
-                        current_symbol_val = ((uint16_t)symbol_read_buffer[0] << 8) | symbol_read_buffer[1];
-                }
-
-                HuffCode hc = huff_codes[current_symbol_val];
-                if (hc.code_len > 0)
-                    BitWriterWriteBits(writer, hc.code, hc.code_len);
-
-                bytes_processed += bytes_actually_read_from_file;
-
-                /* Индикатор прогресса
-                if (bytes_processed % 102400 == 0 || bytes_processed == fileSize)
-                {
-                    printf("\r   Encoding %s: %llu / %llu bytes (%.2f%%)",
-                           fileNameInArchive, (unsigned long long)bytes_processed,
-                           (unsigned long long)fileSize,
-                           fileSize > 0 ? (double)bytes_processed * 100.0 / fileSize : 100.0);
-                    fflush(stdout);
-                }*/
-               printProgress(bytes_processed, fileSize, fileNameInArchive);
-            }
-            printf("\n");
+    // Заголовок архива или сегмента; метка сегмента пока нулевая
+    uint64_t segmentOffset = end.endOffset;
+    if (options->append)
+        BitWriterWriteBits(writer, 0, 32);
+    else
+    {
+        for (size_t i = 0; i < strlen(ARCHIVE_MAGIC); ++i)
+            BitWriterWriteBits(writer, ARCHIVE_MAGIC[i], 8);
+
+        BitWriterWriteBits(writer, ARCHIVE_VERSION, 8);
+        BitWriterWriteBits(writer, (uint8_t)symbol_size, 8);
+        BitWriterWriteBits(writer, options->dictionary ? options->dictionary->id : DICT_ID_NONE, 32);
+    }
+    BitWriterWriteBits(writer, (uint32_t)files->count, 32);
+
+    enc.writer = writer;
+    enc.io = BatchIOCreate(options->allowUring);
+    if (!enc.io)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for batch I/O.\n");
+        FreePlans(&enc);
+        FailEncoding(writer, outputPath, appendFile, end.endOffset);
+        return 1;
+    }
+    Report(HUFF_LOG_INFO, "I/O backend: %s\n", BatchIOBackendName(enc.io));
+
+    int failed = RunPipeline(options->threads, ReadInput, EncodeSlot, WriteOutput, &enc);
+
+    CloseCurrentInput(&enc);
+    ReleaseBatch(&enc, enc.readIndex);
+    BatchIODestroy(enc.io);
+    FreePlans(&enc);
+
+    if (failed)
+    {
+        FailEncoding(writer, outputPath, appendFile, end.endOffset);
+        return 1;
+    }
+
+    // Концевик: общее число записей и начало завершаемого сегмента
+    for (size_t i = 0; i < strlen(ARCHIVE_END_MAGIC); ++i)
+        BitWriterWriteBits(writer, ARCHIVE_END_MAGIC[i], 8);
+    BitWriterWriteBits(writer, end.fileCount + (uint32_t)files->count, 32);
+    WriteUint64(writer, segmentOffset);
+
+    if (appendFile)
+    {
+        BitWriterFlush(writer);
+        int commitFailed = BitWriterError(writer);
+        if (commitFailed)
+            Report(HUFF_LOG_ERROR, "Error writing to archive: %s\n", strerror(errno));
+        else
+            commitFailed = CommitAppend(appendFile, segmentOffset) != 0;
+        if (commitFailed)
+        {
+            FailEncoding(writer, outputPath, appendFile, end.endOffset);
+            return 1;
         }
-        printf("\n");
-        fclose(inFile);
-        if (huff_codes)
-            free(huff_codes);
+        BitWriterClose(writer);
+        fclose(appendFile);
+        Report(HUFF_LOG_SUCCESS, "All files processed. %zu file(s) appended to %s\n", files->count, outputPath);
+        return 0;
+    }
+    // Концевик и остаток буфера уходят в файл только при закрытии
+    if (BitWriterClose(writer) != 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to archive: %s\n", strerror(errno));
+        FailEncoding(NULL, outputPath, NULL, 0);
+        return 1;
     }
 
-    BitWriterClose(writer);
-    printf(COLOR_STR("All files processed. Archive created: %s\n", GREEN), outputPath);
+    Report(HUFF_LOG_SUCCESS, "All files processed. Archive created: %s\n", IsStdStream(outputPath) ? "<stdout>" : outputPath);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,4 +1,6 @@
 #include "fileutils.h"
+#include "report.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -7,6 +9,8 @@
 #include <dirent.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <linux/limits.h> // PATH_MAX
 
 
@@ -23,22 +27,138 @@ int IsDirectory(const char *path)
 
 uint64_t GetFileSize(const char *path)
 {
-    FILE *f = fopen(path, "rb");
+    struct stat st;
 
-    if (!f)
+    if (stat(path, &st) != 0)
         return -1;
+    return (uint64_t)st.st_size;
+}
 
-    fseek(f, 0, SEEK_END);
-    uint64_t size = (uint64_t)ftell(f);
-    fclose(f);
-    return size;
+// --- Список файлов ---
+
+static int FileListAdd(FileList *list, const char *path, size_t nameOffset, uint64_t size, uint32_t mode, int64_t mtime)
+{
+    size_t pathLen = strlen(path) + 1;
+
+    // Амортизированный рост: арена и массив записей удваиваются
+    if (list->arenaSize + pathLen > list->arenaCapacity)
+    {
+        size_t newCapacity = list->arenaCapacity ? list->arenaCapacity * 2 : 4096;
+        while (newCapacity < list->arenaSize + pathLen)
+            newCapacity *= 2;
+        char *grown = realloc(list->arena, newCapacity);
+        if (!grown)
+            return -1;
+        list->arena = grown;
+        list->arenaCapacity = newCapacity;
+    }
+    if (list->count == list->capacity)
+    {
+        size_t newCapacity = list->capacity ? list->capacity * 2 : 64;
+        FileEntry *grown = realloc(list->entries, newCapacity * sizeof(FileEntry));
+        if (!grown)
+            return -1;
+        list->entries = grown;
+        list->capacity = newCapacity;
+    }
+
+    FileEntry *entry = &list->entries[list->count++];
+    entry->pathOffset = list->arenaSize;
+    entry->nameOffset = nameOffset;
+    entry->size = size;
+    entry->mode = mode;
+    entry->mtime = mtime;
+
+    memcpy(list->arena + list->arenaSize, path, pathLen);
+    list->arenaSize += pathLen;
+    return 0;
 }
 
-static void CollectFilesRecursively(const char *basePath, FileList *list)
+const char *FileListPath(const FileList *list, size_t index)
+{
+    return list->arena + list->entries[index].pathOffset;
+}
+
+const char *FileListName(const FileList *list, size_t index)
+{
+    return FileListPath(list, index) + list->entries[index].nameOffset;
+}
+
+uint64_t FileListTotalSize(const FileList *list)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < list->count; ++i)
+        total += list->entries[i].size;
+    return total;
+}
+
+void FreeFileList(FileList *list)
+{
+    free(list->arena);
+    free(list->entries);
+    memset(list, 0, sizeof(*list));
+}
+
+// --- Параллельный обход директорий ---
+
+#define SCAN_MIN_THREADS 4 // Обход упирается в ввод-вывод, поэтому потоков не меньше этого числа
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    char **pending;        // Стек директорий, ожидающих обхода
+    size_t pendingCount;
+    size_t pendingCapacity;
+    size_t active;         // Сколько потоков сейчас обходит директорию
+    int failed;
+    size_t nameOffset;     // Смещение имени в архиве (длина корня обхода)
+} ScanState;
+
+typedef struct
+{
+    ScanState *state;
+    FileList found;        // Локальный список потока, сливается после обхода
+} ScanWorker;
+
+static int PushDirectory(ScanState *state, const char *path)
+{
+    char *copy = strdup(path);
+    if (!copy)
+        return -1;
+
+    pthread_mutex_lock(&state->lock);
+    if (state->pendingCount == state->pendingCapacity)
+    {
+        size_t newCapacity = state->pendingCapacity ? state->pendingCapacity * 2 : 64;
+        char **grown = realloc(state->pending, newCapacity * sizeof(char *));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&state->lock);
+            free(copy);
+            return -1;
+        }
+        state->pending = grown;
+        state->pendingCapacity = newCapacity;
+    }
+    state->pending[state->pendingCount++] = copy;
+    pthread_cond_signal(&state->changed);
+    pthread_mutex_unlock(&state->lock);
+    return 0;
+}
+
+// Обходит одну директорию. Тип записи берётся из d_type; fstatat относительно
+// дескриптора директории вызывается один раз на файл (за размером и правами)
+static int ScanDirectory(ScanWorker *worker, const char *basePath)
 {
     DIR *dir = opendir(basePath);
     if (!dir)
-        return;
+        return 0; // Недоступные директории пропускаются, как и раньше
+
+    int dirFd = dirfd(dir);
+    size_t baseLen = strlen(basePath);
+    int needSlash = baseLen > 0 && basePath[baseLen - 1] != '/';
+    int result = 0;
 
     struct dirent *entry;
     while ((entry = readdir(dir)))
@@ -47,37 +167,160 @@ static void CollectFilesRecursively(const char *basePath, FileList *list)
             continue;
 
         char fullPath[PATH_MAX];
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", basePath, entry->d_name);
+        snprintf(fullPath, sizeof(fullPath), needSlash ? "%s/%s" : "%s%s", basePath, entry->d_name);
 
-        if (IsDirectory(fullPath))
+        if (entry->d_type == DT_DIR)
         {
-            CollectFilesRecursively(fullPath, list);
+            if (PushDirectory(worker->state, fullPath) != 0)
+                result = -1;
+            continue;
         }
-        else
+
+        struct stat st;
+        if (fstatat(dirFd, entry->d_name, &st, 0) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode)) // Символическая ссылка на директорию или d_type == DT_UNKNOWN
         {
-            list->paths = realloc(list->paths, sizeof(char*) * (list->count + 1));
-            list->paths[list->count] = malloc(sizeof(char) * (strlen(fullPath) + 1));
-            strcpy(list->paths[list->count], fullPath);
-            list->count++;
+            if (PushDirectory(worker->state, fullPath) != 0)
+                result = -1;
         }
+        else if (FileListAdd(&worker->found, fullPath, worker->state->nameOffset, (uint64_t)st.st_size, (uint32_t)st.st_mode, (int64_t)st.st_mtime) != 0)
+            result = -1;
     }
 
     closedir(dir);
+    return result;
+}
+
+static void *ScanThread(void *arg)
+{
+    ScanWorker *worker = arg;
+    ScanState *state = worker->state;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&state->lock);
+        while (state->pendingCount == 0 && state->active > 0 && !state->failed)
+            pthread_cond_wait(&state->changed, &state->lock);
+        if (state->pendingCount == 0 || state->failed)
+        {
+            pthread_cond_broadcast(&state->changed);
+            pthread_mutex_unlock(&state->lock);
+            break;
+        }
+        char *path = state->pending[--state->pendingCount];
+        state->active++;
+        pthread_mutex_unlock(&state->lock);
+
+        int result = ScanDirectory(worker, path);
+        free(path);
+
+        pthread_mutex_lock(&state->lock);
+        state->active--;
+        if (result != 0)
+            state->failed = 1;
+        if (state->active == 0 && state->pendingCount == 0)
+            pthread_cond_broadcast(&state->changed);
+        pthread_mutex_unlock(&state->lock);
+    }
+    return NULL;
 }
 
-FileList GetFilesInDirectory(const char *dirPath)
+static int ComparePaths(const void *a, const void *b, void *arena)
 {
-    FileList list = {NULL, 0};
-    CollectFilesRecursively(dirPath, &list);
-    return list;
+    const FileEntry *ea = a;
+    const FileEntry *eb = b;
+    return strcmp((const char *)arena + ea->pathOffset, (const char *)arena + eb->pathOffset);
 }
 
-void FreeFileList(FileList list)
+static int CollectFilesRecursively(const char *basePath, uint32_t threads, FileList *list)
 {
-    for (size_t i = 0; i < list.count; i++)
-        free(list.paths[i]);
+    if (threads < SCAN_MIN_THREADS)
+        threads = SCAN_MIN_THREADS;
 
-    free(list.paths);
+    size_t baseLen = strlen(basePath);
+    ScanState state = {0};
+    state.nameOffset = baseLen + (baseLen > 0 && basePath[baseLen - 1] != '/');
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.changed, NULL);
+
+    ScanWorker *workers = calloc(threads, sizeof(ScanWorker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    int *started = calloc(threads, sizeof(int));
+    int result = (!workers || !ids || !started || PushDirectory(&state, basePath) != 0) ? -1 : 0;
+
+    if (result == 0)
+    {
+        for (uint32_t t = 0; t < threads; ++t)
+        {
+            workers[t].state = &state;
+            started[t] = pthread_create(&ids[t], NULL, ScanThread, &workers[t]) == 0;
+        }
+        if (!started[0])
+            ScanThread(&workers[0]);
+        for (uint32_t t = 0; t < threads; ++t)
+            if (started[t])
+                pthread_join(ids[t], NULL);
+        result = state.failed ? -1 : 0;
+
+        // Слияние локальных списков и сортировка для детерминированного порядка
+        size_t first = list->count;
+        for (uint32_t t = 0; t < threads && result == 0; ++t)
+            for (size_t i = 0; i < workers[t].found.count && result == 0; ++i)
+            {
+                const FileEntry *e = &workers[t].found.entries[i];
+                result = FileListAdd(list, FileListPath(&workers[t].found, i), e->nameOffset, e->size, e->mode, e->mtime);
+            }
+        if (result == 0)
+            qsort_r(list->entries + first, list->count - first, sizeof(FileEntry), ComparePaths, list->arena);
+    }
+
+    for (size_t i = 0; i < state.pendingCount; ++i)
+        free(state.pending[i]);
+    free(state.pending);
+    if (workers)
+        for (uint32_t t = 0; t < threads; ++t)
+            FreeFileList(&workers[t].found);
+    free(workers);
+    free(ids);
+    free(started);
+    pthread_cond_destroy(&state.changed);
+    pthread_mutex_destroy(&state.lock);
+    return result;
+}
+
+int ScanInputPaths(char **inputPaths, size_t numInputPaths, uint32_t threads, FileList *list)
+{
+    memset(list, 0, sizeof(*list));
+
+    for (size_t i = 0; i < numInputPaths; ++i)
+    {
+        const char *path = inputPaths[i];
+
+        if (IsStdStream(path))
+        {
+            if (FileListAdd(list, path, 0, 0, 0, 0) != 0)
+                return -1;
+            continue;
+        }
+
+        struct stat st;
+        if (stat(path, &st) != 0)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Cannot access %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            if (CollectFilesRecursively(path, threads, list) != 0)
+                return -1;
+        }
+        else if (FileListAdd(list, path, (size_t)(GetFileName(path) - path), (uint64_t)st.st_size, (uint32_t)st.st_mode, (int64_t)st.st_mtime) != 0)
+            return -1;
+    }
+    return 0;
 }
 
 unsigned char *ReadBinaryFile(const char *path, size_t *sizeOut)
@@ -208,3 +451,35 @@ const char *GetFileName(const char *path)
     const char *slash = strrchr(path, '/');
     return slash ? slash + 1 : path;
 }
+
+int IsStdStream(const char *path)
+{
+    return path && strcmp(path, STD_STREAM_PATH) == 0;
+}
+
+int SetDirectIO(int fd, int enable)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return -1;
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) == 0 ? 0 : -1;
+}
+
+FILE *TakeStdout(void)
+{
+    // Уже накопленный в буфере stdout текст не сбрасываем: он уйдёт в stderr после dup2
+    int dataFd = dup(STDOUT_FILENO);
+    if (dataFd < 0)
+        return NULL;
+
+    FILE *data = fdopen(dataFd, "wb");
+    if (!data)
+    {
+        close(dataFd);
+        return NULL;
+    }
+
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return data;
+}
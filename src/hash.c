@@ -0,0 +1,139 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t RotateLeft(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+// Чтение little-endian независимо от выравнивания и порядка байт платформы
+static uint64_t Read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static uint32_t Read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = RotateLeft(acc, 31);
+    return acc * PRIME1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t lane)
+{
+    acc ^= Round(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+// Обрабатывает 32-байтную полосу: по 8 байт в каждую из четырёх независимых цепочек
+static void ConsumeStripe(uint64_t *lanes, const unsigned char *p)
+{
+    lanes[0] = Round(lanes[0], Read64(p));
+    lanes[1] = Round(lanes[1], Read64(p + 8));
+    lanes[2] = Round(lanes[2], Read64(p + 16));
+    lanes[3] = Round(lanes[3], Read64(p + 24));
+}
+
+void ContentHashInit(ContentHash *hash)
+{
+    hash->lanes[0] = PRIME1 + PRIME2;
+    hash->lanes[1] = PRIME2;
+    hash->lanes[2] = 0;
+    hash->lanes[3] = 0 - PRIME1;
+    hash->totalSize = 0;
+    hash->bufferSize = 0;
+}
+
+void ContentHashUpdate(ContentHash *hash, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    hash->totalSize += size;
+
+    if (hash->bufferSize + size < sizeof(hash->buffer))
+    {
+        memcpy(hash->buffer + hash->bufferSize, p, size);
+        hash->bufferSize += size;
+        return;
+    }
+
+    if (hash->bufferSize > 0)
+    {
+        size_t fill = sizeof(hash->buffer) - hash->bufferSize;
+        memcpy(hash->buffer + hash->bufferSize, p, fill);
+        ConsumeStripe(hash->lanes, hash->buffer);
+        p += fill;
+        size -= fill;
+        hash->bufferSize = 0;
+    }
+
+    for (; size >= 32; p += 32, size -= 32)
+        ConsumeStripe(hash->lanes, p);
+
+    memcpy(hash->buffer, p, size);
+    hash->bufferSize = size;
+}
+
+uint64_t ContentHashFinal(const ContentHash *hash)
+{
+    uint64_t h;
+    if (hash->totalSize >= 32)
+    {
+        const uint64_t *v = hash->lanes;
+        h = RotateLeft(v[0], 1) + RotateLeft(v[1], 7) + RotateLeft(v[2], 12) + RotateLeft(v[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = MergeRound(h, v[i]);
+    }
+    else
+        h = PRIME5;
+    h += hash->totalSize;
+
+    const unsigned char *p = hash->buffer;
+    size_t size = hash->bufferSize;
+    for (; size >= 8; p += 8, size -= 8)
+        h = RotateLeft(h ^ Round(0, Read64(p)), 27) * PRIME1 + PRIME4;
+    if (size >= 4)
+    {
+        h = RotateLeft(h ^ (Read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; ++p, --size)
+        h = RotateLeft(h ^ (*p * PRIME5), 11) * PRIME1;
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t HashBytes(const void *data, size_t size)
+{
+    ContentHash hash;
+    ContentHashInit(&hash);
+    ContentHashUpdate(&hash, data, size);
+    return ContentHashFinal(&hash);
+}
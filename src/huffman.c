@@ -1,5 +1,6 @@
 #include "huffman.h"
-#include <color.h>
+#include "kernels.h"
+#include "report.h"
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -7,7 +8,6 @@
 
 #define MAX_SYMBOLS_1B 256
 #define MAX_SYMBOLS_2B 65536
-#define PADDING_BYTE 0x00
 
 typedef struct HuffNode
 {
@@ -23,20 +23,113 @@ typedef struct
     size_t capacity;
 } MinHeap;
 
-static MinHeap *CreateMinHeap(size_t capacity)
+// Рабочие таблицы построения кодов. Размер рассчитан на текущий алфавит
+// и растёт только при переходе к 2-байтным символам. Частоты и коды ненулевые только
+// у символов active, и перед следующим построением очищаются только они: малый блок
+// 2-байтных символов не платит за обход всех 65536 элементов
+struct HuffScratch
 {
-    MinHeap *heap = malloc(sizeof(MinHeap));
-    if (!heap)
-        return NULL;
-    heap->data = malloc(capacity * sizeof(HuffNode *));
-    if (!heap->data)
+    size_t symbolCapacity;
+    uint64_t *freq;
+    HuffCode *codes;
+    uint32_t *active;      // Символы с ненулевой частотой по возрастанию
+    uint32_t activeCount;
+    HuffNode *nodes;       // Пул узлов дерева: листья и внутренние узлы (не больше 2 * symbolCapacity)
+    size_t nodeCount;
+    MinHeap heap;
+    uint32_t maxCodeLength; // 0 — без ограничения
+};
+
+HuffScratch *HuffScratchCreate(void)
+{
+    return calloc(1, sizeof(HuffScratch));
+}
+
+void HuffScratchDestroy(HuffScratch *scratch)
+{
+    if (!scratch)
+        return;
+    free(scratch->freq);
+    free(scratch->codes);
+    free(scratch->active);
+    free(scratch->nodes);
+    free(scratch->heap.data);
+    free(scratch);
+}
+
+void HuffScratchSetMaxCodeLength(HuffScratch *scratch, uint32_t maxCodeLength)
+{
+    scratch->maxCodeLength = maxCodeLength;
+}
+
+static int ReserveScratch(HuffScratch *scratch, size_t symbolCount)
+{
+    if (scratch->symbolCapacity >= symbolCount)
+        return 0;
+
+    uint64_t *freq = realloc(scratch->freq, symbolCount * sizeof(uint64_t));
+    if (freq)
+        scratch->freq = freq;
+    HuffCode *codes = realloc(scratch->codes, symbolCount * sizeof(HuffCode));
+    if (codes)
+        scratch->codes = codes;
+    uint32_t *active = realloc(scratch->active, symbolCount * sizeof(uint32_t));
+    if (active)
+        scratch->active = active;
+    HuffNode *nodes = realloc(scratch->nodes, 2 * symbolCount * sizeof(HuffNode));
+    if (nodes)
+        scratch->nodes = nodes;
+    HuffNode **heap = realloc(scratch->heap.data, symbolCount * sizeof(HuffNode *));
+    if (heap)
+        scratch->heap.data = heap;
+
+    if (!freq || !codes || !active || !nodes || !heap)
+        return -1;
+    // Новая часть таблиц обнуляется один раз, дальше их очищает ClearActive
+    memset(freq + scratch->symbolCapacity, 0, (symbolCount - scratch->symbolCapacity) * sizeof(uint64_t));
+    memset(codes + scratch->symbolCapacity, 0, (symbolCount - scratch->symbolCapacity) * sizeof(HuffCode));
+    scratch->symbolCapacity = symbolCount;
+    scratch->heap.capacity = symbolCount;
+    return 0;
+}
+
+// Обнуляет частоты и коды символов прошлой таблицы
+static void ClearActive(HuffScratch *scratch)
+{
+    for (uint32_t k = 0; k < scratch->activeCount; ++k)
     {
-        free(heap);
-        return NULL;
+        uint32_t symbol = scratch->active[k];
+        scratch->freq[symbol] = 0;
+        scratch->codes[symbol].code = 0;
+        scratch->codes[symbol].code_len = 0;
     }
-    heap->size = 0;
-    heap->capacity = capacity;
-    return heap;
+    scratch->activeCount = 0;
+}
+
+// Собирает список символов с ненулевой частотой проходом по всему алфавиту
+static void ListActive(HuffScratch *scratch, uint32_t symbolCount)
+{
+    uint32_t count = 0;
+    for (uint32_t symbol = 0; symbol < symbolCount; ++symbol)
+        if (scratch->freq[symbol])
+            scratch->active[count++] = symbol;
+    scratch->activeCount = count;
+}
+
+static int CompareSymbols(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static HuffNode *NewNode(HuffScratch *scratch, uint64_t freq, uint16_t symbol, HuffNode *left, HuffNode *right)
+{
+    HuffNode *node = &scratch->nodes[scratch->nodeCount++];
+    node->freq = freq;
+    node->symbol = symbol;
+    node->left = left;
+    node->right = right;
+    return node;
 }
 
 static void SwapNodes(HuffNode **a, HuffNode **b)
@@ -92,15 +185,6 @@ static HuffNode *PopHeap(MinHeap *heap)
     return min;
 }
 
-static void FreeTree(HuffNode *root)
-{
-    if (!root)
-        return;
-    FreeTree(root->left);
-    FreeTree(root->right);
-    free(root);
-}
-
 static void BuildCodes(HuffNode *node, HuffCode *table, uint64_t code, uint32_t length)
 {
     if (!node)
@@ -110,7 +194,7 @@ static void BuildCodes(HuffNode *node, HuffCode *table, uint64_t code, uint32_t
     {
         if (length > sizeof(uint64_t) * 8)
         {
-            fprintf(stderr, COLOR_STR("Warning: Huffman code length %u for symbol %u exceeds 64 bits!\n", YELLOW), length, node->symbol);
+            Report(HUFF_LOG_WARNING, "Warning: Huffman code length %u for symbol %u exceeds 64 bits!\n", length, node->symbol);
             table[node->symbol].code_len = 0;
             table[node->symbol].code = 0;
             return;
@@ -133,171 +217,97 @@ static void BuildCodes(HuffNode *node, HuffCode *table, uint64_t code, uint32_t
         BuildCodes(node->right, table, (code << 1) | 1, length + 1);
 }
 
-HuffCode *GenerateCodes(FILE *data, uint64_t file_size, uint32_t symbol_size)
+static int CompareLeaves(const void *a, const void *b)
 {
-    if (symbol_size != 1 && symbol_size != 2)
-        return NULL;
-
-    uint64_t symbol_count = (symbol_size == 1) ? MAX_SYMBOLS_1B : MAX_SYMBOLS_2B;
-    uint64_t *freq_table = calloc(symbol_count, sizeof(uint64_t));
-    if (!freq_table)
-        return NULL;
+    const HuffNode *x = *(const HuffNode *const *)a, *y = *(const HuffNode *const *)b;
+    if (x->freq != y->freq)
+        return x->freq > y->freq ? -1 : 1;
+    return x->symbol < y->symbol ? -1 : x->symbol > y->symbol;
+}
 
-    if (file_size > 0)
+// Укорачивает коды длиннее scratch->maxCodeLength (но не короче, чем нужно для всех листьев).
+// Длинные коды обрезаются до предела, а превышение суммы Крафта снимается, как в zlib: лист
+// с самой длинной допустимой длиной становится узлом на уровень ниже, забирая один обрезанный лист.
+// Затем длины раздаются листьям по убыванию частот, и коды назначаются канонически
+static void LimitCodeLengths(HuffScratch *scratch, HuffCode *table)
+{
+    HuffNode **leaves = scratch->heap.data;
+    size_t count = 0;
+    uint32_t longest = 0;
+    for (size_t i = 0; i < scratch->nodeCount; ++i)
     {
-        uint64_t bytes_counted_from_file = 0;
-        int c1, c2;
+        HuffNode *node = &scratch->nodes[i];
+        if (node->left || node->right)
+            continue;
+        leaves[count++] = node;
+        if (table[node->symbol].code_len > longest)
+            longest = table[node->symbol].code_len;
+    }
+    uint32_t limit = scratch->maxCodeLength;
+    while (((size_t)1 << limit) < count)
+        ++limit;
+    if (longest <= limit || count < 2)
+        return;
 
-        while (bytes_counted_from_file < file_size)
-        {
-            uint16_t symbol_to_count;
-
-            if (symbol_size == 1)
-            {
-                c1 = fgetc(data);
-                if (c1 == EOF)
-                {
-                    if (ferror(data))
-                    {
-                        perror(COLOR_STR("Error reading file for frequency count", RED));
-                        free(freq_table);
-                        return NULL;
-                    }
-                    break;
-                }
-                symbol_to_count = (uint8_t)c1;
-                bytes_counted_from_file += 1;
-            }
-            else
-            {
-                c1 = fgetc(data);
-                if (c1 == EOF)
-                {
-                    if (ferror(data))
-                    {
-                        perror(COLOR_STR("Error reading file for frequency count", RED));
-                        free(freq_table);
-                        return NULL;
-                    }
-                    break;
-                }
-                bytes_counted_from_file += 1;
-
-                if (bytes_counted_from_file < file_size)
-                {
-                    c2 = fgetc(data);
-                    if (c2 == EOF)
-                    {
-                        if (ferror(data))
-                        {
-                            perror(COLOR_STR("Error reading file for frequency count", RED));
-                            free(freq_table);
-                            return NULL;
-                        }
-                        fprintf(stderr, COLOR_STR("Warning: Unexpected EOF when reading second byte of a pair in GenerateCodes. Padding.\n", YELLOW));
-                        symbol_to_count = ((uint16_t)c1 << 8) | PADDING_BYTE;
-                    }
-                    else
-                    {
-                        symbol_to_count = ((uint16_t)c1 << 8) | (uint8_t)c2;
-                        bytes_counted_from_file += 1;
-                    }
-                }
-                else
-                {
-                    symbol_to_count = ((uint16_t)c1 << 8) | PADDING_BYTE;
-                }
-            }
-            freq_table[symbol_to_count]++;
-
-            if (bytes_counted_from_file % 204800 == 0 || bytes_counted_from_file == file_size)
-            {
-                printf("\r  Building alphabet: %llu / %llu bytes (%.2f%%)",
-                       (unsigned long long)bytes_counted_from_file,
-                       (unsigned long long)file_size,
-                       (file_size > 0 ? (double)bytes_counted_from_file * 100.0 / file_size : 0.0));
-                fflush(stdout);
-            }
-        }
-        printf("\n");
+    uint64_t lengthCount[65] = {0};
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t length = table[leaves[k]->symbol].code_len;
+        lengthCount[length < limit ? length : limit]++;
+    }
+    uint64_t kraft = 0;
+    for (uint32_t length = 1; length <= limit; ++length)
+        kraft += lengthCount[length] << (limit - length);
+    while (kraft > ((uint64_t)1 << limit))
+    {
+        uint32_t bits = limit - 1;
+        while (lengthCount[bits] == 0)
+            --bits;
+        lengthCount[bits]--;
+        lengthCount[bits + 1] += 2;
+        lengthCount[limit]--;
+        kraft--;
+    }
 
-        if (fseek(data, 0, SEEK_SET) != 0)
+    qsort(leaves, count, sizeof(HuffNode *), CompareLeaves);
+    uint64_t code = 0;
+    size_t k = 0;
+    for (uint32_t length = 1; length <= limit; ++length)
+    {
+        for (uint64_t n = 0; n < lengthCount[length]; ++n, ++k)
         {
-            perror(COLOR_STR("GenerateCodes: Failed to rewind input file stream after frequency counting", RED));
-            free(freq_table);
-            return NULL;
+            table[leaves[k]->symbol].code = code++;
+            table[leaves[k]->symbol].code_len = length;
         }
+        code <<= 1;
     }
+}
 
-    MinHeap *heap = CreateMinHeap(symbol_count);
-    if (!heap)
-    {
-        free(freq_table);
-        return NULL;
-    }
+// Строит коды по частотам символов scratch->active
+static const HuffCode *BuildFromFrequencies(HuffScratch *scratch, uint64_t file_size)
+{
+    uint64_t *freq_table = scratch->freq;
+    MinHeap *heap = &scratch->heap;
+    heap->size = 0;
+    scratch->nodeCount = 0;
 
     int actual_symbol_count_in_heap = 0;
-    for (uint64_t i = 0; i < symbol_count; ++i)
+    for (uint32_t k = 0; k < scratch->activeCount; ++k)
     {
-        if (freq_table[i])
-        {
-            HuffNode *node = malloc(sizeof(HuffNode));
-            if (!node)
-            {
-                free(freq_table);
-                free(heap->data);
-                free(heap);
-                return NULL;
-            }
-            node->freq = freq_table[i];
-            node->symbol = (uint16_t)i;
-            node->left = node->right = NULL;
-            PushHeap(heap, node);
-            actual_symbol_count_in_heap++;
-        }
+        uint32_t symbol = scratch->active[k];
+        PushHeap(heap, NewNode(scratch, freq_table[symbol], (uint16_t)symbol, NULL, NULL));
+        actual_symbol_count_in_heap++;
     }
-    free(freq_table);
 
     while (heap->size > 1)
     {
         HuffNode *a = PopHeap(heap);
         HuffNode *b = PopHeap(heap);
-        if (!a || !b)
-        {
-            FreeTree(a);
-            FreeTree(b);
-            free(heap->data);
-            free(heap);
-            return NULL;
-        }
-        HuffNode *parent = malloc(sizeof(HuffNode));
-        if (!parent)
-        {
-            FreeTree(a);
-            FreeTree(b);
-            free(heap->data);
-            free(heap);
-            return NULL;
-        }
-        parent->freq = a->freq + b->freq;
-        parent->symbol = 0;
-        parent->left = a;
-        parent->right = b;
-        PushHeap(heap, parent);
+        PushHeap(heap, NewNode(scratch, a->freq + b->freq, 0, a, b));
     }
 
-        HuffNode *root = PopHeap(heap);
-    HuffCode *table = calloc(symbol_count, sizeof(HuffCode));
-    if (!table)
-    {
-        FreeTree(root);
-        if (heap)
-        {
-            free(heap->data);
-            free(heap);
-        }
-        return NULL;
-    }
+    HuffNode *root = PopHeap(heap);
+    HuffCode *table = scratch->codes;
 
     if (root)
     {
@@ -308,14 +318,101 @@ HuffCode *GenerateCodes(FILE *data, uint64_t file_size, uint32_t symbol_size)
             table[root->symbol].code_len = 1;
         }
         else if (file_size > 0 || actual_symbol_count_in_heap > 0)
+        {
             BuildCodes(root, table, 0, 0);
+            if (scratch->maxCodeLength)
+                LimitCodeLengths(scratch, table);
+        }
     }
+    return table;
+}
 
-    FreeTree(root);
-    if (heap)
+const uint64_t *CountFrequencies(HuffScratch *scratch, const unsigned char *data, uint64_t file_size, uint32_t symbol_size)
+{
+    if (symbol_size != 1 && symbol_size != 2)
+        return NULL;
+
+    uint64_t symbol_count = (symbol_size == 1) ? MAX_SYMBOLS_1B : MAX_SYMBOLS_2B;
+    if (ReserveScratch(scratch, symbol_count) != 0)
+        return NULL;
+
+    uint64_t *freq_table = scratch->freq;
+    ClearActive(scratch);
+
+    // Блок, в котором 2-байтных символов меньше, чем в алфавите, считается по данным:
+    // новый символ попадает в список при первой встрече, и весь алфавит не обходится
+    uint64_t symbols = (file_size + symbol_size - 1) / symbol_size;
+    if (symbol_size == 2 && symbols < MAX_SYMBOLS_2B)
     {
-        free(heap->data);
-        free(heap);
+        uint32_t *active = scratch->active;
+        uint32_t count = 0;
+        uint64_t i = 0;
+        for (; i + 1 < file_size; i += 2)
+        {
+            uint32_t symbol = ((uint32_t)data[i] << 8) | data[i + 1];
+            if (freq_table[symbol]++ == 0)
+                active[count++] = symbol;
+        }
+        // Последний неполный символ дополняется нулевым байтом, как в ядре подсчёта
+        if (i < file_size)
+        {
+            uint32_t symbol = (uint32_t)data[i] << 8;
+            if (freq_table[symbol]++ == 0)
+                active[count++] = symbol;
+        }
+        // Порядок по возрастанию даёт те же коды, что и обход всего алфавита
+        qsort(active, count, sizeof(uint32_t), CompareSymbols);
+        scratch->activeCount = count;
+        return freq_table;
     }
-    return table;
-}
\ No newline at end of file
+
+    // Последний неполный 2-байтный символ дополняется нулевым байтом
+    GetKernels()->histogram(freq_table, data, file_size, symbol_size);
+    ListActive(scratch, (uint32_t)symbol_count);
+    return freq_table;
+}
+
+const HuffCode *GenerateCodes(HuffScratch *scratch, const unsigned char *data, uint64_t file_size, uint32_t symbol_size)
+{
+    if (!CountFrequencies(scratch, data, file_size, symbol_size))
+        return NULL;
+
+    return BuildFromFrequencies(scratch, file_size);
+}
+
+const HuffCode *GenerateCodesFromFrequencies(HuffScratch *scratch, const uint64_t *freq, uint32_t symbol_size)
+{
+    if (symbol_size != 1 && symbol_size != 2)
+        return NULL;
+
+    return GenerateCodesForAlphabet(scratch, freq, (symbol_size == 1) ? MAX_SYMBOLS_1B : MAX_SYMBOLS_2B);
+}
+
+const HuffCode *GenerateCodesForAlphabet(HuffScratch *scratch, const uint64_t *freq, uint32_t symbolCount)
+{
+    if (symbolCount == 0 || symbolCount > MAX_SYMBOLS_2B)
+        return NULL;
+    if (ReserveScratch(scratch, symbolCount) != 0)
+        return NULL;
+
+    ClearActive(scratch);
+    uint64_t total = 0;
+    uint32_t count = 0;
+    for (uint32_t symbol = 0; symbol < symbolCount; ++symbol)
+    {
+        if (freq[symbol])
+        {
+            scratch->freq[symbol] = freq[symbol];
+            scratch->active[count++] = symbol;
+            total += freq[symbol];
+        }
+    }
+    scratch->activeCount = count;
+    return BuildFromFrequencies(scratch, total);
+}
+
+uint32_t HuffScratchActiveSymbols(const HuffScratch *scratch, const uint32_t **symbols)
+{
+    *symbols = scratch->active;
+    return scratch->activeCount;
+}
@@ -0,0 +1,87 @@
+#include "kernels.h"
+
+#include <pthread.h>
+#include <string.h>
+
+static const CodecKernels genericKernels = {HistogramGeneric, PackSymbolsGeneric, UnpackSymbolsGeneric,
+                                            UnpackStreams4Generic, PackContextGeneric, UnpackContextGeneric,
+                                            PackDigramsGeneric, UnpackDigramsGeneric, Crc32cGeneric};
+
+static CodecKernels activeKernels;
+static const char *activeName = "generic";
+static pthread_once_t detectOnce = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__)
+static int HasBmi2(void)
+{
+    return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("avx2");
+}
+
+static int HasSse42(void)
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+// Каждое ядро выбирается отдельно: CRC32C из SSE4.2 есть и на процессорах без BMI2
+static int UseKernels(const char *name)
+{
+    int best = strcmp(name, "auto") == 0;
+    if (!best && strcmp(name, "generic") != 0 && strcmp(name, "bmi2") != 0)
+        return -1;
+
+    CodecKernels kernels = genericKernels;
+    const char *chosen = "generic";
+#if defined(__x86_64__)
+    if (strcmp(name, "generic") != 0)
+    {
+        int bmi2 = HasBmi2();
+        if (!bmi2 && !best)
+            return -1;
+        if (bmi2)
+        {
+            kernels.histogram = HistogramBmi2;
+            kernels.packSymbols = PackSymbolsBmi2;
+            kernels.unpackSymbols = UnpackSymbolsBmi2;
+            kernels.unpackStreams4 = UnpackStreams4Bmi2;
+            kernels.packContext = PackContextBmi2;
+            kernels.unpackContext = UnpackContextBmi2;
+            kernels.packDigrams = PackDigramsBmi2;
+            kernels.unpackDigrams = UnpackDigramsBmi2;
+        }
+        if (HasSse42())
+            kernels.crc32c = Crc32cSse42;
+        chosen = bmi2 ? (kernels.crc32c == Crc32cSse42 ? "bmi2+sse4.2" : "bmi2") : (kernels.crc32c == Crc32cSse42 ? "generic+sse4.2" : "generic");
+    }
+#else
+    if (strcmp(name, "bmi2") == 0)
+        return -1;
+#endif
+    activeKernels = kernels;
+    activeName = chosen;
+    return 0;
+}
+
+static void DetectKernels(void)
+{
+    UseKernels("auto");
+}
+
+const CodecKernels *GetKernels(void)
+{
+    pthread_once(&detectOnce, DetectKernels);
+    return &activeKernels;
+}
+
+// Вызывается до запуска рабочих потоков
+int SelectKernels(const char *name)
+{
+    pthread_once(&detectOnce, DetectKernels);
+    return UseKernels(name);
+}
+
+const char *KernelsName(void)
+{
+    pthread_once(&detectOnce, DetectKernels);
+    return activeName;
+}
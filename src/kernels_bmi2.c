@@ -0,0 +1,51 @@
+// Варианты ядер для процессоров с AVX2 и BMI2 (Makefile собирает файл с -mavx2 -mbmi2).
+// Вызываются только после проверки возможностей процессора в kernels.c
+#if defined(__x86_64__)
+
+#include "kernels_impl.h"
+
+void HistogramBmi2(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize)
+{
+    HistogramImpl(freq, data, size, symbolSize);
+}
+
+void PackSymbolsBmi2(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out)
+{
+    PackSymbolsImpl(codes, data, size, symbolSize, out);
+}
+
+UnpackResult UnpackSymbolsBmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp, size_t compSize,
+                               uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size)
+{
+    return UnpackSymbolsImpl(table, nodes, comp, compSize, bitPos, symbolSize, out, size);
+}
+
+UnpackResult UnpackStreams4Bmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4], size_t size)
+{
+    return UnpackStreams4Impl(table, nodes, comp, compSize, bitPos, symbolSize, out, size);
+}
+
+void PackContextBmi2(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out)
+{
+    PackContextImpl(codes, data, size, prev, out);
+}
+
+UnpackResult UnpackContextBmi2(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256], const unsigned char *comp,
+                               size_t compSize, uint64_t *bitPos, unsigned char prev, unsigned char *out, size_t size)
+{
+    return UnpackContextImpl(tables, nodes, comp, compSize, bitPos, prev, out, size);
+}
+
+void PackDigramsBmi2(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out)
+{
+    PackDigramsImpl(codes, pairs, data, size, out);
+}
+
+UnpackResult UnpackDigramsBmi2(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand, const unsigned char *comp,
+                               size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size)
+{
+    return UnpackDigramsImpl(table, nodes, expand, comp, compSize, bitPos, out, size);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "kernels_impl.h"
+
+// Базовые варианты ядер: собираются без расширений набора команд и работают на любом процессоре
+
+void HistogramGeneric(uint64_t *freq, const unsigned char *data, size_t size, uint32_t symbolSize)
+{
+    HistogramImpl(freq, data, size, symbolSize);
+}
+
+void PackSymbolsGeneric(const HuffCode *codes, const unsigned char *data, size_t size, uint32_t symbolSize, BitWriter *out)
+{
+    PackSymbolsImpl(codes, data, size, symbolSize, out);
+}
+
+UnpackResult UnpackSymbolsGeneric(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *comp, size_t compSize,
+                                  uint64_t *bitPos, uint32_t symbolSize, unsigned char *out, size_t size)
+{
+    return UnpackSymbolsImpl(table, nodes, comp, compSize, bitPos, symbolSize, out, size);
+}
+
+UnpackResult UnpackStreams4Generic(const DecodeEntry *table, const DecodingTreeNode *nodes, const unsigned char *const comp[4],
+                                   const size_t compSize[4], uint64_t bitPos[4], uint32_t symbolSize, unsigned char *const out[4], size_t size)
+{
+    return UnpackStreams4Impl(table, nodes, comp, compSize, bitPos, symbolSize, out, size);
+}
+
+void PackContextGeneric(const HuffCode *const codes[256], const unsigned char *data, size_t size, unsigned char prev, BitWriter *out)
+{
+    PackContextImpl(codes, data, size, prev, out);
+}
+
+UnpackResult UnpackContextGeneric(const DecodeEntry *const tables[256], const DecodingTreeNode *const nodes[256], const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char prev, unsigned char *out, size_t size)
+{
+    return UnpackContextImpl(tables, nodes, comp, compSize, bitPos, prev, out, size);
+}
+
+void PackDigramsGeneric(const HuffCode *codes, const uint16_t *pairs, const unsigned char *data, size_t size, BitWriter *out)
+{
+    PackDigramsImpl(codes, pairs, data, size, out);
+}
+
+UnpackResult UnpackDigramsGeneric(const DecodeEntry *table, const DecodingTreeNode *nodes, const uint16_t *expand, const unsigned char *comp,
+                                  size_t compSize, uint64_t *bitPos, unsigned char *out, size_t size)
+{
+    return UnpackDigramsImpl(table, nodes, expand, comp, compSize, bitPos, out, size);
+}
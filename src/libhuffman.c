@@ -0,0 +1,531 @@
+#include "libhuffman.h"
+#include "codec.h"
+#include "bitstream.h"
+#include "dictionary.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define END_MARKER_SIZE 4 // Блок с raw_len = 0 в конце данных
+#define INITIAL_BLOCK_CAPACITY (64 * 1024)
+#define MAX_TABLE_ENTRY_SIZE 7 // Символ (до 16 бит) + длина (8 бит) + код (до 32 бит)
+#define MAX_COMPRESSED_BLOCK (2 * BLOCK_SIZE) // Предел comp_len, как и при чтении архива
+
+struct HuffContext
+{
+    CodecScratch *scratch;
+    BitWriter *block; // Буфер сжатого блока, переиспользуется между вызовами
+    Dictionary *dictionary;
+};
+
+// Потоковый кодер: накапливает один несжатый блок и хранит один сжатый,
+// ожидающий выдачи (заголовок + данные блока)
+struct HuffEncoder
+{
+    CodecScratch *scratch;
+    uint32_t symbolSize;
+    unsigned char *raw;
+    size_t rawSize;
+    BitWriter *block;
+    unsigned char header[BLOCK_HEADER_SIZE];
+    size_t headerSize;
+    size_t outPos;         // Выдано байт текущего заголовка и блока
+    int finishing;
+    int finished;          // Маркер конца подготовлен к выдаче
+};
+
+// Потоковый декодер: собирает заголовок и сжатые данные одного блока
+// и хранит один распакованный блок до выдачи
+struct HuffDecoder
+{
+    CodecScratch *scratch;
+    unsigned char header[BLOCK_HEADER_SIZE];
+    size_t headerFill;
+    unsigned char *comp;
+    size_t compCapacity;
+    size_t compFill;
+    uint32_t compSize;
+    unsigned char *raw;
+    size_t rawCapacity;
+    size_t rawSize;
+    size_t rawPos;
+    int finished;
+    int failed;
+};
+
+static void PutUint32(unsigned char *dst, uint32_t value)
+{
+    dst[0] = (unsigned char)(value >> 24);
+    dst[1] = (unsigned char)(value >> 16);
+    dst[2] = (unsigned char)(value >> 8);
+    dst[3] = (unsigned char)value;
+}
+
+static uint32_t GetUint32(const unsigned char *src)
+{
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+HuffContext *HuffContextCreate(void)
+{
+    HuffContext *ctx = malloc(sizeof(HuffContext));
+    if (!ctx)
+        return NULL;
+
+    ctx->dictionary = NULL;
+    ctx->scratch = CodecScratchCreate();
+    ctx->block = BitWriterCreateMemory(INITIAL_BLOCK_CAPACITY);
+    if (!ctx->scratch || !ctx->block)
+    {
+        HuffContextDestroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void HuffContextDestroy(HuffContext *ctx)
+{
+    if (!ctx)
+        return;
+    CodecScratchDestroy(ctx->scratch);
+    BitWriterClose(ctx->block);
+    DictionaryFree(ctx->dictionary);
+    free(ctx);
+}
+
+HuffStatus HuffContextLoadDictionary(HuffContext *ctx, const char *path)
+{
+    if (!ctx || !path)
+        return HUFF_ERROR_ARGUMENT;
+
+    Dictionary *dictionary = DictionaryLoad(path);
+    if (!dictionary)
+        return HUFF_ERROR_DICTIONARY;
+    DictionaryFree(ctx->dictionary);
+    ctx->dictionary = dictionary;
+    return HUFF_OK;
+}
+
+size_t HuffCompressBound(size_t srcSize)
+{
+    // На блок: заголовок, число кодов, таблица не больше чем из min(n, 65536) записей
+    // и не больше 4 байт кода на каждый входной байт (длина кода блока не превышает 29 бит)
+    size_t blocks = (srcSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t tableEntries = srcSize < blocks * 65536 ? srcSize : blocks * 65536;
+    return END_MARKER_SIZE + blocks * (BLOCK_HEADER_SIZE + 4 + 1) + tableEntries * MAX_TABLE_ENTRY_SIZE + srcSize * 4;
+}
+
+HuffStatus HuffCompress(HuffContext *ctx, uint32_t symbolSize, const void *src, size_t srcSize,
+                        void *dst, size_t dstCapacity, size_t *compressedSize)
+{
+    if (!ctx || (!src && srcSize > 0) || !dst || !compressedSize || (symbolSize != 1 && symbolSize != 2))
+        return HUFF_ERROR_ARGUMENT;
+    if (ctx->dictionary && ctx->dictionary->symbolSize != symbolSize)
+        return HUFF_ERROR_DICTIONARY;
+
+    uint8_t method;
+    if (ctx->dictionary)
+        method = symbolSize == 1 ? BLOCK_METHOD_TABLE8 : BLOCK_METHOD_TABLE16;
+    else
+        method = symbolSize == 1 ? BLOCK_METHOD_HUFF8 : BLOCK_METHOD_HUFF16;
+
+    const unsigned char *in = src;
+    unsigned char *out = dst;
+    size_t written = 0;
+
+    for (size_t offset = 0; offset < srcSize; offset += BLOCK_SIZE)
+    {
+        size_t rawSize = srcSize - offset < BLOCK_SIZE ? srcSize - offset : BLOCK_SIZE;
+
+        BitWriter *block = ctx->block;
+        block->size = 0;
+        int failed = ctx->dictionary ? EncodeBlockWithTable(ctx->dictionary->table, in + offset, rawSize, 1, block, NULL)
+                                     : EncodeBlock(ctx->scratch, in + offset, rawSize, symbolSize, 1, block, NULL);
+        if (failed)
+            return HUFF_ERROR_MEMORY;
+
+        if (dstCapacity - written < BLOCK_HEADER_SIZE + block->size + END_MARKER_SIZE)
+            return HUFF_ERROR_DST_TOO_SMALL;
+
+        PutUint32(out + written, (uint32_t)rawSize);
+        PutUint32(out + written + 4, (uint32_t)block->size);
+        out[written + 8] = method;
+        memcpy(out + written + BLOCK_HEADER_SIZE, block->data, block->size);
+        written += BLOCK_HEADER_SIZE + block->size;
+    }
+
+    if (dstCapacity - written < END_MARKER_SIZE)
+        return HUFF_ERROR_DST_TOO_SMALL;
+    PutUint32(out + written, 0);
+    *compressedSize = written + END_MARKER_SIZE;
+    return HUFF_OK;
+}
+
+HuffStatus HuffDecompressedSize(const void *src, size_t srcSize, uint64_t *size)
+{
+    if (!src || !size)
+        return HUFF_ERROR_ARGUMENT;
+
+    const unsigned char *in = src;
+    uint64_t total = 0;
+    size_t pos = 0;
+
+    for (;;)
+    {
+        if (srcSize - pos < END_MARKER_SIZE)
+            return HUFF_ERROR_CORRUPT;
+        uint32_t rawSize = GetUint32(in + pos);
+        if (rawSize == 0)
+            break;
+        if (rawSize > BLOCK_SIZE || srcSize - pos < BLOCK_HEADER_SIZE)
+            return HUFF_ERROR_CORRUPT;
+        uint32_t compSize = GetUint32(in + pos + 4);
+        if (srcSize - pos - BLOCK_HEADER_SIZE < compSize)
+            return HUFF_ERROR_CORRUPT;
+        total += rawSize;
+        pos += BLOCK_HEADER_SIZE + compSize;
+    }
+    *size = total;
+    return HUFF_OK;
+}
+
+HuffStatus HuffDecompress(HuffContext *ctx, const void *src, size_t srcSize,
+                          void *dst, size_t dstCapacity, size_t *decompressedSize)
+{
+    if (!ctx || !src || (!dst && dstCapacity > 0) || !decompressedSize)
+        return HUFF_ERROR_ARGUMENT;
+
+    const unsigned char *in = src;
+    unsigned char *out = dst;
+    size_t produced = 0;
+    size_t pos = 0;
+
+    for (;;)
+    {
+        if (srcSize - pos < END_MARKER_SIZE)
+            return HUFF_ERROR_CORRUPT;
+        uint32_t rawSize = GetUint32(in + pos);
+        if (rawSize == 0)
+            break;
+        if (rawSize > BLOCK_SIZE || srcSize - pos < BLOCK_HEADER_SIZE)
+            return HUFF_ERROR_CORRUPT;
+        uint32_t compSize = GetUint32(in + pos + 4);
+        uint8_t method = in[pos + 8];
+        pos += BLOCK_HEADER_SIZE;
+        if (srcSize - pos < compSize)
+            return HUFF_ERROR_CORRUPT;
+        if (dstCapacity - produced < rawSize)
+            return HUFF_ERROR_DST_TOO_SMALL;
+
+        if (DecodeBlock(ctx->scratch, ctx->dictionary ? ctx->dictionary->table : NULL, method, in + pos, compSize, out + produced, rawSize, NULL) != 0)
+            return HUFF_ERROR_CORRUPT;
+        produced += rawSize;
+        pos += compSize;
+    }
+
+    *decompressedSize = produced;
+    return HUFF_OK;
+}
+
+const char *HuffStatusString(HuffStatus status)
+{
+    switch (status)
+    {
+        case HUFF_OK:
+            return "success";
+        case HUFF_ERROR_ARGUMENT:
+            return "invalid argument";
+        case HUFF_ERROR_MEMORY:
+            return "out of memory";
+        case HUFF_ERROR_DST_TOO_SMALL:
+            return "destination buffer too small";
+        case HUFF_ERROR_DICTIONARY:
+            return "dictionary cannot be loaded or does not match";
+        case HUFF_ERROR_CORRUPT:
+            return "corrupted input";
+    }
+    return "unknown error";
+}
+
+// --- Потоковый кодер ---
+
+HuffEncoder *HuffEncoderCreate(uint32_t symbolSize)
+{
+    if (symbolSize != 1 && symbolSize != 2)
+        return NULL;
+
+    HuffEncoder *enc = calloc(1, sizeof(HuffEncoder));
+    if (!enc)
+        return NULL;
+
+    enc->symbolSize = symbolSize;
+    enc->scratch = CodecScratchCreate();
+    enc->raw = malloc(BLOCK_SIZE);
+    enc->block = BitWriterCreateMemory(INITIAL_BLOCK_CAPACITY);
+    if (!enc->scratch || !enc->raw || !enc->block)
+    {
+        HuffEncoderDestroy(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+void HuffEncoderDestroy(HuffEncoder *enc)
+{
+    if (!enc)
+        return;
+    CodecScratchDestroy(enc->scratch);
+    free(enc->raw);
+    BitWriterClose(enc->block);
+    free(enc);
+}
+
+static size_t PendingOutput(const HuffEncoder *enc)
+{
+    return enc->headerSize + enc->block->size - enc->outPos;
+}
+
+// Кодирует накопленный блок (или маркер конца при пустом блоке на финише) для выдачи
+static HuffStatus StageBlock(HuffEncoder *enc)
+{
+    enc->block->size = 0;
+    enc->outPos = 0;
+
+    if (enc->rawSize == 0)
+    {
+        PutUint32(enc->header, 0);
+        enc->headerSize = END_MARKER_SIZE;
+        enc->finished = 1;
+        return HUFF_OK;
+    }
+
+    if (EncodeBlock(enc->scratch, enc->raw, enc->rawSize, enc->symbolSize, 1, enc->block, NULL) != 0)
+        return HUFF_ERROR_MEMORY;
+    PutUint32(enc->header, (uint32_t)enc->rawSize);
+    PutUint32(enc->header + 4, (uint32_t)enc->block->size);
+    enc->header[8] = enc->symbolSize == 1 ? BLOCK_METHOD_HUFF8 : BLOCK_METHOD_HUFF16;
+    enc->headerSize = BLOCK_HEADER_SIZE;
+    enc->rawSize = 0;
+    return HUFF_OK;
+}
+
+HuffStatus HuffEncoderPush(HuffEncoder *enc, const void *src, size_t size, size_t *consumed)
+{
+    if (!enc || (!src && size > 0) || !consumed || enc->finishing)
+        return HUFF_ERROR_ARGUMENT;
+
+    const unsigned char *in = src;
+    size_t done = 0;
+    while (done < size)
+    {
+        if (enc->rawSize == BLOCK_SIZE)
+        {
+            if (PendingOutput(enc) > 0)
+                break; // Предыдущий блок ещё не забран
+            HuffStatus status = StageBlock(enc);
+            if (status != HUFF_OK)
+            {
+                *consumed = done;
+                return status;
+            }
+        }
+
+        size_t chunk = BLOCK_SIZE - enc->rawSize;
+        if (chunk > size - done)
+            chunk = size - done;
+        memcpy(enc->raw + enc->rawSize, in + done, chunk);
+        enc->rawSize += chunk;
+        done += chunk;
+    }
+
+    *consumed = done;
+    return HUFF_OK;
+}
+
+HuffStatus HuffEncoderPull(HuffEncoder *enc, void *dst, size_t capacity, size_t *produced)
+{
+    if (!enc || !dst || capacity == 0 || !produced)
+        return HUFF_ERROR_ARGUMENT;
+
+    unsigned char *out = dst;
+    size_t done = 0;
+    while (done < capacity)
+    {
+        if (PendingOutput(enc) == 0)
+        {
+            // Следующий блок готовится, когда он заполнен или вход завершён
+            int ready = enc->rawSize == BLOCK_SIZE || (enc->finishing && !enc->finished);
+            if (!ready)
+                break;
+            HuffStatus status = StageBlock(enc);
+            if (status != HUFF_OK)
+            {
+                *produced = done;
+                return status;
+            }
+        }
+
+        size_t chunk;
+        if (enc->outPos < enc->headerSize)
+        {
+            chunk = enc->headerSize - enc->outPos;
+            if (chunk > capacity - done)
+                chunk = capacity - done;
+            memcpy(out + done, enc->header + enc->outPos, chunk);
+        }
+        else
+        {
+            size_t blockPos = enc->outPos - enc->headerSize;
+            chunk = enc->block->size - blockPos;
+            if (chunk > capacity - done)
+                chunk = capacity - done;
+            memcpy(out + done, enc->block->data + blockPos, chunk);
+        }
+        enc->outPos += chunk;
+        done += chunk;
+    }
+
+    *produced = done;
+    return HUFF_OK;
+}
+
+HuffStatus HuffEncoderFinish(HuffEncoder *enc)
+{
+    if (!enc)
+        return HUFF_ERROR_ARGUMENT;
+    enc->finishing = 1;
+    return HUFF_OK;
+}
+
+// --- Потоковый декодер ---
+
+HuffDecoder *HuffDecoderCreate(void)
+{
+    HuffDecoder *dec = calloc(1, sizeof(HuffDecoder));
+    if (!dec)
+        return NULL;
+
+    dec->scratch = CodecScratchCreate();
+    if (!dec->scratch)
+    {
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+void HuffDecoderDestroy(HuffDecoder *dec)
+{
+    if (!dec)
+        return;
+    CodecScratchDestroy(dec->scratch);
+    free(dec->comp);
+    free(dec->raw);
+    free(dec);
+}
+
+// Увеличивает буфер до size байт; буферы растут до размера наибольшего встреченного блока
+static int Reserve(unsigned char **buffer, size_t *capacity, size_t size)
+{
+    if (*capacity >= size)
+        return 0;
+    unsigned char *grown = realloc(*buffer, size);
+    if (!grown)
+        return -1;
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+// Проверяет заголовок блока и готовит буферы под его данные
+static HuffStatus AcceptHeader(HuffDecoder *dec)
+{
+    uint32_t rawSize = GetUint32(dec->header);
+    dec->compSize = GetUint32(dec->header + 4);
+    if (rawSize > BLOCK_SIZE || dec->compSize > MAX_COMPRESSED_BLOCK)
+        return HUFF_ERROR_CORRUPT;
+    if (Reserve(&dec->comp, &dec->compCapacity, dec->compSize > 0 ? dec->compSize : 1) != 0 ||
+        Reserve(&dec->raw, &dec->rawCapacity, rawSize) != 0)
+        return HUFF_ERROR_MEMORY;
+    dec->rawSize = rawSize;
+    dec->rawPos = rawSize; // Выдавать нечего, пока блок не декодирован
+    dec->compFill = 0;
+    return HUFF_OK;
+}
+
+HuffStatus HuffDecoderPush(HuffDecoder *dec, const void *src, size_t size, size_t *consumed)
+{
+    if (!dec || (!src && size > 0) || !consumed)
+        return HUFF_ERROR_ARGUMENT;
+    *consumed = 0;
+    if (dec->failed)
+        return HUFF_ERROR_CORRUPT;
+
+    const unsigned char *in = src;
+    size_t done = 0;
+    HuffStatus status = HUFF_OK;
+
+    while (done < size && !dec->finished && status == HUFF_OK)
+    {
+        if (dec->rawPos < dec->rawSize)
+            break; // Распакованный блок ещё не забран
+
+        if (dec->headerFill < BLOCK_HEADER_SIZE)
+        {
+            // Сначала raw_len: нулевое значение — маркер конца без остальных полей
+            size_t want = (dec->headerFill < END_MARKER_SIZE ? END_MARKER_SIZE : BLOCK_HEADER_SIZE) - dec->headerFill;
+            if (want > size - done)
+                want = size - done;
+            memcpy(dec->header + dec->headerFill, in + done, want);
+            dec->headerFill += want;
+            done += want;
+
+            if (dec->headerFill == END_MARKER_SIZE && GetUint32(dec->header) == 0)
+                dec->finished = 1;
+            else if (dec->headerFill == BLOCK_HEADER_SIZE)
+                status = AcceptHeader(dec);
+            continue;
+        }
+
+        size_t want = dec->compSize - dec->compFill;
+        if (want > size - done)
+            want = size - done;
+        memcpy(dec->comp + dec->compFill, in + done, want);
+        dec->compFill += want;
+        done += want;
+
+        if (dec->compFill == dec->compSize)
+        {
+            if (DecodeBlock(dec->scratch, NULL, dec->header[8], dec->comp, dec->compSize, dec->raw, dec->rawSize, NULL) != 0)
+                status = HUFF_ERROR_CORRUPT;
+            dec->rawPos = 0;
+            dec->headerFill = 0;
+        }
+    }
+
+    if (status != HUFF_OK)
+        dec->failed = 1;
+    *consumed = done;
+    return status;
+}
+
+HuffStatus HuffDecoderPull(HuffDecoder *dec, void *dst, size_t capacity, size_t *produced)
+{
+    if (!dec || !dst || !produced)
+        return HUFF_ERROR_ARGUMENT;
+
+    size_t chunk = dec->rawSize - dec->rawPos;
+    if (chunk > capacity)
+        chunk = capacity;
+    // До первого блока и на пустом потоке буфера ещё нет
+    if (chunk > 0)
+        memcpy(dst, dec->raw + dec->rawPos, chunk);
+    dec->rawPos += chunk;
+    *produced = chunk;
+    return HUFF_OK;
+}
+
+int HuffDecoderFinished(const HuffDecoder *dec)
+{
+    return dec && dec->finished && dec->rawPos == dec->rawSize;
+}
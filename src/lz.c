@@ -0,0 +1,227 @@
+#include "lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_HASH_BITS 16
+#define LZ_EMPTY UINT32_MAX
+// Повтор минимальной длины дальше этого расстояния стоит дороже своих литералов
+#define LZ_FAR_MIN_MATCH (1U << 12)
+
+// Параметры уровней: сколько кандидатов цепочки проверяется, откладывается ли решение на байт
+// (ленивое сравнение) и какой длины повтора достаточно, чтобы прекратить поиск
+static const struct
+{
+    uint32_t depth;
+    int lazy;
+    uint32_t niceLength;
+} LevelParams[LZ_MAX_LEVEL + 1] = {
+    {0, 0, 0},
+    {1, 0, 16},
+    {2, 0, 32},
+    {4, 0, 32},
+    {8, 1, 64},
+    {16, 1, 128},
+    {32, 1, 128},
+    {64, 1, 256},
+    {128, 1, 1024},
+    {256, 1, 4096},
+};
+
+struct LzMatcher
+{
+    uint32_t *head;  // Последняя позиция с данным хешем
+    uint32_t *chain; // Предыдущая позиция с тем же хешем, что и у данной
+    size_t chainCapacity;
+    LzSequence *sequences;
+    size_t sequenceCapacity;
+};
+
+LzMatcher *LzMatcherCreate(void)
+{
+    LzMatcher *matcher = calloc(1, sizeof(LzMatcher));
+    if (!matcher)
+        return NULL;
+    matcher->head = malloc(sizeof(uint32_t) << LZ_HASH_BITS);
+    if (!matcher->head)
+    {
+        free(matcher);
+        return NULL;
+    }
+    return matcher;
+}
+
+void LzMatcherDestroy(LzMatcher *matcher)
+{
+    if (!matcher)
+        return;
+    free(matcher->head);
+    free(matcher->chain);
+    free(matcher->sequences);
+    free(matcher);
+}
+
+static int Reserve(LzMatcher *matcher, size_t size)
+{
+    if (matcher->chainCapacity < size)
+    {
+        uint32_t *chain = realloc(matcher->chain, size * sizeof(uint32_t));
+        if (!chain)
+            return -1;
+        matcher->chain = chain;
+        matcher->chainCapacity = size;
+    }
+    size_t sequences = size / LZ_MIN_MATCH + 1;
+    if (matcher->sequenceCapacity < sequences)
+    {
+        LzSequence *buffer = realloc(matcher->sequences, sequences * sizeof(LzSequence));
+        if (!buffer)
+            return -1;
+        matcher->sequences = buffer;
+        matcher->sequenceCapacity = sequences;
+    }
+    return 0;
+}
+
+static inline uint32_t Hash4(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Длина совпадения a и b, не длиннее limit; сравнение по 8 байт
+static inline uint32_t MatchLength(const unsigned char *a, const unsigned char *b, uint32_t limit)
+{
+    uint32_t length = 0;
+    while (length + 8 <= limit)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + length, sizeof(x));
+        memcpy(&y, b + length, sizeof(y));
+        uint64_t diff = x ^ y;
+        if (diff)
+        {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return length + (uint32_t)(__builtin_ctzll(diff) >> 3);
+#else
+            return length + (uint32_t)(__builtin_clzll(diff) >> 3);
+#endif
+        }
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length])
+        ++length;
+    return length;
+}
+
+typedef struct
+{
+    LzMatcher *matcher;
+    const unsigned char *data;
+    size_t size;
+    size_t inserted; // Позиции до этой уже в цепочках
+    uint32_t depth;
+    uint32_t niceLength;
+} ParseState;
+
+static inline void InsertUpTo(ParseState *state, size_t end)
+{
+    if (end + LZ_MIN_MATCH > state->size)
+        end = state->size >= LZ_MIN_MATCH ? state->size - LZ_MIN_MATCH + 1 : 0;
+    for (size_t p = state->inserted; p < end; ++p)
+    {
+        uint32_t h = Hash4(state->data + p);
+        state->matcher->chain[p] = state->matcher->head[h];
+        state->matcher->head[h] = (uint32_t)p;
+    }
+    if (end > state->inserted)
+        state->inserted = end;
+}
+
+// Лучший повтор для позиции pos среди depth последних позиций с тем же хешем
+static uint32_t FindMatch(ParseState *state, size_t pos, uint32_t *distance)
+{
+    InsertUpTo(state, pos);
+    const unsigned char *data = state->data;
+    uint32_t limit = (uint32_t)(state->size - pos);
+    uint32_t best = 0;
+    uint32_t candidate = state->matcher->head[Hash4(data + pos)];
+    for (uint32_t steps = state->depth; candidate != LZ_EMPTY && steps > 0; --steps)
+    {
+        // Кандидат не может улучшить результат, если не совпадает байт сразу за лучшей длиной
+        if (best < limit && data[candidate + best] == data[pos + best])
+        {
+            uint32_t length = MatchLength(data + candidate, data + pos, limit);
+            if (length > best)
+            {
+                best = length;
+                *distance = (uint32_t)(pos - candidate);
+                if (length >= state->niceLength || length == limit)
+                    break;
+            }
+        }
+        candidate = state->matcher->chain[candidate];
+    }
+    InsertUpTo(state, pos + 1);
+    if (best < LZ_MIN_MATCH || (best == LZ_MIN_MATCH && *distance > LZ_FAR_MIN_MATCH))
+        return 0;
+    return best;
+}
+
+size_t LzParse(LzMatcher *matcher, const unsigned char *data, size_t size, uint32_t level, const LzSequence **sequences)
+{
+    if (level < LZ_MIN_LEVEL)
+        level = LZ_MIN_LEVEL;
+    if (level > LZ_MAX_LEVEL)
+        level = LZ_MAX_LEVEL;
+    if (Reserve(matcher, size) != 0)
+        return (size_t)-1;
+    memset(matcher->head, 0xFF, sizeof(uint32_t) << LZ_HASH_BITS);
+
+    ParseState state = {matcher, data, size, 0, LevelParams[level].depth, LevelParams[level].niceLength};
+    LzSequence *out = matcher->sequences;
+    size_t count = 0;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= size)
+    {
+        uint32_t distance = 0;
+        uint32_t length = FindMatch(&state, pos, &distance);
+        if (length == 0)
+        {
+            ++pos;
+            continue;
+        }
+
+        // Ленивое сравнение: если со следующего байта повтор длиннее, текущий байт уходит в литералы
+        while (LevelParams[level].lazy && length < state.niceLength && pos + 1 + LZ_MIN_MATCH <= size)
+        {
+            uint32_t nextDistance = 0;
+            uint32_t nextLength = FindMatch(&state, pos + 1, &nextDistance);
+            if (nextLength <= length)
+                break;
+            ++pos;
+            length = nextLength;
+            distance = nextDistance;
+        }
+
+        out[count].literals = (uint32_t)(pos - anchor);
+        out[count].length = length;
+        out[count].distance = distance;
+        ++count;
+        pos += length;
+        anchor = pos;
+        InsertUpTo(&state, pos);
+    }
+
+    if (anchor < size)
+    {
+        out[count].literals = (uint32_t)(size - anchor);
+        out[count].length = 0;
+        out[count].distance = 0;
+        ++count;
+    }
+    *sequences = out;
+    return count;
+}
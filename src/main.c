@@ -1,7 +1,11 @@
 #include "args.h"
 #include "encoder.h"
 #include "decoder.h"
+#include "dictionary.h"
+#include "merge.h"
 #include "fileutils.h"
+#include "kernels.h"
+#include "libhuffman.h"
 #include <color.h>
 
 #include <stdio.h>
@@ -9,32 +13,86 @@
 #include <string.h>
 #include <sys/stat.h>
 
-static void PrintCompressionStats(FileList fileList, const char outputPath[])
+// previousSize — размер архива до дописывания (0 для нового архива)
+static void PrintCompressionStats(const FileList *fileList, const char outputPath[], uint64_t previousSize)
 {
-    long inSize = 0;
-    for (int i = 0; i < fileList.count; i++)
-        inSize += GetFileSize(fileList.paths[i]);
+    // Размер потоковых данных (stdin/stdout) заранее неизвестен
+    if (IsStdStream(outputPath))
+        return;
+    for (size_t i = 0; i < fileList->count; i++)
+        if (IsStdStream(FileListPath(fileList, i)))
+            return;
 
-    long outSize = GetFileSize(outputPath);
+    // Размеры входных файлов уже известны из обхода, повторный stat не нужен
+    uint64_t inSize = FileListTotalSize(fileList);
+    uint64_t outSize = GetFileSize(outputPath);
 
-    if (inSize < 0 || outSize < 0)
+    if (outSize == (uint64_t)-1 || outSize < previousSize)
     {
         fprintf(stderr, COLOR_STR("Cannot compute compression stats.\n", RED));
         return;
     }
+    outSize -= previousSize;
 
     printf("\n--- Compression stats ---\n");
-    printf("Input file(s) size:   %ld bytes\n", inSize);
-    printf("Output archive size:  %ld bytes\n", outSize);
+    printf("Input file(s) size:   %llu bytes\n", (unsigned long long)inSize);
+    printf(previousSize ? "Appended segment:     %llu bytes\n" : "Output archive size:  %llu bytes\n", (unsigned long long)outSize);
     if (inSize > 0)
         printf("Compression ratio:    %.2f%%\n", 100.0 * inSize / outSize);
     printf("-------------------------\n");
 }
 
+// Вывод сообщений библиотеки: ошибки и предупреждения в stderr, остальное в stdout
+static void PrintMessage(HuffLogLevel level, const char *message, void *userData)
+{
+    (void)userData;
+    switch (level)
+    {
+        case HUFF_LOG_ERROR:
+            fprintf(stderr, RED "%s" RESET, message);
+            break;
+        case HUFF_LOG_WARNING:
+            fprintf(stderr, YELLOW "%s" RESET, message);
+            break;
+        case HUFF_LOG_SUCCESS:
+            printf(GREEN "%s" RESET, message);
+            break;
+        case HUFF_LOG_PROGRESS:
+            printf("%s", message);
+            fflush(stdout);
+            break;
+        default:
+            printf("%s", message);
+            break;
+    }
+}
+
 int main(int argc, char *argv[])
 {
+    HuffSetLogger(PrintMessage, NULL);
     ParsedArgs *args = parse_args(argc, argv);
 
+    // Ядра выбираются до запуска рабочих потоков
+    if (args->cpu && SelectKernels(args->cpu) != 0)
+    {
+        free_parsed_args(args);
+        print_error_and_exit("This CPU does not support the requested --cpu kernels.", argv[0]);
+    }
+
+    Dictionary *dictionary = NULL;
+    if (args->dict_path)
+    {
+        dictionary = DictionaryLoad(args->dict_path);
+        if (!dictionary)
+        {
+            free_parsed_args(args);
+            print_error_and_exit("Cannot load dictionary.", argv[0]);
+        }
+        if (args->mode == MODE_COMPRESS && args->symbol_size == 0)
+            args->symbol_size = dictionary->symbolSize;
+    }
+
+    int status = 0; // Код завершения: 1, если режим завершился ошибкой
     switch (args->mode)
     {
         case MODE_HELP:
@@ -48,41 +106,45 @@ int main(int argc, char *argv[])
 
             // Собрать список всех файлов из директорий
             FileList inputFiles;
-            inputFiles.paths = NULL;
-            inputFiles.count = 0;
-
-            for (size_t i = 0; i < args->num_input_paths; ++i)
+            int result = 1;
+            uint64_t previousSize = args->append ? GetFileSize(args->output_path) : 0;
+            if (ScanInputPaths(args->input_paths, args->num_input_paths, args->threads, &inputFiles) == 0)
             {
-                if (IsDirectory(args->input_paths[i]))
-                {
-                    FileList list = GetFilesInDirectory(args->input_paths[i]);
-                    size_t oldCount = inputFiles.count;
-                    inputFiles.count += list.count;
-                    inputFiles.paths = realloc(inputFiles.paths, inputFiles.count * sizeof(char *));
-                    for (size_t j = 0; j < list.count; ++j)
-                    {
-                        inputFiles.paths[oldCount + j] = malloc(sizeof(char) * (strlen(list.paths[j]) + 1));
-                        strcpy(inputFiles.paths[oldCount + j], list.paths[j]);
-                    }
-                    FreeFileList(list);
-                }
-                else
-                {
-                    inputFiles.count++;
-                    inputFiles.paths = realloc(inputFiles.paths, inputFiles.count * sizeof(char*));
-                    inputFiles.paths[inputFiles.count - 1] = malloc(sizeof(char) * (strlen(args->input_paths[i]) + 1));
-                    strcpy(inputFiles.paths[inputFiles.count - 1], args->input_paths[i]);
-                }
+                EncodeOptions options = {
+                    .symbolSize = args->symbol_size,
+                    .threads = args->threads,
+                    .allowUring = args->allow_uring,
+                    .directIO = args->direct_io,
+                    .solid = args->solid,
+                    .solidThreshold = args->solid_threshold,
+                    .solidBlockSize = args->solid_block_size,
+                    .dictionary = dictionary,
+                    .dedup = args->dedup,
+                    .basePath = args->base_path,
+                    .append = args->append,
+                    .streams = args->streams,
+                    .coder = (BlockCoder)args->coder,
+                    .lzLevel = args->lz_level,
+                    .contextModel = args->context_model,
+                    .digrams = args->digrams,
+                    .transforms = args->transforms,
+                    .blockSize = args->block_size,
+                    .sampleStep = args->sample_step,
+                    .storedPercent = args->stored_percent,
+                    .maxCodeLength = args->max_code_length,
+                };
+                result = EncodeFiles(&options, &inputFiles, args->output_path);
             }
 
-            int result = EncodeFiles(args, (const char**)inputFiles.paths, inputFiles.count, args->output_path, args->symbol_size);
-
             if (result == 0)
-                PrintCompressionStats(inputFiles, args->output_path);
+                PrintCompressionStats(&inputFiles, args->output_path, previousSize == (uint64_t)-1 ? 0 : previousSize);
             else
+            {
                 fprintf(stderr, COLOR_STR("Compression failed.\n", RED));
+                status = 1;
+            }
 
-            FreeFileList(inputFiles);
+            FreeFileList(&inputFiles);
             break;
         }
 
@@ -101,9 +163,50 @@ int main(int argc, char *argv[])
                 wantedCount = args->num_input_paths - 1;
             }
 
-            int res = DecodeArchive(archive, args->output_path, wanted, wantedCount, wantedCount == 0);
+            int res = args->has_range
+                ? DecodeRange(archive, wanted[0], args->range_offset, args->range_length, args->output_path, args->threads, dictionary)
+                : DecodeArchive(archive, args->output_path, wanted, wantedCount, wantedCount == 0, args->threads, args->allow_uring, dictionary);
             if (res != 0)
+            {
                 fprintf(stderr, COLOR_STR("Decompression failed.\n", RED));
+                status = 1;
+            }
+            break;
+        }
+
+        case MODE_TRAIN:
+        {
+            FileList samples;
+            int result = 1;
+            if (ScanInputPaths(args->input_paths, args->num_input_paths, args->threads, &samples) == 0)
+                result = TrainDictionary(&samples, args->symbol_size, args->output_path);
+            if (result != 0)
+            {
+                fprintf(stderr, COLOR_STR("Training failed.\n", RED));
+                status = 1;
+            }
+            FreeFileList(&samples);
+            break;
+        }
+
+        case MODE_TEST:
+        {
+            const char **wanted = args->num_input_paths > 1 ? (const char **)(args->input_paths + 1) : NULL;
+            if (TestArchive(args->input_paths[0], wanted, args->num_input_paths - 1, args->threads, dictionary) != 0)
+            {
+                fprintf(stderr, COLOR_STR("Test failed.\n", RED));
+                status = 1;
+            }
+            break;
+        }
+
+        case MODE_MERGE:
+        {
+            if (MergeArchives((const char **)args->input_paths, args->num_input_paths, args->output_path) != 0)
+            {
+                fprintf(stderr, COLOR_STR("Merge failed.\n", RED));
+                status = 1;
+            }
             break;
         }
 
@@ -111,6 +214,7 @@ int main(int argc, char *argv[])
             print_error_and_exit("Invalid or missing mode", argv[0]);
     }
 
+    DictionaryFree(dictionary);
     free_parsed_args(args);
-    return 0;
+    return status;
 }
@@ -0,0 +1,480 @@
+#include "merge.h"
+#include "archive.h"
+#include "bitstream.h"
+#include "codec.h"
+#include "dictionary.h"
+#include "fileutils.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+
+#define MERGE_COPY_CHUNK (1024 * 1024)
+#define MERGE_MAX_REPORTED_COLLISIONS 10
+
+// Имя записи и номер архива, из которого оно взято
+typedef struct
+{
+    const char *name;
+    size_t archive;
+} MergeName;
+
+// Разбор одного входного архива. Первый проход (writer == NULL) только собирает имена
+// и перематывает блоки, второй — переписывает записи в выходной архив
+typedef struct
+{
+    BitReader *reader;
+    BitWriter *writer;
+    const char *path;
+    size_t archive;
+    uint8_t version;
+    uint8_t symbolSize;
+    uint32_t dictId;
+    uint32_t fileCount;       // Записей в первом сегменте по заголовку
+    unsigned char *buffer;    // Буфер копирования блоков
+
+    // Имена всех архивов; пока арена растёт, они хранятся смещениями
+    char *names;
+    size_t namesSize;
+    size_t namesCapacity;
+    size_t *nameOffsets;
+    size_t *nameArchives;
+    size_t nameCount;
+    size_t nameCapacity;
+} Merger;
+
+// Читает целое из bytes байт и повторяет его в выходном архиве; -1 при обрыве архива
+static int CopyUint(Merger *m, size_t bytes, uint64_t *value)
+{
+    unsigned char raw[8];
+    if (BitReaderReadBytes(m->reader, raw, bytes) != bytes)
+        return -1;
+    *value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        *value = (*value << 8) | raw[i];
+    if (m->writer)
+        BitWriterWriteBytes(m->writer, raw, bytes);
+    return 0;
+}
+
+// Переносит count байт как есть; на первом проходе они перематываются
+static int CopyBytes(Merger *m, uint64_t count)
+{
+    if (!m->writer)
+        return BitReaderSkipBytes(m->reader, count) == count ? 0 : -1;
+
+    while (count > 0)
+    {
+        size_t chunk = count < MERGE_COPY_CHUNK ? (size_t)count : MERGE_COPY_CHUNK;
+        if (BitReaderReadBytes(m->reader, m->buffer, chunk) != chunk)
+            return -1;
+        BitWriterWriteBytes(m->writer, m->buffer, chunk);
+        count -= chunk;
+    }
+    return 0;
+}
+
+// Переносит имя записи; на первом проходе запоминает его для проверки совпадений
+static int CopyName(Merger *m)
+{
+    uint64_t nameLen;
+    if (CopyUint(m, 2, &nameLen) != 0 || nameLen == 0 || nameLen >= PATH_MAX)
+        return -1;
+    if (m->writer)
+        return CopyBytes(m, nameLen);
+
+    if (m->nameCount == m->nameCapacity)
+    {
+        size_t capacity = m->nameCapacity ? m->nameCapacity * 2 : 256;
+        size_t *offsets = realloc(m->nameOffsets, capacity * sizeof(size_t));
+        if (offsets)
+            m->nameOffsets = offsets;
+        size_t *archives = realloc(m->nameArchives, capacity * sizeof(size_t));
+        if (archives)
+            m->nameArchives = archives;
+        if (!offsets || !archives)
+            return -1;
+        m->nameCapacity = capacity;
+    }
+    if (m->namesSize + nameLen + 1 > m->namesCapacity)
+    {
+        size_t capacity = m->namesCapacity ? m->namesCapacity * 2 : 64 * 1024;
+        while (capacity < m->namesSize + nameLen + 1)
+            capacity *= 2;
+        char *names = realloc(m->names, capacity);
+        if (!names)
+            return -1;
+        m->names = names;
+        m->namesCapacity = capacity;
+    }
+
+    char *name = m->names + m->namesSize;
+    if (BitReaderReadBytes(m->reader, (unsigned char *)name, nameLen) != nameLen)
+        return -1;
+    name[nameLen] = '\0';
+    m->nameOffsets[m->nameCount] = m->namesSize;
+    m->nameArchives[m->nameCount++] = m->archive;
+    m->namesSize += nameLen + 1;
+    return 0;
+}
+
+// Переносит блоки до завершающего raw_len = 0 включительно и возвращает исходный размер файла
+static int CopyBlocks(Merger *m, uint64_t *size)
+{
+    *size = 0;
+    for (;;)
+    {
+        uint64_t rawLen, compLen, method;
+        if (CopyUint(m, 4, &rawLen) != 0)
+            return -1;
+        if (rawLen == 0)
+            return 0;
+        // Контрольная сумма блока (если есть) переносится вместе с данными
+        if (CopyUint(m, 4, &compLen) != 0 || CopyUint(m, 1, &method) != 0 ||
+            CopyBytes(m, ((method & BLOCK_FLAG_CRC) ? BLOCK_CRC_SIZE : 0) + compLen) != 0)
+            return -1;
+        *size += rawLen;
+    }
+}
+
+// Переносит записи сегмента; возвращает число файлов в них или -1
+static int64_t CopySegment(Merger *m, uint32_t fileCount)
+{
+    for (uint32_t index = 0; index < fileCount;)
+    {
+        // В версии 2 тип записи не хранится: все записи — отдельные файлы
+        uint64_t kind = RECORD_FILE, count = 1;
+        if (m->version >= 3 && CopyUint(m, 1, &kind) != 0)
+            return -1;
+        if (m->version < 3 && m->writer)
+            BitWriterWriteBits(m->writer, RECORD_FILE, 8);
+
+        if (kind == RECORD_SOLID)
+        {
+            // Список файлов группы и её единственный блок переносятся целиком
+            if (CopyUint(m, 2, &count) != 0 || count == 0)
+                return -1;
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                uint64_t offset, size;
+                if (CopyName(m) != 0 || CopyUint(m, 4, &offset) != 0 || CopyUint(m, 4, &size) != 0)
+                    return -1;
+            }
+            uint64_t rawLen, compLen, method;
+            if (CopyUint(m, 4, &rawLen) != 0 || CopyUint(m, 4, &compLen) != 0 ||
+                CopyUint(m, 1, &method) != 0 || CopyBytes(m, ((method & BLOCK_FLAG_CRC) ? BLOCK_CRC_SIZE : 0) + compLen) != 0)
+                return -1;
+            index += (uint32_t)count;
+            continue;
+        }
+
+        if (kind == RECORD_COPIES && (CopyUint(m, 2, &count) != 0 || count == 0))
+            return -1;
+        if (kind != RECORD_FILE && kind != RECORD_COPIES)
+            return -1;
+        for (uint64_t i = 0; i < count; ++i)
+            if (CopyName(m) != 0)
+                return -1;
+
+        uint64_t size;
+        if (CopyBlocks(m, &size) != 0)
+            return -1;
+        if (m->version >= RECORD_INFO_VERSION)
+        {
+            if (CopyBytes(m, RECORD_INFO_SIZE) != 0)
+                return -1;
+        }
+        else if (m->writer)
+        {
+            // В старых архивах сведений о файле нет: размер известен из блоков, а время
+            // помечено как отсутствующее, и хеш не сверяют ни -t, ни --base
+            BitWriterWriteBits(m->writer, (uint32_t)(size >> 32), 32);
+            BitWriterWriteBits(m->writer, (uint32_t)size, 32);
+            BitWriterWriteBits(m->writer, (uint32_t)(RECORD_INFO_NO_MTIME >> 32), 32);
+            BitWriterWriteBits(m->writer, (uint32_t)RECORD_INFO_NO_MTIME, 32);
+            BitWriterWriteBits(m->writer, 0, 32);
+            BitWriterWriteBits(m->writer, 0, 32);
+        }
+        index += (uint32_t)count;
+    }
+    return fileCount;
+}
+
+// Переносит записи всех завершённых сегментов архива. Концевики и метки сегментов
+// не копируются: в выходном архиве все записи образуют один сегмент
+static int64_t CopyRecords(Merger *m)
+{
+    BitWriter *writer = m->writer;
+    int64_t total = CopySegment(m, m->fileCount);
+    if (total < 0 || m->version < ARCHIVE_SEGMENT_VERSION)
+        return total;
+
+    for (;;)
+    {
+        // Концевик проверяется без копирования
+        m->writer = NULL;
+        unsigned char magic[4];
+        uint64_t count, offset;
+        if (BitReaderReadBytes(m->reader, magic, 4) != 4 || memcmp(magic, ARCHIVE_END_MAGIC, 4) != 0 ||
+            CopyUint(m, 4, &count) != 0 || count != (uint64_t)total || CopyUint(m, 8, &offset) != 0)
+            total = -1;
+        else
+        {
+            size_t got = BitReaderReadBytes(m->reader, magic, 4);
+            if (got != 4 || memcmp(magic, ARCHIVE_APPEND_MAGIC, 4) != 0)
+            {
+                if (got != 0 && writer == NULL)
+                    Report(HUFF_LOG_WARNING, "Warning: Ignoring an incomplete append at the end of %s.\n", m->path);
+                m->writer = writer;
+                return total;
+            }
+            if (CopyUint(m, 4, &count) != 0 || count == 0 || count > UINT32_MAX - (uint64_t)total)
+                total = -1;
+        }
+        m->writer = writer;
+        if (total < 0)
+            return -1;
+
+        int64_t segment = CopySegment(m, (uint32_t)count);
+        if (segment < 0)
+            return -1;
+        total += segment;
+    }
+}
+
+// Открывает архив и читает его заголовок; у архивов до версии 4 нет dict_id
+static int OpenInput(Merger *m, const char *path, size_t archive)
+{
+    m->path = path;
+    m->archive = archive;
+    m->reader = BitReaderOpen(path);
+    if (!m->reader)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening archive %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char magic[5] = {0};
+    uint8_t header[2];
+    if (BitReaderReadBytes(m->reader, (unsigned char *)magic, 4) != 4 || strcmp(magic, ARCHIVE_MAGIC) != 0 ||
+        BitReaderReadBytes(m->reader, header, 2) != 2 || header[0] < ARCHIVE_MIN_VERSION || header[0] > ARCHIVE_VERSION ||
+        (header[1] != 1 && header[1] != 2))
+    {
+        Report(HUFF_LOG_ERROR, "Error: %s is not a supported archive.\n", path);
+        BitReaderClose(m->reader);
+        m->reader = NULL;
+        return -1;
+    }
+    m->version = header[0];
+    m->symbolSize = header[1];
+    m->dictId = m->version >= 4 ? BitReaderReadBits(m->reader, 32) : DICT_ID_NONE;
+    m->fileCount = BitReaderReadBits(m->reader, 32);
+    return 0;
+}
+
+static int CompareNames(const void *a, const void *b)
+{
+    const MergeName *x = a, *y = b;
+    int order = strcmp(x->name, y->name);
+    if (order != 0)
+        return order;
+    return (x->archive > y->archive) - (x->archive < y->archive);
+}
+
+// Ищет имена, встречающиеся в разных архивах. Повторы внутри одного архива
+// (например, после дописывания файла с тем же именем) переносятся как есть
+static int FindCollisions(Merger *m, const char **archivePaths)
+{
+    MergeName *sorted = malloc((m->nameCount ? m->nameCount : 1) * sizeof(MergeName));
+    if (!sorted)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for entry names.\n");
+        return -1;
+    }
+    for (size_t i = 0; i < m->nameCount; ++i)
+    {
+        sorted[i].name = m->names + m->nameOffsets[i];
+        sorted[i].archive = m->nameArchives[i];
+    }
+    qsort(sorted, m->nameCount, sizeof(MergeName), CompareNames);
+
+    size_t collisions = 0;
+    for (size_t i = 1; i < m->nameCount; ++i)
+    {
+        if (strcmp(sorted[i - 1].name, sorted[i].name) != 0 || sorted[i - 1].archive == sorted[i].archive)
+            continue;
+        if (collisions < MERGE_MAX_REPORTED_COLLISIONS)
+            Report(HUFF_LOG_ERROR, "Error: Entry %s is present in both %s and %s.\n", sorted[i].name,
+                   archivePaths[sorted[i - 1].archive], archivePaths[sorted[i].archive]);
+        collisions++;
+    }
+    free(sorted);
+
+    if (collisions > MERGE_MAX_REPORTED_COLLISIONS)
+        Report(HUFF_LOG_ERROR, "Error: ... and %zu more name collision(s).\n", collisions - MERGE_MAX_REPORTED_COLLISIONS);
+    return collisions ? -1 : 0;
+}
+
+// Первый проход: проверяет параметры кодирования, разбор записей и имена
+static int ScanInputs(Merger *m, const char **archivePaths, size_t archiveCount, uint32_t *totalFiles,
+                      uint8_t *symbolSize, uint32_t *dictId)
+{
+    uint64_t total = 0;
+    for (size_t a = 0; a < archiveCount; ++a)
+    {
+        if (OpenInput(m, archivePaths[a], a) != 0)
+            return -1;
+        if (a == 0)
+        {
+            *symbolSize = m->symbolSize;
+            *dictId = m->dictId;
+        }
+
+        // Блоки с другим размером символа или словарём не декодировались бы в общем архиве
+        int64_t count = -1;
+        if (m->symbolSize != *symbolSize || m->dictId != *dictId)
+            Report(HUFF_LOG_ERROR, "Error: %s uses %u-byte symbols and dictionary %08x, but %s uses %u-byte symbols and dictionary %08x.\n",
+                   archivePaths[a], m->symbolSize, m->dictId, archivePaths[0], *symbolSize, *dictId);
+        else if ((count = CopyRecords(m)) < 0)
+            Report(HUFF_LOG_ERROR, "Error: Archive %s is corrupted.\n", archivePaths[a]);
+        BitReaderClose(m->reader);
+        m->reader = NULL;
+        if (count < 0)
+            return -1;
+
+        total += (uint64_t)count;
+        if (total > UINT32_MAX)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Too many files in the merged archive.\n");
+            return -1;
+        }
+    }
+    *totalFiles = (uint32_t)total;
+    return FindCollisions(m, archivePaths);
+}
+
+// Выходной архив открывается с усечением, поэтому не может быть одним из входных
+static int CheckOutputIsNotInput(const char **archivePaths, size_t archiveCount, const char *outputPath)
+{
+    struct stat outputStat, inputStat;
+    if (IsStdStream(outputPath) || stat(outputPath, &outputStat) != 0)
+        return 0;
+    for (size_t a = 0; a < archiveCount; ++a)
+    {
+        if (stat(archivePaths[a], &inputStat) == 0 &&
+            inputStat.st_dev == outputStat.st_dev && inputStat.st_ino == outputStat.st_ino)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Input archive %s cannot be the output archive.\n", archivePaths[a]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void FreeMerger(Merger *m)
+{
+    free(m->buffer);
+    free(m->names);
+    free(m->nameOffsets);
+    free(m->nameArchives);
+}
+
+int MergeArchives(const char **archivePaths, size_t archiveCount, const char *outputPath)
+{
+    if (!archivePaths || archiveCount == 0 || !outputPath)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Invalid arguments to MergeArchives.\n");
+        return 1;
+    }
+    for (size_t a = 0; a < archiveCount; ++a)
+    {
+        // Архивы читаются дважды, поэтому поток не подходит
+        if (IsStdStream(archivePaths[a]))
+        {
+            Report(HUFF_LOG_ERROR, "Error: Archives to merge must be files, not a stream.\n");
+            return 1;
+        }
+    }
+    if (CheckOutputIsNotInput(archivePaths, archiveCount, outputPath) != 0)
+        return 1;
+
+    Merger m = {0};
+    uint32_t totalFiles = 0, dictId = 0;
+    uint8_t symbolSize = 0;
+    if (ScanInputs(&m, archivePaths, archiveCount, &totalFiles, &symbolSize, &dictId) != 0)
+    {
+        FreeMerger(&m);
+        return 1;
+    }
+
+    m.buffer = malloc(MERGE_COPY_CHUNK);
+    FILE *out = IsStdStream(outputPath) ? TakeStdout() : fopen(outputPath, "wb");
+    BitWriter *writer = out ? BitWriterOpenStream(out, 0) : NULL;
+    if (!m.buffer || !writer)
+    {
+        Report(HUFF_LOG_ERROR, "Error opening output archive for writing: %s\n", strerror(errno));
+        if (out)
+            fclose(out);
+        FreeMerger(&m);
+        return 1;
+    }
+
+    // Заголовок описывает все записи как один сегмент
+    for (size_t i = 0; i < strlen(ARCHIVE_MAGIC); ++i)
+        BitWriterWriteBits(writer, ARCHIVE_MAGIC[i], 8);
+    BitWriterWriteBits(writer, ARCHIVE_VERSION, 8);
+    BitWriterWriteBits(writer, symbolSize, 8);
+    BitWriterWriteBits(writer, dictId, 32);
+    BitWriterWriteBits(writer, totalFiles, 32);
+
+    // Второй проход: записи переносятся байт в байт
+    int failed = 0;
+    for (size_t a = 0; a < archiveCount && !failed; ++a)
+    {
+        if (OpenInput(&m, archivePaths[a], a) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        m.writer = writer;
+        if (CopyRecords(&m) < 0)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Archive %s changed or became unreadable while merging.\n", archivePaths[a]);
+            failed = 1;
+        }
+        else
+            Report(HUFF_LOG_INFO, "Merged %s\n", archivePaths[a]);
+        m.writer = NULL;
+        BitReaderClose(m.reader);
+        m.reader = NULL;
+    }
+
+    if (!failed)
+    {
+        for (size_t i = 0; i < strlen(ARCHIVE_END_MAGIC); ++i)
+            BitWriterWriteBits(writer, ARCHIVE_END_MAGIC[i], 8);
+        BitWriterWriteBits(writer, totalFiles, 32);
+        BitWriterWriteBits(writer, 0, 32);
+        BitWriterWriteBits(writer, 0, 32);
+    }
+    BitWriterClose(writer);
+    if (!failed && (fflush(out) != 0 || ferror(out)))
+    {
+        Report(HUFF_LOG_ERROR, "Error writing to archive: %s\n", strerror(errno));
+        failed = 1;
+    }
+    fclose(out);
+    if (failed && !IsStdStream(outputPath))
+        remove(outputPath);
+    FreeMerger(&m);
+
+    if (failed)
+        return 1;
+    Report(HUFF_LOG_SUCCESS, "%zu archive(s) merged into %s: %u file(s).\n", archiveCount, IsStdStream(outputPath) ? "<stdout>" : outputPath, totalFiles);
+    return 0;
+}
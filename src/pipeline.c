@@ -0,0 +1,256 @@
+#include "pipeline.h"
+#include "codec.h"
+#include "fileutils.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_CODER_THREADS 64
+#define SLOTS_PER_CODER 2 // Двойная буферизация: пока кодер работает с одной ячейкой, читатель заполняет другую
+
+typedef enum
+{
+    SLOT_FREE,
+    SLOT_FILLED,
+    SLOT_DONE
+} SlotState;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    PipelineSlot *slots;
+    size_t slotCount;
+
+    // Порядковые номера: следующая ячейка для чтения, кодирования и записи
+    size_t readSeq;
+    size_t codeSeq;
+    size_t writeSeq;
+
+    int inputFinished;
+    int failed;
+
+    PipelineReadFn read;
+    PipelineCodeFn code;
+    void *ctx;
+} Pipeline;
+
+uint32_t PipelineDefaultThreads(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    if (cpus > MAX_CODER_THREADS)
+        return MAX_CODER_THREADS;
+    return (uint32_t)cpus;
+}
+
+static void *ReaderThread(void *arg)
+{
+    Pipeline *pipe = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->failed && pipe->readSeq - pipe->writeSeq >= pipe->slotCount)
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        if (pipe->failed)
+        {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        PipelineSlot *slot = &pipe->slots[pipe->readSeq % pipe->slotCount];
+        pthread_mutex_unlock(&pipe->lock);
+
+        // Ячейка свободна и принадлежит только читателю, поэтому ввод идёт без блокировки
+        slot->kind = PIPE_ITEM_DATA;
+        slot->entry = 0;
+        slot->name[0] = '\0';
+        slot->skip = 0;
+        slot->rawSize = 0;
+        slot->comp->size = 0;
+        slot->method = 0;
+        slot->crc = 0;
+        slot->memberCount = 0;
+        slot->index->size = 0;
+        slot->digest = 0;
+        slot->position = 0;
+        slot->failed = 0;
+
+        int result = pipe->read(pipe->ctx, slot);
+
+        pthread_mutex_lock(&pipe->lock);
+        if (result < 0)
+            pipe->failed = 1;
+        else if (result == 0)
+            pipe->inputFinished = 1;
+        else
+        {
+            slot->state = SLOT_FILLED;
+            pipe->readSeq++;
+        }
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+
+        if (result <= 0)
+            break;
+    }
+    return NULL;
+}
+
+static void *CoderThread(void *arg)
+{
+    Pipeline *pipe = arg;
+
+    CodecScratch *scratch = CodecScratchCreate();
+    if (!scratch)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for coder tables.\n");
+        pthread_mutex_lock(&pipe->lock);
+        pipe->failed = 1;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->failed && pipe->codeSeq == pipe->readSeq && !pipe->inputFinished)
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        if (pipe->failed || pipe->codeSeq == pipe->readSeq)
+        {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        PipelineSlot *slot = &pipe->slots[pipe->codeSeq % pipe->slotCount];
+        pipe->codeSeq++;
+        pthread_mutex_unlock(&pipe->lock);
+
+        int hasBlock = slot->kind == PIPE_ITEM_DATA || slot->kind == PIPE_ITEM_SOLID;
+        int result = (hasBlock && !slot->skip && slot->rawSize > 0) ? pipe->code(pipe->ctx, slot, scratch) : 0;
+
+        pthread_mutex_lock(&pipe->lock);
+        if (result != 0)
+            pipe->failed = 1;
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    CodecScratchDestroy(scratch);
+    return NULL;
+}
+
+static void FreeSlots(PipelineSlot *slots, size_t count)
+{
+    if (!slots)
+        return;
+    for (size_t i = 0; i < count; ++i)
+    {
+        free(slots[i].raw);
+        BitWriterClose(slots[i].comp);
+        BitWriterClose(slots[i].index);
+    }
+    free(slots);
+}
+
+int RunPipeline(uint32_t coderThreads, PipelineReadFn read, PipelineCodeFn code, PipelineWriteFn write, void *ctx)
+{
+    if (coderThreads < 1)
+        coderThreads = 1;
+    if (coderThreads > MAX_CODER_THREADS)
+        coderThreads = MAX_CODER_THREADS;
+
+    Pipeline pipe = {0};
+    pipe.slotCount = (size_t)coderThreads * SLOTS_PER_CODER + 2;
+    pipe.read = read;
+    pipe.code = code;
+    pipe.ctx = ctx;
+
+    pipe.slots = calloc(pipe.slotCount, sizeof(PipelineSlot));
+    if (!pipe.slots)
+        return 1;
+    for (size_t i = 0; i < pipe.slotCount; ++i)
+    {
+        // Буфер выровнен, чтобы в него можно было читать напрямую с O_DIRECT
+        void *raw = NULL;
+        if (posix_memalign(&raw, DIRECT_IO_ALIGNMENT, BLOCK_SIZE) == 0)
+            pipe.slots[i].raw = raw;
+        pipe.slots[i].comp = BitWriterCreateMemory(BLOCK_SIZE + BLOCK_SIZE / 2);
+        pipe.slots[i].index = BitWriterCreateMemory(4096);
+        pipe.slots[i].state = SLOT_FREE;
+        if (!pipe.slots[i].raw || !pipe.slots[i].comp || !pipe.slots[i].index)
+        {
+            Report(HUFF_LOG_ERROR, "Error: Memory allocation failed for pipeline buffers.\n");
+            FreeSlots(pipe.slots, pipe.slotCount);
+            return 1;
+        }
+    }
+
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.changed, NULL);
+
+    pthread_t reader;
+    pthread_t coders[MAX_CODER_THREADS];
+    uint32_t startedCoders = 0;
+    int readerStarted = pthread_create(&reader, NULL, ReaderThread, &pipe) == 0;
+    if (readerStarted)
+    {
+        for (; startedCoders < coderThreads; ++startedCoders)
+            if (pthread_create(&coders[startedCoders], NULL, CoderThread, &pipe) != 0)
+                break;
+    }
+    if (!readerStarted || startedCoders == 0)
+    {
+        Report(HUFF_LOG_ERROR, "Error: Failed to start pipeline threads.\n");
+        pthread_mutex_lock(&pipe.lock);
+        pipe.failed = 1;
+        pthread_cond_broadcast(&pipe.changed);
+        pthread_mutex_unlock(&pipe.lock);
+    }
+
+    // Стадия записи: ячейки забираются строго по порядку чтения
+    for (;;)
+    {
+        pthread_mutex_lock(&pipe.lock);
+        for (;;)
+        {
+            if (pipe.failed || (pipe.inputFinished && pipe.writeSeq == pipe.readSeq))
+                break;
+            if (pipe.writeSeq < pipe.readSeq && pipe.slots[pipe.writeSeq % pipe.slotCount].state == SLOT_DONE)
+                break;
+            pthread_cond_wait(&pipe.changed, &pipe.lock);
+        }
+        if (pipe.failed || pipe.writeSeq == pipe.readSeq)
+        {
+            pthread_mutex_unlock(&pipe.lock);
+            break;
+        }
+        PipelineSlot *slot = &pipe.slots[pipe.writeSeq % pipe.slotCount];
+        pthread_mutex_unlock(&pipe.lock);
+
+        int result = write(ctx, slot);
+
+        pthread_mutex_lock(&pipe.lock);
+        if (result != 0)
+            pipe.failed = 1;
+        slot->state = SLOT_FREE;
+        pipe.writeSeq++;
+        pthread_cond_broadcast(&pipe.changed);
+        pthread_mutex_unlock(&pipe.lock);
+    }
+
+    if (readerStarted)
+        pthread_join(reader, NULL);
+    for (uint32_t i = 0; i < startedCoders; ++i)
+        pthread_join(coders[i], NULL);
+
+    pthread_cond_destroy(&pipe.changed);
+    pthread_mutex_destroy(&pipe.lock);
+    FreeSlots(pipe.slots, pipe.slotCount);
+    return pipe.failed;
+}
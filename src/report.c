@@ -0,0 +1,28 @@
+#include "report.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define REPORT_MESSAGE_SIZE 8192 // Хватает на сообщение с двумя путями PATH_MAX
+
+static HuffLogFn logger = NULL;
+static void *loggerData = NULL;
+
+void HuffSetLogger(HuffLogFn fn, void *userData)
+{
+    logger = fn;
+    loggerData = userData;
+}
+
+void Report(HuffLogLevel level, const char *format, ...)
+{
+    if (!logger)
+        return;
+
+    char message[REPORT_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    logger(level, message, loggerData);
+}
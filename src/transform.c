@@ -0,0 +1,150 @@
+#include "transform.h"
+
+#include <string.h>
+
+// Длина серии нулей в одном байте счётчика
+#define ZERO_RUN_MAX 256
+
+static size_t ZeroRleForward(const unsigned char *data, size_t size, unsigned char *out)
+{
+    size_t length = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        if (length + 2 > size)
+            return TRANSFORM_EXPANDED;
+        if (data[i] != 0)
+        {
+            out[length++] = data[i++];
+            continue;
+        }
+        size_t run = 1;
+        while (i + run < size && run < ZERO_RUN_MAX && data[i + run] == 0)
+            ++run;
+        out[length++] = 0;
+        out[length++] = (unsigned char)(run - 1);
+        i += run;
+    }
+    return length;
+}
+
+size_t TransformForward(BlockTransform transform, const unsigned char *data, size_t size, unsigned char *out)
+{
+    switch (transform)
+    {
+    case TRANSFORM_DELTA8:
+        for (size_t i = 0; i < size; ++i)
+            out[i] = (unsigned char)(data[i] - (i ? data[i - 1] : 0));
+        return size;
+    case TRANSFORM_DELTA16:
+        for (size_t i = 0; i < size; ++i)
+            out[i] = (unsigned char)(data[i] - (i >= 2 ? data[i - 2] : 0));
+        return size;
+    case TRANSFORM_ZERO_RLE:
+        return ZeroRleForward(data, size, out);
+    case TRANSFORM_MTF:
+    {
+        unsigned char order[256];
+        for (uint32_t k = 0; k < 256; ++k)
+            order[k] = (unsigned char)k;
+        for (size_t i = 0; i < size; ++i)
+        {
+            unsigned char value = data[i];
+            uint32_t rank = 0;
+            while (order[rank] != value)
+                ++rank;
+            memmove(order + 1, order, rank);
+            order[0] = value;
+            out[i] = (unsigned char)rank;
+        }
+        return size;
+    }
+    default:
+        memcpy(out, data, size);
+        return size;
+    }
+}
+
+void TransformStateInit(TransformState *state, BlockTransform transform)
+{
+    state->transform = transform;
+    state->history[0] = state->history[1] = 0;
+    state->pendingZeros = 0;
+    for (uint32_t k = 0; k < 256; ++k)
+        state->order[k] = (unsigned char)k;
+}
+
+int TransformInverse(TransformState *state, const unsigned char *in, size_t inSize, unsigned char *out, size_t capacity, size_t *produced)
+{
+    *produced = 0;
+    if (state->transform != TRANSFORM_ZERO_RLE && inSize > capacity)
+        return 1;
+
+    switch (state->transform)
+    {
+    case TRANSFORM_DELTA8:
+    {
+        unsigned char prev = state->history[1];
+        for (size_t i = 0; i < inSize; ++i)
+            out[i] = prev = (unsigned char)(in[i] + prev);
+        state->history[1] = prev;
+        break;
+    }
+    case TRANSFORM_DELTA16:
+    {
+        // history[0] — байт двумя позициями раньше, history[1] — предыдущий
+        unsigned char older = state->history[0], prev = state->history[1];
+        for (size_t i = 0; i < inSize; ++i)
+        {
+            unsigned char value = (unsigned char)(in[i] + older);
+            out[i] = value;
+            older = prev;
+            prev = value;
+        }
+        state->history[0] = older;
+        state->history[1] = prev;
+        break;
+    }
+    case TRANSFORM_ZERO_RLE:
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < inSize; ++i)
+        {
+            if (state->pendingZeros)
+            {
+                size_t run = (size_t)in[i] + 1;
+                if (capacity - length < run)
+                    return 1;
+                memset(out + length, 0, run);
+                length += run;
+                state->pendingZeros = 0;
+            }
+            else if (in[i] == 0)
+                state->pendingZeros = 1;
+            else
+            {
+                if (length == capacity)
+                    return 1;
+                out[length++] = in[i];
+            }
+        }
+        *produced = length;
+        return 0;
+    }
+    case TRANSFORM_MTF:
+        for (size_t i = 0; i < inSize; ++i)
+        {
+            uint32_t rank = in[i];
+            unsigned char value = state->order[rank];
+            memmove(state->order + 1, state->order, rank);
+            state->order[0] = value;
+            out[i] = value;
+        }
+        break;
+    default:
+        memcpy(out, in, inSize);
+        break;
+    }
+    *produced = inSize;
+    return 0;
+}